@@ -9445,42 +9445,17 @@ echo "gmt psclip -C -K -O ${VERBOSE} >> map.ps" >> makemap.sh
           ;;
 
           t)
-            demwidth=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $10}')
-            demheight=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $11}')
-            demxmin=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $2}')
-            demxmax=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $3}')
-            demymin=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $4}')
-            demymax=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $5}')
-
             info_msg "Calculating and rendering texture map"
 
             # Calculate the texture shade
-            # Project from WGS1984 to Mercator / HDF format
+            # Convert to HDF format; the tools resample to Mercator and back internally (-remap)
             # The -dstnodata option is a kluge to get around unknown NaNs in dem.flt even if ${F_TOPO}dem.nc has NaNs filled.
-            [[ ! -e ${F_TOPO}dem.flt ]] && gdalwarp -dstnodata -9999 -t_srs EPSG:3395 -s_srs EPSG:4326 -r bilinear -if netCDF -of EHdr -ot Float32 -ts $demwidth $demheight ${F_TOPO}dem.nc ${F_TOPO}dem.flt -q
-
-            # texture the DEM. Pipe output to /dev/null to silence the program
-            if [[ $(echo "$DEM_MAXLAT >= 90" | bc) -eq 1 ]]; then
-              MERCMAXLAT=89.999
-            else
-              MERCMAXLAT=$DEM_MAXLAT
-            fi
-            if [[ $(echo "$DEM_MINLAT <= -90" | bc) -eq 1 ]]; then
-              MERCMINLAT=-89.999
-            else
-              MERCMINLAT=$DEM_MINLAT
-            fi
+            [[ ! -e ${F_TOPO}dem.flt ]] && gdalwarp -dstnodata -9999 -if netCDF -of EHdr -ot Float32 ${F_TOPO}dem.nc ${F_TOPO}dem.flt -q
 
-            ${TEXTURE} ${TS_FRAC} ${F_TOPO}dem.flt ${F_TOPO}texture.flt -mercator ${MERCMINLAT} ${MERCMAXLAT} > /dev/null
-            # make the image. Pipe output to /dev/null to silence the program
-            ${TEXTURE_IMAGE} +${TS_STRETCH} ${F_TOPO}texture.flt ${F_TOPO}texture_merc.tif > /dev/null
-            # project back to WGS1984
-
-            gdalwarp -s_srs EPSG:3395 -t_srs EPSG:4326 -r bilinear  -ts $demwidth $demheight -te $demxmin $demymin $demxmax $demymax ${F_TOPO}texture_merc.tif ${F_TOPO}texture_2byte.tif -q
-
-            # Change to 8 bit unsigned format
-            gdal_translate -of GTiff -ot Byte -scale 0 65535 0 255 ${F_TOPO}texture_2byte.tif ${F_TOPO}texture.tif -q
-            cleanup ${F_TOPO}texture_2byte.tif ${F_TOPO}texture_merc.tif ${F_TOPO}dem.flt ${F_TOPO}dem.hdr ${F_TOPO}dem.flt.aux.xml ${F_TOPO}dem.prj ${F_TOPO}texture.flt ${F_TOPO}texture.hdr ${F_TOPO}texture.prj ${F_TOPO}texture_merc.prj ${F_TOPO}texture_merc.tfw
+            # texture the DEM and write it directly as an 8 bit GeoTIFF image.
+            # Pipe output to /dev/null to silence the program
+            ${TEXTURE} ${TS_FRAC} ${F_TOPO}dem.flt ${F_TOPO}texture.tif -remap -image +${TS_STRETCH} -bits 8 > /dev/null
+            cleanup ${F_TOPO}dem.flt ${F_TOPO}dem.hdr ${F_TOPO}dem.flt.aux.xml ${F_TOPO}dem.prj ${F_TOPO}texture.tfw ${F_TOPO}texture.prj
 
             # Combine it with the existing intensity
             weighted_average_combine ${F_TOPO}texture.tif ${F_TOPO}intensity.tif ${TS_FACT} ${F_TOPO}intensity.tif
@@ -9512,37 +9487,16 @@ echo "gmt psclip -C -K -O ${VERBOSE} >> map.ps" >> makemap.sh
           # Compute and render the sky view factor
           v)
 
-            demwidth=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $10}')
-            demheight=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $11}')
-            demxmin=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $2}')
-            demxmax=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $3}')
-            demymin=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $4}')
-            demymax=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $5}')
-
             info_msg "Creating sky view factor"
 
-            [[ ! -e ${F_TOPO}dem.flt ]] && gdalwarp -dstnodata -9999 -t_srs EPSG:3395 -s_srs EPSG:4326 -r bilinear -if netCDF -of EHdr -ot Float32 -ts $demwidth $demheight ${F_TOPO}dem.nc ${F_TOPO}dem.flt -q
-
-            # texture the DEM. Pipe output to /dev/null to silence the program
-            if [[ $(echo "$DEM_MAXLAT >= 90" | bc) -eq 1 ]]; then
-              MERCMAXLAT=89.999
-            else
-              MERCMAXLAT=$DEM_MAXLAT
-            fi
-            if [[ $(echo "$DEM_MINLAT <= -90" | bc) -eq 1 ]]; then
-              MERCMINLAT=-89.999
-            else
-              MERCMINLAT=$DEM_MINLAT
-            fi
+            [[ ! -e ${F_TOPO}dem.flt ]] && gdalwarp -dstnodata -9999 -if netCDF -of EHdr -ot Float32 ${F_TOPO}dem.nc ${F_TOPO}dem.flt -q
 
             # start_time=`date +%s`
-            ${SVF} ${NUM_SVF_ANGLES} ${F_TOPO}dem.flt ${F_TOPO}svf.flt -mercator ${MERCMINLAT} ${MERCMAXLAT} > /dev/null
+            ${SVF} ${NUM_SVF_ANGLES} ${F_TOPO}dem.flt ${F_TOPO}svf.flt -remap > /dev/null
             # echo run time is $(expr `date +%s` - $start_time) s
-            # project back to WGS1984
-            gdalwarp -s_srs EPSG:3395 -t_srs EPSG:4326 -r bilinear  -ts $demwidth $demheight -te $demxmin $demymin $demxmax $demymax ${F_TOPO}svf.flt ${F_TOPO}svf_back.tif -q
 
-            zrange=($(grid_zrange ${F_TOPO}svf_back.tif -Vn))
-            gdal_translate -of GTiff -ot Byte -a_nodata 255 -scale ${zrange[1]} ${zrange[0]} 1 254 ${F_TOPO}svf_back.tif ${F_TOPO}svf.tif -q
+            zrange=($(grid_zrange ${F_TOPO}svf.flt -Vn))
+            gdal_translate -of GTiff -ot Byte -a_nodata 255 -scale ${zrange[1]} ${zrange[0]} 1 254 ${F_TOPO}svf.flt ${F_TOPO}svf.tif -q
 
             # Combine it with the existing intensity
             weighted_average_combine ${F_TOPO}svf.tif ${F_TOPO}intensity.tif ${SKYVIEW_FACT} ${F_TOPO}intensity.tif
@@ -9552,37 +9506,14 @@ echo "gmt psclip -C -K -O ${VERBOSE} >> map.ps" >> makemap.sh
           d)
             info_msg "Creating cast shadow map"
 
-            demwidth=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $10}')
-            demheight=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $11}')
-            demxmin=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $2}')
-            demxmax=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $3}')
-            demymin=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $4}')
-            demymax=$(gmt grdinfo -C ${F_TOPO}dem.nc ${VERBOSE} | awk '{print $5}')
-
-
-            [[ ! -e ${F_TOPO}dem.flt ]] && gdalwarp -dstnodata -9999 -t_srs EPSG:3395 -s_srs EPSG:4326 -r bilinear -if netCDF -of EHdr -ot Float32 -ts $demwidth $demheight ${F_TOPO}dem.nc ${F_TOPO}dem.flt -q
-
-            # texture the DEM. Pipe output to /dev/null to silence the program
-            if [[ $(echo "$MAXLAT >= 90" | bc) -eq 1 ]]; then
-              MERCMAXLAT=89.999
-            else
-              MERCMAXLAT=$MAXLAT
-            fi
-            if [[ $(echo "$MINLAT <= -90" | bc) -eq 1 ]]; then
-              MERCMINLAT=-89.999
-            else
-              MERCMINLAT=$MINLAT
-            fi
-
-            ${SHADOW} ${SUN_AZ} ${SUN_EL} ${F_TOPO}dem.flt ${F_TOPO}shadow.flt -mercator ${MERCMINLAT} ${MERCMAXLAT} > /dev/null
-            # project back to WGS1984
+            [[ ! -e ${F_TOPO}dem.flt ]] && gdalwarp -dstnodata -9999 -if netCDF -of EHdr -ot Float32 ${F_TOPO}dem.nc ${F_TOPO}dem.flt -q
 
-            gdalwarp -s_srs EPSG:3395 -t_srs EPSG:4326 -r bilinear  -ts $demwidth $demheight -te $demxmin $demymin $demxmax $demymax ${F_TOPO}shadow.flt ${F_TOPO}shadow_back.tif -q
+            ${SHADOW} ${SUN_AZ} ${SUN_EL} ${F_TOPO}dem.flt ${F_TOPO}shadow.flt -remap > /dev/null
 
             MAX_SHADOW=$(grep "max_value" ${F_TOPO}shadow.hdr | gawk '{print $2}')
 
             # Change to 8 bit unsigned format
-            gdal_translate -of GTiff -ot Byte -a_nodata 255 -scale $MAX_SHADOW 0 1 254 ${F_TOPO}shadow_back.tif ${F_TOPO}shadow.tif -q
+            gdal_translate -of GTiff -ot Byte -a_nodata 255 -scale $MAX_SHADOW 0 1 254 ${F_TOPO}shadow.flt ${F_TOPO}shadow.tif -q
             # Combine it with the existing intensity
             alpha_value ${F_TOPO}shadow.tif ${SHADOW_ALPHA} ${F_TOPO}shadow_alpha.tif
 
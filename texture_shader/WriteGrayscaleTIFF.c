@@ -61,10 +61,25 @@
 #define Software            305
 #define ColorMap            320
 #define TIFFTAG_SAMPLEFORMAT        339 // data sample format
+#define ModelPixelScale     33550
+#define ModelTiepoint       33922
+#define GeoKeyDirectory     34735
 
 #define PHOTOMETRIC_MINISBLACK  1      // min value is black
 #define SAMPLEFORMAT_UINT       1      // unsigned integer data
 
+// GeoTIFF keys for WGS84 longitude/latitude, pixels covering areas:
+// header (version 1.1.0, 3 keys), then GTModelType = geographic,
+// GTRasterType = PixelIsArea, GeographicType = EPSG 4326
+#define GEOKEY_COUNT 16
+static const unsigned short geographicKeys[GEOKEY_COUNT] =
+   {
+   1, 1, 0, 3,
+   1024, 0, 1, 2,
+   1025, 0, 1, 1,
+   2048, 0, 1, 4326
+   };
+
 static int am_big_endian()
    {
    const int one = 1;
@@ -118,6 +133,19 @@ static int Write8Byte(FILE *hFileRef, long long n)
    return 0;
    }
 
+static int WriteDouble(FILE *hFileRef, double x)
+   {
+   int lCount;
+
+   lCount = fwrite(&x, sizeof(double), 1, hFileRef);
+   if (lCount != 1)
+      {
+      return -1;
+      }
+
+   return 0;
+   }
+
 static int WriteString(FILE *hFileRef, const char *str, int count)
    // count MUST include the NUL terminator
    {
@@ -231,7 +259,71 @@ static int WriteBigTIFFAsciiTag(FILE *hFile, int tag, const char *str, int count
    return err;
    }
 
-static int WriteBitmap(FILE *hFile, int width, int height, const float *data)
+static int GeoTagCount(const struct Grayscale_TIFF_Georef *georef)
+   {
+   if (!georef)
+      {
+      return 0;
+      }
+   return georef->geographic ? 3 : 2;
+   }
+
+static int WriteGeoTags(FILE *hFile, const struct Grayscale_TIFF_Georef *georef, long long offset, int big)
+   // writes tags for the values written by WriteGeoData() at offset
+   {
+   int err;
+
+   if (big)
+      {
+      err = WriteBigTIFFTag(hFile, ModelPixelScale, TIFFdouble, 3, offset);
+      err |= WriteBigTIFFTag(hFile, ModelTiepoint, TIFFdouble, 6, offset + 24);
+      if (georef->geographic)
+         {
+         err |= WriteBigTIFFTag(hFile, GeoKeyDirectory, TIFFshort, GEOKEY_COUNT, offset + 72);
+         }
+      }
+   else
+      {
+      err = WriteTIFFTag(hFile, ModelPixelScale, TIFFdouble, 3, (int) offset);
+      err |= WriteTIFFTag(hFile, ModelTiepoint, TIFFdouble, 6, (int) (offset + 24));
+      if (georef->geographic)
+         {
+         err |= WriteTIFFTag(hFile, GeoKeyDirectory, TIFFshort, GEOKEY_COUNT, (int) (offset + 72));
+         }
+      }
+   return err;
+   }
+
+static int WriteGeoData(FILE *hFile, const struct Grayscale_TIFF_Georef *georef)
+   {
+   int err;
+   int k;
+
+   // pixel scale (X, Y, Z)
+   err = WriteDouble(hFile, georef->xdim);
+   err |= WriteDouble(hFile, georef->ydim);
+   err |= WriteDouble(hFile, 0.0);
+
+   // tie point: raster (0,0,0) is at model (xmin,ymax,0)
+   err |= WriteDouble(hFile, 0.0);
+   err |= WriteDouble(hFile, 0.0);
+   err |= WriteDouble(hFile, 0.0);
+   err |= WriteDouble(hFile, georef->xmin);
+   err |= WriteDouble(hFile, georef->ymax);
+   err |= WriteDouble(hFile, 0.0);
+
+   if (georef->geographic)
+      {
+      for (k=0; k<GEOKEY_COUNT; ++k)
+         {
+         err |= WriteWord(hFile, geographicKeys[k]);
+         }
+      }
+   return err;
+   }
+
+// writes either float data converted to 16 bits, or pixels already of the given bits
+static int WriteBitmap(FILE *hFile, int width, int height, const float *data, const void *pixels, int bits)
    {
    int lCount;
    int i, j;
@@ -239,9 +331,25 @@ static int WriteBitmap(FILE *hFile, int width, int height, const float *data)
    const float *ptr;
    int bufsize;
    unsigned short *buffer;
+   const unsigned char *bytes;
 
    const unsigned short nodata = 0;
 
+   if (pixels)
+      {
+      bufsize = width * (bits / 8);
+      bytes = (const unsigned char *) pixels;
+      for (i=0; i<height; ++i, bytes+=bufsize)
+         {
+         lCount = fwrite(bytes, 1, bufsize, hFile);
+         if (lCount != bufsize)
+            {
+            return -1;
+            }
+         }
+      return 0;
+      }
+
    bufsize = width * sizeof(unsigned short);
    buffer = (unsigned short *) malloc(bufsize);
    if (!buffer)
@@ -285,8 +393,49 @@ static int WriteBitmap(FILE *hFile, int width, int height, const float *data)
    return 0;
    }
 
+static int WriteGeoTIFF(
+   FILE *hFile, int width, int height, const float *data, const void *pixels, int bits,
+   const struct Grayscale_TIFF_Georef *georef, const char *softwareVersion, size_t *fileSize
+);
+
+static int WriteBigGeoTIFF(
+   FILE *hFile, int width, int height, const float *data, const void *pixels, int bits,
+   const struct Grayscale_TIFF_Georef *georef, const char *softwareVersion, size_t *fileSize
+);
+
 int WriteGrayscale16BitToTIFF(
    FILE *hFile, int width, int height, const float *data, const char *softwareVersion, size_t *fileSize
+)
+   {
+   return WriteGeoTIFF(hFile, width, height, data, NULL, 16, NULL, softwareVersion, fileSize);
+   }
+
+int WriteGrayscale16BitToBigTIFF(
+   FILE *hFile, int width, int height, const float *data, const char *softwareVersion, size_t *fileSize
+)
+   {
+   return WriteBigGeoTIFF(hFile, width, height, data, NULL, 16, NULL, softwareVersion, fileSize);
+   }
+
+int WriteGrayscaleToGeoTIFF(
+   FILE *hFile, int width, int height, const void *pixels, int bits,
+   const struct Grayscale_TIFF_Georef *georef, const char *softwareVersion, size_t *fileSize
+)
+   {
+   return WriteGeoTIFF(hFile, width, height, NULL, pixels, bits, georef, softwareVersion, fileSize);
+   }
+
+int WriteGrayscaleToBigGeoTIFF(
+   FILE *hFile, int width, int height, const void *pixels, int bits,
+   const struct Grayscale_TIFF_Georef *georef, const char *softwareVersion, size_t *fileSize
+)
+   {
+   return WriteBigGeoTIFF(hFile, width, height, NULL, pixels, bits, georef, softwareVersion, fileSize);
+   }
+
+static int WriteGeoTIFF(
+   FILE *hFile, int width, int height, const float *data, const void *pixels, int bits,
+   const struct Grayscale_TIFF_Georef *georef, const char *softwareVersion, size_t *fileSize
 )
    {
    size_t lWriteCount, tiffSize;
@@ -294,10 +443,12 @@ int WriteGrayscale16BitToTIFF(
    long pos, offsetpos;
    int err;
    int softwareCount, softwareSpace;
+   int geoTagCount;
 
    err = 0;
 
-   lWriteCount = (size_t) height * (size_t) width * sizeof(unsigned short);
+   lWriteCount = (size_t) height * (size_t) width * (bits / 8);
+   geoTagCount = GeoTagCount(georef);
 
    softwareCount = softwareVersion ? strlen(softwareVersion) : 0;
 
@@ -309,6 +460,7 @@ int WriteGrayscale16BitToTIFF(
       softwareSpace = softwareCount + (softwareCount & 1);  // round up to word boundary
       sTagCount++;
       }
+   sTagCount += geoTagCount;
 
 // Write the header
    if (am_big_endian())
@@ -343,7 +495,7 @@ int WriteGrayscale16BitToTIFF(
 
    err |= WriteTIFFTag(hFile, ImageWidth, TIFFlong, 1, width);
    err |= WriteTIFFTag(hFile, ImageLength, TIFFlong, 1, height);
-   err |= WriteTIFFTag(hFile, BitsPerSample, TIFFshort, 1, 16);
+   err |= WriteTIFFTag(hFile, BitsPerSample, TIFFshort, 1, bits);
    err |= WriteTIFFTag(hFile, Compression, TIFFshort, 1, 1);
    err |= WriteTIFFTag(hFile, PhotometricInterp, TIFFshort, 1, PHOTOMETRIC_MINISBLACK);
    err |= WriteTIFFTag(hFile, StripOffsets, TIFFlong, 1, 0);
@@ -364,9 +516,19 @@ int WriteGrayscale16BitToTIFF(
       err |= WriteTIFFAsciiTag(hFile, Software, softwareVersion, softwareCount, 24);
       }
    err |= WriteTIFFTag(hFile, TIFFTAG_SAMPLEFORMAT, TIFFshort, 1, SAMPLEFORMAT_UINT);
+   if (georef)
+      {
+      // values follow the directory
+      err |= WriteGeoTags(hFile, georef, 24 + softwareSpace + 2 + 12*sTagCount + 4, 0);
+      }
 
    err |= WriteLong(hFile, 0);
 
+   if (georef)
+      {
+      err |= WriteGeoData(hFile, georef);
+      }
+
    if (err)
       {
       return err;
@@ -384,7 +546,7 @@ int WriteGrayscale16BitToTIFF(
    if ((tiffSize-1)>>31 > 1)
       {
       rewind(hFile);
-      return WriteGrayscale16BitToBigTIFF(hFile, width, height, data, softwareVersion, fileSize);
+      return WriteBigGeoTIFF(hFile, width, height, data, pixels, bits, georef, softwareVersion, fileSize);
       }
 
    if (fileSize)
@@ -401,14 +563,15 @@ int WriteGrayscale16BitToTIFF(
       return err;
       }
 
-   err = WriteBitmap(hFile, width, height, data);
+   err = WriteBitmap(hFile, width, height, data, pixels, bits);
 
    return err;
    }
 
 
-int WriteGrayscale16BitToBigTIFF(
-   FILE *hFile, int width, int height, const float *data, const char *softwareVersion, size_t *fileSize
+static int WriteBigGeoTIFF(
+   FILE *hFile, int width, int height, const float *data, const void *pixels, int bits,
+   const struct Grayscale_TIFF_Georef *georef, const char *softwareVersion, size_t *fileSize
 )
    {
    size_t lWriteCount;
@@ -416,10 +579,12 @@ int WriteGrayscale16BitToBigTIFF(
    long pos, offsetpos;
    int err;
    int softwareCount, softwareSpace;
+   int geoTagCount;
 
    err = 0;
 
-   lWriteCount = (size_t) height * (size_t) width * sizeof(unsigned short);
+   lWriteCount = (size_t) height * (size_t) width * (bits / 8);
+   geoTagCount = GeoTagCount(georef);
 
    softwareCount = softwareVersion ? strlen(softwareVersion) : 0;
 
@@ -431,6 +596,7 @@ int WriteGrayscale16BitToBigTIFF(
       softwareSpace = softwareCount + (softwareCount & 1);  // round up to word boundary
       sTagCount++;
       }
+   sTagCount += geoTagCount;
 
 // Write the header
    if (am_big_endian())
@@ -460,7 +626,7 @@ int WriteGrayscale16BitToBigTIFF(
 
    err |= WriteBigTIFFTag(hFile, ImageWidth, TIFFlong, 1, width);
    err |= WriteBigTIFFTag(hFile, ImageLength, TIFFlong, 1, height);
-   err |= WriteBigTIFFTag(hFile, BitsPerSample, TIFFshort, 1, 16);
+   err |= WriteBigTIFFTag(hFile, BitsPerSample, TIFFshort, 1, bits);
    err |= WriteBigTIFFTag(hFile, Compression, TIFFshort, 1, 1);
    err |= WriteBigTIFFTag(hFile, PhotometricInterp, TIFFshort, 1, PHOTOMETRIC_MINISBLACK);
    err |= WriteBigTIFFTag(hFile, StripOffsets, TIFFlong, 1, 0);
@@ -490,9 +656,19 @@ int WriteGrayscale16BitToBigTIFF(
       err |= WriteBigTIFFAsciiTag(hFile, Software, softwareVersion, softwareCount, 24);
       }
    err |= WriteBigTIFFTag(hFile, TIFFTAG_SAMPLEFORMAT, TIFFshort, 1, SAMPLEFORMAT_UINT);
+   if (georef)
+      {
+      // values follow the directory
+      err |= WriteGeoTags(hFile, georef, 24 + softwareSpace + 8 + 20*sTagCount + 8, 1);
+      }
 
    err |= Write8Byte(hFile, 0);
 
+   if (georef)
+      {
+      err |= WriteGeoData(hFile, georef);
+      }
+
    if (err)
       {
       return err;
@@ -519,7 +695,7 @@ int WriteGrayscale16BitToBigTIFF(
       return err;
       }
 
-   err = WriteBitmap(hFile, width, height, data);
+   err = WriteBitmap(hFile, width, height, data, pixels, bits);
 
    return err;
    }
@@ -37,6 +37,16 @@
 extern "C" {
 #endif
 
+// Georeferencing written as GeoTIFF tags by WriteGrayscaleToGeoTIFF()
+struct Grayscale_TIFF_Georef {
+   double xmin;      // X coordinate of left   edge of image (longitude or easting)
+   double ymax;      // Y coordinate of top    edge of image (latitude  or northing)
+   double xdim;      // pixel width
+   double ydim;      // pixel height
+   int geographic;   // nonzero if coordinates are WGS84 longitude/latitude
+                     // (otherwise no coordinate system is written - see .prj file)
+};
+
 // writes BigTIFF instead if file size would exceed 4 GB
 int WriteGrayscale16BitToTIFF(
    FILE *hFile, int width, int height, const float *data, const char *softwareVersion, size_t *fileSize
@@ -46,6 +56,18 @@ int WriteGrayscale16BitToBigTIFF(
    FILE *hFile, int width, int height, const float *data, const char *softwareVersion, size_t *fileSize
 );
 
+// same as above for pixels already converted to bits = 8 or 16 (unsigned char or
+// unsigned short), and GeoTIFF tags if georef is not NULL; writes BigTIFF if needed
+int WriteGrayscaleToGeoTIFF(
+   FILE *hFile, int width, int height, const void *pixels, int bits,
+   const struct Grayscale_TIFF_Georef *georef, const char *softwareVersion, size_t *fileSize
+);
+
+int WriteGrayscaleToBigGeoTIFF(
+   FILE *hFile, int width, int height, const void *pixels, int bits,
+   const struct Grayscale_TIFF_Georef *georef, const char *softwareVersion, size_t *fileSize
+);
+
 #ifdef __cplusplus
 }
 #endif
@@ -5,6 +5,7 @@ TEXTURE_DIR=$1
 
 CC=gcc
 CFLAGS="-O2 -funroll-loops"
+LIBS="-lm -lpthread"
 
 echo dir is $TEXTURE_DIR
 cd $TEXTURE_DIR
@@ -12,11 +13,11 @@ cd $TEXTURE_DIR
 [[ -e texture ]] && rm -f texture
 [[ -e texture_image ]] && rm -f texture_image
 
-${CC} -DNOMAIN -c *.c
-${CC} ${CFLAGS} *.o texture.c -o texture
-${CC} ${CFLAGS} *.o shadow.c -o shadow
-${CC} ${CFLAGS} *.o svf.c -o svf
-${CC} ${CFLAGS} *.o texture_image.c -o texture_image
+${CC} ${CFLAGS} -DNOMAIN -c *.c
+${CC} ${CFLAGS} *.o texture.c -o texture ${LIBS}
+${CC} ${CFLAGS} *.o shadow.c -o shadow ${LIBS}
+${CC} ${CFLAGS} *.o svf.c -o svf ${LIBS}
+${CC} ${CFLAGS} *.o texture_image.c -o texture_image ${LIBS}
 
 # Cleanup
 rm -f *.o
@@ -0,0 +1,389 @@
+/*
+ * dct.c
+ *
+ * Selects the DCT implementation used through the interface in dct.h.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "dct.h"
+#include "dct_backends.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#   include <unistd.h>      // getpid()
+#   include <pthread.h>
+#   define DCT_PTHREADS 1
+#else
+#   define DCT_PTHREADS 0   // no native threads (see thread_pool.c) - no locking needed
+#endif
+
+// Build-time default; e.g. compile with -DDCT_DEFAULT_BACKEND=DCT_BACKEND_SIMD
+#ifndef DCT_DEFAULT_BACKEND
+#   define DCT_DEFAULT_BACKEND DCT_BACKEND_FFTPACK
+#endif
+
+// Maximum number of released plans kept by cleanup_dcts() for reuse
+#ifndef DCT_MAX_CACHED_PLANS
+#   define DCT_MAX_CACHED_PLANS 64
+#endif
+
+struct Cached_Plan {
+    struct Dct_Plan     plan;
+    struct Cached_Plan *next;
+};
+
+static struct Cached_Plan *cached_plans     = NULL;   // most recently released first
+static int                 num_cached_plans = 0;
+
+#if DCT_PTHREADS
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+void lock_dct_caches( void )
+{
+#if DCT_PTHREADS
+    pthread_mutex_lock( &cache_mutex );
+#endif
+}
+
+void unlock_dct_caches( void )
+{
+#if DCT_PTHREADS
+    pthread_mutex_unlock( &cache_mutex );
+#endif
+}
+
+static const char *const backend_names[] = {
+    "default", "fftpack", "simd", "sse2", "avx2", "avx512"
+};
+
+static const int num_backend_names = sizeof( backend_names ) / sizeof( *backend_names );
+
+enum Dct_Backend dct_backend_from_name( const char *name )
+{
+    int i;
+
+    for (i=1; i<num_backend_names; ++i) {
+        if (strcmp( name, backend_names[i] ) == 0) {
+            return (enum Dct_Backend)i;
+        }
+    }
+    return DCT_BACKEND_DEFAULT;
+}
+
+const char *dct_backend_name( enum Dct_Backend backend )
+{
+    if ((int)backend < 0 || (int)backend >= num_backend_names) {
+        return "unknown";
+    }
+    return backend_names[backend];
+}
+
+enum Dct_Backend default_dct_backend( void )
+{
+    const char *env = getenv( "TEXTURE_DCT" );
+    enum Dct_Backend backend = DCT_BACKEND_DEFAULT;
+
+    if (env) {
+        backend = dct_backend_from_name( env );
+    }
+    if (backend == DCT_BACKEND_DEFAULT) {
+        backend = DCT_DEFAULT_BACKEND;
+    }
+    return backend;
+}
+
+const char *default_dct_wisdom( void )
+{
+    const char *env = getenv( "TEXTURE_DCT_WISDOM" );
+
+    return env && *env ? env : NULL;
+}
+
+static enum Dct_Backend select_backend( int dct_type, enum Dct_Backend backend )
+// Returns the backend setup_dcts_backend() actually uses for this request.
+{
+    if (backend == DCT_BACKEND_DEFAULT) {
+        backend = default_dct_backend();
+    }
+
+    switch (backend) {
+        case DCT_BACKEND_SIMD:
+        case DCT_BACKEND_SIMD_SSE2:
+        case DCT_BACKEND_SIMD_AVX2:
+        case DCT_BACKEND_SIMD_AVX512:
+            // SIMD kernels implement only types II and III
+            if (dct_type == 2 || dct_type == 3) {
+                return select_backend_simd( backend );
+            }
+            return DCT_BACKEND_FFTPACK;
+        default:
+            return DCT_BACKEND_FFTPACK;
+    }
+}
+
+static int take_cached_plan(
+    int dct_type, int nelems, enum Dct_Backend backend, struct Dct_Plan *plan )
+// Removes a matching plan released earlier from the cache; returns 0 if none.
+{
+    struct Cached_Plan **link;
+    struct Cached_Plan  *entry = NULL;
+
+    lock_dct_caches();
+    for (link=&cached_plans; *link; link=&(*link)->next) {
+        if ((*link)->plan.dct_type == dct_type &&
+            (*link)->plan.nelems   == nelems   &&
+            (*link)->plan.backend  == (int)backend)
+        {
+            entry = *link;
+            *link = entry->next;
+            --num_cached_plans;
+            break;
+        }
+    }
+    unlock_dct_caches();
+
+    if (!entry) {
+        return 0;
+    }
+    *plan = entry->plan;
+    free( entry );
+    return 1;
+}
+
+static void free_plan( struct Dct_Plan *plan )
+{
+    if (plan->backend == DCT_BACKEND_FFTPACK) {
+        cleanup_dcts_fftpack( plan );
+    } else {
+        cleanup_dcts_simd( plan );
+    }
+}
+
+struct Dct_Plan setup_dcts(
+    int dct_type,   // 1, 2, or 3 (DCT types I, II, III)
+    int nelems      // data length for each DCT
+)
+{
+    return setup_dcts_backend( dct_type, nelems, DCT_BACKEND_DEFAULT );
+}
+
+struct Dct_Plan setup_dcts_backend(
+    int dct_type,   // 1, 2, or 3 (DCT types I, II, III)
+    int nelems,     // data length for each DCT
+    enum Dct_Backend
+        backend     // implementation to use
+)
+{
+    struct Dct_Plan plan;
+
+    backend = select_backend( dct_type, backend );
+
+    if (take_cached_plan( dct_type, nelems, backend, &plan )) {
+        return plan;
+    }
+    if (backend == DCT_BACKEND_FFTPACK) {
+        return setup_dcts_fftpack( dct_type, nelems );
+    } else {
+        return setup_dcts_simd( dct_type, nelems, backend );
+    }
+}
+
+void perform_dcts(
+    const struct Dct_Plan *plan // from setup_dcts()
+)
+{
+    if (plan->backend == DCT_BACKEND_FFTPACK) {
+        perform_dcts_fftpack( plan );
+    } else {
+        perform_dcts_simd( plan );
+    }
+}
+
+void perform_dcts_rows(
+    const struct Dct_Plan *plan,    // from setup_dcts()
+    float    *data,                 // input/output: first element of first row
+    int       count,                // input: number of rows to transform
+    ptrdiff_t row_stride,           // input: distance between first elements of successive rows
+    ptrdiff_t elem_stride           // input: distance between successive elements of each row
+)
+{
+    if (plan->backend == DCT_BACKEND_FFTPACK) {
+        perform_dcts_rows_fftpack( plan, data, count, row_stride, elem_stride );
+    } else {
+        perform_dcts_rows_simd( plan, data, count, row_stride, elem_stride );
+    }
+}
+
+void cleanup_dcts(
+    struct Dct_Plan *plan   // from setup_dcts()
+)
+{
+    struct Cached_Plan *entry;
+    int cached = 0;
+    int i;
+
+    entry = (struct Cached_Plan *)malloc( sizeof( struct Cached_Plan ) );
+    if (entry) {
+        entry->plan = *plan;
+
+        lock_dct_caches();
+        if (num_cached_plans < DCT_MAX_CACHED_PLANS) {
+            entry->next  = cached_plans;
+            cached_plans = entry;
+            ++num_cached_plans;
+            cached = 1;
+        }
+        unlock_dct_caches();
+    }
+
+    if (!cached) {
+        free( entry );
+        free_plan( plan );
+        return;
+    }
+
+    // caller no longer owns the buffers
+    for (i=0; i<DCT_MAX_BATCH; ++i) {
+        plan->in_data[i]  = NULL;
+        plan->out_data[i] = NULL;
+    }
+    plan->dct_buffer = NULL;
+}
+
+void dct_forget_plans( void )
+{
+    struct Cached_Plan *entry;
+
+    lock_dct_caches();
+    while (cached_plans) {
+        entry = cached_plans;
+        cached_plans = entry->next;
+        --num_cached_plans;
+
+        unlock_dct_caches();
+        free_plan( &entry->plan );
+        free( entry );
+        lock_dct_caches();
+    }
+    unlock_dct_caches();
+
+    forget_wisdom_fftpack();
+}
+
+// Wisdom file header: identifies format version and native number formats.
+
+static const char wisdom_magic[8] = { 'D', 'C', 'T', 'W', 'I', 'S', 'D', '2' };
+
+static const int    wisdom_int_check    = 0x01020304;
+static const double wisdom_double_check = -1.0 / 3.0;
+
+static int read_wisdom_header( FILE *file )
+// Returns nonzero if file begins with a header written on a compatible machine.
+{
+    char   magic[8];
+    int    sizes[2];
+    int    int_check;
+    double double_check;
+
+    return
+        fread( magic,         1,                8, file ) == 8 &&
+        memcmp( magic, wisdom_magic, 8 ) == 0             &&
+        fread( sizes,         sizeof( int ),    2, file ) == 2 &&
+        sizes[0] == (int)sizeof( int ) && sizes[1] == (int)sizeof( double ) &&
+        fread( &int_check,    sizeof( int ),    1, file ) == 1 &&
+        fread( &double_check, sizeof( double ), 1, file ) == 1 &&
+        int_check    == wisdom_int_check &&
+        double_check == wisdom_double_check;
+}
+
+static int write_wisdom_header( FILE *file )
+// Returns 0 on success, nonzero if a write error occurred.
+{
+    int sizes[2];
+
+    sizes[0] = (int)sizeof( int );
+    sizes[1] = (int)sizeof( double );
+
+    return
+        fwrite( wisdom_magic,         1,                8, file ) != 8 ||
+        fwrite( sizes,                sizeof( int ),    2, file ) != 2 ||
+        fwrite( &wisdom_int_check,    sizeof( int ),    1, file ) != 1 ||
+        fwrite( &wisdom_double_check, sizeof( double ), 1, file ) != 1;
+}
+
+int dct_import_wisdom(
+    const char *filename    // input: wisdom file name
+)
+{
+    FILE *file;
+    int   count = -1;
+
+    file = fopen( filename, "rb" );
+    if (!file) {
+        return -1;
+    }
+    if (read_wisdom_header( file )) {
+        count = import_wisdom_fftpack( file );
+    }
+    fclose( file );
+
+    return count;
+}
+
+int dct_export_wisdom(
+    const char *filename    // input: wisdom file name
+)
+{
+    FILE *file;
+    char *temp_name;
+    int   error;
+
+    // write to a temporary file first, so other processes
+    // reading the same wisdom never see a partial file
+    temp_name = (char *)malloc( strlen( filename ) + 32 );
+    if (!temp_name) {
+        return 1;
+    }
+#if DCT_PTHREADS
+    sprintf( temp_name, "%s.%ld.tmp", filename, (long)getpid() );
+#else
+    sprintf( temp_name, "%s.tmp", filename );
+#endif
+
+    file = fopen( temp_name, "wb" );
+    if (!file) {
+        free( temp_name );
+        return 1;
+    }
+
+    error = write_wisdom_header( file ) || export_wisdom_fftpack( file );
+    error = fclose( file ) || error;
+
+#ifdef _WIN32
+    if (!error) {
+        remove( filename );     // rename() does not replace existing files
+    }
+#endif
+    if (!error) {
+        error = rename( temp_name, filename ) != 0;
+    }
+    if (error) {
+        remove( temp_name );
+    }
+    free( temp_name );
+
+    return error;
+}
+
+int dct_wisdom_updated( void )
+{
+    return wisdom_updated_fftpack();
+}
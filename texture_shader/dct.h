@@ -33,47 +33,137 @@
 // The functions prototyped here may be implemented with appropriate
 // calls to any DCT or FFT library. These implementations should be
 // functionally interchangeable as long as they conform to this interface.
+// dct.c selects among the implementations linked in (see dct_backends.h).
 //
 
 #ifndef DCT_H
 #define DCT_H
 
+#include <stddef.h> // for ptrdiff_t
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Maximum number of DCTs performed by one call to perform_dcts().
+#define DCT_MAX_BATCH 32
+
+// Available DCT implementations. The SIMD backends compute in single precision
+// and transform 2 x 4, 2 x 8, or 2 x 16 rows at once depending on instruction set.
+enum Dct_Backend {
+    DCT_BACKEND_DEFAULT     = 0,    // see default_dct_backend()
+    DCT_BACKEND_FFTPACK     = 1,    // double-precision FFTPACK, two rows at a time
+    DCT_BACKEND_SIMD        = 2,    // widest SIMD instruction set supported by this processor
+    DCT_BACKEND_SIMD_SSE2   = 3,    // portable 4-lane vectors (SSE2 on x86, NEON on ARM)
+    DCT_BACKEND_SIMD_AVX2   = 4,    // 8-lane AVX2/FMA vectors
+    DCT_BACKEND_SIMD_AVX512 = 5     // 16-lane AVX-512 vectors
+};
+
 struct Dct_Plan {
     // This structure must be filled in by calling setup_dcts() and should
     // not be modified by the caller.
     // Do NOT free these pointers - use cleanup_dcts() instead.
     // Note: input and output buffers may be the same.
-    void   * dct_buffer;    // internal buffer for use by perform_dcts()
-    double * in_data[2];    // input  data buffers for perform_dcts()
-    double * out_data[2];   // output data buffers for perform_dcts()
+    void   * dct_buffer;                // internal buffer for use by perform_dcts()
+    double * in_data[DCT_MAX_BATCH];    // input  data buffers for perform_dcts()
+    double * out_data[DCT_MAX_BATCH];   // output data buffers for perform_dcts()
+    int      batch_size;                // number of DCTs done by each perform_dcts() call
+                                        // (at least 2; only this many buffers are used)
+    int      backend;                   // enum Dct_Backend actually used by this plan
+    int      dct_type;                  // as passed to setup_dcts()
+    int      nelems;                    // as passed to setup_dcts()
 };
 
 // Specifies a DCT operation to be performed one or more times and
 // allocates buffers to be used by perform_dcts().
 // On return, plan->dct_buffer will be null if a memory allocation error occurred.
+// Uses the backend given by default_dct_backend().
 struct Dct_Plan setup_dcts(
     int dct_type,   // 1, 2, or 3 (DCT types I, II, III)
     int nelems      // data length for each DCT
 );
 
-// Performs two DCTs, each of size nelems (see setup_dcts()).
+// Same as setup_dcts(), using the given backend. If the requested SIMD instruction set
+// is not supported by this processor (or build), the next narrower one is used.
+struct Dct_Plan setup_dcts_backend(
+    int dct_type,   // 1, 2, or 3 (DCT types I, II, III)
+    int nelems,     // data length for each DCT
+    enum Dct_Backend
+        backend     // implementation to use
+);
+
+// Performs plan->batch_size DCTs, each of size nelems (see setup_dcts()).
 // Input arrays are plan->in_data[.] and output arrays are plan->out_data[.].
 // Note: input buffers may be overwritten, even if output buffers are different.
-// Values in both data buffers must have similar magnitude to avoid roundoff error;
-// for a single DCT, fill both buffers with the same values, or one with zeroes.
+// Values in all data buffers must have similar magnitude to avoid roundoff error;
+// for fewer DCTs, fill the extra buffers with copies of the same values, or zeroes.
 void perform_dcts(
     const struct Dct_Plan *plan // from setup_dcts()
 );
 
-// Frees memory allocated by setup_dcts().
+// Performs DCTs in place on count rows of float data, each of size nelems
+// (see setup_dcts()), using the plan's internal buffers. Any count is allowed;
+// rows are transformed plan->batch_size at a time. Element j of row i is
+//     data[i * row_stride + j * elem_stride]
+// so rows of a row-major array use (row_stride, elem_stride) = (ncols, 1),
+// and columns use (1, ncols). Rows must not overlap.
+// Values in all rows must have similar magnitude to avoid roundoff error.
+// Results are identical to copying the rows through perform_dcts().
+void perform_dcts_rows(
+    const struct Dct_Plan *plan,    // from setup_dcts()
+    float    *data,                 // input/output: first element of first row
+    int       count,                // input: number of rows to transform
+    ptrdiff_t row_stride,           // input: distance between first elements of successive rows
+    ptrdiff_t elem_stride           // input: distance between successive elements of each row
+);
+
+// Releases a plan from setup_dcts(). Released plans are kept for reuse by later
+// setup_dcts() calls with the same type, length, and backend; call dct_forget_plans()
+// to free them.
 void cleanup_dcts(
     struct Dct_Plan *plan   // from setup_dcts()
 );
 
+// Frees all plans kept by cleanup_dcts() and all precomputed twiddle factors,
+// including those read by dct_import_wisdom(). Must not be called while any
+// other thread is calling the functions in this file.
+void dct_forget_plans( void );
+
+// Reads twiddle factors precomputed by an earlier process (see dct_export_wisdom()),
+// so that setup_dcts() need not compute them again. Entries already known are ignored,
+// and damaged entries (bad checksum or factorization) are skipped: setup_dcts() then
+// computes them as usual, and dct_wisdom_updated() reports them as not yet written.
+// Returns number of entries read, or -1 if the file could not be opened or is not
+// a wisdom file written on a compatible machine.
+int dct_import_wisdom(
+    const char *filename    // input: wisdom file name
+);
+
+// Writes all twiddle factors computed or imported so far by this process to a file,
+// replacing it if it exists. Returns 0 on success, nonzero if the file could not be written.
+// Currently only the fftpack backend stores wisdom; other backends are unaffected.
+int dct_export_wisdom(
+    const char *filename    // input: wisdom file name
+);
+
+// Returns nonzero if setup_dcts() has computed twiddle factors not yet written
+// by dct_export_wisdom() nor read by dct_import_wisdom().
+int dct_wisdom_updated( void );
+
+// Returns the backend used by setup_dcts(): set at run time by environment variable
+// TEXTURE_DCT (fftpack, simd, sse2, avx2, or avx512), otherwise at build time by
+// defining DCT_DEFAULT_BACKEND; FFTPACK if neither is set.
+enum Dct_Backend default_dct_backend( void );
+
+// Returns name of wisdom file set by environment variable TEXTURE_DCT_WISDOM, or NULL.
+const char *default_dct_wisdom( void );
+
+// Parses a backend name as accepted in TEXTURE_DCT; returns DCT_BACKEND_DEFAULT if not recognized.
+enum Dct_Backend dct_backend_from_name( const char *name );
+
+// Returns name of backend, e.g. for progress messages.
+const char *dct_backend_name( enum Dct_Backend backend );
+
 #ifdef __cplusplus
 }
 #endif
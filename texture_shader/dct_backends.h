@@ -0,0 +1,55 @@
+/*
+ * dct_backends.h
+ *
+ * Entry points of the DCT implementations selected by dct.c.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+//
+// Each implementation provides the functions of dct.h under its own name.
+// Callers should use the functions in dct.h instead of calling these directly.
+//
+
+#ifndef DCT_BACKENDS_H
+#define DCT_BACKENDS_H
+
+#include "dct.h"
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// dct.c: serializes access to the plan and twiddle caches shared by all threads
+void lock_dct_caches( void );
+void unlock_dct_caches( void );
+
+// dct_fftpack.c: double precision, two DCTs per call
+struct Dct_Plan setup_dcts_fftpack( int dct_type, int nelems );
+void perform_dcts_fftpack( const struct Dct_Plan *plan );
+void perform_dcts_rows_fftpack( const struct Dct_Plan *plan, float *data, int count,
+                                ptrdiff_t row_stride, ptrdiff_t elem_stride );
+void cleanup_dcts_fftpack( struct Dct_Plan *plan );
+// wisdom entries follow the file header written by dct.c
+int  import_wisdom_fftpack( FILE *file );   // returns number of entries read, or -1
+int  export_wisdom_fftpack( FILE *file );   // returns 0 on success
+int  wisdom_updated_fftpack( void );
+void forget_wisdom_fftpack( void );
+
+// dct_simd.c: single precision, vectorized
+// backend is one of the DCT_BACKEND_SIMD* values; plan->backend returns the one used,
+// which is also returned by select_backend_simd()
+struct Dct_Plan setup_dcts_simd( int dct_type, int nelems, enum Dct_Backend backend );
+enum Dct_Backend select_backend_simd( enum Dct_Backend backend );
+void perform_dcts_simd( const struct Dct_Plan *plan );
+void perform_dcts_rows_simd( const struct Dct_Plan *plan, float *data, int count,
+                             ptrdiff_t row_stride, ptrdiff_t elem_stride );
+void cleanup_dcts_simd( struct Dct_Plan *plan );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -33,21 +33,117 @@
 // in this case using the DCT functions declared in myfftpack.h. Similar
 // implementations are possible using other DCT or FFT libraries, if desired.
 // These implementations should be functionally interchangeable as long as
-// they conform to the interface in dct.h.
+// they conform to the interface in dct.h. (See also dct_backends.h.)
 //
 
 #define _CRT_SECURE_NO_DEPRECATE
 #define _CRT_SECURE_NO_WARNINGS
 
 #include "dct.h"
+#include "dct_backends.h"
 
 #include "fftpack.h"
+#include "spectrum_cache.h"   // for cache_hash()
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 static const int max_factors = 30;
 
+#define MAX_IFAC ((int)( 1.8 * 30 + 6.9 ))  // max_ifac for max_factors above
+
+// Twiddle factors from cosqi(), kept for all plans of the same type and length.
+struct Fftpack_Twiddles {
+    int     dct_type;
+    int     nelems;
+    int     nsave;      // number of wsave values stored; the rest are zero
+    int     saved;      // nonzero if read from or written to a wisdom file
+    double *wsave;
+    int    *ifac;       // MAX_IFAC values, stored after wsave
+    struct Fftpack_Twiddles
+           *next;
+};
+
+static struct Fftpack_Twiddles *twiddle_cache = NULL;
+
+static const struct Fftpack_Twiddles *find_twiddles( int dct_type, int nelems )
+{
+    const struct Fftpack_Twiddles *entry;
+
+    lock_dct_caches();
+    for (entry=twiddle_cache; entry; entry=entry->next) {
+        if (entry->dct_type == dct_type && entry->nelems == nelems) {
+            break;
+        }
+    }
+    unlock_dct_caches();
+
+    return entry;
+}
+
+static struct Fftpack_Twiddles *new_twiddles( int dct_type, int nelems, int nsave )
+{
+    struct Fftpack_Twiddles *entry =
+        (struct Fftpack_Twiddles *)malloc( sizeof( struct Fftpack_Twiddles ) );
+
+    if (!entry) {
+        return NULL;
+    }
+    entry->wsave = (double *)malloc( nsave * sizeof( double ) + MAX_IFAC * sizeof( int ) );
+    if (!entry->wsave) {
+        free( entry );
+        return NULL;
+    }
+    entry->dct_type = dct_type;
+    entry->nelems   = nelems;
+    entry->nsave    = nsave;
+    entry->saved    = 0;
+    entry->ifac     = (int *)(entry->wsave + nsave);
+    entry->next     = NULL;
+    return entry;
+}
+
+static void add_twiddles( struct Fftpack_Twiddles *entry )
+// Takes ownership of entry; discards it if another thread added the same one first.
+{
+    const struct Fftpack_Twiddles *other;
+
+    lock_dct_caches();
+    for (other=twiddle_cache; other; other=other->next) {
+        if (other->dct_type == entry->dct_type && other->nelems == entry->nelems) {
+            break;
+        }
+    }
+    if (!other) {
+        entry->next   = twiddle_cache;
+        twiddle_cache = entry;
+    }
+    unlock_dct_caches();
+
+    if (other) {
+        free( entry->wsave );
+        free( entry );
+    }
+}
+
+static void keep_twiddles( int dct_type, int nelems, const double *wsave, const int *ifac )
+// Copies twiddle factors computed by cosqi() into the cache (if memory is available).
+{
+    struct Fftpack_Twiddles *entry;
+    int nsave = 28 * nelems;
+
+    while (nsave > 0 && wsave[nsave-1] == 0.0) {
+        --nsave;
+    }
+    entry = new_twiddles( dct_type, nelems, nsave );
+    if (entry) {
+        memcpy( entry->wsave, wsave, nsave * sizeof( double ) );
+        memcpy( entry->ifac,  ifac,  MAX_IFAC * sizeof( int ) );
+        add_twiddles( entry );
+    }
+}
+
 struct Dct_Buffer{
     int     dct_type;   // 1 to 3 (DCT types I to III)
     int     nelems;     // length of inout_data0 and inout_data1 buffers
@@ -57,7 +153,7 @@ struct Dct_Buffer{
     int    *ifac;       // info on factorization of nelems
 };
 
-struct Dct_Plan setup_dcts(
+struct Dct_Plan setup_dcts_fftpack(
     int dct_type,   // 1, 2, or 3 (DCT types I, II, III)
     int nelems      // data length for each DCT
 )
@@ -69,13 +165,19 @@ struct Dct_Plan setup_dcts(
     
     struct Dct_Plan plan;
     struct Dct_Buffer *buf;
+    const struct Fftpack_Twiddles *twiddles;
     double *data;
+    int i;
 
     plan.dct_buffer  = NULL;
-    plan.in_data[0]  = NULL;
-    plan.in_data[1]  = NULL;
-    plan.out_data[0] = NULL;
-    plan.out_data[1] = NULL;
+    for (i=0; i<DCT_MAX_BATCH; ++i) {
+        plan.in_data[i]  = NULL;
+        plan.out_data[i] = NULL;
+    }
+    plan.batch_size  = 2;
+    plan.backend     = DCT_BACKEND_FFTPACK;
+    plan.dct_type    = dct_type;
+    plan.nelems      = nelems;
     
     buf = (struct Dct_Buffer *)malloc( sizeof( struct Dct_Buffer ) );
     if (!buf) {
@@ -98,15 +200,32 @@ struct Dct_Plan setup_dcts(
     buf->wsave =        data + nelems * 2;
     buf->ifac = (int *)(data + nelems * 30);
     
-    switch (dct_type) {
-    //  case 1:
-    //  //  costi( nelems, buf->wsave, buf->ifac );
-    //      break;
-        case 2: case 3:
-            cosqi( nelems, buf->wsave, buf->ifac );
-            break;
-        default:
-            assert( 0 );    // illegal or unsupported dct_type
+    assert( max_ifac == MAX_IFAC );
+
+    // reuse twiddle factors already computed (or read from a wisdom file)
+    twiddles = find_twiddles( dct_type, nelems );
+    if (twiddles) {
+        memcpy( buf->wsave, twiddles->wsave, twiddles->nsave * sizeof( double ) );
+        memset( buf->wsave + twiddles->nsave, 0,
+                (28 * nelems - twiddles->nsave) * sizeof( double ) );
+        memcpy( buf->ifac, twiddles->ifac, max_ifac * sizeof( int ) );
+    } else {
+        // zero unused space so keep_twiddles() need not store it
+        memset( buf->wsave, 0, 28 * nelems * sizeof( double ) );
+        memset( buf->ifac,  0, max_ifac * sizeof( int ) );
+
+        switch (dct_type) {
+        //  case 1:
+        //  //  costi( nelems, buf->wsave, buf->ifac );
+        //      break;
+            case 2: case 3:
+                cosqi( nelems, buf->wsave, buf->ifac );
+                break;
+            default:
+                assert( 0 );    // illegal or unsupported dct_type
+        }
+
+        keep_twiddles( dct_type, nelems, buf->wsave, buf->ifac );
     }
     
     assert( buf->ifac[1] <= max_factors );
@@ -119,7 +238,7 @@ struct Dct_Plan setup_dcts(
     return plan;
 }
 
-void perform_dcts(
+void perform_dcts_fftpack(
     const struct Dct_Plan *plan // from setup_dcts()
 )
 // Performs two DCTs, each of size nelems (see setup_dcts()).
@@ -156,7 +275,45 @@ void perform_dcts(
     }
 }
 
-void cleanup_dcts(
+void perform_dcts_rows_fftpack(
+    const struct Dct_Plan *plan,    // from setup_dcts()
+    float    *data,                 // input/output: first element of first row
+    int       count,                // input: number of rows to transform
+    ptrdiff_t row_stride,           // input: distance between first elements of successive rows
+    ptrdiff_t elem_stride           // input: distance between successive elements of each row
+)
+// Performs DCTs on count rows of float data, two rows at a time (see perform_dcts_rows()).
+// For an odd count, the last row is transformed together with a copy of itself.
+{
+    struct Dct_Buffer *buf = (struct Dct_Buffer *)(plan->dct_buffer);
+    const int nelems = buf->nelems;
+    int i, j;
+
+    for (i=0; i<count; i+=2) {
+        float *ptr0 = data + (ptrdiff_t)i * row_stride;
+        float *ptr1 = i+1 < count ? ptr0 + row_stride : ptr0;
+
+        for (j=0; j<nelems; ++j) {
+            buf->inout_data0[j] = (double)ptr0[(ptrdiff_t)j * elem_stride];
+        }
+        for (j=0; j<nelems; ++j) {
+            buf->inout_data1[j] = (double)ptr1[(ptrdiff_t)j * elem_stride];
+        }
+
+        perform_dcts_fftpack( plan );
+
+        for (j=0; j<nelems; ++j) {
+            ptr0[(ptrdiff_t)j * elem_stride] = (float)buf->inout_data0[j];
+        }
+        if (ptr1 != ptr0) {
+            for (j=0; j<nelems; ++j) {
+                ptr1[(ptrdiff_t)j * elem_stride] = (float)buf->inout_data1[j];
+            }
+        }
+    }
+}
+
+void cleanup_dcts_fftpack(
     struct Dct_Plan *plan   // from setup_dcts()
 )
 // Frees memory allocated by setup_dcts().
@@ -178,3 +335,186 @@ void cleanup_dcts(
     plan->out_data[0] = NULL;
     plan->dct_buffer  = NULL;
 }
+
+// Each wisdom entry: five ints (backend, dct_type, nelems, nsave, MAX_IFAC),
+// then nsave doubles (wsave), MAX_IFAC ints (ifac), and an unsigned long long
+// checksum of all of these from twiddles_checksum(), all in native format.
+
+static unsigned long long twiddles_checksum( const int *fields,
+                                             const struct Fftpack_Twiddles *entry )
+{
+    unsigned long long hash;
+
+    hash = cache_hash( 0,    fields,       5 * sizeof( int ) );
+    hash = cache_hash( hash, entry->wsave, entry->nsave * sizeof( double ) );
+    hash = cache_hash( hash, entry->ifac,  MAX_IFAC * sizeof( int ) );
+    return hash;
+}
+
+static int check_factors( const int *ifac, int n, int max_len )
+// Returns number of ints used by a factorization of n from rffti() at ifac
+// (n, number of factors, then the factors), or 0 if it is not a valid one.
+{
+    long long product = 1;
+    int nf = ifac[1];
+    int k;
+
+    if (ifac[0] != n || nf < 1 || nf > max_factors || nf + 2 > max_len) {
+        return 0;
+    }
+    for (k=0; k<nf; ++k) {
+        if (ifac[k+2] < 2) {
+            return 0;
+        }
+        product *= ifac[k+2];
+        if (product > n) {
+            return 0;
+        }
+    }
+    return product == n ? nf + 2 : 0;
+}
+
+static int check_twiddles( const struct Fftpack_Twiddles *entry )
+// Returns nonzero if the factorizations in entry->ifac are those cosqi() could
+// have computed, so that a corrupt wisdom file cannot make the transforms
+// index outside their buffers.
+{
+    const int *ifac = entry->ifac;
+    int n = entry->nelems;
+    int m, len, mlen;
+
+    if (n < 2) {
+        // rffti() stores nothing for a single element
+        return ifac[0] == 0 && ifac[1] == 0;
+    }
+
+    len = check_factors( ifac, n, MAX_IFAC );
+    if (!len || len >= MAX_IFAC) {
+        return 0;
+    }
+    if (ifac[len] == 0) {
+        return 1;   // Bluestein's algorithm not used
+    }
+
+    // otherwise the factorization of the Bluestein convolution length follows
+    m = 4;
+    while (m < n) {
+        m += m;
+    }
+    m += m;
+    mlen = check_factors( ifac + len, m, MAX_IFAC - len );
+    return mlen && len + mlen <= MAX_IFAC;
+}
+
+int import_wisdom_fftpack(
+    FILE *file  // input: positioned after header written by dct.c
+)
+// Returns number of entries read, or -1 if the file is not in the expected format.
+{
+    struct Fftpack_Twiddles *entry;
+    unsigned long long checksum;
+    int fields[5];
+    int count = 0;
+
+    while (fread( fields, sizeof( int ), 5, file ) == 5) {
+        if (fields[0] != DCT_BACKEND_FFTPACK ||
+            (fields[1] != 2 && fields[1] != 3) ||
+            fields[2] < 1 || fields[3] < 0 || fields[3] > 28 * fields[2] ||
+            fields[4] != MAX_IFAC)
+        {
+            return -1;
+        }
+
+        entry = new_twiddles( fields[1], fields[2], fields[3] );
+        if (!entry) {
+            break;
+        }
+        if (fread( entry->wsave, sizeof( double ), entry->nsave, file ) != (size_t)entry->nsave ||
+            fread( entry->ifac,  sizeof( int ),    MAX_IFAC,     file ) != (size_t)MAX_IFAC ||
+            fread( &checksum, sizeof( checksum ), 1, file ) != 1)
+        {
+            free( entry->wsave );
+            free( entry );
+            return -1;
+        }
+        if (checksum != twiddles_checksum( fields, entry ) || !check_twiddles( entry )) {
+            // skip a damaged entry; setup_dcts() will compute it again, and
+            // leave it unsaved so that the next export replaces it
+            free( entry->wsave );
+            free( entry );
+            continue;
+        }
+
+        entry->saved = 1;
+        add_twiddles( entry );
+        ++count;
+    }
+
+    return count;
+}
+
+int export_wisdom_fftpack(
+    FILE *file  // input: positioned after header written by dct.c
+)
+// Returns 0 on success, nonzero if a write error occurred.
+{
+    struct Fftpack_Twiddles *entry;
+    unsigned long long checksum;
+    int fields[5];
+    int error = 0;
+
+    lock_dct_caches();
+    for (entry=twiddle_cache; entry && !error; entry=entry->next) {
+        fields[0] = DCT_BACKEND_FFTPACK;
+        fields[1] = entry->dct_type;
+        fields[2] = entry->nelems;
+        fields[3] = entry->nsave;
+        fields[4] = MAX_IFAC;
+        checksum  = twiddles_checksum( fields, entry );
+
+        error =
+            fwrite( fields,       sizeof( int ),    5,            file ) != 5 ||
+            fwrite( entry->wsave, sizeof( double ), entry->nsave, file ) != (size_t)entry->nsave ||
+            fwrite( entry->ifac,  sizeof( int ),    MAX_IFAC,     file ) != (size_t)MAX_IFAC ||
+            fwrite( &checksum, sizeof( checksum ), 1, file ) != 1;
+    }
+    if (!error) {
+        for (entry=twiddle_cache; entry; entry=entry->next) {
+            entry->saved = 1;
+        }
+    }
+    unlock_dct_caches();
+
+    return error;
+}
+
+int wisdom_updated_fftpack( void )
+{
+    const struct Fftpack_Twiddles *entry;
+    int updated = 0;
+
+    lock_dct_caches();
+    for (entry=twiddle_cache; entry; entry=entry->next) {
+        if (!entry->saved) {
+            updated = 1;
+            break;
+        }
+    }
+    unlock_dct_caches();
+
+    return updated;
+}
+
+void forget_wisdom_fftpack( void )
+{
+    struct Fftpack_Twiddles *entry;
+
+    lock_dct_caches();
+    while (twiddle_cache) {
+        entry = twiddle_cache;
+        twiddle_cache = entry->next;
+        free( entry->wsave );
+        free( entry );
+    }
+    unlock_dct_caches();
+}
@@ -0,0 +1,517 @@
+/*
+ * dct_simd.c
+ *
+ * Single-precision vectorized implementation of the functions in dct.h.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+//
+// This file provides an implementation of the DCT functions in dct.h that
+// computes in single precision and transforms many rows at once, one row per
+// SIMD lane. DCTs are computed from complex FFTs (Makhoul's algorithm), with
+// two groups of rows packed into the real and imaginary parts of each FFT.
+// FFTs use a mixed-radix Stockham algorithm, or Bluestein's algorithm for
+// lengths with large prime factors (same idea as cosqi() in fftpack.c).
+//
+// Results agree with dct_fftpack.c to single precision (not bit-for-bit).
+//
+// The kernels in dct_simd_kernel.h are compiled once for each instruction
+// set; the widest one supported by the processor is selected at run time.
+//
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "dct.h"
+#include "dct_backends.h"
+
+#include "compatibility.h"
+
+#include <stddef.h> // for ptrdiff_t
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+// For a 64-bit compile we need LONG to be 64 bits, even if the compiler uses an LLP64 model
+#define LONG ptrdiff_t
+
+#ifndef M_PI
+#   define M_PI 3.14159265358979323846
+#endif
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#   define DCT_SIMD_X86 1   // compile AVX2 and AVX-512 kernels; select at run time
+#else
+#   define DCT_SIMD_X86 0
+#endif
+
+#if defined __GNUC__
+#   define DCT_SIMD_LANES 4 // portable GCC/Clang vectors (SSE2, NEON, ...)
+#else
+#   define DCT_SIMD_LANES 1 // no vector extensions - plain scalar code
+#endif
+
+#define MAX_PASSES  32
+#define ALIGNMENT   64
+
+// Complex FFT of length n, forward direction
+struct Simd_Fft {
+    int    n;
+    int    nfactors;
+    int    factors  [MAX_PASSES];
+    LONG   tw_offset[MAX_PASSES];   // offsets into twr/twi for each pass
+    LONG   om_offset[MAX_PASSES];   // offsets into omr/omi for each pass
+    float *twr, *twi;               // twiddle factors for each pass
+    float *omr, *omi;               // roots of unity for passes with generic radix
+    int    max_radix;
+    struct Simd_Fft
+          *blue;                    // power-of-2 FFT for Bluestein's algorithm, or null
+    float *chirp_r, *chirp_i;       // Bluestein chirp exp(-i*pi*k^2/n), n values
+    float *kern_r,  *kern_i;        // FFT of conjugate chirp divided by m, m values
+    LONG   work_len;                // vectors of workspace needed by fft()
+};
+
+struct Simd_Dct_Buffer {
+    int     dct_type;   // 2 or 3 (DCT types II, III)
+    int     nelems;     // length of each DCT
+    int     lanes;      // rows per vector; plan does 2*lanes rows per call
+    struct Simd_Fft
+            fft;        // FFT of length nelems
+    float  *cosk;       // cos(pi*k/(2*nelems))
+    float  *sink;       // sin(pi*k/(2*nelems))
+    void   *vwork;      // aligned vector workspace
+    void   *vwork_mem;  // allocated memory containing vwork
+    double *data;       // in/out buffers: 2*lanes rows of nelems values
+};
+
+static void *aligned_alloc_vectors( size_t bytes, void **mem )
+{
+    char *ptr = (char *)malloc( bytes + ALIGNMENT );
+    *mem = ptr;
+    if (!ptr) {
+        return NULL;
+    }
+    return ptr + (ALIGNMENT - (size_t)ptr % ALIGNMENT);
+}
+
+
+// FFT planning:
+
+static void fft_double( int n, double *re, double *im, double *tr, double *ti )
+// Simple recursive radix-2 FFT in double precision, forward direction;
+// n must be a power of 2. Used only to set up Bluestein's algorithm.
+{
+    int k, h = n / 2;
+
+    if (n == 1) {
+        return;
+    }
+    for (k=0; k<h; ++k) {
+        tr[k]   = re[2*k];
+        ti[k]   = im[2*k];
+        tr[k+h] = re[2*k+1];
+        ti[k+h] = im[2*k+1];
+    }
+    fft_double( h, tr,   ti,   re,   im   );
+    fft_double( h, tr+h, ti+h, re+h, im+h );
+    for (k=0; k<h; ++k) {
+        double c  = cos( -2.0 * M_PI * k / n );
+        double s  = sin( -2.0 * M_PI * k / n );
+        double br = tr[k+h] * c - ti[k+h] * s;
+        double bi = tr[k+h] * s + ti[k+h] * c;
+        re[k]   = tr[k] + br;
+        im[k]   = ti[k] + bi;
+        re[k+h] = tr[k] - br;
+        im[k+h] = ti[k] - bi;
+    }
+}
+
+static void free_fft( struct Simd_Fft *fft )
+{
+    if (fft->blue) {
+        free_fft( fft->blue );
+        free( fft->blue );
+        fft->blue = NULL;
+    }
+    free( fft->twr );
+    fft->twr = NULL;
+}
+
+static int factor_fft( int n, int *factors )
+// Splits n into radices for the FFT passes: 4's first, then 2, 3, 5, and other primes.
+// Returns number of factors.
+{
+    int nf = 0;
+    int p;
+
+    while (n % 4 == 0 && nf < MAX_PASSES) {
+        factors[nf++] = 4;
+        n /= 4;
+    }
+    for (p=2; n>1 && nf<MAX_PASSES; ) {
+        if (n % p == 0) {
+            factors[nf++] = p;
+            n /= p;
+        } else {
+            p += (p == 2) ? 1 : 2;
+        }
+    }
+    return nf;
+}
+
+static int setup_fft( struct Simd_Fft *fft, int n, int allow_bluestein )
+// Returns 0 on success, nonzero if a memory allocation error occurred.
+{
+    int  f, p, u;
+    int  nc;
+    int  m, log2m;
+    long sum;
+    LONG tw_len, om_len;
+    float *storage;
+
+    memset( fft, 0, sizeof( *fft ) );
+
+    fft->n = n;
+    fft->nfactors = factor_fft( n, fft->factors );
+
+    sum = 0;
+    fft->max_radix = 1;
+    for (f=0; f<fft->nfactors; ++f) {
+        sum += fft->factors[f];
+        if (fft->factors[f] > fft->max_radix) {
+            fft->max_radix = fft->factors[f];
+        }
+    }
+
+    // For large prime factors, the direct DFT of each radix becomes expensive;
+    // use Bluestein's algorithm if it's estimated to be faster.
+    m = 1;
+    log2m = 0;
+    while (m < 2*n - 1) {
+        m += m;
+        ++log2m;
+    }
+    if (allow_bluestein && n > 5 && sum * (long)n > 3L * m * log2m) {
+        double *buf;
+        int k;
+
+        fft->blue = (struct Simd_Fft *)malloc( sizeof( struct Simd_Fft ) );
+        if (!fft->blue) {
+            return 1;
+        }
+        if (setup_fft( fft->blue, m, 0 )) {
+            free( fft->blue );
+            fft->blue = NULL;
+            return 1;
+        }
+
+        storage = (float *)malloc( sizeof( float ) * (2 * (LONG)n + 2 * (LONG)m) );
+        buf = (double *)malloc( sizeof( double ) * 4 * (LONG)m );
+        if (!storage || !buf) {
+            free( storage );
+            free( buf );
+            free_fft( fft );
+            return 1;
+        }
+        fft->twr     = storage;     // owns the allocation, freed by free_fft()
+        fft->chirp_r = storage;
+        fft->chirp_i = storage + n;
+        fft->kern_r  = storage + 2*n;
+        fft->kern_i  = storage + 2*n + m;
+
+        for (k=0; k<m; ++k) {
+            buf[k]   = 0.0;
+            buf[k+m] = 0.0;
+        }
+        for (k=0; k<n; ++k) {
+            double theta = M_PI * (double)(((long long)k * k) % (2 * (long long)n)) / n;
+            fft->chirp_r[k] = (float)cos( theta );
+            fft->chirp_i[k] = (float)-sin( theta );
+            // kernel = conjugate chirp, symmetric about 0 (mod m)
+            buf[k]   = cos( theta ) / m;
+            buf[k+m] = sin( theta ) / m;
+            if (k > 0) {
+                buf[m-k]   = buf[k];
+                buf[m-k+m] = buf[k+m];
+            }
+        }
+        fft_double( m, buf, buf+m, buf+2*m, buf+3*m );
+        for (k=0; k<m; ++k) {
+            fft->kern_r[k] = (float)buf[k];
+            fft->kern_i[k] = (float)buf[k+m];
+        }
+        free( buf );
+
+        fft->work_len = 2 * (LONG)m + fft->blue->work_len;
+        return 0;
+    }
+
+    // Twiddle factors for each pass, and roots of unity for generic radices
+
+    tw_len = 0;
+    om_len = 0;
+    nc = n;
+    for (f=0; f<fft->nfactors; ++f) {
+        int r = fft->factors[f];
+        fft->tw_offset[f] = tw_len;
+        fft->om_offset[f] = om_len;
+        tw_len += (LONG)(nc / r) * (r - 1);
+        if (r > 5) {
+            om_len += r;
+        }
+        nc /= r;
+    }
+
+    storage = (float *)malloc( sizeof( float ) * 2 * (tw_len + om_len + 1) );
+    if (!storage) {
+        return 1;
+    }
+    fft->twr = storage;
+    fft->twi = storage + tw_len;
+    fft->omr = storage + tw_len * 2;
+    fft->omi = storage + tw_len * 2 + om_len;
+
+    nc = n;
+    for (f=0; f<fft->nfactors; ++f) {
+        int r = fft->factors[f];
+        int mc = nc / r;
+        float *twr = fft->twr + fft->tw_offset[f];
+        float *twi = fft->twi + fft->tw_offset[f];
+        for (p=0; p<mc; ++p) {
+            for (u=1; u<r; ++u) {
+                double theta = -2.0 * M_PI * (double)(((long long)p * u) % nc) / nc;
+                twr[(LONG)p * (r-1) + (u-1)] = (float)cos( theta );
+                twi[(LONG)p * (r-1) + (u-1)] = (float)sin( theta );
+            }
+        }
+        if (r > 5) {
+            float *omr = fft->omr + fft->om_offset[f];
+            float *omi = fft->omi + fft->om_offset[f];
+            for (u=0; u<r; ++u) {
+                double theta = -2.0 * M_PI * u / r;
+                omr[u] = (float)cos( theta );
+                omi[u] = (float)sin( theta );
+            }
+        }
+        nc /= r;
+    }
+
+    fft->work_len = 2 * (LONG)n + 2 * fft->max_radix;
+    return 0;
+}
+
+
+// Kernels for each instruction set:
+
+#define VLANES DCT_SIMD_LANES
+#define VFLOAT vfloat_generic
+#define KFN(name) name##_generic
+#define KATTR
+#include "dct_simd_kernel.h"
+#undef VLANES
+#undef VFLOAT
+#undef KFN
+#undef KATTR
+
+#if DCT_SIMD_X86
+
+#define VLANES 8
+#define VFLOAT vfloat_avx2
+#define KFN(name) name##_avx2
+#define KATTR __attribute__(( target( "avx2,fma" ) ))
+#include "dct_simd_kernel.h"
+#undef VLANES
+#undef VFLOAT
+#undef KFN
+#undef KATTR
+
+#define VLANES 16
+#define VFLOAT vfloat_avx512
+#define KFN(name) name##_avx512
+#define KATTR __attribute__(( target( "avx512f" ) ))
+#include "dct_simd_kernel.h"
+#undef VLANES
+#undef VFLOAT
+#undef KFN
+#undef KATTR
+
+#endif
+
+static enum Dct_Backend select_isa( enum Dct_Backend backend )
+// Returns the widest instruction set supported that is no wider than requested.
+{
+#if DCT_SIMD_X86
+    if (backend == DCT_BACKEND_SIMD) {
+        backend = DCT_BACKEND_SIMD_AVX512;
+    }
+    __builtin_cpu_init();
+    if (backend == DCT_BACKEND_SIMD_AVX512 && !__builtin_cpu_supports( "avx512f" )) {
+        backend = DCT_BACKEND_SIMD_AVX2;
+    }
+    if (backend == DCT_BACKEND_SIMD_AVX2 &&
+        !(__builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" )))
+    {
+        backend = DCT_BACKEND_SIMD_SSE2;
+    }
+    return backend;
+#else
+    return DCT_BACKEND_SIMD_SSE2;
+#endif
+}
+
+static int isa_lanes( enum Dct_Backend backend )
+{
+    switch (backend) {
+        case DCT_BACKEND_SIMD_AVX512:
+            return 16;
+        case DCT_BACKEND_SIMD_AVX2:
+            return 8;
+        default:
+            return DCT_SIMD_LANES;
+    }
+}
+
+
+// Functions in dct_backends.h:
+
+enum Dct_Backend select_backend_simd(
+    enum Dct_Backend
+        backend     // requested instruction set
+)
+{
+    return select_isa( backend );
+}
+
+struct Dct_Plan setup_dcts_simd(
+    int dct_type,   // 2 or 3 (DCT types II, III)
+    int nelems,     // data length for each DCT
+    enum Dct_Backend
+        backend     // requested instruction set
+)
+{
+    struct Dct_Plan plan;
+    struct Simd_Dct_Buffer *buf;
+    LONG vectors;
+    int i, k;
+
+    assert( dct_type == 2 || dct_type == 3 );   // illegal or unsupported dct_type
+
+    plan.dct_buffer = NULL;
+    for (i=0; i<DCT_MAX_BATCH; ++i) {
+        plan.in_data[i]  = NULL;
+        plan.out_data[i] = NULL;
+    }
+    plan.backend    = select_isa( backend );
+    plan.batch_size = 2 * isa_lanes( (enum Dct_Backend)plan.backend );
+    plan.dct_type   = dct_type;
+    plan.nelems     = nelems;
+
+    buf = (struct Simd_Dct_Buffer *)calloc( 1, sizeof( struct Simd_Dct_Buffer ) );
+    if (!buf) {
+        return plan;
+    }
+
+    buf->dct_type = dct_type;
+    buf->nelems   = nelems;
+    buf->lanes    = plan.batch_size / 2;
+
+    if (setup_fft( &buf->fft, nelems, 1 )) {
+        free( buf );
+        return plan;
+    }
+
+    buf->cosk = (float *)malloc( sizeof( float ) * 2 * (LONG)nelems );
+    buf->data = (double *)malloc( sizeof( double ) * plan.batch_size * (LONG)nelems );
+
+    // xa, xb, and work arrays for dct(): see dct_simd_kernel.h
+    vectors = 4 * (LONG)nelems + buf->fft.work_len;
+    buf->vwork = aligned_alloc_vectors(
+        sizeof( float ) * buf->lanes * vectors, &buf->vwork_mem );
+
+    if (!buf->cosk || !buf->data || !buf->vwork) {
+        free( buf->vwork_mem );
+        free( buf->data );
+        free( buf->cosk );
+        free_fft( &buf->fft );
+        free( buf );
+        return plan;
+    }
+
+    buf->sink = buf->cosk + nelems;
+    for (k=0; k<nelems; ++k) {
+        double theta = M_PI * k / (2.0 * nelems);
+        buf->cosk[k] = (float)cos( theta );
+        buf->sink[k] = (float)sin( theta );
+    }
+
+    plan.dct_buffer = (void *)buf;
+    for (i=0; i<plan.batch_size; ++i) {
+        plan.in_data[i]  = buf->data + (LONG)i * nelems;
+        plan.out_data[i] = plan.in_data[i];     // in-place transforms
+    }
+    return plan;
+}
+
+void perform_dcts_simd(
+    const struct Dct_Plan *plan // from setup_dcts_simd()
+)
+{
+    switch (plan->backend) {
+#if DCT_SIMD_X86
+        case DCT_BACKEND_SIMD_AVX512:
+            perform_avx512( plan );
+            break;
+        case DCT_BACKEND_SIMD_AVX2:
+            perform_avx2( plan );
+            break;
+#endif
+        default:
+            perform_generic( plan );
+    }
+}
+
+void perform_dcts_rows_simd(
+    const struct Dct_Plan *plan,    // from setup_dcts_simd()
+    float    *data,                 // input/output: first element of first row
+    int       count,                // input: number of rows to transform
+    ptrdiff_t row_stride,           // input: distance between first elements of successive rows
+    ptrdiff_t elem_stride           // input: distance between successive elements of each row
+)
+{
+    switch (plan->backend) {
+#if DCT_SIMD_X86
+        case DCT_BACKEND_SIMD_AVX512:
+            perform_rows_avx512( plan, data, count, row_stride, elem_stride );
+            break;
+        case DCT_BACKEND_SIMD_AVX2:
+            perform_rows_avx2( plan, data, count, row_stride, elem_stride );
+            break;
+#endif
+        default:
+            perform_rows_generic( plan, data, count, row_stride, elem_stride );
+    }
+}
+
+void cleanup_dcts_simd(
+    struct Dct_Plan *plan   // from setup_dcts_simd()
+)
+{
+    struct Simd_Dct_Buffer *buf = (struct Simd_Dct_Buffer *)(plan->dct_buffer);
+    int i;
+
+    if (buf) {
+        free( buf->vwork_mem );
+        free( buf->data );
+        free( buf->cosk );
+        free_fft( &buf->fft );
+        free( buf );
+    }
+
+    for (i=0; i<DCT_MAX_BATCH; ++i) {
+        plan->in_data[i]  = NULL;
+        plan->out_data[i] = NULL;
+    }
+    plan->dct_buffer = NULL;
+}
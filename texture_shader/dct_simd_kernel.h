@@ -0,0 +1,480 @@
+/*
+ * dct_simd_kernel.h
+ *
+ * Vectorized FFT and DCT kernels used by dct_simd.c.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+//
+// This file is NOT a normal header. It is included by dct_simd.c once for
+// each instruction set supported, with these macros defined beforehand:
+//
+//      VLANES      number of float lanes per vector (1 for plain scalar code)
+//      VFLOAT      name of vector type to define
+//      KFN(name)   decorates names of functions defined here
+//      KATTR       attributes for functions defined here (e.g., target instruction set)
+//
+// Each vector holds the same element of VLANES different rows, so every
+// operation below transforms VLANES rows at once. Twiddle factors are the
+// same for all rows and are stored as scalars.
+//
+
+#if VLANES > 1
+typedef float VFLOAT __attribute__(( vector_size( VLANES * sizeof( float ) ) ));
+#else
+typedef float VFLOAT;
+#endif
+
+// One radix-r pass of a Stockham autosort FFT (forward, sign -1).
+// nc = remaining transform length, s = stride (product of radices done so far).
+static KATTR void KFN(fft_pass)(
+    int r, int nc, int s,
+    const VFLOAT *RESTRICT xr, const VFLOAT *RESTRICT xi,
+    VFLOAT *RESTRICT yr, VFLOAT *RESTRICT yi,
+    const float *RESTRICT twr, const float *RESTRICT twi,
+    const float *RESTRICT omr, const float *RESTRICT omi,
+    VFLOAT *RESTRICT scratch )
+{
+    const int m = nc / r;
+    const LONG sm = (LONG)s * (LONG)m;
+    int p, q, t, u;
+
+    switch (r) {
+        case 2:
+            for (p=0; p<m; ++p) {
+                const float w1r = twr[p], w1i = twi[p];
+                const VFLOAT *ar = xr + (LONG)s * p, *ai = xi + (LONG)s * p;
+                VFLOAT *br = yr + (LONG)s * (2*p), *bi = yi + (LONG)s * (2*p);
+                for (q=0; q<s; ++q) {
+                    VFLOAT a0r = ar[q],    a0i = ai[q];
+                    VFLOAT a1r = ar[q+sm], a1i = ai[q+sm];
+                    VFLOAT dr = a0r - a1r, di = a0i - a1i;
+                    br[q]   = a0r + a1r;
+                    bi[q]   = a0i + a1i;
+                    br[q+s] = dr * w1r - di * w1i;
+                    bi[q+s] = dr * w1i + di * w1r;
+                }
+            }
+            break;
+
+        case 3: {
+            const float s3 = 0.86602540378443864676f;
+            for (p=0; p<m; ++p) {
+                const float w1r = twr[2*p],   w1i = twi[2*p];
+                const float w2r = twr[2*p+1], w2i = twi[2*p+1];
+                const VFLOAT *ar = xr + (LONG)s * p, *ai = xi + (LONG)s * p;
+                VFLOAT *br = yr + (LONG)s * (3*p), *bi = yi + (LONG)s * (3*p);
+                for (q=0; q<s; ++q) {
+                    VFLOAT a0r = ar[q],      a0i = ai[q];
+                    VFLOAT a1r = ar[q+sm],   a1i = ai[q+sm];
+                    VFLOAT a2r = ar[q+2*sm], a2i = ai[q+2*sm];
+                    VFLOAT t1r = a1r + a2r, t1i = a1i + a2i;
+                    VFLOAT t2r = a1r - a2r, t2i = a1i - a2i;
+                    VFLOAT m1r = a0r - t1r * 0.5f, m1i = a0i - t1i * 0.5f;
+                    VFLOAT m2r = t2i * s3,         m2i = t2r * -s3;
+                    VFLOAT c1r = m1r + m2r, c1i = m1i + m2i;
+                    VFLOAT c2r = m1r - m2r, c2i = m1i - m2i;
+                    br[q]     = a0r + t1r;
+                    bi[q]     = a0i + t1i;
+                    br[q+s]   = c1r * w1r - c1i * w1i;
+                    bi[q+s]   = c1r * w1i + c1i * w1r;
+                    br[q+2*s] = c2r * w2r - c2i * w2i;
+                    bi[q+2*s] = c2r * w2i + c2i * w2r;
+                }
+            }
+            break;
+        }
+
+        case 4:
+            for (p=0; p<m; ++p) {
+                const float w1r = twr[3*p],   w1i = twi[3*p];
+                const float w2r = twr[3*p+1], w2i = twi[3*p+1];
+                const float w3r = twr[3*p+2], w3i = twi[3*p+2];
+                const VFLOAT *ar = xr + (LONG)s * p, *ai = xi + (LONG)s * p;
+                VFLOAT *br = yr + (LONG)s * (4*p), *bi = yi + (LONG)s * (4*p);
+                for (q=0; q<s; ++q) {
+                    VFLOAT a0r = ar[q],      a0i = ai[q];
+                    VFLOAT a1r = ar[q+sm],   a1i = ai[q+sm];
+                    VFLOAT a2r = ar[q+2*sm], a2i = ai[q+2*sm];
+                    VFLOAT a3r = ar[q+3*sm], a3i = ai[q+3*sm];
+                    VFLOAT t0r = a0r + a2r, t0i = a0i + a2i;
+                    VFLOAT t1r = a0r - a2r, t1i = a0i - a2i;
+                    VFLOAT t2r = a1r + a3r, t2i = a1i + a3i;
+                    VFLOAT t3r = a1r - a3r, t3i = a1i - a3i;
+                    VFLOAT c1r = t1r + t3i, c1i = t1i - t3r;
+                    VFLOAT c2r = t0r - t2r, c2i = t0i - t2i;
+                    VFLOAT c3r = t1r - t3i, c3i = t1i + t3r;
+                    br[q]     = t0r + t2r;
+                    bi[q]     = t0i + t2i;
+                    br[q+s]   = c1r * w1r - c1i * w1i;
+                    bi[q+s]   = c1r * w1i + c1i * w1r;
+                    br[q+2*s] = c2r * w2r - c2i * w2i;
+                    bi[q+2*s] = c2r * w2i + c2i * w2r;
+                    br[q+3*s] = c3r * w3r - c3i * w3i;
+                    bi[q+3*s] = c3r * w3i + c3i * w3r;
+                }
+            }
+            break;
+
+        case 5: {
+            const float c1 =  0.30901699437494742410f;  // cos(2*pi/5)
+            const float c2 = -0.80901699437494742410f;  // cos(4*pi/5)
+            const float s1 =  0.95105651629515357212f;  // sin(2*pi/5)
+            const float s2 =  0.58778525229247312917f;  // sin(4*pi/5)
+            for (p=0; p<m; ++p) {
+                const float *wr = twr + 4*p, *wi = twi + 4*p;
+                const VFLOAT *ar = xr + (LONG)s * p, *ai = xi + (LONG)s * p;
+                VFLOAT *br = yr + (LONG)s * (5*p), *bi = yi + (LONG)s * (5*p);
+                for (q=0; q<s; ++q) {
+                    VFLOAT a0r = ar[q],      a0i = ai[q];
+                    VFLOAT a1r = ar[q+sm],   a1i = ai[q+sm];
+                    VFLOAT a2r = ar[q+2*sm], a2i = ai[q+2*sm];
+                    VFLOAT a3r = ar[q+3*sm], a3i = ai[q+3*sm];
+                    VFLOAT a4r = ar[q+4*sm], a4i = ai[q+4*sm];
+                    VFLOAT t1r = a1r + a4r, t1i = a1i + a4i;
+                    VFLOAT t2r = a2r + a3r, t2i = a2i + a3i;
+                    VFLOAT t3r = a1r - a4r, t3i = a1i - a4i;
+                    VFLOAT t4r = a2r - a3r, t4i = a2i - a3i;
+                    VFLOAT b1r = a0r + t1r * c1 + t2r * c2, b1i = a0i + t1i * c1 + t2i * c2;
+                    VFLOAT b2r = a0r + t1r * c2 + t2r * c1, b2i = a0i + t1i * c2 + t2i * c1;
+                    // d = -i * (...)
+                    VFLOAT d1r =   t3i * s1 + t4i * s2,  d1i = -(t3r * s1 + t4r * s2);
+                    VFLOAT d2r =   t3i * s2 - t4i * s1,  d2i = -(t3r * s2 - t4r * s1);
+                    VFLOAT c1r_ = b1r + d1r, c1i_ = b1i + d1i;
+                    VFLOAT c4r_ = b1r - d1r, c4i_ = b1i - d1i;
+                    VFLOAT c2r_ = b2r + d2r, c2i_ = b2i + d2i;
+                    VFLOAT c3r_ = b2r - d2r, c3i_ = b2i - d2i;
+                    br[q]     = a0r + t1r + t2r;
+                    bi[q]     = a0i + t1i + t2i;
+                    br[q+s]   = c1r_ * wr[0] - c1i_ * wi[0];
+                    bi[q+s]   = c1r_ * wi[0] + c1i_ * wr[0];
+                    br[q+2*s] = c2r_ * wr[1] - c2i_ * wi[1];
+                    bi[q+2*s] = c2r_ * wi[1] + c2i_ * wr[1];
+                    br[q+3*s] = c3r_ * wr[2] - c3i_ * wi[2];
+                    bi[q+3*s] = c3r_ * wi[2] + c3i_ * wr[2];
+                    br[q+4*s] = c4r_ * wr[3] - c4i_ * wi[3];
+                    bi[q+4*s] = c4r_ * wi[3] + c4i_ * wr[3];
+                }
+            }
+            break;
+        }
+
+        default: {
+            // generic odd radix: direct DFT of length r using table of roots of unity
+            VFLOAT *sr = scratch;
+            VFLOAT *si = scratch + r;
+            for (p=0; p<m; ++p) {
+                const float *wr = twr + (LONG)(r-1) * p, *wi = twi + (LONG)(r-1) * p;
+                const VFLOAT *ar = xr + (LONG)s * p, *ai = xi + (LONG)s * p;
+                VFLOAT *br = yr + (LONG)s * (r*p), *bi = yi + (LONG)s * (r*p);
+                for (q=0; q<s; ++q) {
+                    for (t=0; t<r; ++t) {
+                        sr[t] = ar[q + t*sm];
+                        si[t] = ai[q + t*sm];
+                    }
+                    for (u=0; u<r; ++u) {
+                        VFLOAT cr = sr[0], ci = si[0];
+                        int k = 0;
+                        for (t=1; t<r; ++t) {
+                            k += u;
+                            if (k >= r) {
+                                k -= r;
+                            }
+                            cr += sr[t] * omr[k] - si[t] * omi[k];
+                            ci += sr[t] * omi[k] + si[t] * omr[k];
+                        }
+                        if (u == 0) {
+                            br[q] = cr;
+                            bi[q] = ci;
+                        } else {
+                            br[q+u*s] = cr * wr[u-1] - ci * wi[u-1];
+                            bi[q+u*s] = cr * wi[u-1] + ci * wr[u-1];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Forward complex FFT of length fft->n (no Bluestein), from (xr,xi) using
+// work arrays (yr,yi); returns nonzero if the result ended up in (yr,yi).
+static KATTR int KFN(fft_stockham)(
+    const struct Simd_Fft *fft,
+    VFLOAT *xr, VFLOAT *xi, VFLOAT *yr, VFLOAT *yi, VFLOAT *scratch )
+{
+    int f;
+    int nc = fft->n;
+    int s  = 1;
+    int swapped = 0;
+    VFLOAT *tr, *ti;
+
+    for (f=0; f<fft->nfactors; ++f) {
+        int r = fft->factors[f];
+        const float *twr = fft->twr + fft->tw_offset[f];
+        const float *twi = fft->twi + fft->tw_offset[f];
+        const float *omr = fft->omr + fft->om_offset[f];
+        const float *omi = fft->omi + fft->om_offset[f];
+
+        KFN(fft_pass)( r, nc, s, xr, xi, yr, yi, twr, twi, omr, omi, scratch );
+
+        tr = xr, xr = yr, yr = tr;
+        ti = xi, xi = yi, yi = ti;
+        swapped = !swapped;
+
+        s  *= r;
+        nc /= r;
+    }
+
+    return swapped;
+}
+
+// Forward complex FFT of length fft->n, in place in (xr,xi).
+// work must have room for 2*fft->work_len vectors.
+static KATTR void KFN(fft)(
+    const struct Simd_Fft *fft, VFLOAT *xr, VFLOAT *xi, VFLOAT *work )
+{
+    const int n = fft->n;
+    int j;
+
+    if (!fft->blue) {
+        VFLOAT *yr = work;
+        VFLOAT *yi = work + n;
+        VFLOAT *scratch = work + 2*n;
+        if (KFN(fft_stockham)( fft, xr, xi, yr, yi, scratch )) {
+            for (j=0; j<n; ++j) {
+                xr[j] = yr[j];
+                xi[j] = yi[j];
+            }
+        }
+    } else {
+        // Bluestein's algorithm: convolution with chirp via power-of-2 FFTs
+        const struct Simd_Fft *sub = fft->blue;
+        const int m = sub->n;
+        const float *cr = fft->chirp_r, *ci = fft->chirp_i;
+        const float *kr = fft->kern_r,  *ki = fft->kern_i;
+        const VFLOAT vzero = { 0.0f };
+        VFLOAT *ar = work;
+        VFLOAT *ai = work + m;
+        VFLOAT *subwork = work + 2*m;
+
+        for (j=0; j<n; ++j) {
+            ar[j] = xr[j] * cr[j] - xi[j] * ci[j];
+            ai[j] = xr[j] * ci[j] + xi[j] * cr[j];
+        }
+        for (; j<m; ++j) {
+            ar[j] = vzero;
+            ai[j] = vzero;
+        }
+
+        KFN(fft)( sub, ar, ai, subwork );
+
+        // multiply by transformed kernel (already scaled by 1/m) and conjugate,
+        // so that the forward FFT below computes the inverse transform
+        for (j=0; j<m; ++j) {
+            VFLOAT tr = ar[j] * kr[j] - ai[j] * ki[j];
+            VFLOAT ti = ar[j] * ki[j] + ai[j] * kr[j];
+            ar[j] =  tr;
+            ai[j] = -ti;
+        }
+
+        KFN(fft)( sub, ar, ai, subwork );
+
+        for (j=0; j<n; ++j) {
+            VFLOAT tr =  ar[j];
+            VFLOAT ti = -ai[j];
+            xr[j] = tr * cr[j] - ti * ci[j];
+            xi[j] = tr * ci[j] + ti * cr[j];
+        }
+    }
+}
+
+// Performs DCTs on 2*VLANES rows: rows of group a are in the lanes of xa,
+// rows of group b in the lanes of xb; element j of each row is in vector j.
+// Scaling matches FFTPACK cosqb() (type 2) and cosqf() (type 3).
+static KATTR void KFN(dct)(
+    const struct Simd_Dct_Buffer *buf, VFLOAT *xa, VFLOAT *xb, VFLOAT *work )
+{
+    const int n  = buf->nelems;
+    const int nh = (n + 1) >> 1;
+    const float *cs = buf->cosk;    // cos(pi*k/(2n))
+    const float *sn = buf->sink;    // sin(pi*k/(2n))
+    VFLOAT *zr = work;
+    VFLOAT *zi = work + n;
+    VFLOAT *fftwork = work + 2*n;
+    int k;
+
+    if (n == 1) {
+        if (buf->dct_type == 2) {
+            xa[0] *= 4.0f;
+            xb[0] *= 4.0f;
+        }
+        return;
+    }
+
+    if (buf->dct_type == 2) {
+        // pack both groups into one complex sequence, even elements forward
+        // and odd elements backward (Makhoul's algorithm)
+        for (k=0; k<nh; ++k) {
+            zr[k] = xa[2*k];
+            zi[k] = xb[2*k];
+        }
+        for (k=0; k<n/2; ++k) {
+            zr[n-1-k] = xa[2*k+1];
+            zi[n-1-k] = xb[2*k+1];
+        }
+
+        KFN(fft)( &buf->fft, zr, zi, fftwork );
+
+        // separate the two real transforms and rotate by exp(-i*pi*k/(2n))
+        xa[0] = zr[0] * 4.0f;
+        xb[0] = zi[0] * 4.0f;
+        for (k=1; k<n; ++k) {
+            VFLOAT are = (zr[k] + zr[n-k]) * 2.0f;     // 4 * Re(A[k])
+            VFLOAT aim = (zi[k] - zi[n-k]) * 2.0f;     // 4 * Im(A[k])
+            VFLOAT bre = (zi[k] + zi[n-k]) * 2.0f;     // 4 * Re(B[k])
+            VFLOAT bim = (zr[n-k] - zr[k]) * 2.0f;     // 4 * Im(B[k])
+            xa[k] = are * cs[k] + aim * sn[k];
+            xb[k] = bre * cs[k] + bim * sn[k];
+        }
+    } else {
+        // rotate by exp(+i*pi*k/(2n)) and combine into one Hermitian-packed sequence;
+        // the inverse FFT is done as a forward FFT of the conjugate
+        zr[0] = xa[0];
+        zi[0] = -xb[0];
+        for (k=1; k<n; ++k) {
+            VFLOAT var = xa[k] * cs[k] + xa[n-k] * sn[k];
+            VFLOAT vai = xa[k] * sn[k] - xa[n-k] * cs[k];
+            VFLOAT vbr = xb[k] * cs[k] + xb[n-k] * sn[k];
+            VFLOAT vbi = xb[k] * sn[k] - xb[n-k] * cs[k];
+            zr[k] =   var - vbi;
+            zi[k] = -(vai + vbr);
+        }
+
+        KFN(fft)( &buf->fft, zr, zi, fftwork );
+
+        for (k=0; k<nh; ++k) {
+            xa[2*k] =  zr[k];
+            xb[2*k] = -zi[k];
+        }
+        for (k=0; k<n/2; ++k) {
+            xa[2*k+1] =  zr[n-1-k];
+            xb[2*k+1] = -zi[n-1-k];
+        }
+    }
+}
+
+// Loads plan->in_data[] into lanes, performs DCTs, and stores results to plan->out_data[].
+// Rows are copied in blocks of elements so the interleaved vectors stay in cache.
+static KATTR void KFN(perform)( const struct Dct_Plan *plan )
+{
+    const struct Simd_Dct_Buffer *buf = (const struct Simd_Dct_Buffer *)(plan->dct_buffer);
+    const int n = buf->nelems;
+    const int block = 256;
+    VFLOAT *xa   = (VFLOAT *)buf->vwork;
+    VFLOAT *xb   = xa + n;
+    VFLOAT *work = xb + n;
+    float  *fa   = (float *)xa;
+    float  *fb   = (float *)xb;
+    int j, j0, j1, lane;
+
+    for (j0=0; j0<n; j0=j1) {
+        j1 = j0 + block < n ? j0 + block : n;
+        for (lane=0; lane<VLANES; ++lane) {
+            const double *ina = plan->in_data[lane];
+            const double *inb = plan->in_data[lane + VLANES];
+            for (j=j0; j<j1; ++j) {
+                fa[(LONG)j * VLANES + lane] = (float)ina[j];
+                fb[(LONG)j * VLANES + lane] = (float)inb[j];
+            }
+        }
+    }
+
+    KFN(dct)( buf, xa, xb, work );
+
+    for (j0=0; j0<n; j0=j1) {
+        j1 = j0 + block < n ? j0 + block : n;
+        for (lane=0; lane<VLANES; ++lane) {
+            double *outa = plan->out_data[lane];
+            double *outb = plan->out_data[lane + VLANES];
+            for (j=j0; j<j1; ++j) {
+                outa[j] = (double)fa[(LONG)j * VLANES + lane];
+                outb[j] = (double)fb[(LONG)j * VLANES + lane];
+            }
+        }
+    }
+}
+
+// Performs DCTs in place on count rows of float data (see perform_dcts_rows() in dct.h),
+// 2*VLANES rows at a time. In the last batch, unused lanes repeat the last row.
+static KATTR void KFN(perform_rows)(
+    const struct Dct_Plan *plan, float *data, int count, LONG row_stride, LONG elem_stride )
+{
+    const struct Simd_Dct_Buffer *buf = (const struct Simd_Dct_Buffer *)(plan->dct_buffer);
+    const int n = buf->nelems;
+    const int block = 256;
+    VFLOAT *xa   = (VFLOAT *)buf->vwork;
+    VFLOAT *xb   = xa + n;
+    VFLOAT *work = xb + n;
+    float  *fx   = (float *)xa;     // xa and xb are contiguous: lane L of xb is at lane L+VLANES
+    float  *rows[2*VLANES];
+    int first, num;
+    int i, j, j0, j1, lane;
+
+    for (first=0; first<count; first+=2*VLANES) {
+        num = count - first < 2*VLANES ? count - first : 2*VLANES;
+        for (i=0; i<2*VLANES; ++i) {
+            rows[i] = data + (LONG)(first + (i < num ? i : num-1)) * row_stride;
+        }
+
+        if (elem_stride == 1) {
+            // rows are contiguous: read each row sequentially, a block at a time
+            for (j0=0; j0<n; j0=j1) {
+                j1 = j0 + block < n ? j0 + block : n;
+                for (i=0; i<2*VLANES; ++i) {
+                    const float *src = rows[i];
+                    float *dst = fx + (i < VLANES ? i : (LONG)n * VLANES + i - VLANES);
+                    for (j=j0; j<j1; ++j) {
+                        dst[(LONG)j * VLANES] = src[j];
+                    }
+                }
+            }
+        } else {
+            // strided rows (e.g., columns): gather all lanes of each element together
+            for (j=0; j<n; ++j) {
+                float *dsta = fx + (LONG)j * VLANES;
+                float *dstb = dsta + (LONG)n * VLANES;
+                LONG   off  = (LONG)j * elem_stride;
+                for (lane=0; lane<VLANES; ++lane) {
+                    dsta[lane] = rows[lane][off];
+                    dstb[lane] = rows[lane + VLANES][off];
+                }
+            }
+        }
+
+        KFN(dct)( buf, xa, xb, work );
+
+        if (elem_stride == 1) {
+            for (j0=0; j0<n; j0=j1) {
+                j1 = j0 + block < n ? j0 + block : n;
+                for (i=0; i<num; ++i) {
+                    float *dst = rows[i];
+                    const float *src = fx + (i < VLANES ? i : (LONG)n * VLANES + i - VLANES);
+                    for (j=j0; j<j1; ++j) {
+                        dst[j] = src[(LONG)j * VLANES];
+                    }
+                }
+            }
+        } else {
+            for (j=0; j<n; ++j) {
+                const float *srca = fx + (LONG)j * VLANES;
+                const float *srcb = srca + (LONG)n * VLANES;
+                LONG off = (LONG)j * elem_stride;
+                for (i=0; i<num; ++i) {
+                    rows[i][off] = i < VLANES ? srca[i] : srcb[i - VLANES];
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,296 @@
+/*
+ * horizon.c
+ *
+ * Terrain horizon angles along one azimuth for every pixel of a grid.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+//
+// Scanlines are rasterized with one step along the major axis of the azimuth and a
+// rounded step along the minor axis, so every pixel lies on exactly one line; the
+// distance between points of a line is taken along the line. Lines are independent,
+// so bands of adjacent lines are handed out to threads. Each band is processed one row
+// at a time (in an order such that the previous point of every line is always in an
+// earlier row or earlier in the same row) to keep memory access sequential, with one
+// hull stack per line of the band.
+//
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+#define _USE_MATH_DEFINES
+
+#include "horizon.h"
+#include "thread_pool.h"
+
+#include <stddef.h> // for ptrdiff_t
+#include <stdlib.h>
+#include <math.h>
+
+// For a 64-bit compile we need LONG to be 64 bits, even if the compiler uses an LLP64 model
+#define LONG ptrdiff_t
+
+#ifndef M_PI
+#   define M_PI 3.14159265358979323846
+#endif
+
+// number of lines per band (one thread pool work item)
+#define HORIZON_BAND 32
+
+struct Hull_Point {
+    int   step;     // position along line
+    float z;        // elevation
+};
+
+struct Horizon_Work {
+    int     max_steps;  // longest line (rows or columns) the buffers hold
+    int     num_workers;
+    int    *offset;     // max_steps offsets
+    struct Hull_Point *stacks;  // HORIZON_BAND stacks of max_steps points, per worker
+    int    *sizes;              // HORIZON_BAND stack sizes, per worker
+};
+
+struct Horizon_State {
+    const float *data;
+    float  *horizon;
+    int     nrows;
+    int     ncols;
+    int     xmajor;     // nonzero if lines advance one column per step
+    int     rstep;      // direction of row    order (+1 or -1)
+    int     cstep;      // direction of column order (+1 or -1)
+    int     nsteps;     // number of steps along major axis
+    int    *offset;     // minor axis offset of each line, by step along major axis
+    int     max_offset;
+    double  scale;      // 1 / distance between steps
+    struct Hull_Point *stacks;  // HORIZON_BAND stacks of nsteps points, per worker
+    int    *sizes;              // HORIZON_BAND stack sizes, per worker
+};
+
+struct Horizon_Work *create_horizon_work(
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    struct Thread_Pool
+          *pool         // input: pool of worker threads, or NULL for none
+)
+{
+    struct Horizon_Work *work = (struct Horizon_Work *)malloc( sizeof( struct Horizon_Work ) );
+
+    if (!work) {
+        return NULL;
+    }
+    work->max_steps   = nrows > ncols ? nrows : ncols;
+    work->num_workers = thread_pool_size( pool );
+
+    work->offset = (int *)malloc( (size_t)work->max_steps * sizeof( int ) );
+    work->stacks = (struct Hull_Point *)malloc( (size_t)work->num_workers * HORIZON_BAND *
+        (size_t)work->max_steps * sizeof( struct Hull_Point ) );
+    work->sizes  = (int *)malloc( (size_t)work->num_workers * HORIZON_BAND * sizeof( int ) );
+    if (!work->offset || !work->stacks || !work->sizes) {
+        free_horizon_work( work );
+        return NULL;
+    }
+    return work;
+}
+
+void free_horizon_work(
+    struct Horizon_Work *work   // input: from create_horizon_work(), or NULL
+)
+{
+    if (work) {
+        free( work->offset );
+        free( work->stacks );
+        free( work->sizes );
+        free( work );
+    }
+}
+
+static int first_step_at( const int *offset, int nsteps, int sign, int value )
+// Returns first step k with sign*offset[k] >= sign*value (offset is monotonic).
+{
+    int lo = 0;
+    int hi = nsteps;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (sign * offset[mid] < sign * value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void horizon_lines( long first, long last, int worker, void *state )
+{
+    const struct Horizon_State *s = (const struct Horizon_State *)state;
+
+    int    nrows  = s->nrows;
+    int    ncols  = s->ncols;
+    int    nsteps = s->nsteps;
+    struct Hull_Point *stacks = s->stacks + (LONG)worker * HORIZON_BAND * (LONG)nsteps;
+    int   *sizes  = s->sizes  + (LONG)worker * HORIZON_BAND;
+
+    // lines first .. last-1 are numbered first-max_offset .. last-1-max_offset
+    int    lo = (int)first - s->max_offset;
+    int    hi = (int)last  - s->max_offset;
+
+    int    n, i, j, k, kbeg, kend, step, line;
+
+    for (n=0; n<hi-lo; ++n) {
+        sizes[n] = 0;
+    }
+
+    for (n=0; n<nrows; ++n) {
+        const float *ptr;
+        float *out;
+
+        i   = s->rstep > 0 ? n : nrows-1-n;
+        ptr = s->data    + (LONG)i * (LONG)ncols;
+        out = s->horizon + (LONG)i * (LONG)ncols;
+
+        if (s->xmajor) {
+            // pixel at step k is in column k or ncols-1-k, on line i - offset[k];
+            // find steps with i-hi < offset[k] <= i-lo
+            if (s->rstep > 0) {
+                kbeg = first_step_at( s->offset, nsteps, +1, i - hi + 1 );
+                kend = first_step_at( s->offset, nsteps, +1, i - lo + 1 );
+            } else {
+                // offsets decrease along the line
+                kbeg = first_step_at( s->offset, nsteps, -1, i - lo );
+                kend = first_step_at( s->offset, nsteps, -1, i - hi );
+            }
+        } else {
+            // pixel in column j is on line j - offset[n]
+            kbeg = lo + s->offset[n] > 0     ? lo + s->offset[n] : 0;
+            kend = hi + s->offset[n] < ncols ? hi + s->offset[n] : ncols;
+        }
+
+        for (k=kbeg; k<kend; ++k) {
+            struct Hull_Point *hull;
+            int   *size;
+            float  z;
+
+            if (s->xmajor) {
+                j    = s->cstep > 0 ? k : ncols-1-k;
+                line = i - s->offset[k];
+                step = k;
+            } else {
+                j    = k;
+                line = j - s->offset[n];
+                step = n;
+            }
+            hull = stacks + (LONG)(line - lo) * (LONG)nsteps;
+            size = sizes + (line - lo);
+
+            z = ptr[j];
+            if (z != z) {
+                // void point: no horizon, and not part of the terrain profile
+                out[j] = z;
+                continue;
+            }
+
+            // pop hull points hidden behind the next point on the hull, as seen from here:
+            // (z1 - z) / (step - step1) >= (z0 - z) / (step - step0)
+            while (*size >= 2) {
+                const struct Hull_Point *p0 = hull + *size - 1;
+                const struct Hull_Point *p1 = hull + *size - 2;
+                if ((double)(p1->z - z) * (double)(step - p0->step) <
+                    (double)(p0->z - z) * (double)(step - p1->step))
+                {
+                    break;
+                }
+                --*size;
+            }
+
+            if (*size) {
+                const struct Hull_Point *p0 = hull + *size - 1;
+                out[j] = (float)((double)(p0->z - z) / (double)(step - p0->step) * s->scale);
+            } else {
+                out[j] = (float)-HUGE_VAL;
+            }
+
+            hull[*size].step = step;
+            hull[*size].z    = z;
+            ++*size;
+        }
+    }
+}
+
+int terrain_horizon(
+    const float *data,  // input: array of elevations (row-major order)
+    float *horizon,     // output: tangent of horizon angle of each pixel
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xres,        // input: spacing between pixel columns (same units as elevations)
+    double yres,        // input: spacing between pixel rows    (same units as elevations)
+    double azimuth,     // input: direction to search, degrees clockwise from top of grid
+    struct Thread_Pool
+          *pool,        // input: pool of worker threads, or NULL for none
+    struct Horizon_Work
+          *work         // input: from create_horizon_work() with the same pool
+)
+{
+    struct Horizon_State state;
+
+    double az = azimuth * (M_PI / 180.0);
+
+    // lines are walked away from the horizon, in grid units
+    double ux = -sin( az ) / fabs( xres );
+    double uy =  cos( az ) / fabs( yres );
+
+    double slope;       // minor axis offset per step along major axis
+    int    nminor;      // number of pixels across lines
+    int    min_offset;
+    LONG   nlines;
+    int    k;
+
+    if (nrows > work->max_steps || ncols > work->max_steps ||
+        thread_pool_size( pool ) > work->num_workers)
+    {
+        return 1;
+    }
+
+    state.data    = data;
+    state.horizon = horizon;
+    state.nrows   = nrows;
+    state.ncols   = ncols;
+    state.xmajor  = fabs( ux ) >= fabs( uy );
+    if (state.xmajor) {
+        state.nsteps = ncols;
+        nminor       = nrows;
+        slope        = uy / fabs( ux );
+        state.cstep  = ux > 0.0 ? 1 : -1;
+        state.rstep  = slope >= 0.0 ? 1 : -1;
+        state.scale  = 1.0 / sqrt( xres*xres + slope*slope*yres*yres );
+    } else {
+        state.nsteps = nrows;
+        nminor       = ncols;
+        slope        = ux / fabs( uy );
+        state.rstep  = uy > 0.0 ? 1 : -1;
+        state.cstep  = 1;
+        state.scale  = 1.0 / sqrt( yres*yres + slope*slope*xres*xres );
+    }
+
+    state.offset = work->offset;
+    state.stacks = work->stacks;
+    state.sizes  = work->sizes;
+
+    min_offset = 0;
+    state.max_offset = 0;
+    for (k=0; k<state.nsteps; ++k) {
+        state.offset[k] = (int)floor( k*slope + 0.5 );
+        if (state.offset[k] < min_offset) {
+            min_offset = state.offset[k];
+        } else if (state.offset[k] > state.max_offset) {
+            state.max_offset = state.offset[k];
+        }
+    }
+
+    // line numbers run from -max_offset to nminor-1-min_offset
+    nlines = (LONG)nminor + state.max_offset - min_offset;
+
+    run_thread_pool( pool, nlines, HORIZON_BAND, horizon_lines, &state, NULL );
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * horizon.h
+ *
+ * Terrain horizon angles along one azimuth for every pixel of a grid.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+//
+// The horizon of a pixel in a given direction is the steepest elevation angle from the
+// pixel to any terrain in that direction, out to the edge of the grid. Searching along
+// a ray from every pixel costs O(N*L) for N pixels and rays of length L, so the search
+// radius is usually cut short. Instead, following Stewart (1998), the grid is covered
+// by rasterized scanlines parallel to the azimuth, and each scanline is walked once
+// toward the horizon side. A stack holds the upper convex hull of the terrain profile
+// already passed; the horizon of each new point is its tangent to that hull, and the
+// hull points below the tangent are popped, as they can never be a horizon again.
+// Each point is pushed and popped at most once, so every horizon is exact over the
+// whole grid at a cost of O(N) per azimuth, independent of distance.
+//
+
+#ifndef HORIZON_H
+#define HORIZON_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct Thread_Pool;     // see thread_pool.h
+struct Horizon_Work;    // opaque - use create_horizon_work() and free_horizon_work()
+
+// Returns work space for terrain_horizon() on grids of up to nrows x ncols, for the
+// workers of pool, or NULL if a memory allocation error occurred. It can be reused
+// for any number of azimuths, so that threads and buffers are set up only once.
+struct Horizon_Work *create_horizon_work(
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    struct Thread_Pool
+          *pool         // input: pool of worker threads, or NULL for none
+);
+
+void free_horizon_work(
+    struct Horizon_Work *work   // input: from create_horizon_work(), or NULL
+);
+
+// Computes the tangent of the horizon elevation angle of every pixel along azimuth.
+// Pixels with no terrain in that direction (at the edge of the grid) are set to
+// -HUGE_VAL; void (NaN) pixels are set to NaN and do not block the horizon.
+// Returns 0 on success, nonzero if the grid is larger than work was created for.
+int terrain_horizon(
+    const float *data,  // input: array of elevations (row-major order)
+    float *horizon,     // output: tangent of horizon angle of each pixel
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xres,        // input: spacing between pixel columns (same units as elevations)
+    double yres,        // input: spacing between pixel rows    (same units as elevations)
+    double azimuth,     // input: direction to search, degrees clockwise from top of grid
+    struct Thread_Pool
+          *pool,        // input: pool of worker threads, or NULL for none
+    struct Horizon_Work
+          *work         // input: from create_horizon_work() with the same pool
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
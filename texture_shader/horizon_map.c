@@ -0,0 +1,691 @@
+/*
+ * horizon_map.c
+ *
+ * Horizon angles of every pixel along a set of azimuths, and the terrain
+ * measures derived from them (sky view factor, openness, shadows, ...).
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+#define _USE_MATH_DEFINES
+
+#include "horizon_map.h"
+#include "horizon.h"
+#include "spectrum_cache.h"
+#include "thread_pool.h"
+
+#include <stddef.h> // for ptrdiff_t
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef _WIN32
+#   include <unistd.h>      // getpid()
+#   include <sys/types.h>
+#   include <sys/stat.h>    // fstat()
+#   include <sys/mman.h>    // mmap()
+#   define HAVE_MMAP 1
+#else
+#   define HAVE_MMAP 0
+#endif
+
+// For a 64-bit compile we need LONG to be 64 bits, even if the compiler uses an LLP64 model
+#define LONG ptrdiff_t
+
+#ifndef M_PI
+#   define M_PI 3.14159265358979323846
+#endif
+
+// File header: magic, hash, nrows, ncols, num_angles, has_lower, float check value.
+#define HEADER_SIZE 64
+
+static const char  map_magic[8]    = { 'T', 'X', 'H', 'O', 'R', 'Z', '0', '1' };
+static const float map_float_check = -1.0f / 3.0f;
+
+// quantized angle of +90 degrees
+#define QUARTER (90 * HORIZON_MAP_SCALE)
+
+static const double min_mean_sine_angle = -70.0;    // as in original svf program
+
+
+// Quantizing horizons:
+
+struct Quantize_State {
+    const float *horizon;   // tangents from terrain_horizon()
+    short  *angles;
+    int     ncols;
+    int     lower;          // nonzero if horizon was computed from negated elevations
+};
+
+static void quantize_rows( long first, long last, int worker, void *state )
+{
+    const struct Quantize_State *s = (const struct Quantize_State *)state;
+
+    LONG   k;
+    float  t;
+    double deg;
+
+    (void)worker;
+
+    for (k=first*(LONG)s->ncols; k<last*(LONG)s->ncols; ++k) {
+        t = s->horizon[k];
+        if (t != t) {
+            s->angles[k] = HORIZON_MAP_VOID;
+        } else {
+            // atan(-HUGE_VAL) gives -90 degrees where there is no terrain
+            deg = atan( t ) * (180.0 / M_PI);
+            if (s->lower) {
+                deg = -deg;
+            }
+            s->angles[k] = (short)floor( deg * HORIZON_MAP_SCALE + 0.5 );
+        }
+    }
+}
+
+static int compute_plane(
+    const float *data,      // elevations, or negated elevations for lowest angles
+    float *horizon,         // work array of nrows x ncols
+    short *angles,          // output plane
+    int    nrows,
+    int    ncols,
+    double xres,
+    double yres,
+    double azimuth,
+    int    lower,
+    struct Thread_Pool  *pool,
+    struct Horizon_Work *work )
+{
+    struct Quantize_State state;
+
+    if (terrain_horizon( data, horizon, nrows, ncols, xres, yres, azimuth, pool, work )) {
+        return 1;
+    }
+
+    state.horizon = horizon;
+    state.angles  = angles;
+    state.ncols   = ncols;
+    state.lower   = lower;
+
+    run_thread_pool( pool, nrows, 16, quantize_rows, &state, NULL );
+
+    return 0;
+}
+
+static float *negate_data( const float *data, int nrows, int ncols )
+{
+    LONG   k, size = (LONG)nrows * (LONG)ncols;
+    float *neg = (float *)malloc( (size_t)size * sizeof( float ) );
+
+    if (neg) {
+        for (k=0; k<size; ++k) {
+            neg[k] = -data[k];
+        }
+    }
+    return neg;
+}
+
+static struct Thread_Pool *create_pool( int num_threads )
+{
+    if (num_threads <= 0) {
+        num_threads = default_thread_count();
+    }
+    // if threads cannot be created, fall back to single-threaded processing
+    return num_threads > 1 ? create_thread_pool( num_threads ) : NULL;
+}
+
+
+// Deriving measures:
+
+struct Measure_State {
+    const short *angles;    // plane of quantized angles
+    const float *table;     // contribution of each angle (NaN if not counted)
+    float  *sum;
+    float  *count;
+    int     ncols;
+};
+
+static void measure_rows( long first, long last, int worker, void *state )
+{
+    const struct Measure_State *s = (const struct Measure_State *)state;
+
+    const float *table = s->table + QUARTER;    // indexed by quantized angle
+    LONG   k;
+    short  q;
+    float  v;
+
+    (void)worker;
+
+    for (k=first*(LONG)s->ncols; k<last*(LONG)s->ncols; ++k) {
+        q = s->angles[k];
+        if (q != HORIZON_MAP_VOID) {
+            v = table[q];
+            if (v == v) {
+                s->sum[k]   += v;
+                s->count[k] += 1.0f;
+            }
+        }
+    }
+}
+
+int horizon_measure_needs_lower( enum Horizon_Measure measure )
+{
+    return measure == HORIZON_NEGATIVE_OPENNESS;
+}
+
+static void fill_measure_table( float *table, enum Horizon_Measure measure )
+// table has 2*QUARTER+1 entries, for angles -90 to +90 degrees
+{
+    int    q;
+    double deg, rad;
+
+    for (q=-QUARTER; q<=QUARTER; ++q) {
+        deg = (double)q / HORIZON_MAP_SCALE;
+        rad = deg * (M_PI / 180.0);
+        switch (measure) {
+            case HORIZON_MEAN_SINE:
+                table[q+QUARTER] = deg > min_mean_sine_angle ? (float)sin( rad ) : NAN;
+                break;
+            case HORIZON_SKY_VIEW:
+                table[q+QUARTER] = deg > 0.0 ? (float)sin( rad ) : 0.0f;
+                break;
+            case HORIZON_OPENNESS:
+                // no terrain in this direction (edge of grid) is not counted
+                table[q+QUARTER] = q > -QUARTER ? (float)(90.0 - deg) : NAN;
+                break;
+            case HORIZON_NEGATIVE_OPENNESS:
+                table[q+QUARTER] = q <  QUARTER ? (float)(90.0 + deg) : NAN;
+                break;
+            case HORIZON_AMBIENT:
+                table[q+QUARTER] = deg > 0.0 ? (float)(cos( rad ) * cos( rad )) : 1.0f;
+                break;
+        }
+    }
+}
+
+static void finish_measure(
+    float *output, const float *count, LONG size, enum Horizon_Measure measure )
+{
+    LONG k;
+
+    // pixels with nothing counted are left as NaN (0/0)
+    for (k=0; k<size; ++k) {
+        output[k] /= count[k];
+        if (measure == HORIZON_SKY_VIEW) {
+            output[k] = 1.0f - output[k];
+        }
+    }
+}
+
+int horizon_map_measure(
+    const struct Horizon_Map *map,  // input: from map_horizon_map()
+    enum Horizon_Measure measure,   // input: which measure to compute
+    float *output,                  // output: array of nrows x ncols values
+    int    num_threads              // input: number of threads to use (0 = default)
+)
+{
+    struct Measure_State state;
+    struct Thread_Pool *pool;
+
+    LONG   size = (LONG)map->nrows * (LONG)map->ncols;
+    float  table[2*QUARTER+1];
+    float *count;
+    int    a, lower;
+
+    lower = horizon_measure_needs_lower( measure );
+    if (lower && !map->has_lower) {
+        return 1;
+    }
+
+    count = (float *)calloc( (size_t)size, sizeof( float ) );
+    if (!count) {
+        return 1;
+    }
+    memset( output, 0, (size_t)size * sizeof( float ) );
+
+    fill_measure_table( table, measure );
+
+    state.table = table;
+    state.sum   = output;
+    state.count = count;
+    state.ncols = map->ncols;
+
+    pool = create_pool( num_threads );
+
+    for (a=0; a<map->num_angles; ++a) {
+        state.angles = map->angles + (LONG)(lower ? map->num_angles + a : a) * size;
+        run_thread_pool( pool, map->nrows, 16, measure_rows, &state, NULL );
+    }
+
+    destroy_thread_pool( pool );
+
+    finish_measure( output, count, size, measure );
+    free( count );
+
+    return 0;
+}
+
+int horizon_measure(
+    const float *data,      // input: array of elevations (row-major order)
+    int    nrows,           // input: number of rows    in data array
+    int    ncols,           // input: number of columns in data array
+    double xres,            // input: spacing between pixel columns (same units as elevations)
+    double yres,            // input: spacing between pixel rows    (same units as elevations)
+    int    num_angles,      // input: number of azimuths
+    enum Horizon_Measure measure,   // input: which measure to compute
+    float *output,                  // output: array of nrows x ncols values
+    int    num_threads              // input: number of threads to use (0 = default)
+)
+{
+    struct Measure_State state;
+    struct Thread_Pool  *pool;
+    struct Horizon_Work *work;
+
+    LONG   size = (LONG)nrows * (LONG)ncols;
+    float  table[2*QUARTER+1];
+    float *count;
+    float *horizon;
+    short *angles;
+    float *neg = NULL;
+    int    a, lower;
+    int    error = 0;
+
+    lower = horizon_measure_needs_lower( measure );
+
+    count   = (float *)calloc( (size_t)size, sizeof( float ) );
+    horizon = (float *)malloc( (size_t)size * sizeof( float ) );
+    angles  = (short *)malloc( (size_t)size * sizeof( short ) );
+    if (lower) {
+        neg = negate_data( data, nrows, ncols );
+    }
+    if (!count || !horizon || !angles || (lower && !neg)) {
+        free( count );
+        free( horizon );
+        free( angles );
+        free( neg );
+        return 1;
+    }
+    memset( output, 0, (size_t)size * sizeof( float ) );
+
+    fill_measure_table( table, measure );
+
+    state.angles = angles;
+    state.table  = table;
+    state.sum    = output;
+    state.count  = count;
+    state.ncols  = ncols;
+
+    // threads and horizon work space are shared by all azimuths
+    pool = create_pool( num_threads );
+    work = create_horizon_work( nrows, ncols, pool );
+    error = !work;
+
+    for (a=0; a<num_angles && !error; ++a) {
+        error = compute_plane(
+            lower ? neg : data, horizon, angles, nrows, ncols, xres, yres,
+            a*360.0/num_angles, lower, pool, work );
+        if (!error) {
+            run_thread_pool( pool, nrows, 16, measure_rows, &state, NULL );
+        }
+    }
+
+    free_horizon_work( work );
+    destroy_thread_pool( pool );
+
+    finish_measure( output, count, size, measure );
+
+    free( count );
+    free( horizon );
+    free( angles );
+    free( neg );
+
+    return error;
+}
+
+
+// Shadows:
+
+struct Shadow_State {
+    const short *angles0;   // plane at azimuth just counterclockwise of sun
+    const short *angles1;   // plane at azimuth just clockwise of sun
+    float  *output;
+    int     ncols;
+    double  weight;         // weight of angles1
+    double  sun_q;          // quantized sun elevation
+};
+
+static void shadow_rows( long first, long last, int worker, void *state )
+{
+    const struct Shadow_State *s = (const struct Shadow_State *)state;
+
+    LONG   k;
+    short  q0, q1;
+    double q;
+
+    (void)worker;
+
+    for (k=first*(LONG)s->ncols; k<last*(LONG)s->ncols; ++k) {
+        q0 = s->angles0[k];
+        q1 = s->angles1[k];
+        if (q0 == HORIZON_MAP_VOID || q1 == HORIZON_MAP_VOID) {
+            s->output[k] = 0.0f;
+        } else {
+            q = q0 + s->weight * (q1 - q0);
+            s->output[k] = q > s->sun_q ? (float)((q - s->sun_q) / HORIZON_MAP_SCALE) : 0.0f;
+        }
+    }
+}
+
+int horizon_map_shadow(
+    const struct Horizon_Map *map,  // input: from map_horizon_map()
+    double sun_az,                  // input: sun azimuth (degrees clockwise from top of grid)
+    double sun_el,                  // input: sun elevation (degrees above horizon)
+    float *output,                  // output: array of nrows x ncols values
+    struct Thread_Pool *pool        // input: pool of worker threads, or NULL for none
+)
+{
+    struct Shadow_State state;
+
+    LONG   size = (LONG)map->nrows * (LONG)map->ncols;
+    double pos;
+    int    a0;
+
+    // position of sun between stored azimuths
+    pos = fmod( sun_az / 360.0, 1.0 ) * map->num_angles;
+    if (pos < 0.0) {
+        pos += map->num_angles;
+    }
+    a0 = (int)floor( pos );
+    if (a0 >= map->num_angles) {
+        a0 = 0;
+        pos = 0.0;
+    }
+
+    state.angles0 = map->angles + (LONG)a0 * size;
+    state.angles1 = map->angles + (LONG)((a0 + 1) % map->num_angles) * size;
+    state.output  = output;
+    state.ncols   = map->ncols;
+    state.weight  = pos - a0;
+    state.sun_q   = sun_el * HORIZON_MAP_SCALE;
+
+    run_thread_pool( pool, map->nrows, 16, shadow_rows, &state, NULL );
+
+    return 0;
+}
+
+
+// Map files:
+
+static unsigned long long map_hash(
+    const float *data, int nrows, int ncols, double xres, double yres )
+{
+    unsigned long long hash;
+    double dims[2];
+
+    dims[0] = xres;
+    dims[1] = yres;
+
+    hash = cache_hash( 0, data, sizeof( float ) * (size_t)nrows * (size_t)ncols );
+    hash = cache_hash( hash, dims, sizeof( dims ) );
+    return hash;
+}
+
+static void fill_header(
+    char *header, unsigned long long hash, int nrows, int ncols, int num_angles, int lower )
+{
+    int ints[4];
+
+    ints[0] = nrows;
+    ints[1] = ncols;
+    ints[2] = num_angles;
+    ints[3] = lower;
+
+    memset( header, 0, HEADER_SIZE );
+    memcpy( header,      map_magic,        8 );
+    memcpy( header +  8, &hash,            8 );
+    memcpy( header + 16, ints,            16 );
+    memcpy( header + 32, &map_float_check, 4 );
+}
+
+static int check_header(
+    const char *header, unsigned long long hash, int nrows, int ncols,
+    int *num_angles, int *lower )
+// Returns nonzero if header matches (except num_angles and lower, which it returns).
+{
+    char expected[HEADER_SIZE];
+    int  ints[4];
+
+    fill_header( expected, hash, nrows, ncols, 0, 0 );
+
+    if (memcmp( header, expected, 24 ) != 0 ||
+        memcmp( header + 32, expected + 32, HEADER_SIZE - 32 ) != 0)
+    {
+        return 0;
+    }
+    memcpy( ints, header + 16, 16 );
+    *num_angles = ints[2];
+    *lower      = ints[3] != 0;
+    return *num_angles > 0;
+}
+
+static size_t map_file_size( int nrows, int ncols, int num_angles, int lower )
+{
+    return HEADER_SIZE +
+        sizeof( short ) * (size_t)nrows * (size_t)ncols * (size_t)num_angles * (lower ? 2 : 1);
+}
+
+int write_horizon_map(
+    const char  *filename,  // input: name of map file
+    const float *data,      // input: array of elevations (row-major order)
+    int    nrows,           // input: number of rows    in data array
+    int    ncols,           // input: number of columns in data array
+    double xres,            // input: spacing between pixel columns (same units as elevations)
+    double yres,            // input: spacing between pixel rows    (same units as elevations)
+    int    num_angles,      // input: number of azimuths
+    int    lower,           // input: nonzero to include lowest terrain angles
+    int    num_threads      // input: number of threads to use (0 = default)
+)
+{
+    struct Thread_Pool  *pool;
+    struct Horizon_Work *work;
+
+    size_t count = (size_t)nrows * (size_t)ncols;
+    char   header[HEADER_SIZE];
+    char  *temp_name;
+    FILE  *file;
+    float *horizon;
+    short *angles;
+    float *neg = NULL;
+    int    a, pass;
+    int    error = 0;
+
+    horizon = (float *)malloc( count * sizeof( float ) );
+    angles  = (short *)malloc( count * sizeof( short ) );
+    if (lower) {
+        neg = negate_data( data, nrows, ncols );
+    }
+    // write to a temporary file first, so other processes
+    // reading the same map never see a partial file
+    temp_name = (char *)malloc( strlen( filename ) + 32 );
+    if (!horizon || !angles || (lower && !neg) || !temp_name) {
+        free( horizon );
+        free( angles );
+        free( neg );
+        free( temp_name );
+        return 1;
+    }
+#if HAVE_MMAP
+    sprintf( temp_name, "%s.%ld.tmp", filename, (long)getpid() );
+#else
+    sprintf( temp_name, "%s.tmp", filename );
+#endif
+
+    file = fopen( temp_name, "wb" );
+    if (!file) {
+        error = 2;
+    } else {
+        fill_header( header, map_hash( data, nrows, ncols, xres, yres ),
+            nrows, ncols, num_angles, lower );
+        if (fwrite( header, 1, HEADER_SIZE, file ) != HEADER_SIZE) {
+            error = 2;
+        }
+
+        pool = create_pool( num_threads );
+        work = create_horizon_work( nrows, ncols, pool );
+        if (!work && !error) {
+            error = 1;
+        }
+
+        // horizon angles, then lowest terrain angles
+        for (pass=0; pass<=lower && !error; ++pass) {
+            for (a=0; a<num_angles && !error; ++a) {
+                error = compute_plane(
+                    pass ? neg : data, horizon, angles, nrows, ncols, xres, yres,
+                    a*360.0/num_angles, pass, pool, work );
+                if (!error && fwrite( angles, sizeof( short ), count, file ) != count) {
+                    error = 2;
+                }
+            }
+        }
+
+        free_horizon_work( work );
+        destroy_thread_pool( pool );
+
+        if (fclose( file ) && !error) {
+            error = 2;
+        }
+    }
+
+#ifdef _WIN32
+    if (!error) {
+        remove( filename );     // rename() does not replace existing files
+    }
+#endif
+    if (!error && rename( temp_name, filename ) != 0) {
+        error = 2;
+    }
+    if (error) {
+        remove( temp_name );
+    }
+
+    free( temp_name );
+    free( horizon );
+    free( angles );
+    free( neg );
+
+    return error;
+}
+
+struct Horizon_Map *map_horizon_map(
+    const char  *filename,  // input: name of map file
+    const float *data,      // input: array of elevations the map must be for
+    int    nrows,           // input: number of rows    in data array
+    int    ncols,           // input: number of columns in data array
+    double xres,            // input: spacing between pixel columns
+    double yres,            // input: spacing between pixel rows
+    int    num_angles,      // input: number of azimuths required (0 = any)
+    int    lower            // input: nonzero if lowest terrain angles are required
+)
+{
+    struct Horizon_Map *map;
+
+    char   header[HEADER_SIZE];
+    char  *buffer;
+    FILE  *file;
+    size_t size;
+    int    file_angles, file_lower;
+
+    file = fopen( filename, "rb" );
+    if (!file) {
+        return NULL;
+    }
+
+    if (fread( header, 1, HEADER_SIZE, file ) != HEADER_SIZE ||
+        !check_header( header, map_hash( data, nrows, ncols, xres, yres ),
+            nrows, ncols, &file_angles, &file_lower ) ||
+        (num_angles && file_angles != num_angles) || (lower && !file_lower))
+    {
+        fclose( file );
+        return NULL;
+    }
+    size = map_file_size( nrows, ncols, file_angles, file_lower );
+
+    map = (struct Horizon_Map *)malloc( sizeof( struct Horizon_Map ) );
+    if (!map) {
+        fclose( file );
+        return NULL;
+    }
+    map->nrows      = nrows;
+    map->ncols      = ncols;
+    map->num_angles = file_angles;
+    map->has_lower  = file_lower;
+    map->mapped     = 0;
+
+#if HAVE_MMAP
+    {
+        struct stat info;
+
+        if (fstat( fileno( file ), &info ) || !S_ISREG( info.st_mode ) ||
+            (size_t)info.st_size != size)
+        {
+            free( map );
+            fclose( file );
+            return NULL;
+        }
+
+        buffer = (char *)mmap( NULL, size, PROT_READ, MAP_SHARED, fileno( file ), 0 );
+        if (buffer != (char *)MAP_FAILED) {
+            fclose( file );     // mapping remains valid
+
+            map->angles = (const short *)(buffer + HEADER_SIZE);
+            map->mapped = 1;
+            return map;
+        }
+    }
+#endif
+
+    // no mapping - read file into memory (keeping the same layout)
+    buffer = (char *)malloc( size );
+    if (!buffer) {
+        free( map );
+        fclose( file );
+        return NULL;
+    }
+    memcpy( buffer, header, HEADER_SIZE );
+    if (fread( buffer + HEADER_SIZE, 1, size - HEADER_SIZE, file ) != size - HEADER_SIZE ||
+        fgetc( file ) != EOF)
+    {
+        free( buffer );
+        free( map );
+        fclose( file );
+        return NULL;
+    }
+    fclose( file );
+
+    map->angles = (const short *)(buffer + HEADER_SIZE);
+    return map;
+}
+
+void free_horizon_map(
+    struct Horizon_Map *map // input: from map_horizon_map(), or NULL
+)
+{
+    char *buffer;
+
+    if (!map) {
+        return;
+    }
+    buffer = (char *)map->angles - HEADER_SIZE;
+
+#if HAVE_MMAP
+    if (map->mapped) {
+        munmap( buffer, map_file_size( map->nrows, map->ncols, map->num_angles, map->has_lower ) );
+        free( map );
+        return;
+    }
+#endif
+    free( buffer );
+    free( map );
+}
@@ -0,0 +1,137 @@
+/*
+ * horizon_map.h
+ *
+ * Horizon angles of every pixel along a set of azimuths, and the terrain
+ * measures derived from them (sky view factor, openness, shadows, ...).
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+//
+// Sky view factor, openness, ambient occlusion, and cast shadows all depend on the
+// terrain only through the horizon angles of each pixel. A horizon map holds these
+// for num_angles azimuths equally spaced clockwise from the top of the grid (and
+// optionally the lowest terrain angles, for negative openness), computed once by
+// terrain_horizon() and quantized to 1/100 degree in 16 bits. A map file holds a short
+// header followed by one plane of nrows x ncols angles per azimuth, so it can be
+// memory-mapped and shared by later runs, e.g. by svf and shadow on the same grid.
+// The header identifies the grid by a hash of the elevations and pixel spacing; a
+// file that does not match is ignored. Files are never deleted automatically.
+//
+// Measures can also be computed without a map file, one azimuth at a time, in which
+// case the horizons are never all held in memory; the results are identical.
+//
+
+#ifndef HORIZON_MAP_H
+#define HORIZON_MAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct Thread_Pool;     // see thread_pool.h
+
+// Quantized angles are in units of 1/HORIZON_MAP_SCALE degree.
+#define HORIZON_MAP_SCALE 100
+#define HORIZON_MAP_VOID  (-32768)  // void (NaN) pixel
+
+// Per-pixel measures derived from horizon angles; the mean is over azimuths.
+enum Horizon_Measure {
+    HORIZON_MEAN_SINE,          // mean sine of horizon angles above -70 degrees
+                                // (original measure of the svf program)
+    HORIZON_SKY_VIEW,           // sky view factor: 1 - mean sine of horizon angles
+                                // above 0, i.e. visible fraction of the sky dome
+    HORIZON_OPENNESS,           // positive openness: mean zenith angle of horizon, degrees
+    HORIZON_NEGATIVE_OPENNESS,  // negative openness: mean nadir angle of lowest terrain,
+                                // degrees (needs lower angles)
+    HORIZON_AMBIENT             // ambient occlusion factor: fraction of uniform sky light
+                                // reaching a horizontal surface (1 = unoccluded)
+};
+
+struct Horizon_Map {
+    int    nrows;
+    int    ncols;
+    int    num_angles;  // number of azimuths, at num_angles/360 degree spacing
+    int    has_lower;   // nonzero if lowest terrain angles follow the horizon angles
+    const short *angles;    // planes of nrows x ncols angles, by azimuth
+    int    mapped;      // nonzero if angles are mapped from file
+};
+
+// Returns nonzero if measure needs the lowest terrain angles.
+int horizon_measure_needs_lower( enum Horizon_Measure measure );
+
+// Computes horizon map of data and writes it to filename (replacing it atomically
+// if it exists).
+// Returns 0 on success, 1 if a memory allocation error occurred,
+// 2 if the file could not be written.
+int write_horizon_map(
+    const char  *filename,  // input: name of map file
+    const float *data,      // input: array of elevations (row-major order)
+    int    nrows,           // input: number of rows    in data array
+    int    ncols,           // input: number of columns in data array
+    double xres,            // input: spacing between pixel columns (same units as elevations)
+    double yres,            // input: spacing between pixel rows    (same units as elevations)
+    int    num_angles,      // input: number of azimuths
+    int    lower,           // input: nonzero to include lowest terrain angles
+    int    num_threads      // input: number of threads to use (0 = default)
+);
+
+// Returns horizon map from filename, or NULL if the file does not exist or does not
+// match; pass it to free_horizon_map() when done.
+struct Horizon_Map *map_horizon_map(
+    const char  *filename,  // input: name of map file
+    const float *data,      // input: array of elevations the map must be for
+    int    nrows,           // input: number of rows    in data array
+    int    ncols,           // input: number of columns in data array
+    double xres,            // input: spacing between pixel columns
+    double yres,            // input: spacing between pixel rows
+    int    num_angles,      // input: number of azimuths required (0 = any)
+    int    lower            // input: nonzero if lowest terrain angles are required
+);
+
+void free_horizon_map(
+    struct Horizon_Map *map // input: from map_horizon_map(), or NULL
+);
+
+// Computes measure for every pixel from a horizon map.
+// Pixels with no azimuths counted (e.g. voids) are set to NaN.
+// Returns 0 on success, nonzero if a memory allocation error occurred
+// (or if measure needs lowest terrain angles that the map does not have).
+int horizon_map_measure(
+    const struct Horizon_Map *map,  // input: from map_horizon_map()
+    enum Horizon_Measure measure,   // input: which measure to compute
+    float *output,                  // output: array of nrows x ncols values
+    int    num_threads              // input: number of threads to use (0 = default)
+);
+
+// Same as horizon_map_measure() for the horizon map of data, without storing the map.
+int horizon_measure(
+    const float *data,      // input: array of elevations (row-major order)
+    int    nrows,           // input: number of rows    in data array
+    int    ncols,           // input: number of columns in data array
+    double xres,            // input: spacing between pixel columns (same units as elevations)
+    double yres,            // input: spacing between pixel rows    (same units as elevations)
+    int    num_angles,      // input: number of azimuths
+    enum Horizon_Measure measure,   // input: which measure to compute
+    float *output,                  // output: array of nrows x ncols values
+    int    num_threads              // input: number of threads to use (0 = default)
+);
+
+// Computes cast shadows from a horizon map: the angle in degrees by which the horizon
+// toward the sun rises above the sun (interpolated between the nearest azimuths),
+// or 0 if the pixel is lit. Void pixels are set to 0. Takes a thread pool rather than
+// a thread count, as it is typically called for many sun positions.
+// Returns 0 on success.
+int horizon_map_shadow(
+    const struct Horizon_Map *map,  // input: from map_horizon_map()
+    double sun_az,                  // input: sun azimuth (degrees clockwise from top of grid)
+    double sun_el,                  // input: sun elevation (degrees above horizon)
+    float *output,                  // output: array of nrows x ncols values
+    struct Thread_Pool *pool        // input: pool of worker threads, or NULL for none
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * max_pyramid.c
+ *
+ * Hierarchy of block maxima of an elevation grid, for skipping terrain that
+ * cannot block a line of sight.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stddef.h> // for ptrdiff_t
+#include <stdlib.h>
+#include <math.h>
+
+#include "max_pyramid.h"
+#include "thread_pool.h"
+
+// For a 64-bit compile we need LONG to be 64 bits, even if the compiler uses an LLP64 model
+#define LONG ptrdiff_t
+
+struct Pyramid_State {
+    const float *fine;  // level below (or data)
+    float  *coarse;     // level being built
+    int     fine_rows;
+    int     fine_cols;
+    int     coarse_cols;
+};
+
+static void pyramid_rows( long first, long last, int worker, void *state )
+// Each coarse block is the maximum of (up to) 2x2 fine blocks.
+{
+    const struct Pyramid_State *s = (const struct Pyramid_State *)state;
+
+    const float *ptr;
+    long   i;
+    int    j, r, c;
+    float  v, m;
+
+    (void)worker;
+
+    for (i=first; i<last; ++i) {
+        for (j=0; j<s->coarse_cols; ++j) {
+            m = (float)-HUGE_VAL;
+            for (r=2*(int)i; r<2*(int)i+2 && r<s->fine_rows; ++r) {
+                ptr = s->fine + (LONG)r * (LONG)s->fine_cols;
+                for (c=2*j; c<2*j+2 && c<s->fine_cols; ++c) {
+                    v = ptr[c];
+                    // comparison is false for NaN
+                    if (v > m) {
+                        m = v;
+                    }
+                }
+            }
+            s->coarse[(LONG)i * (LONG)s->coarse_cols + j] = m;
+        }
+    }
+}
+
+struct Max_Pyramid *create_max_pyramid(
+    const float *data,  // input: array of elevations (row-major order)
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    struct Thread_Pool
+          *pool         // input: pool of worker threads, or NULL for none
+)
+{
+    struct Max_Pyramid *pyramid;
+    struct Pyramid_State state;
+
+    int    k;
+    int    rows = nrows;
+    int    cols = ncols;
+
+    pyramid = (struct Max_Pyramid *)calloc( 1, sizeof( struct Max_Pyramid ) );
+    if (!pyramid) {
+        return NULL;
+    }
+
+    state.fine = data;
+    pyramid->ncols[0] = ncols;
+
+    for (k=1; k<=MAX_PYRAMID_LEVELS && (rows > 1 || cols > 1); ++k) {
+        state.fine_rows   = rows;
+        state.fine_cols   = cols;
+        rows = (rows + 1) / 2;
+        cols = (cols + 1) / 2;
+        state.coarse_cols = cols;
+        state.coarse      = (float *)malloc( (size_t)rows * (size_t)cols * sizeof( float ) );
+        if (!state.coarse) {
+            free_max_pyramid( pyramid );
+            return NULL;
+        }
+
+        run_thread_pool( pool, rows, 16, pyramid_rows, &state, NULL );
+
+        pyramid->levels[k] = state.coarse;
+        pyramid->ncols[k]  = cols;
+        pyramid->num_levels = k;
+        state.fine = state.coarse;
+    }
+
+    return pyramid;
+}
+
+void free_max_pyramid(
+    struct Max_Pyramid *pyramid // input: from create_max_pyramid(), or NULL
+)
+{
+    int k;
+
+    if (!pyramid) {
+        return;
+    }
+    for (k=1; k<=pyramid->num_levels; ++k) {
+        free( pyramid->levels[k] );
+    }
+    free( pyramid );
+}
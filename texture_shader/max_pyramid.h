@@ -0,0 +1,70 @@
+/*
+ * max_pyramid.h
+ *
+ * Hierarchy of block maxima of an elevation grid, for skipping terrain that
+ * cannot block a line of sight.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+//
+// Level k of the pyramid (1 <= k <= num_levels) holds the highest elevation in each
+// aligned block of 2^k x 2^k pixels, i.e. of the pixels (i,j) with the same i>>k and
+// j>>k; level 0 is the grid itself. Void (NaN) pixels are ignored, so a block of only
+// voids has maximum -HUGE_VAL. The levels together take about 1/3 of the grid size.
+//
+// A ray marching over the grid (e.g. toward the sun) that is at or above the maximum
+// of the block it is in, and is not descending, cannot meet terrain above it until it
+// leaves that block, so it can step through the block without reading elevations.
+// The blocks around a point are nested, and each holds the maximum of the smaller ones,
+// so checking from a fine level up, while the ray is still above the next larger block,
+// finds the largest block to skip; most points on a ray stop after a level or two.
+//
+
+#ifndef MAX_PYRAMID_H
+#define MAX_PYRAMID_H
+
+#include <stddef.h> // for ptrdiff_t
+
+#include "compatibility.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAX_PYRAMID_LEVELS 16
+
+struct Thread_Pool;     // see thread_pool.h
+
+struct Max_Pyramid {
+    int    num_levels;
+    int    ncols[MAX_PYRAMID_LEVELS+1];     // number of blocks across each level
+    float *levels[MAX_PYRAMID_LEVELS+1];    // row-major block maxima (levels[0] unused)
+};
+
+// Returns pyramid of block maxima of data, with enough levels that the top level is
+// a single block (up to MAX_PYRAMID_LEVELS), or NULL if a memory allocation error
+// occurred. Pass it to free_max_pyramid() when done.
+struct Max_Pyramid *create_max_pyramid(
+    const float *data,  // input: array of elevations (row-major order)
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    struct Thread_Pool
+          *pool         // input: pool of worker threads, or NULL for none
+);
+
+void free_max_pyramid(
+    struct Max_Pyramid *pyramid // input: from create_max_pyramid(), or NULL
+);
+
+// Returns highest elevation in the level-k block containing pixel (i,j), 1 <= k <= num_levels.
+static INLINE float max_pyramid_block( const struct Max_Pyramid *pyramid, int k, int i, int j )
+{
+    return pyramid->levels[k][(ptrdiff_t)(i >> k) * pyramid->ncols[k] + (j >> k)];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * mercator_remap.c
+ *
+ * Row resampling between geographic and normal Mercator grids.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+#include "mercator_remap.h"
+#include "terrain_filter.h"
+#include "thread_pool.h"
+
+#include <stddef.h> // for ptrdiff_t
+#include <stdlib.h>
+#include <math.h>
+
+// For a 64-bit compile we need LONG to be 64 bits, even if the compiler uses an LLP64 model
+#define LONG ptrdiff_t
+
+struct Remap_State {
+    const float *input;
+    float       *output;
+    int          ncols;
+    const int   *source;    // for each output row, first of two input rows
+    const float *weight;    // for each output row, weight of second input row
+};
+
+static void remap_rows( long first, long last, int worker, void *state )
+{
+    const struct Remap_State *s = (const struct Remap_State *)state;
+
+    int ncols = s->ncols;
+    long i;
+    int  j;
+
+    (void)worker;
+
+    for (i=first; i<last; ++i) {
+        const float *row0 = s->input + (LONG)s->source[i] * (LONG)ncols;
+        const float *row1 = row0 + ncols;
+        float *ptr = s->output + (LONG)i * (LONG)ncols;
+        float  w   = s->weight[i];
+
+        if (w == 0.0f) {
+            for (j=0; j<ncols; ++j) {
+                ptr[j] = row0[j];
+            }
+        } else {
+            for (j=0; j<ncols; ++j) {
+                float z = row0[j] + w * (row1[j] - row0[j]);
+                if (z != z) {
+                    // void on one side - use nearer row as is
+                    z = w < 0.5f ? row0[j] : row1[j];
+                }
+                ptr[j] = z;
+            }
+        }
+    }
+}
+
+int mercator_remap_pool(
+    const float *input,     // input: array of data to resample (row-major order)
+    float *output,          // output: resampled array (row-major order)
+    int    in_rows,         // input: number of rows in input array
+    int    out_rows,        // input: number of rows in output array
+    int    ncols,           // input: number of columns in both arrays
+    double lat1deg,         // input: latitude at bottom edge of bottom pixels, degrees
+    double lat2deg,         // input: latitude at top    edge of top    pixels, degrees
+    enum Mercator_Remap_Direction
+           direction,       // input: which grid input is on
+    struct Thread_Pool
+          *pool             // input: pool of worker threads, or NULL for none
+)
+// Resamples rows of input into output, which must not overlap.
+// Returns 0 on success, nonzero if a memory allocation error occurred.
+{
+    struct Remap_State state;
+
+    int   *source;
+    float *weight;
+
+    double north1 = mercator_northing( lat1deg );
+    double north2 = mercator_northing( lat2deg );
+
+    // output row spacing, and input rows per unit (both from the top edge)
+    double out_step;
+    double in_scale;
+    double pos;
+
+    int i, k;
+
+    source = (int   *)malloc( (size_t)out_rows * sizeof( int ) );
+    weight = (float *)malloc( (size_t)out_rows * sizeof( float ) );
+    if (!source || !weight) {
+        free( source );
+        free( weight );
+        return 1;
+    }
+
+    if (direction == MERCATOR_FROM_GEOGRAPHIC) {
+        out_step = (north2 - north1) / (double)out_rows;
+        in_scale = (double)in_rows / (lat2deg - lat1deg);
+    } else {
+        out_step = (lat2deg - lat1deg) / (double)out_rows;
+        in_scale = (double)in_rows / (north2 - north1);
+    }
+
+    for (i=0; i<out_rows; ++i) {
+        // position of output row center, as fractional input row
+        if (direction == MERCATOR_FROM_GEOGRAPHIC) {
+            double lat = mercator_latitude( north2 - ((double)i + 0.5) * out_step );
+            pos = (lat2deg - lat) * in_scale - 0.5;
+        } else {
+            double north = mercator_northing( lat2deg - ((double)i + 0.5) * out_step );
+            pos = (north2 - north) * in_scale - 0.5;
+        }
+
+        if (pos <= 0.0) {
+            source[i] = 0;
+            weight[i] = 0.0f;
+        } else if (pos >= (double)(in_rows - 1)) {
+            source[i] = in_rows - 1;
+            weight[i] = 0.0f;
+        } else {
+            k = (int)pos;
+            source[i] = k;
+            weight[i] = (float)(pos - (double)k);
+        }
+    }
+
+    state.input  = input;
+    state.output = output;
+    state.ncols  = ncols;
+    state.source = source;
+    state.weight = weight;
+
+    run_thread_pool( pool, out_rows, 16, remap_rows, &state, NULL );
+
+    free( source );
+    free( weight );
+
+    return 0;
+}
+
+int mercator_remap(
+    const float *input,     // input: array of data to resample (row-major order)
+    float *output,          // output: resampled array (row-major order)
+    int    in_rows,         // input: number of rows in input array
+    int    out_rows,        // input: number of rows in output array
+    int    ncols,           // input: number of columns in both arrays
+    double lat1deg,         // input: latitude at bottom edge of bottom pixels, degrees
+    double lat2deg,         // input: latitude at top    edge of top    pixels, degrees
+    enum Mercator_Remap_Direction
+           direction,       // input: which grid input is on
+    int    num_threads      // input: number of threads to use (0 = default)
+)
+{
+    struct Thread_Pool *pool = NULL;
+    int error;
+
+    if (num_threads <= 0) {
+        num_threads = default_thread_count();
+    }
+    if (num_threads > 1) {
+        // if threads cannot be created, fall back to single-threaded processing
+        pool = create_thread_pool( num_threads );
+    }
+
+    error = mercator_remap_pool(
+        input, output, in_rows, out_rows, ncols, lat1deg, lat2deg, direction, pool );
+
+    destroy_thread_pool( pool );
+
+    return error;
+}
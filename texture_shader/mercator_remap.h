@@ -0,0 +1,71 @@
+/*
+ * mercator_remap.h
+ *
+ * Row resampling between geographic and normal Mercator grids.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+//
+// A geographic grid and a normal Mercator grid covering the same extent have the same
+// columns; only the rows differ, being equally spaced in latitude or in Mercator
+// northing respectively. So converting between them needs just a 1-D interpolation
+// down each column, with the same row weights for every column. This lets the tools
+// accept geographic data and process it in Mercator projection internally (see option
+// -remap), instead of warping the grid to and from Mercator with external tools.
+//
+// Both grids are cell-registered: lat1 and lat2 are the outer edges of the bottom and
+// top rows of pixels. Values are interpolated linearly between row centers; rows
+// beyond the outermost row centers take the value of the outermost row.
+//
+
+#ifndef MERCATOR_REMAP_H
+#define MERCATOR_REMAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct Thread_Pool;     // see thread_pool.h
+
+enum Mercator_Remap_Direction {
+    MERCATOR_FROM_GEOGRAPHIC,   // input rows equally spaced in latitude
+    MERCATOR_TO_GEOGRAPHIC      // input rows equally spaced in Mercator northing
+};
+
+// Resamples rows of input into output, which must not overlap.
+// Returns 0 on success, nonzero if a memory allocation error occurred.
+int mercator_remap(
+    const float *input,     // input: array of data to resample (row-major order)
+    float *output,          // output: resampled array (row-major order)
+    int    in_rows,         // input: number of rows in input array
+    int    out_rows,        // input: number of rows in output array
+    int    ncols,           // input: number of columns in both arrays
+    double lat1deg,         // input: latitude at bottom edge of bottom pixels, degrees
+    double lat2deg,         // input: latitude at top    edge of top    pixels, degrees
+    enum Mercator_Remap_Direction
+           direction,       // input: which grid input is on
+    int    num_threads      // input: number of threads to use (0 = default)
+);
+
+// Same as mercator_remap(), with the rows distributed among the workers in pool,
+// e.g. to resample many grids without starting threads for each.
+int mercator_remap_pool(
+    const float *input,     // input: array of data to resample (row-major order)
+    float *output,          // output: resampled array (row-major order)
+    int    in_rows,         // input: number of rows in input array
+    int    out_rows,        // input: number of rows in output array
+    int    ncols,           // input: number of columns in both arrays
+    double lat1deg,         // input: latitude at bottom edge of bottom pixels, degrees
+    double lat2deg,         // input: latitude at top    edge of top    pixels, degrees
+    enum Mercator_Remap_Direction
+           direction,       // input: which grid input is on
+    struct Thread_Pool
+          *pool             // input: pool of worker threads, or NULL for none
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -41,6 +41,15 @@
 #include <ctype.h>
 #include <math.h>
 
+#ifndef _WIN32
+#   include <sys/types.h>
+#   include <sys/stat.h>    // fstat()
+#   include <sys/mman.h>    // mmap()
+#   define HAVE_MMAP 1
+#else
+#   define HAVE_MMAP 0
+#endif
+
 // For a 64-bit compile we need LONG to be 64 bits, even if the compiler uses an LLP64 model
 #define LONG ptrdiff_t
 
@@ -151,10 +160,15 @@ static void read_hdr_file(
     float *nodata, int *big_endian, int *skipbytes, int *rowpad,
     char **software );
 
-static float *read_flt_file(
+static void read_flt_file(
     FILE *in_flt_file, int nrows, int ncols,
     float nodata, int big_endian, int skipbytes, int rowpad,
-    int *has_nulls, int *all_ints );
+    float *data, int *has_nulls, int *all_ints, float *data_min, float *data_max );
+
+static float *map_flt_file( FILE *in_flt_file, int nrows, int ncols );
+
+static void check_flt_row(
+    float *ptr, int ncols, float nodata, int *has_nulls, int *all_ints, float *lo, float *hi );
 
 float *read_flt_hdr_files(
     // returns allocated array of data values;
@@ -173,12 +187,41 @@ float *read_flt_hdr_files(
                         // null or pointing to a software name/version string;
                         // caller is responsible to free *software pointer!
 )
+{
+    float data_min, data_max;
+
+    return read_flt_hdr_range(
+        in_flt_file, in_hdr_file, nrows, ncols, xmin, xmax, ymin, ymax,
+        has_nulls, all_ints, &data_min, &data_max, software );
+}
+
+float *read_flt_hdr_range(
+    // returns allocated array of data values;
+    // NOTE: caller is responsible to free this pointer!
+    FILE *in_flt_file,  // .flt file - should be opened in BINARY mode
+    FILE *in_hdr_file,  // .hdr file - should be opened in BINARY mode
+    int *nrows,         // number of rows in data array
+    int *ncols,         // number of cols in data array
+    double *xmin,       // min X coordinate (longitude or easting)
+    double *xmax,       // max X coordinate (longitude or easting)
+    double *ymin,       // min Y coordinate (latitude  or northing)
+    double *ymax,       // max Y coordinate (latitude  or northing)
+    int *has_nulls,
+    int *all_ints,
+    float *data_min,    // minimum data value
+    float *data_max,    // maximum data value
+    char * (*software)  // if software != 0, returns with *software either
+                        // null or pointing to a software name/version string;
+                        // caller is responsible to free *software pointer!
+)
 {
     float nodata;
     int big_endian;
     int skipbytes;
     int rowpad;
 
+    float *data;
+
     // Read and validate .hdr file:
 
     read_hdr_file(
@@ -187,9 +230,143 @@ float *read_flt_hdr_files(
 
     // Read data from .flt file:
 
-    return read_flt_file(
+    data = (float *)malloc( (LONG)(*nrows) * (LONG)(*ncols) * sizeof( float ) );
+
+    if (!data) {
+        error_exit( "Insufficient memory for input .flt data." );
+    }
+
+    read_flt_file(
         in_flt_file, *nrows, *ncols, nodata, big_endian, skipbytes, rowpad,
-        has_nulls, all_ints );
+        data, has_nulls, all_ints, data_min, data_max );
+
+    return data;
+}
+
+float *map_flt_hdr_files(
+    // returns array of data values - either mapped from the .flt file or allocated;
+    // NOTE: caller is responsible to release this pointer with free_flt_data()!
+    FILE *in_flt_file,  // .flt file - should be opened in BINARY mode
+    FILE *in_hdr_file,  // .hdr file - should be opened in BINARY mode
+    int *nrows,         // number of rows in data array
+    int *ncols,         // number of cols in data array
+    double *xmin,       // min X coordinate (longitude or easting)
+    double *xmax,       // max X coordinate (longitude or easting)
+    double *ymin,       // min Y coordinate (latitude  or northing)
+    double *ymax,       // max Y coordinate (latitude  or northing)
+    int *has_nulls,
+    int *all_ints,
+    float *data_min,    // minimum data value
+    float *data_max,    // maximum data value
+    int *mapped,        // nonzero if data array is mapped from the .flt file
+    char * (*software)  // if software != 0, returns with *software either
+                        // null or pointing to a software name/version string;
+                        // caller is responsible to free *software pointer!
+)
+{
+    float nodata;
+    int big_endian;
+    int skipbytes;
+    int rowpad;
+
+    float *data;
+
+    // Read and validate .hdr file:
+
+    read_hdr_file(
+        in_hdr_file, nrows, ncols, xmin, xmax, ymin, ymax,
+        &nodata, &big_endian, &skipbytes, &rowpad, software );
+
+    // Map .flt file if it can be used as is:
+
+    *mapped = 0;
+
+    if (big_endian == am_big_endian() && skipbytes == 0 && rowpad == 0) {
+        data = map_flt_file( in_flt_file, *nrows, *ncols );
+
+        if (data) {
+            float lo = (float) HUGE_VAL;
+            float hi = (float)-HUGE_VAL;
+
+            float *ptr;
+            int i;
+
+            *has_nulls = 0;
+            *all_ints  = 1;
+
+            for (i=0, ptr=data; i<*nrows; ++i, ptr+=*ncols) {
+                check_flt_row( ptr, *ncols, nodata, has_nulls, all_ints, &lo, &hi );
+            }
+
+            *data_min = lo;
+            *data_max = hi;
+            *mapped   = 1;
+
+            return data;
+        }
+    }
+
+    // Otherwise read data from .flt file:
+
+    data = (float *)malloc( (LONG)(*nrows) * (LONG)(*ncols) * sizeof( float ) );
+
+    if (!data) {
+        error_exit( "Insufficient memory for input .flt data." );
+    }
+
+    read_flt_file(
+        in_flt_file, *nrows, *ncols, nodata, big_endian, skipbytes, rowpad,
+        data, has_nulls, all_ints, data_min, data_max );
+
+    return data;
+}
+
+void free_flt_data(
+    float *data,        // array of data values from map_flt_hdr_files()
+    int nrows,          // number of rows in data array
+    int ncols,          // number of cols in data array
+    int mapped          // *mapped value from map_flt_hdr_files()
+)
+{
+#if HAVE_MMAP
+    if (mapped) {
+        munmap( data, (size_t)nrows * (size_t)ncols * sizeof( float ) );
+        return;
+    }
+#endif
+    free( data );
+}
+
+void read_hdr_info(
+    FILE *in_hdr_file,  // .hdr file - should be opened in BINARY mode
+    struct Flt_File_Info
+         *info,         // output: layout of .flt file
+    char * (*software)  // if software != 0, returns with *software either
+                        // null or pointing to a software name/version string;
+                        // caller is responsible to free *software pointer!
+)
+{
+    read_hdr_file(
+        in_hdr_file, &info->nrows, &info->ncols,
+        &info->xmin, &info->xmax, &info->ymin, &info->ymax,
+        &info->nodata, &info->big_endian, &info->skipbytes, &info->rowpad, software );
+}
+
+void read_flt_data(
+    FILE *in_flt_file,  // .flt file - should be opened in BINARY mode
+    const struct Flt_File_Info
+         *info,         // input: layout of .flt file from read_hdr_info()
+    float *data,        // output: array of data values
+    int *has_nulls,
+    int *all_ints,
+    float *data_min,    // minimum data value (after any NODATA values are set to 0)
+    float *data_max     // maximum data value
+)
+{
+    read_flt_file(
+        in_flt_file, info->nrows, info->ncols,
+        info->nodata, info->big_endian, info->skipbytes, info->rowpad,
+        data, has_nulls, all_ints, data_min, data_max );
 }
 
 #define MAXLINE 80
@@ -534,17 +711,16 @@ void copy_prj_file( FILE *in_prj_file, FILE *out_prj_file )
     }
 }
 
-static float *read_flt_file(
+static void read_flt_file(
     FILE *in_flt_file, int nrows, int ncols,
     float nodata, int big_endian, int skipbytes, int rowpad,
-    int *has_nulls, int *all_ints )
+    float *data, int *has_nulls, int *all_ints, float *data_min, float *data_max )
 {
     union {
         float f;
         char c[4];
     } pun;
 
-    float *data;
     float *ptr;
     int i, j;
     int count;
@@ -552,18 +728,15 @@ static float *read_flt_file(
     char c;
     int reverse_bytes = ( am_big_endian() != big_endian );
     char temp;
+
+    float lo = (float) HUGE_VAL;
+    float hi = (float)-HUGE_VAL;
     
     *has_nulls = 0;
     *all_ints  = 1;
 
     // Read data from .flt file:
 
-    data = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
-
-    if (!data) {
-        error_exit( "Insufficient memory for input .flt data." );
-    }
-
     error = fseek( in_flt_file, skipbytes, SEEK_CUR );
     if (error) {
         error_exit( "Read error occurred on input .flt file." );
@@ -592,20 +765,7 @@ static float *read_flt_file(
             }
         }
 
-        for (j=0; j<ncols; ++j) {
-            if (flt_isnan( ptr[j] )) {
-                prefix_error();
-                fprintf( stderr, "Input .flt file contains NaNs - probably bad data" );
-                fprintf( stderr, "(or wrong .hdr file).\n" );
-                exit( EXIT_FAILURE );
-            }
-            if (ptr[j] == nodata || ptr[j] < -1.0e+38) {
-                ptr[j] = 0.0;
-                *has_nulls = 1;
-            } else if (*all_ints && ptr[j] != floor( ptr[j] )) {
-                *all_ints = 0;
-            }
-        }
+        check_flt_row( ptr, ncols, nodata, has_nulls, all_ints, &lo, &hi );
 
         error = fseek( in_flt_file, rowpad, SEEK_CUR );
         if (error) {
@@ -613,11 +773,172 @@ static float *read_flt_file(
         }
     }
     
+    *data_min = lo;
+    *data_max = hi;
+
     fread( &c, 1, 1, in_flt_file );
     if (!feof( in_flt_file )) {
         fprintf( stderr, "*** WARNING: " );
         fprintf( stderr, "Input .flt file size too large - does not match .hdr info.\n" );
     }
-    
-    return data;
+}
+
+static float *map_flt_file( FILE *in_flt_file, int nrows, int ncols )
+// Returns data array mapped from .flt file, or null if mapping is not supported.
+// Mapping is private (copy-on-write): changes to the array are not written to the file,
+// and only pages that are changed take up memory of their own.
+{
+#if HAVE_MMAP
+    size_t size = (size_t)nrows * (size_t)ncols * sizeof( float );
+    struct stat info;
+    void *data;
+
+    if (fstat( fileno( in_flt_file ), &info ) || !S_ISREG( info.st_mode )) {
+        return NULL;
+    }
+
+    if ((size_t)info.st_size < size) {
+        error_exit( "Input .flt file size too small - does not match .hdr info." );
+    }
+    if ((size_t)info.st_size > size) {
+        fprintf( stderr, "*** WARNING: " );
+        fprintf( stderr, "Input .flt file size too large - does not match .hdr info.\n" );
+    }
+
+    data = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno( in_flt_file ), 0 );
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+
+    return (float *)data;
+#else
+    return NULL;
+#endif
+}
+
+#if defined __GNUC__
+
+// Vector check of a row using GCC/Clang vector extensions (SSE2 on x86, NEON on ARM).
+// Most rows contain no NaN or NODATA values, so nothing needs to be stored; rows that do
+// are checked again one value at a time by check_flt_row().
+
+#define FLT_LANES 4
+
+typedef float Flt_VFloat __attribute__(( vector_size( 16 ) ));
+typedef int   Flt_VInt   __attribute__(( vector_size( 16 ) ));
+
+static int quick_check_flt_row(
+    const float *ptr, int ncols, float nodata, int *all_ints, float *lo, float *hi )
+// Returns 0 if row contains no NaN or NODATA values, after updating *all_ints, *lo, and *hi;
+// returns 1 (leaving them unchanged) otherwise.
+{
+    const Flt_VFloat vnodata = { nodata,    nodata,    nodata,    nodata    };
+    const Flt_VFloat vlimit  = { -1.0e+38f, -1.0e+38f, -1.0e+38f, -1.0e+38f };
+
+    Flt_VFloat v, vlo, vhi, vint;
+    Flt_VInt   bad  = { 0, 0, 0, 0 };
+    Flt_VInt   frac = { 0, 0, 0, 0 };
+    Flt_VInt   mask;
+
+    float rowlo, rowhi;
+    int   nonint = 0;
+    int   j, k;
+
+    if (ncols < FLT_LANES) {
+        return 1;
+    }
+
+    memcpy( &vlo, ptr, sizeof( vlo ) );
+    vhi = vlo;
+
+    for (j=0; j+FLT_LANES<=ncols; j+=FLT_LANES) {
+        memcpy( &v, ptr+j, sizeof( v ) );
+
+        bad |= (v != v) | (v == vnodata) | (v < vlimit);
+
+        // non-integer if v differs from v truncated, for |v| < 2^23
+        vint  = __builtin_convertvector( __builtin_convertvector( v, Flt_VInt ), Flt_VFloat );
+        frac |= (v != vint) & (((Flt_VInt)v & 0x7FFFFFFF) < 0x4B000000);
+
+        mask = v < vlo;
+        vlo  = (Flt_VFloat)( ((Flt_VInt)v & mask) | ((Flt_VInt)vlo & ~mask) );
+        mask = v > vhi;
+        vhi  = (Flt_VFloat)( ((Flt_VInt)v & mask) | ((Flt_VInt)vhi & ~mask) );
+    }
+
+    for (k=0; k<FLT_LANES; ++k) {
+        if (bad[k]) {
+            return 1;
+        }
+    }
+
+    rowlo = vlo[0];
+    rowhi = vhi[0];
+    for (k=1; k<FLT_LANES; ++k) {
+        rowlo = vlo[k] < rowlo ? vlo[k] : rowlo;
+        rowhi = vhi[k] > rowhi ? vhi[k] : rowhi;
+    }
+
+    // remaining values
+    for (; j<ncols; ++j) {
+        if (flt_isnan( ptr[j] ) || ptr[j] == nodata || ptr[j] < -1.0e+38) {
+            return 1;
+        }
+        if (ptr[j] != floor( ptr[j] )) {
+            nonint = 1;
+        }
+        rowlo = ptr[j] < rowlo ? ptr[j] : rowlo;
+        rowhi = ptr[j] > rowhi ? ptr[j] : rowhi;
+    }
+
+    for (k=0; k<FLT_LANES; ++k) {
+        if (frac[k]) {
+            nonint = 1;
+        }
+    }
+    if (nonint) {
+        *all_ints = 0;
+    }
+
+    *lo = rowlo < *lo ? rowlo : *lo;
+    *hi = rowhi > *hi ? rowhi : *hi;
+
+    return 0;
+}
+
+#endif
+
+static void check_flt_row(
+    float *ptr, int ncols, float nodata, int *has_nulls, int *all_ints, float *lo, float *hi )
+// Checks row of data for NaNs, replaces NODATA values with 0, and updates
+// *has_nulls, *all_ints, and range of values *lo to *hi.
+{
+    int j;
+
+#ifdef FLT_LANES
+    if (!quick_check_flt_row( ptr, ncols, nodata, all_ints, lo, hi )) {
+        return;
+    }
+#endif
+
+    for (j=0; j<ncols; ++j) {
+        if (flt_isnan( ptr[j] )) {
+            prefix_error();
+            fprintf( stderr, "Input .flt file contains NaNs - probably bad data" );
+            fprintf( stderr, "(or wrong .hdr file).\n" );
+            exit( EXIT_FAILURE );
+        }
+        if (ptr[j] == nodata || ptr[j] < -1.0e+38) {
+            ptr[j] = 0.0;
+            *has_nulls = 1;
+        } else if (*all_ints && ptr[j] != floor( ptr[j] )) {
+            *all_ints = 0;
+        }
+        if (ptr[j] < *lo) {
+            *lo = ptr[j];
+        }
+        if (ptr[j] > *hi) {
+            *hi = ptr[j];
+        }
+    }
 }
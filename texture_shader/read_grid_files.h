@@ -55,6 +55,99 @@ float *read_flt_hdr_files(
                         // caller is responsible to free *software pointer!
 );
 
+// Same as read_flt_hdr_files(), also returning the range of data values
+// (after any NODATA values are set to 0), found while reading the data.
+float *read_flt_hdr_range(
+    // returns allocated array of data values;
+    // NOTE: caller is responsible to free this pointer!
+    FILE *in_flt_file,  // .flt file - should be opened in BINARY mode
+    FILE *in_hdr_file,  // .hdr file - should be opened in BINARY mode
+    int *nrows,         // number of rows in data array
+    int *ncols,         // number of cols in data array
+    double *xmin,       // min X coordinate (longitude or easting)  - left   edge of left   pixels
+    double *xmax,       // max X coordinate (longitude or easting)  - right  edge of right  pixels
+    double *ymin,       // min Y coordinate (latitude  or northing) - bottom edge of bottom pixels
+    double *ymax,       // max Y coordinate (latitude  or northing) - top    edge of top    pixels
+    int *has_nulls,
+    int *all_ints,
+    float *data_min,    // minimum data value
+    float *data_max,    // maximum data value
+    char * (*software)  // if software != 0, returns with *software either
+                        // null or pointing to a software name/version string;
+                        // caller is responsible to free *software pointer!
+);
+
+// Same as read_flt_hdr_range(), but if the .flt file has native byte order and no padding,
+// maps it into memory instead of reading it. The mapping is private (copy-on-write),
+// so the array may be modified in place without changing the file; only changed pages
+// take up memory of their own. Otherwise the data are read as usual.
+float *map_flt_hdr_files(
+    // returns array of data values - either mapped from the .flt file or allocated;
+    // NOTE: caller is responsible to release this pointer with free_flt_data()!
+    FILE *in_flt_file,  // .flt file - should be opened in BINARY mode
+    FILE *in_hdr_file,  // .hdr file - should be opened in BINARY mode
+    int *nrows,         // number of rows in data array
+    int *ncols,         // number of cols in data array
+    double *xmin,       // min X coordinate (longitude or easting)  - left   edge of left   pixels
+    double *xmax,       // max X coordinate (longitude or easting)  - right  edge of right  pixels
+    double *ymin,       // min Y coordinate (latitude  or northing) - bottom edge of bottom pixels
+    double *ymax,       // max Y coordinate (latitude  or northing) - top    edge of top    pixels
+    int *has_nulls,
+    int *all_ints,
+    float *data_min,    // minimum data value
+    float *data_max,    // maximum data value
+    int *mapped,        // nonzero if data array is mapped from the .flt file
+    char * (*software)  // if software != 0, returns with *software either
+                        // null or pointing to a software name/version string;
+                        // caller is responsible to free *software pointer!
+);
+
+// Releases data array returned by map_flt_hdr_files().
+void free_flt_data(
+    float *data,        // array of data values from map_flt_hdr_files()
+    int nrows,          // number of rows in data array
+    int ncols,          // number of cols in data array
+    int mapped          // *mapped value from map_flt_hdr_files()
+);
+
+// Layout of a .flt file as described by its .hdr file.
+struct Flt_File_Info {
+    int    nrows;       // number of rows in data array
+    int    ncols;       // number of cols in data array
+    double xmin;        // min X coordinate (longitude or easting)  - left   edge of left   pixels
+    double xmax;        // max X coordinate (longitude or easting)  - right  edge of right  pixels
+    double ymin;        // min Y coordinate (latitude  or northing) - bottom edge of bottom pixels
+    double ymax;        // max Y coordinate (latitude  or northing) - top    edge of top    pixels
+    float  nodata;      // NODATA value
+    int    big_endian;  // nonzero if .flt file is in big-endian (MSBFIRST) byte order
+    int    skipbytes;   // number of bytes to skip at start of .flt file
+    int    rowpad;      // number of padding bytes at end of each row in .flt file
+};
+
+// Reads and validates .hdr file. Same as first half of read_flt_hdr_files(),
+// for use when the caller provides the memory for the data array.
+void read_hdr_info(
+    FILE *in_hdr_file,  // .hdr file - should be opened in BINARY mode
+    struct Flt_File_Info
+         *info,         // output: layout of .flt file
+    char * (*software)  // if software != 0, returns with *software either
+                        // null or pointing to a software name/version string;
+                        // caller is responsible to free *software pointer!
+);
+
+// Reads data from .flt file into caller-provided array of info->nrows x info->ncols
+// values (e.g., a memory-mapped output file). Same as second half of read_flt_hdr_files().
+void read_flt_data(
+    FILE *in_flt_file,  // .flt file - should be opened in BINARY mode
+    const struct Flt_File_Info
+         *info,         // input: layout of .flt file from read_hdr_info()
+    float *data,        // output: array of data values
+    int *has_nulls,
+    int *all_ints,
+    float *data_min,    // minimum data value (after any NODATA values are set to 0)
+    float *data_max     // maximum data value
+);
+
 // Copies input .prj file to output .prj file, and changes any "ZUNITS" line to "ZUNITS NO"
 void copy_prj_file( FILE *in_prj_file, FILE *out_prj_file );
 
@@ -43,6 +43,11 @@
 #include <math.h>
 #include <assert.h>
 #include "terrain_filter.h"
+#include "mercator_remap.h"
+#include "thread_pool.h"
+#include "horizon_map.h"
+#include "max_pyramid.h"
+#include "solar_position.h"
 
 #define LONG ptrdiff_t
 
@@ -61,6 +66,12 @@ static const char sw_format[] = "%s v%s %s";
 
 static const char *command_name;
 
+// number of azimuths in horizon files written by this program
+static const int default_horizon_angles = 32;
+
+// most sun positions (output frames) in one run
+static const int max_sun_frames = 10000;
+
 static const char *get_command_name( const char *argv[] )
 {
     const char *colon;
@@ -102,6 +113,8 @@ static void usage_exit( const char *message )
     fprintf( stderr, "\n" );
     fprintf( stderr, "USAGE:    %s sun_az sun_elev elev_file [-options ...]\n", command_name );
     fprintf( stderr, "          %s 120 22 rainier_elev -mercator -32.5 45\n", command_name );
+    fprintf( stderr, "   or:    %s elev_file out_prefix -suns file | -sunpath ... [-options ...]\n",
+        command_name );
     fprintf( stderr, "\n" );
     fprintf( stderr, "Requires both .flt and .hdr files as input  " );
     fprintf( stderr, "(e.g., rainier_elev.flt and rainier_elev.hdr).\n" );
@@ -112,9 +125,45 @@ static void usage_exit( const char *message )
     fprintf( stderr, "Input and output filenames must not be the same.\n" );
     fprintf( stderr, "NOTE: Output files will be overwritten if they already exist.\n" );
     fprintf( stderr, "\n" );
-    fprintf( stderr, "Available option:\n" );
+    fprintf( stderr, "Available options:\n" );
     fprintf( stderr, "    -mercator lat1 lat2    " );
     fprintf( stderr, "input is in normal Mercator projection (not UTM)\n" );
+    fprintf( stderr, "    -remap                 " );
+    fprintf( stderr, "input is geographic; process it in Mercator projection\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "internally and write output on the input grid\n" );
+    fprintf( stderr, "    -summed                " );
+    fprintf( stderr, "output log of summed terrain height above each sun ray\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "(original, much slower algorithm) instead of log of\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "1 + depth below the shadow envelope\n" );
+    fprintf( stderr, "    -horizons file         " );
+    fprintf( stderr, "output angle in degrees of horizon above the sun, from\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "horizon angles in file if it matches the input (e.g.\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "from svf -horizons); otherwise compute horizons along\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "%d azimuths and save them in file for reuse\n", default_horizon_angles );
+    fprintf( stderr, "    -threads n             " );
+    fprintf( stderr, "use n worker threads (default: number of processors)\n" );
+    fprintf( stderr, "    -suns file             " );
+    fprintf( stderr, "instead of sun_az sun_elev, process each sun position in\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "file (one \"sun_az sun_elev\" pair per line) in turn,\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "writing out_prefix_000.flt, out_prefix_001.flt, ...\n" );
+    fprintf( stderr, "    -sunpath lat lon start end minutes\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "same, for the sun as seen from lat, lon every given\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "number of minutes from start to end (UTC times of the\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "form 2024-06-21T06:30); times with the sun below the\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "horizon are skipped\n" );
+    fprintf( stderr, "At most %d sun positions are allowed in one run.\n", max_sun_frames );
     fprintf( stderr, "Values lat1 and lat2 must be in decimal degrees.\n" );
     fprintf( stderr, "\n" );
     exit( EXIT_FAILURE );
@@ -159,20 +208,6 @@ static void get_filenames(
     }
 }
 
-static int print_progress( float portion, float steps_done, int total_steps, void *state )
-{
-    int *last_count = (int *)state;
-    int  this_count = (int)steps_done;
-
-    if (this_count > *last_count) {
-        printf( "Processing phase %d...\n", this_count + 1 );
-        fflush( stdout );
-        *last_count = this_count;
-    }
-
-    return 0;
-}
-
 // Returns -1 for geographic coordinates, +1 for projected coordinates, 0 if unable to determine
 static int determine_projection(
     double xmin, double xmax, double ymin, double ymax, double xdim, double ydim )
@@ -262,6 +297,409 @@ static double fix_azimuth(double az, double xdim, double ydim )
   return val;
 }
 
+// Original shadow algorithm: marches a ray from every pixel toward the sun until it
+// leaves the grid or rises above the highest point, summing the terrain height above
+// the ray. Costs O(N*L) for N pixels and ray length L. Where the ray is above all
+// terrain in a block of the max pyramid (see max_pyramid.h), it steps through the
+// block without reading elevations; the steps themselves are unchanged, so the
+// result is the same as without the pyramid. Every pixel is independent,
+// so small blocks of rows are handed out to threads as they become free (rays are
+// much longer in some areas than others).
+// Output is the natural log of the total height above the ray (0 if lit).
+
+// smallest level of max pyramid worth checking (blocks of 2^level pixels square)
+#ifndef SUMMED_MIN_LEVEL
+#   define SUMMED_MIN_LEVEL 3
+#endif
+
+struct Summed_State {
+    const float *data;
+    float  *shadow;
+    int     nrows;
+    int     ncols;
+    float   z_max;
+    const struct Max_Pyramid *pyramid;  // NULL if sun is not above the horizon
+    double  sun_x;
+    double  sun_y;
+    double  sun_z;
+};
+
+static double steps_to_edge( double pos, double step, double inv_step, int lo, int hi )
+// Returns (approximate) number of steps from pos to leave [lo,hi), or HUGE_VAL if never.
+{
+    if (step > 0.0) {
+        return (hi - pos) * inv_step;
+    } else if (step < 0.0) {
+        return (lo - pos) * inv_step;
+    }
+    return HUGE_VAL;
+}
+
+static void summed_rows( long first, long last, int worker, void *state )
+{
+    const struct Summed_State *s = (const struct Summed_State *)state;
+
+    const float *data = s->data;
+    int    nrows = s->nrows;
+    int    ncols = s->ncols;
+    float  z_max = s->z_max;
+    const struct Max_Pyramid *pyramid = s->pyramid;
+    double sun_x = s->sun_x;
+    double sun_y = s->sun_y;
+    double sun_z = s->sun_z;
+    double inv_x = sun_x != 0.0 ? 1.0 / sun_x : 0.0;
+    double inv_y = sun_y != 0.0 ? 1.0 / sun_y : 0.0;
+
+    const float *ptr;
+    const float *ptr3;
+    float *ptr2;
+
+    double base_zval;
+    double ny;
+    double zval;
+    double x;
+    double y;
+    double n;
+    double k;   // step number
+    int lit;
+    int x_int;
+    int y_int;
+    int level;
+    int size;
+    int x_block;
+    int y_block;
+
+    (void)worker;
+
+    for(long i=first;i<last;i++) {
+      ptr = data + (LONG)i * (LONG)ncols;
+      ptr2 = s->shadow + (LONG)i * (LONG)ncols;
+      for(int j=0;j<ncols;j++) {
+        // position and height of step k along the ray are computed directly from k
+        // (rather than by adding up steps), so whole blocks can be skipped at once
+        k=0;
+        x=j;
+        y=i;
+        base_zval=ptr[j];   // dataarray[row][column]
+        zval=base_zval;
+        lit=0;
+        x_int=x;
+        y_int=y;
+        size=0;     // no block checked yet
+        x_block=0;
+        y_block=0;
+
+        while(x_int > 0 && x_int < ncols && y_int > 0 && y_int < nrows && zval <= z_max) {
+          if (pyramid && !((unsigned)(x_int - x_block) < (unsigned)size &&
+                           (unsigned)(y_int - y_block) < (unsigned)size))
+          {
+            // find largest block around this point with no terrain above the ray
+            level = SUMMED_MIN_LEVEL - 1;
+            while (level < pyramid->num_levels &&
+                   zval >= max_pyramid_block( pyramid, level+1, y_int, x_int ))
+            {
+              level++;
+            }
+            size = 1 << (level >= SUMMED_MIN_LEVEL ? level : SUMMED_MIN_LEVEL);
+            x_block = x_int & -size;
+            y_block = y_int & -size;
+            if (level >= SUMMED_MIN_LEVEL) {
+              // the ray only rises, so jump to the first step outside the block
+              // (from an estimate that may be a little short, but not past it)
+              n  = steps_to_edge( x, sun_x, inv_x, x_block, x_block + size );
+              ny = steps_to_edge( y, sun_y, inv_y, y_block, y_block + size );
+              if (ny < n) {
+                n = ny;
+              }
+              k = n < 2.0 ? k + 1.0 : k + floor( n ) - 1.0;
+              for (;;) {
+                x=j+k*sun_x;
+                y=i+k*sun_y;
+                x_int=(int) x;
+                y_int=(int) y;
+                if (!((unsigned)(x_int - x_block) < (unsigned)size &&
+                      (unsigned)(y_int - y_block) < (unsigned)size))
+                {
+                  break;
+                }
+                k+=1.0;
+              }
+              zval=base_zval+k*sun_z;
+              continue;
+            }
+            // otherwise check every step until leaving the smallest block
+          }
+          ptr3 = data + (LONG)y_int * (LONG)ncols;
+          if (zval < ptr3[x_int]) {
+            lit=lit+(ptr3[x_int]-zval);  // Sum the height above the sun line
+          }
+          k+=1.0;
+          x=j+k*sun_x;
+          y=i+k*sun_y;
+          zval=base_zval+k*sun_z;
+          x_int=(int) x;
+          y_int=(int) y;
+        }
+        if (lit==0) {
+          ptr2[j]=0;
+        } else {
+          ptr2[j]=log(lit);  // Use the natural logarithm of the total shading volume
+        }
+      }
+    }
+}
+
+static float grid_max( const float *data, int nrows, int ncols )
+{
+    const float *ptr;
+    float z_max=-999999;
+
+    // Find maximum value to limit shadow search
+    for (int i=0; i<nrows; ++i) {
+      ptr = data + (LONG)i * (LONG)ncols;
+      for (int j=0; j<ncols; ++j) {
+          if (ptr[j] > z_max) {
+            z_max = ptr[j];
+          }
+      }
+    }
+    return z_max;
+}
+
+static void cast_shadows_summed(
+    const float *data,  // input: array of elevations (row-major order)
+    float *shadow,      // output: array of shadow values
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    float  z_max,       // input: from grid_max()
+    const struct Max_Pyramid *pyramid,
+                        // input: from create_max_pyramid() (NULL to check every step)
+    double sun_x,       // input: ray step toward sun in columns
+    double sun_y,       // input: ray step toward sun in rows
+    double sun_z,       // input: ray rise per step in elevation units
+    struct Thread_Pool *pool    // input: thread pool (NULL to run in this thread)
+)
+{
+    struct Summed_State state;
+
+    state.data   = data;
+    state.shadow = shadow;
+    state.nrows  = nrows;
+    state.ncols  = ncols;
+    state.z_max  = z_max;
+    // rounding errors in sin() and cos() must not turn rays along rows or columns
+    // (which are computed from the step number) into the neighboring row or column
+    state.sun_x  = fabs( sun_x ) < 1e-12 ? 0.0 : sun_x;
+    state.sun_y  = fabs( sun_y ) < 1e-12 ? 0.0 : sun_y;
+    state.sun_z  = sun_z;
+
+    // blocks can only be skipped by rays that never descend
+    state.pyramid = sun_z >= 0.0 ? pyramid : NULL;
+
+    run_thread_pool( pool, nrows, 4, summed_rows, &state, NULL );
+}
+
+// Sweep-line shadow algorithm: the grid is covered by rasterized lines parallel to the
+// sun azimuth (one step along the major axis and a rounded step along the minor axis),
+// so every pixel lies on exactly one line. Walking each line away from the sun while
+// keeping the running envelope of shadow-casting terrain,
+//     env(p) = max( h(p), env(prev(p)) - drop ),
+// visits each pixel once: O(N). Pixels are sampled at the nearest grid point as in the
+// original algorithm, so shadow edges match it.
+// Lines are independent, so bands of adjacent lines are handed out to threads. Each
+// band is still processed one row at a time (in an order such that prev(p) is always
+// in an earlier row or earlier in the same row) to keep memory access sequential.
+// Output is the natural log of 1 + the depth of the pixel below the shadow envelope
+// (0 if lit). Void (NaN) points are set to 0 and do not cast shadows.
+
+struct Sweep_State {
+    const float *data;
+    float  *shadow;
+    int     nrows;
+    int     ncols;
+    int     xmajor;     // nonzero if lines advance one column per step
+    int     rstep;      // direction of row    order (+1 or -1)
+    int     cstep;      // direction of column order (+1 or -1)
+    int     nsteps;     // number of steps along major axis
+    int    *offset;     // minor axis offset of each line, by step along major axis
+    int     max_offset;
+    double  drop;       // fall of envelope per step
+    double *env;        // current envelope of each line
+};
+
+static int first_step_at( const int *offset, int nsteps, int sign, int value )
+// Returns first step k with sign*offset[k] >= sign*value (offset is monotonic).
+{
+    int lo = 0;
+    int hi = nsteps;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (sign * offset[mid] < sign * value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void sweep_lines( long first, long last, int worker, void *state )
+{
+    const struct Sweep_State *s = (const struct Sweep_State *)state;
+
+    int    nrows = s->nrows;
+    int    ncols = s->ncols;
+    double drop  = s->drop;
+    double *env  = s->env + s->max_offset;  // indexed by line number
+
+    // lines first .. last-1 are numbered first-max_offset .. last-1-max_offset
+    int    lo = (int)first - s->max_offset;
+    int    hi = (int)last  - s->max_offset;
+
+    int    n, i, j, k, kbeg, kend, line;
+    double h, e;
+
+    (void)worker;
+
+    for (n=lo; n<hi; ++n) {
+        env[n] = -HUGE_VAL;
+    }
+
+    for (n=0; n<nrows; ++n) {
+        const float *ptr;
+        float *out;
+
+        i   = s->rstep > 0 ? n : nrows-1-n;
+        ptr = s->data   + (LONG)i * (LONG)ncols;
+        out = s->shadow + (LONG)i * (LONG)ncols;
+
+        if (s->xmajor) {
+            // pixel at step k is in column k or ncols-1-k, on line i - offset[k];
+            // find steps with i-hi < offset[k] <= i-lo
+            if (s->rstep > 0) {
+                kbeg = first_step_at( s->offset, s->nsteps, +1, i - hi + 1 );
+                kend = first_step_at( s->offset, s->nsteps, +1, i - lo + 1 );
+            } else {
+                // offsets decrease along the line
+                kbeg = first_step_at( s->offset, s->nsteps, -1, i - lo );
+                kend = first_step_at( s->offset, s->nsteps, -1, i - hi );
+            }
+        } else {
+            // pixel in column j is on line j - offset[n]
+            kbeg = lo + s->offset[n] > 0     ? lo + s->offset[n] : 0;
+            kend = hi + s->offset[n] < ncols ? hi + s->offset[n] : ncols;
+        }
+
+        for (k=kbeg; k<kend; ++k) {
+            if (s->xmajor) {
+                j    = s->cstep > 0 ? k : ncols-1-k;
+                line = i - s->offset[k];
+            } else {
+                j    = k;
+                line = j - s->offset[n];
+            }
+
+            // envelope arriving from previous pixel on this line (if any)
+            e = env[line] - drop;
+
+            h = ptr[j];
+            if (h < e) {
+                out[j] = (float)log( 1.0 + (e - h) );
+            } else {
+                out[j] = 0.0f;
+                if (h == h) {   // not NaN
+                    e = h;
+                }
+            }
+            env[line] = e;
+        }
+    }
+}
+
+// Returns 0 on success, nonzero if memory allocation failed.
+
+static int cast_shadows_sweep(
+    const float *data,  // input: array of elevations (row-major order)
+    float *shadow,      // output: array of shadow values
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double sun_x,       // input: ray step toward sun in columns
+    double sun_y,       // input: ray step toward sun in rows
+    double sun_z,       // input: ray rise per step in elevation units
+    struct Thread_Pool *pool    // input: thread pool (NULL to run in this thread)
+)
+{
+    struct Sweep_State state;
+
+    // lines run away from the sun
+    double ux = -sun_x;
+    double uy = -sun_y;
+    double len = sqrt( ux*ux + uy*uy );
+
+    double slope;       // minor axis offset per step along major axis
+    int    nminor;      // number of pixels across lines
+    int    min_offset;
+    LONG   nlines;
+    int    k;
+
+    if (len < 1e-12) {
+        // sun straight overhead
+        memset( shadow, 0, (size_t)nrows * (size_t)ncols * sizeof( float ) );
+        return 0;
+    }
+
+    state.data   = data;
+    state.shadow = shadow;
+    state.nrows  = nrows;
+    state.ncols  = ncols;
+    state.xmajor = fabs( ux ) >= fabs( uy );
+    if (state.xmajor) {
+        state.nsteps = ncols;
+        nminor       = nrows;
+        slope        = uy / fabs( ux );
+        state.cstep  = ux > 0.0 ? 1 : -1;
+        state.rstep  = slope >= 0.0 ? 1 : -1;
+    } else {
+        state.nsteps = nrows;
+        nminor       = ncols;
+        slope        = ux / fabs( uy );
+        state.rstep  = uy > 0.0 ? 1 : -1;
+        state.cstep  = 1;
+    }
+    state.drop = sun_z / len * sqrt( 1.0 + slope*slope );
+
+    state.offset = (int *)malloc( (size_t)state.nsteps * sizeof( int ) );
+    if (!state.offset) {
+        return 1;
+    }
+    min_offset = 0;
+    state.max_offset = 0;
+    for (k=0; k<state.nsteps; ++k) {
+        state.offset[k] = (int)floor( k*slope + 0.5 );
+        if (state.offset[k] < min_offset) {
+            min_offset = state.offset[k];
+        } else if (state.offset[k] > state.max_offset) {
+            state.max_offset = state.offset[k];
+        }
+    }
+
+    // line numbers run from -max_offset to nminor-1-min_offset
+    nlines = (LONG)nminor + state.max_offset - min_offset;
+    state.env = (double *)malloc( (size_t)nlines * sizeof( double ) );
+    if (!state.env) {
+        free( state.offset );
+        return 1;
+    }
+
+    // bands small enough to balance the load, large enough to keep rows sequential
+    run_thread_pool( pool, nlines, 256, sweep_lines, &state, NULL );
+
+    free( state.offset );
+    free( state.env );
+
+    return 0;
+}
 
 // Main terrain_filter function:
 //
@@ -340,16 +778,133 @@ static double fix_azimuth(double az, double xdim, double ydim )
 
 
 
+// Batch mode: a list of sun positions is processed in one run, sharing the input,
+// the acceleration structures, and the thread pool; each frame is written to its
+// own output files, numbered in order.
+
+static int add_sun( double **suns, int *num_suns, double sun_az, double sun_el )
+// Appends sun position to list of azimuth, elevation pairs.
+// Returns 0 on success, nonzero if a memory allocation error occurred.
+{
+    double *list;
+
+    // grow list when count reaches a power of 2
+    if ((*num_suns & (*num_suns - 1)) == 0) {
+        list = (double *)realloc( *suns, 2 * sizeof( double ) * (*num_suns ? 2 * *num_suns : 1) );
+        if (!list) {
+            return 1;
+        }
+        *suns = list;
+    }
+    (*suns)[2 * *num_suns]     = sun_az;
+    (*suns)[2 * *num_suns + 1] = sun_el;
+    ++*num_suns;
+    return 0;
+}
+
+static void read_sun_list( const char *filename, double **suns, int *num_suns )
+// Reads sun positions from text file with one "sun_az sun_el" pair per line;
+// blank lines and lines starting with # are ignored. Exits on error.
+{
+    FILE  *file;
+    char   line[256];
+    char  *ptr;
+    double sun_az, sun_el;
+    char   extra;
+    int    line_num = 0;
+
+    file = fopen( filename, "r" );
+    if (!file) {
+        prefix_error();
+        fprintf( stderr, "Could not open sun position file '%s'.\n", filename );
+        usage_exit( 0 );
+    }
+    while (fgets( line, sizeof( line ), file )) {
+        ++line_num;
+        for (ptr=line; *ptr==' ' || *ptr=='\t'; ++ptr) {}
+        if (*ptr == '#' || *ptr == '\n' || *ptr == '\r' || *ptr == '\0') {
+            continue;
+        }
+        if (sscanf( ptr, "%lf %lf %c", &sun_az, &sun_el, &extra ) != 2) {
+            prefix_error();
+            fprintf( stderr, "Line %d of sun position file '%s' is not a pair of numbers.\n",
+                line_num, filename );
+            exit( EXIT_FAILURE );
+        }
+        if (*num_suns >= max_sun_frames) {
+            prefix_error();
+            fprintf( stderr, "Sun position file '%s' has more than %d positions.\n",
+                filename, max_sun_frames );
+            exit( EXIT_FAILURE );
+        }
+        if (add_sun( suns, num_suns, sun_az, sun_el )) {
+            prefix_error();
+            fprintf( stderr, "Memory allocation error occurred.\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+    fclose( file );
+}
+
+static void copy_prj_to( const char *in_prj_name, const char *out_prj_name )
+// Copies optional .prj file.
+{
+    FILE *in_prj_file;
+    FILE *out_prj_file;
+
+    in_prj_file = fopen( in_prj_name, "rb" );   // use binary mode for compatibility
+    if (in_prj_file) {
+        out_prj_file = fopen( out_prj_name, "wb" ); // use binary mode for compatibility
+        if (!out_prj_file) {
+            fprintf( stderr, "*** WARNING: " );
+            fprintf( stderr, "Could not open output file '%s'.\n", out_prj_name );
+        } else {
+            // copy file and change any "ZUNITS" line to "ZUNITS NO"
+            copy_prj_file( in_prj_file, out_prj_file );
+
+            fclose( out_prj_file );
+        }
+        fclose( in_prj_file );
+    }
+}
+
+static char *frame_basename( const char *out_arg, int frame, int num_frames )
+// Returns output name (without extension) for frame in batch mode: out_arg with
+// any .flt extension removed, then _ and the frame number (at least 3 digits).
+// NOTE: caller is responsible to free returned pointer!
+{
+    size_t len = strlen( out_arg );
+    int    digits = 3;
+    int    n;
+    char   number[16];
+    size_t num_len, pad;
+    char  *name;
+
+    if (len > 4 && (strcmp( out_arg+len-4, ".flt" ) == 0 || strcmp( out_arg+len-4, ".FLT" ) == 0)) {
+        len -= 4;
+    }
+    for (n=1000; n<num_frames; n*=10) {
+        ++digits;
+    }
+
+    snprintf( number, sizeof( number ), "%d", frame );
+    num_len = strlen( number );
+    pad = num_len < (size_t)digits ? (size_t)digits - num_len : 0;
+
+    name = (char *)malloc( len + 1 + pad + num_len + 1 );  // assume this malloc succeeds
+    memcpy( name, out_arg, len );
+    name[len] = '_';
+    memset( name+len+1, '0', pad );
+    strcpy( name+len+1+pad, number );
+    return name;
+}
+
 #ifndef NOMAIN
 
 int main( int argc, const char *argv[] )
 {
     const int minargs = 4;  // including command name
 
-    int last_count = -1;
-
-    struct Terrain_Progress_Callback progress = { print_progress, &last_count };
-
     int argnum;
 
     const char *thisarg;
@@ -363,14 +918,12 @@ int main( int argc, const char *argv[] )
     char *out_hdr_name;
     char *out_prj_name;
 
-    double detail;
+    double detail = 0.0;    // not used by this program
 
     FILE *in_dat_file;
     FILE *in_hdr_file;
-    FILE *in_prj_file;
     FILE *out_dat_file;
     FILE *out_hdr_file;
-    FILE *out_prj_file;
 
     int nrows;
     int ncols;
@@ -388,14 +941,41 @@ int main( int argc, const char *argv[] )
     int proj_type;
     int has_nulls;
     int all_ints;
+    float data_min, data_max;
+    int in_mapped;
 
     double lat1 = 0.0;  // default unless -merc option used
     double lat2 = 0.0;  // default unless -merc option used
     double center_lat;
     double temp;
+    int    remap = 0;
+    float *remapped;
+    int    summed = 0;
+    int    num_threads = 0;    // default
+    long   count;
+    const char *horizons_name = NULL;
+    struct Horizon_Map *horizons;
+    double xres, yres;
+    double xsize, ysize;
 
     double sun_az;
     double sun_el;
+    double *suns = NULL;    // list of sun_az, sun_el pairs
+    int    num_suns = 0;
+    int    batch = 0;       // nonzero if sun positions are given by option
+    const char *suns_name = NULL;
+    int    sunpath = 0;
+    double path_lat = 0.0, path_lon = 0.0;
+    double path_start = 0.0, path_end = 0.0, path_step = 0.0;
+    double path_frames = 0.0;
+    double jd;
+    const char *out_arg;
+    char  *frame_name;
+    int    frame;
+    struct Thread_Pool *pool = NULL;
+    struct Max_Pyramid *pyramid = NULL;
+    float  z_max = 0.0f;    // used with -summed
+    float *output;
     // float *ptr;
 
     int error;
@@ -415,17 +995,23 @@ int main( int argc, const char *argv[] )
 
     argnum = 1;
 
-    thisarg = argv[argnum++];
+    thisarg = argv[argnum];
     // read decimal number
     sun_az = strtod( thisarg, &endptr );
     if (endptr == thisarg || *endptr != '\0') {
-        usage_exit( "First parameter (sun_az) must be a number." );
+        // no sun position - must be given by -suns or -sunpath
+        batch = 1;
+    } else {
+        ++argnum;
+        thisarg = argv[argnum++];
+        // read decimal number
+        sun_el = strtod( thisarg, &endptr );
+        if (endptr == thisarg || *endptr != '\0') {
+            usage_exit( "Second parameter (sun_el) must be a number." );
+        }
     }
-    thisarg = argv[argnum++];
-    // read decimal number
-    sun_el = strtod( thisarg, &endptr );
-    if (endptr == thisarg || *endptr != '\0') {
-        usage_exit( "Second parameter (sun_el) must be a number." );
+    if (argnum + 2 > argc) {
+        usage_exit( "Not enough command-line parameters." );
     }
 
     software = (char *)malloc( strlen(sw_format) + strlen(sw_name) + strlen(sw_version) + strlen(sw_date) );
@@ -441,8 +1027,9 @@ int main( int argc, const char *argv[] )
     strncpy( extension, "flt", 4 );
     get_filenames( argv[argnum++], &in_dat_name, &in_hdr_name, &in_prj_name, extension );
 
+    out_arg = argv[argnum++];
     strncpy( extension, "flt", 4 );
-    get_filenames( argv[argnum++], &out_dat_name, &out_hdr_name, &out_prj_name, extension );
+    get_filenames( out_arg, &out_dat_name, &out_hdr_name, &out_prj_name, extension );
 
     if (!strcmp( in_hdr_name, out_hdr_name )) {
         usage_exit( "Input and outfile filenames must not be the same." );
@@ -481,6 +1068,68 @@ int main( int argc, const char *argv[] )
             if (lat1 <= -90.0 || lat2 >= 90.0) {
                 usage_exit( "Mercator latitude limits must be between -90 and +90 (exclusive)." );
             }
+        } else if (strncmp( thisarg, "remap", 5 ) == 0) {
+            remap = 1;
+        } else if (strncmp( thisarg, "summed", 6 ) == 0) {
+            summed = 1;
+        } else if (strncmp( thisarg, "horizons", 7 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -horizons must be followed by a filename." );
+            }
+            horizons_name = argv[argnum++];
+        } else if (strncmp( thisarg, "suns", 4 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -suns must be followed by a filename." );
+            }
+            suns_name = argv[argnum++];
+        } else if (strncmp( thisarg, "sunpath", 7 ) == 0) {
+            if (argnum+4 >= argc) {
+                usage_exit( "Option -sunpath must be followed by lat, lon, start, end, and minutes." );
+            }
+            thisarg = argv[argnum++];
+            path_lat = strtod( thisarg, &endptr );
+            if (endptr == thisarg || *endptr != '\0' || fabs( path_lat ) > 90.0) {
+                usage_exit( "Option -sunpath latitude must be between -90 and +90." );
+            }
+            thisarg = argv[argnum++];
+            path_lon = strtod( thisarg, &endptr );
+            if (endptr == thisarg || *endptr != '\0') {
+                usage_exit( "Option -sunpath longitude must be a number." );
+            }
+            if (!parse_utc_time( argv[argnum++], &path_start ) ||
+                !parse_utc_time( argv[argnum++], &path_end ))
+            {
+                usage_exit( "Option -sunpath times must be UTC in the form YYYY-MM-DDTHH:MM." );
+            }
+            thisarg = argv[argnum++];
+            path_step = strtod( thisarg, &endptr );
+            if (endptr == thisarg || *endptr != '\0' || path_step <= 0.0) {
+                usage_exit( "Option -sunpath interval must be a positive number of minutes." );
+            }
+            if (path_end < path_start) {
+                usage_exit( "Option -sunpath end time must not be before start time." );
+            }
+            // number of times from start to end (small tolerance so the end time
+            // is included despite rounding)
+            path_frames = floor( (path_end - path_start) * 1440.0 / path_step + 1e-6 ) + 1.0;
+            if (path_frames > max_sun_frames) {
+                prefix_error();
+                fprintf( stderr, "Option -sunpath gives %.0f times; at most %d are allowed\n",
+                    path_frames, max_sun_frames );
+                fprintf( stderr, "(use a longer interval or a shorter time span).\n" );
+                exit( EXIT_FAILURE );
+            }
+            sunpath = 1;
+        } else if (strncmp( thisarg, "threads", 6 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -threads must be followed by a positive integer." );
+            }
+            thisarg = argv[argnum++];
+            count = strtol( thisarg, &endptr, 10 );
+            if (endptr == thisarg || *endptr != '\0' || count < 1 || count > 1024) {
+                usage_exit( "Option -threads must be followed by a positive integer." );
+            }
+            num_threads = (int)count;
         } else if (strncmp( thisarg, "cellreg", 4 ) == 0 ||
                    strncmp( thisarg, "corner",  6 ) == 0)
         {
@@ -500,6 +1149,52 @@ int main( int argc, const char *argv[] )
         }
     }
 
+    if (summed && horizons_name) {
+        usage_exit( "Options -summed and -horizons cannot be used together." );
+    }
+    if (suns_name && sunpath) {
+        usage_exit( "Options -suns and -sunpath cannot be used together." );
+    }
+    if (!batch && (suns_name || sunpath)) {
+        usage_exit( "Sun position cannot be given both as parameters and by option." );
+    }
+
+    // List sun positions:
+
+    if (!batch) {
+        error = add_sun( &suns, &num_suns, sun_az, sun_el );
+    } else if (suns_name) {
+        read_sun_list( suns_name, &suns, &num_suns );
+        error = 0;
+    } else if (sunpath) {
+        error = 0;
+        for (frame=0; frame<(int)path_frames && !error; ++frame) {
+            jd = path_start + frame * path_step / 1440.0;
+            solar_position( jd, path_lat, path_lon, &sun_az, &sun_el );
+            // sun below the horizon casts no useful shadows
+            if (sun_el > 0.0) {
+                error = add_sun( &suns, &num_suns, sun_az, sun_el );
+            }
+        }
+        if (!num_suns && !error) {
+            prefix_error();
+            fprintf( stderr, "Sun is below the horizon at all times given by -sunpath.\n" );
+            exit( EXIT_FAILURE );
+        }
+    } else {
+        usage_exit( "First parameter (sun_az) must be a number, or use -suns or -sunpath." );
+    }
+    if (error) {
+        prefix_error();
+        fprintf( stderr, "Memory allocation error occurred.\n" );
+        exit( EXIT_FAILURE );
+    }
+    if (!num_suns) {
+        prefix_error();
+        fprintf( stderr, "No sun positions in file '%s'.\n", suns_name );
+        exit( EXIT_FAILURE );
+    }
+
     in_hdr_file = fopen( in_hdr_name, "rb" );   // use binary mode for compatibility
     if (!in_hdr_file) {
         prefix_error();
@@ -517,31 +1212,14 @@ int main( int argc, const char *argv[] )
     free( in_dat_name );
     free( in_hdr_name );
 
-    out_hdr_file = fopen( out_hdr_name, "wb" ); // use binary mode for compatibility
-    if (!out_hdr_file) {
-        prefix_error();
-        fprintf( stderr, "Could not open output file '%s'.\n", out_hdr_name );
-        usage_exit( 0 );
-    }
-
-    out_dat_file = fopen( out_dat_name, "wb" );
-    if (!out_dat_file) {
-        prefix_error();
-        fprintf( stderr, "Could not open output file '%s'.\n", out_dat_name );
-        usage_exit( 0 );
-    }
-
-    free( out_dat_name );
-    free( out_hdr_name );
-
     // Read .flt and .hdr files:
 
     // printf( "Reading input files...\n" );
     fflush( stdout );
 
-    data = read_flt_hdr_files(
+    data = map_flt_hdr_files(
         in_dat_file, in_hdr_file, &nrows, &ncols, &xmin, &xmax, &ymin, &ymax,
-        &has_nulls, &all_ints, 0 );
+        &has_nulls, &all_ints, &data_min, &data_max, &in_mapped, 0 );
 
     fclose( in_dat_file );
     fclose( in_hdr_file );
@@ -562,6 +1240,15 @@ int main( int argc, const char *argv[] )
 
     // Process data:
 
+    // one pool of threads for all steps and all sun positions
+    if (num_threads <= 0) {
+        num_threads = default_thread_count();
+    }
+    if (num_threads > 1) {
+        // if threads cannot be created, fall back to single-threaded processing
+        pool = create_thread_pool( num_threads );
+    }
+
     xdim = (xmax - xmin) / (double)ncols;
     ydim = (ymax - ymin) / (double)nrows;
 
@@ -597,6 +1284,38 @@ int main( int argc, const char *argv[] )
 
     }
 
+    if (remap) {
+        if (proj_type >= 0) {
+            usage_exit( "Option -remap is only valid for data in geographic coordinates." );
+        }
+
+        // the poles themselves cannot be projected (as tectoplot does for -mercator)
+        lat1 = ymin > -89.999 ? ymin : -89.999;
+        lat2 = ymax <  89.999 ? ymax :  89.999;
+
+        // printf( "Resampling to Mercator projection...\n" );
+
+        // same number of rows, equally spaced in northing instead of latitude
+        remapped = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
+        if (!remapped || mercator_remap_pool(
+                data, remapped, nrows, nrows, ncols, lat1, lat2, MERCATOR_FROM_GEOGRAPHIC, pool ))
+        {
+            prefix_error();
+            fprintf( stderr, "Memory allocation error occurred.\n" );
+            exit( EXIT_FAILURE );
+        }
+        free_flt_data( data, nrows, ncols, in_mapped );
+        data = remapped;
+        in_mapped = 0;
+
+        // process as if called with -mercator on the resampled grid
+        xdim = (mercator_easting ( xmax ) - mercator_easting ( xmin )) / (double)ncols;
+        ydim = (mercator_northing( lat2 ) - mercator_northing( lat1 )) / (double)nrows;
+        coord_type = TERRAIN_METERS;
+        center_lat = 0.0;
+        proj_type  = 2;
+    }
+
     // check pixel aspect ratio and size of map extent
     check_aspect( xmin, xmax, ymin, ymax, xdim, ydim, proj_type );
 
@@ -606,87 +1325,146 @@ int main( int argc, const char *argv[] )
     fflush( stdout );
 
     float *shadowarray2 = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
-    float z_max=-999999;
+    remapped = remap ? (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) ) : NULL;
+    if (!shadowarray2 || (remap && !remapped)) {
+        prefix_error();
+        fprintf( stderr, "Insufficient memory for shadow array data.\n" );
+        exit( EXIT_FAILURE );
+    }
 
-    // Find maximum value to limit shadow search
-    float *ptr;
-    //
-    for (int i=0; i<nrows; ++i) {
-      ptr = data + (LONG)i * (LONG)ncols;
-      for (int j=0; j<ncols; ++j) {
-          if (ptr[j] > z_max) {
-            z_max = ptr[j];
-          }
-      }
-      ptr+=(LONG)ncols;
+    // Prepare for shadow algorithm (once for all sun positions):
+
+    error = 0;
+    horizons = NULL;
+    if (horizons_name) {
+        // pixel spacing in meters, as for elevations (so azimuths are true azimuths)
+        if (coord_type == TERRAIN_DEGREES) {
+            geographic_scale( center_lat, &xsize, &ysize );
+            xres = xdim * xsize;
+            yres = ydim * ysize;
+        } else if (proj_type == 2) {
+            // Mercator scale at center of map
+            temp = mercator_latitude( 0.5 * (mercator_northing( lat1 ) + mercator_northing( lat2 )) );
+            xres = xdim * cos( deg2rad(temp) );
+            yres = ydim * cos( deg2rad(temp) );
+        } else {
+            xres = xdim;
+            yres = ydim;
+        }
+
+        // any number of azimuths will do
+        horizons = map_horizon_map( horizons_name, data, nrows, ncols, xres, yres, 0, 0 );
+        if (!horizons) {
+            error = write_horizon_map(
+                horizons_name, data, nrows, ncols, xres, yres,
+                default_horizon_angles, 0, num_threads );
+            if (error == 2) {
+                prefix_error();
+                fprintf( stderr, "Could not write horizon file '%s'.\n", horizons_name );
+                exit( EXIT_FAILURE );
+            }
+            if (!error) {
+                horizons = map_horizon_map( horizons_name, data, nrows, ncols, xres, yres, 0, 0 );
+            }
+        }
+        if (!horizons) {
+            error = TERRAIN_FILTER_MALLOC_ERROR;
+        }
+    } else if (summed) {
+        z_max = grid_max( data, nrows, ncols );
+        // without memory for the pyramid, every step is checked
+        pyramid = create_max_pyramid( data, nrows, ncols, pool );
     }
 
-    double zval;
-    double x;
-    double y;
-    int lit;
-    int x_int;
-    int y_int;
-    int xp_int;
-    int yp_int;
-    int i_smooth=4;
+    for (frame=0; frame<num_suns && !error; ++frame) {
+        sun_az = suns[2*frame];
+        sun_el = suns[2*frame+1];
+
+        // printf(
+        //     "Processing %d column x %d row array using sun_az = %f, sun_el = %f...\n",
+        //     ncols, nrows, sun_az, sun_el );
+        fflush( stdout );
 
-    double const_deg_m=111132;
+        double csa=cos(deg2rad(sun_az));
+        double ssa=sin(deg2rad(sun_az));
 
-    double csa=cos(deg2rad(sun_az));
-    double ssa=sin(deg2rad(sun_az));
+        double num_az= deg2rad(fix_azimuth(sun_az, xdim, ydim));
+        // fprintf(stderr, "xdim=%f, ydim=%f, sun_az=%f, fixed sun look angle=%f\n", xdim, ydim, sun_az, fix_azimuth(sun_az+180, xdim, ydim));
+        double num_el= deg2rad(sun_el);
+        double sun_x = sin(num_az)*cos(num_el);
+        double sun_y = -cos(num_az)*cos(num_el);
+        double sun_z = sin(num_el)*sqrt(ydim*ydim*csa*csa+xdim*xdim*ssa*ssa);
 
-    double num_az= deg2rad(fix_azimuth(sun_az, xdim, ydim));
-    // fprintf(stderr, "xdim=%f, ydim=%f, sun_az=%f, fixed sun look angle=%f\n", xdim, ydim, sun_az, fix_azimuth(sun_az+180, xdim, ydim));
-    double num_el= deg2rad(sun_el);
-    double sun_x = sin(num_az)*cos(num_el);
-    double sun_y = -cos(num_az)*cos(num_el);
-    double sun_z = sin(num_el)*sqrt(ydim*ydim*csa*csa+xdim*xdim*ssa*ssa);
-    double xp;
-    double yp;
+        // fprintf(stderr, "xdim=%f, ydim=%f, sun_x=%f, sun_y=%f, sun_z=%f\n", xdim, ydim, sun_x, sun_y, sun_z);
 
-    // fprintf(stderr, "zmax=%f, xdim=%f, ydim=%f, sun_x=%f, sun_y=%f, sun_z=%f\n", z_max, xdim, ydim, sun_x, sun_y, sun_z);
+        // Shadow algorithm
 
-    double val;
-    double this_z;
-    float *ptr2;
-    float *ptr3;
-    int j;
-    int i;
-    int runcount;
-    int i_set;
-    int j_set;
+        if (horizons) {
+            horizon_map_shadow( horizons, sun_az, sun_el, shadowarray2, pool );
+        } else if (summed) {
+            cast_shadows_summed(
+                data, shadowarray2, nrows, ncols, z_max, pyramid, sun_x, sun_y, sun_z, pool );
+        } else if (cast_shadows_sweep( data, shadowarray2, nrows, ncols, sun_x, sun_y, sun_z, pool )) {
+            error = TERRAIN_FILTER_MALLOC_ERROR;
+            break;
+        }
 
-    // Shadow algorithm
+        // if (lat1 != lat2) {
+        //     fix_mercator( data, detail, nrows, ncols, lat1, lat2 );
+        // }
 
-    for(int i=0;i<nrows;i++) {
-      ptr = data + (LONG)i * (LONG)ncols;
-      ptr2 = shadowarray2 + (LONG)i * (LONG)ncols;
-      for(int j=0;j<ncols;j++) {
-        x=j;
-        y=i;
-        zval=ptr[j];   // dataarray[row][column]
-        lit=0;
-        x_int=x;
-        y_int=y;
+        output = shadowarray2;
+        if (remap) {
+            // printf( "Resampling back to geographic coordinates...\n" );
 
-        while(x_int > 0 && x_int < ncols && y_int > 0 && y_int < nrows && zval <= z_max) {
-          ptr3 = data + (LONG)y_int * (LONG)ncols;
-          if (zval < ptr3[x_int]) {
-            lit=lit+(ptr3[x_int]-zval);  // Sum the height above the sun line
-          }
-          x=x+sun_x;
-          y=y+sun_y;
-          zval=zval+sun_z;
-          x_int=(int) x;
-          y_int=(int) y;
+            if (mercator_remap_pool(
+                    shadowarray2, remapped, nrows, nrows, ncols, lat1, lat2, MERCATOR_TO_GEOGRAPHIC, pool ))
+            {
+                prefix_error();
+                fprintf( stderr, "Memory allocation error occurred.\n" );
+                exit( EXIT_FAILURE );
+            }
+            output = remapped;
         }
-        if (lit==0) {
-          ptr2[j]=0;
-        } else {
-          ptr2[j]=log(lit);  // Use the natural logarithm of the total shading volume
+
+        // Write .flt and .hdr files:
+
+        if (batch) {
+            free( out_dat_name );
+            free( out_hdr_name );
+            free( out_prj_name );
+            frame_name = frame_basename( out_arg, frame, num_suns );
+            get_filenames( frame_name, &out_dat_name, &out_hdr_name, &out_prj_name, extension );
+            free( frame_name );
+            printf( "Frame %d: sun_az = %.3f, sun_el = %.3f -> %s\n", frame, sun_az, sun_el, out_dat_name );
         }
-      }
+
+        // printf( "Writing output files...\n" );
+        fflush( stdout );
+
+        out_hdr_file = fopen( out_hdr_name, "wb" ); // use binary mode for compatibility
+        if (!out_hdr_file) {
+            prefix_error();
+            fprintf( stderr, "Could not open output file '%s'.\n", out_hdr_name );
+            exit( EXIT_FAILURE );
+        }
+
+        out_dat_file = fopen( out_dat_name, "wb" );
+        if (!out_dat_file) {
+            prefix_error();
+            fprintf( stderr, "Could not open output file '%s'.\n", out_dat_name );
+            exit( EXIT_FAILURE );
+        }
+
+        write_flt_hdr_files(
+            out_dat_file, out_hdr_file, nrows, ncols, xmin, xmax, ymin, ymax, output, software );
+
+        fclose( out_dat_file );
+        fclose( out_hdr_file );
+
+        // Copy optional .prj file:
+
+        copy_prj_to( in_prj_name, out_prj_name );
     }
 
     if (error) {
@@ -696,42 +1474,20 @@ int main( int argc, const char *argv[] )
         exit( EXIT_FAILURE );
     }
 
-    // if (lat1 != lat2) {
-    //     fix_mercator( data, detail, nrows, ncols, lat1, lat2 );
-    // }
-
-    // Write .flt and .hdr files:
-
-    // printf( "Writing output files...\n" );
-    fflush( stdout );
+    destroy_thread_pool( pool );
+    free_horizon_map( horizons );
+    free_max_pyramid( pyramid );
 
-    write_flt_hdr_files(
-        out_dat_file, out_hdr_file, nrows, ncols, xmin, xmax, ymin, ymax, shadowarray2, software );
+    free( shadowarray2 );
+    free( remapped );
+    free( suns );
 
-    fclose( out_dat_file );
-    fclose( out_hdr_file );
-
-    free( data );
+    free_flt_data( data, nrows, ncols, in_mapped );
     free( software );
 
-    // Copy optional .prj file:
-
-    in_prj_file = fopen( in_prj_name, "rb" );   // use binary mode for compatibility
-    if (in_prj_file) {
-        out_prj_file = fopen( out_prj_name, "wb" ); // use binary mode for compatibility
-        if (!out_prj_file) {
-            fprintf( stderr, "*** WARNING: " );
-            fprintf( stderr, "Could not open output file '%s'.\n", out_prj_name );
-        } else {
-            // copy file and change any "ZUNITS" line to "ZUNITS NO"
-            copy_prj_file( in_prj_file, out_prj_file );
-
-            fclose( out_prj_file );
-        }
-        fclose( in_prj_file );
-    }
-
     free( in_prj_name );
+    free( out_dat_name );
+    free( out_hdr_name );
     free( out_prj_name );
 
     // printf( "DONE.\n" );
@@ -0,0 +1,113 @@
+/*
+ * solar_position.c
+ *
+ * Apparent position of the sun in the sky at a given time and place.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+#define _USE_MATH_DEFINES
+
+#include "solar_position.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+#   define M_PI 3.14159265358979323846
+#endif
+
+#define deg2rad(angleDegrees) ((angleDegrees) * M_PI / 180.0)
+#define rad2deg(angleRadians) ((angleRadians) * 180.0 / M_PI)
+
+double julian_date(
+    int    year,
+    int    month,       // 1 to 12
+    int    day,         // 1 to 31
+    double hours        // hours since midnight UTC (may include minutes and seconds)
+)
+{
+    int a, b;
+
+    // count January and February as months 13 and 14 of the previous year
+    if (month <= 2) {
+        year  -= 1;
+        month += 12;
+    }
+    a = year / 100;
+    b = 2 - a + a / 4;  // Gregorian correction
+
+    return floor( 365.25 * (year + 4716) ) + floor( 30.6001 * (month + 1) ) +
+        day + b - 1524.5 + hours / 24.0;
+}
+
+int parse_utc_time( const char *text, double *jd )
+{
+    int    year, month, day, hour, minute;
+    double second;
+    int    used;
+    int    len = (int)strlen( text );
+
+    // each form must match the whole text, with nothing left over
+    used = -1;
+    if (sscanf( text, "%d-%d-%dT%d:%d:%lf%n",
+                &year, &month, &day, &hour, &minute, &second, &used ) != 6 || used != len)
+    {
+        second = 0.0;
+        used = -1;
+        if (sscanf( text, "%d-%d-%dT%d:%d%n",
+                    &year, &month, &day, &hour, &minute, &used ) != 5 || used != len)
+        {
+            hour   = 0;
+            minute = 0;
+            used = -1;
+            if (sscanf( text, "%d-%d-%d%n", &year, &month, &day, &used ) != 3 || used != len) {
+                return 0;
+            }
+        }
+    }
+    if (month < 1 || month > 12 || day < 1 || day > 31 ||
+        hour < 0 || hour > 24 || minute < 0 || minute >= 60 || second < 0.0 || second >= 61.0)
+    {
+        return 0;
+    }
+
+    *jd = julian_date( year, month, day, hour + minute / 60.0 + second / 3600.0 );
+    return 1;
+}
+
+void solar_position(
+    double jd,          // input: Julian date (UTC)
+    double lat,         // input: latitude  of observer in degrees (north positive)
+    double lon,         // input: longitude of observer in degrees (east  positive)
+    double *azimuth,    // output: azimuth of sun, degrees clockwise from north (0 to 360)
+    double *elevation   // output: elevation of sun above the horizon in degrees
+)
+{
+    double n = jd - 2451545.0;  // days since J2000.0
+
+    double mean_lon  = fmod( 280.460 + 0.9856474 * n, 360.0 );
+    double anomaly   = deg2rad(fmod( 357.528 + 0.9856003 * n, 360.0 ));
+    double ecl_lon   = deg2rad(mean_lon + 1.915 * sin( anomaly ) + 0.020 * sin( 2.0 * anomaly ));
+    double obliquity = deg2rad(23.439 - 0.0000004 * n);
+
+    double right_asc   = atan2( cos( obliquity ) * sin( ecl_lon ), cos( ecl_lon ) );
+    double declination = asin( sin( obliquity ) * sin( ecl_lon ) );
+
+    // Greenwich mean sidereal time, then local hour angle of the sun
+    double sidereal = fmod( 280.46061837 + 360.98564736629 * n, 360.0 );
+    double hour_ang = deg2rad(sidereal + lon) - right_asc;
+
+    double phi = deg2rad(lat);
+    double az;
+
+    *elevation = rad2deg(asin(
+        sin( phi ) * sin( declination ) + cos( phi ) * cos( declination ) * cos( hour_ang ) ));
+
+    az = rad2deg(atan2(
+        -sin( hour_ang ), tan( declination ) * cos( phi ) - sin( phi ) * cos( hour_ang ) ));
+    *azimuth = az < 0.0 ? az + 360.0 : az;
+}
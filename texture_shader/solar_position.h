@@ -0,0 +1,48 @@
+/*
+ * solar_position.h
+ *
+ * Apparent position of the sun in the sky at a given time and place.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+//
+// Uses the low-precision solar coordinates of the Astronomical Almanac (good to
+// about 0.01 degree from 1950 to 2050, and still well under 0.1 degree for some
+// centuries around that), which is ample for shading terrain. Atmospheric
+// refraction is ignored, so the sun appears up to 0.6 degree lower than it does
+// near the horizon.
+//
+
+#ifndef SOLAR_POSITION_H
+#define SOLAR_POSITION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns Julian date of a UTC date and time (Gregorian calendar).
+double julian_date(
+    int    year,
+    int    month,       // 1 to 12
+    int    day,         // 1 to 31
+    double hours        // hours since midnight UTC (may include minutes and seconds)
+);
+
+// Returns nonzero if text is a UTC date and time of the form YYYY-MM-DDTHH:MM[:SS]
+// (or YYYY-MM-DD for midnight), and sets *jd to its Julian date.
+int parse_utc_time( const char *text, double *jd );
+
+void solar_position(
+    double jd,          // input: Julian date (UTC)
+    double lat,         // input: latitude  of observer in degrees (north positive)
+    double lon,         // input: longitude of observer in degrees (east  positive)
+    double *azimuth,    // output: azimuth of sun, degrees clockwise from north (0 to 360)
+    double *elevation   // output: elevation of sun above the horizon in degrees
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,314 @@
+/*
+ * spectrum_cache.c
+ *
+ * Files holding DCT spectra from terrain_filter_spectrum(), for reuse by later runs.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "spectrum_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#   include <unistd.h>      // getpid()
+#   include <sys/types.h>
+#   include <sys/stat.h>    // fstat()
+#   include <sys/mman.h>    // mmap()
+#   define HAVE_MMAP 1
+#else
+#   define HAVE_MMAP 0
+#endif
+
+// File header: magic, hash, nrows, ncols, data_min, data_max, float check value;
+// padded so the spectrum is aligned for vector loads.
+#define HEADER_SIZE 64
+
+static const char   cache_magic[8]    = { 'T', 'X', 'S', 'P', 'E', 'C', '0', '1' };
+static const float  cache_float_check = -1.0f / 3.0f;
+
+// Hash of data in 64-bit words, four independent lanes at a time
+// (same round and final mix as the xxHash64 algorithm).
+
+static const unsigned long long hash_prime1 = 0x9E3779B185EBCA87ULL;
+static const unsigned long long hash_prime2 = 0xC2B2AE3D27D4EB4FULL;
+static const unsigned long long hash_prime3 = 0x165667B19E3779F9ULL;
+
+static unsigned long long hash_round( unsigned long long acc, unsigned long long word )
+{
+    acc += word * hash_prime2;
+    acc  = (acc << 31) | (acc >> 33);
+    return acc * hash_prime1;
+}
+
+static unsigned long long hash_bytes( unsigned long long acc, const void *bytes, size_t size )
+{
+    const char *ptr = (const char *)bytes;
+    unsigned long long lane[4];
+    unsigned long long word;
+    size_t i, nwords = size / 8;
+    int k;
+
+    for (k=0; k<4; ++k) {
+        lane[k] = acc + (unsigned long long)k * hash_prime1;
+    }
+    for (i=0; i+4<=nwords; i+=4) {
+        for (k=0; k<4; ++k) {
+            memcpy( &word, ptr + (i+k) * 8, 8 );
+            lane[k] = hash_round( lane[k], word );
+        }
+    }
+    for (; i<nwords; ++i) {
+        memcpy( &word, ptr + i * 8, 8 );
+        lane[0] = hash_round( lane[0], word );
+    }
+    for (i=nwords*8; i<size; ++i) {
+        lane[1] = hash_round( lane[1], (unsigned char)ptr[i] );
+    }
+
+    acc = (unsigned long long)size;
+    for (k=0; k<4; ++k) {
+        acc = hash_round( acc, lane[k] );
+    }
+    return acc;
+}
+
+unsigned long long spectrum_hash(
+    const float *data,  // input: array of data (row-major order)
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xdim,        // input: spacing between pixel columns
+    double ydim,        // input: spacing between pixel rows
+    int    coord_type,  // input: enum Terrain_Coord_Type
+    int    dct_backend  // input: enum Dct_Backend used for the spectrum
+)
+{
+    unsigned long long hash;
+    int    ints[4];
+    double dims[2];
+
+    ints[0] = nrows;
+    ints[1] = ncols;
+    ints[2] = coord_type;
+    ints[3] = dct_backend;
+    dims[0] = xdim;
+    dims[1] = ydim;
+
+    hash = hash_bytes( 0, data, sizeof( float ) * (size_t)nrows * (size_t)ncols );
+    hash = hash_bytes( hash, ints, sizeof( ints ) );
+    hash = hash_bytes( hash, dims, sizeof( dims ) );
+
+    hash ^= hash >> 33;
+    hash *= hash_prime2;
+    hash ^= hash >> 29;
+    hash *= hash_prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+unsigned long long cache_hash(
+    unsigned long long hash,    // input: hash of preceding bytes, or 0
+    const void *bytes,          // input: bytes to hash
+    size_t size                 // input: number of bytes
+)
+{
+    return hash_bytes( hash, bytes, size );
+}
+
+char *spectrum_cache_name(
+    const char *dir,            // input: cache directory
+    unsigned long long hash     // input: from spectrum_hash()
+)
+{
+    size_t len = strlen( dir );
+    char  *name = (char *)malloc( len + 40 );
+
+    if (name) {
+        if (len > 0 && dir[len-1] != '/' && dir[len-1] != '\\') {
+            sprintf( name, "%s/texture_%016llx.spectrum", dir, hash );
+        } else {
+            sprintf( name, "%stexture_%016llx.spectrum", dir, hash );
+        }
+    }
+    return name;
+}
+
+static void fill_header(
+    char *header, int nrows, int ncols, unsigned long long hash, float data_min, float data_max )
+{
+    int ints[2];
+
+    ints[0] = nrows;
+    ints[1] = ncols;
+
+    memset( header, 0, HEADER_SIZE );
+    memcpy( header,      cache_magic,        8 );
+    memcpy( header +  8, &hash,              8 );
+    memcpy( header + 16, ints,               8 );
+    memcpy( header + 24, &data_min,          4 );
+    memcpy( header + 28, &data_max,          4 );
+    memcpy( header + 32, &cache_float_check, 4 );
+}
+
+static int check_header(
+    const char *header, int nrows, int ncols, unsigned long long hash,
+    float *data_min, float *data_max )
+// Returns nonzero if header matches (except data range, which it returns).
+{
+    char expected[HEADER_SIZE];
+
+    fill_header( expected, nrows, ncols, hash, 0.0f, 0.0f );
+
+    if (memcmp( header, expected, 24 ) != 0 ||
+        memcmp( header + 32, expected + 32, HEADER_SIZE - 32 ) != 0)
+    {
+        return 0;
+    }
+    memcpy( data_min, header + 24, 4 );
+    memcpy( data_max, header + 28, 4 );
+    return 1;
+}
+
+float *map_spectrum_cache(
+    const char *filename,       // input: from spectrum_cache_name()
+    int    nrows,               // input: number of rows    in data array
+    int    ncols,               // input: number of columns in data array
+    unsigned long long hash,    // input: from spectrum_hash()
+    float *data_min,            // output: minimum value of input data
+    float *data_max,            // output: maximum value of input data
+    int   *mapped               // output: nonzero if spectrum is mapped from file
+)
+{
+    size_t size = HEADER_SIZE + sizeof( float ) * (size_t)nrows * (size_t)ncols;
+    char  *buffer;
+    FILE  *file;
+
+    *mapped = 0;
+
+    file = fopen( filename, "rb" );
+    if (!file) {
+        return NULL;
+    }
+
+#if HAVE_MMAP
+    {
+        struct stat info;
+
+        if (fstat( fileno( file ), &info ) || !S_ISREG( info.st_mode ) ||
+            (size_t)info.st_size != size)
+        {
+            fclose( file );
+            return NULL;
+        }
+
+        buffer = (char *)mmap( NULL, size, PROT_READ, MAP_SHARED, fileno( file ), 0 );
+        if (buffer != (char *)MAP_FAILED) {
+            fclose( file );     // mapping remains valid
+
+            if (!check_header( buffer, nrows, ncols, hash, data_min, data_max )) {
+                munmap( buffer, size );
+                return NULL;
+            }
+            *mapped = 1;
+            return (float *)(buffer + HEADER_SIZE);
+        }
+    }
+#endif
+
+    // no mapping - read file into memory (keeping the same layout)
+    buffer = (char *)malloc( size );
+    if (!buffer) {
+        fclose( file );
+        return NULL;
+    }
+    if (fread( buffer, 1, size, file ) != size || fgetc( file ) != EOF ||
+        !check_header( buffer, nrows, ncols, hash, data_min, data_max ))
+    {
+        free( buffer );
+        fclose( file );
+        return NULL;
+    }
+    fclose( file );
+
+    return (float *)(buffer + HEADER_SIZE);
+}
+
+void free_spectrum_cache(
+    float *spectrum,            // input: from map_spectrum_cache()
+    int    nrows,               // input: number of rows    in data array
+    int    ncols,               // input: number of columns in data array
+    int    mapped               // input: from map_spectrum_cache()
+)
+{
+    char *buffer = (char *)spectrum - HEADER_SIZE;
+
+#if HAVE_MMAP
+    if (mapped) {
+        munmap( buffer, HEADER_SIZE + sizeof( float ) * (size_t)nrows * (size_t)ncols );
+        return;
+    }
+#endif
+    free( buffer );
+}
+
+int write_spectrum_cache(
+    const char  *filename,      // input: from spectrum_cache_name()
+    const float *spectrum,      // input: from terrain_filter_spectrum()
+    int    nrows,               // input: number of rows    in data array
+    int    ncols,               // input: number of columns in data array
+    unsigned long long hash,    // input: from spectrum_hash()
+    float  data_min,            // input: from terrain_filter_spectrum()
+    float  data_max             // input: from terrain_filter_spectrum()
+)
+{
+    size_t count = (size_t)nrows * (size_t)ncols;
+    char   header[HEADER_SIZE];
+    char  *temp_name;
+    FILE  *file;
+    int    error;
+
+    // write to a temporary file first, so other processes
+    // reading the same cache never see a partial file
+    temp_name = (char *)malloc( strlen( filename ) + 32 );
+    if (!temp_name) {
+        return 1;
+    }
+#if HAVE_MMAP
+    sprintf( temp_name, "%s.%ld.tmp", filename, (long)getpid() );
+#else
+    sprintf( temp_name, "%s.tmp", filename );
+#endif
+
+    file = fopen( temp_name, "wb" );
+    if (!file) {
+        free( temp_name );
+        return 1;
+    }
+
+    fill_header( header, nrows, ncols, hash, data_min, data_max );
+
+    error =
+        fwrite( header,   1,               HEADER_SIZE, file ) != HEADER_SIZE ||
+        fwrite( spectrum, sizeof( float ), count,       file ) != count;
+    error = fclose( file ) || error;
+
+#ifdef _WIN32
+    if (!error) {
+        remove( filename );     // rename() does not replace existing files
+    }
+#endif
+    if (!error) {
+        error = rename( temp_name, filename ) != 0;
+    }
+    if (error) {
+        remove( temp_name );
+    }
+    free( temp_name );
+
+    return error;
+}
@@ -0,0 +1,87 @@
+/*
+ * spectrum_cache.h
+ *
+ * Files holding DCT spectra from terrain_filter_spectrum(), for reuse by later runs.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+//
+// A cache file holds a short header followed by the nrows x ncols spectrum in native
+// float format, so it can be memory-mapped and passed directly to
+// terrain_filter_from_spectrum(). Files are named by a hash of the input data and of
+// the parameters the spectrum depends on; a file with a matching name and header is
+// assumed to hold the right spectrum. Files are never deleted automatically.
+//
+
+#ifndef SPECTRUM_CACHE_H
+#define SPECTRUM_CACHE_H
+
+#include <stddef.h> // for size_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns hash identifying the spectrum of data.
+unsigned long long spectrum_hash(
+    const float *data,  // input: array of data (row-major order)
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xdim,        // input: spacing between pixel columns
+    double ydim,        // input: spacing between pixel rows
+    int    coord_type,  // input: enum Terrain_Coord_Type
+    int    dct_backend  // input: enum Dct_Backend used for the spectrum
+);
+
+// Returns hash of size bytes, continuing from hash of preceding bytes (or 0);
+// for other cache files keyed by their input data.
+unsigned long long cache_hash(
+    unsigned long long hash,    // input: hash of preceding bytes, or 0
+    const void *bytes,          // input: bytes to hash
+    size_t size                 // input: number of bytes
+);
+
+// Returns name of cache file for hash in directory dir, or NULL if out of memory.
+// NOTE: caller is responsible to free returned pointer!
+char *spectrum_cache_name(
+    const char *dir,            // input: cache directory
+    unsigned long long hash     // input: from spectrum_hash()
+);
+
+// Returns read-only spectrum from cache file, or NULL if the file does not exist
+// or does not match; pass it to free_spectrum_cache() when done.
+float *map_spectrum_cache(
+    const char *filename,       // input: from spectrum_cache_name()
+    int    nrows,               // input: number of rows    in data array
+    int    ncols,               // input: number of columns in data array
+    unsigned long long hash,    // input: from spectrum_hash()
+    float *data_min,            // output: minimum value of input data
+    float *data_max,            // output: maximum value of input data
+    int   *mapped               // output: nonzero if spectrum is mapped from file
+);
+
+void free_spectrum_cache(
+    float *spectrum,            // input: from map_spectrum_cache()
+    int    nrows,               // input: number of rows    in data array
+    int    ncols,               // input: number of columns in data array
+    int    mapped               // input: from map_spectrum_cache()
+);
+
+// Writes spectrum to cache file (replacing it atomically if it exists).
+// Returns 0 on success, nonzero if the file could not be written.
+int write_spectrum_cache(
+    const char  *filename,      // input: from spectrum_cache_name()
+    const float *spectrum,      // input: from terrain_filter_spectrum()
+    int    nrows,               // input: number of rows    in data array
+    int    ncols,               // input: number of columns in data array
+    unsigned long long hash,    // input: from spectrum_hash()
+    float  data_min,            // input: from terrain_filter_spectrum()
+    float  data_max             // input: from terrain_filter_spectrum()
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
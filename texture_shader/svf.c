@@ -43,6 +43,9 @@
 #include <math.h>
 #include <assert.h>
 #include "terrain_filter.h"
+#include "mercator_remap.h"
+#include "thread_pool.h"
+#include "horizon_map.h"
 
 #define LONG ptrdiff_t
 
@@ -112,9 +115,33 @@ static void usage_exit( const char *message )
     fprintf( stderr, "Input and output filenames must not be the same.\n" );
     fprintf( stderr, "NOTE: Output files will be overwritten if they already exist.\n" );
     fprintf( stderr, "\n" );
-    fprintf( stderr, "Available option:\n" );
+    fprintf( stderr, "Available options:\n" );
     fprintf( stderr, "    -mercator lat1 lat2    " );
     fprintf( stderr, "input is in normal Mercator projection (not UTM)\n" );
+    fprintf( stderr, "    -remap                 " );
+    fprintf( stderr, "input is geographic; process it in Mercator projection\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "internally and write output on the input grid\n" );
+    fprintf( stderr, "    -threads n             " );
+    fprintf( stderr, "use n worker threads (default: number of processors)\n" );
+    fprintf( stderr, "    -rays                  " );
+    fprintf( stderr, "search for horizons only within 10 pixels along rays\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "(original algorithm) instead of over the whole grid\n" );
+    fprintf( stderr, "    -measure name          " );
+    fprintf( stderr, "output sine (mean sine of horizon angles, default),\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "skyview (sky view factor), openness, negopenness\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "(positive/negative openness, degrees), or ambient\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "(ambient occlusion); not with -rays\n" );
+    fprintf( stderr, "    -horizons file         " );
+    fprintf( stderr, "read horizon angles from file if it matches the input,\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "otherwise compute them and save them in file for reuse\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "(e.g. by shadow -horizons); not with -rays\n" );
     fprintf( stderr, "Values lat1 and lat2 must be in decimal degrees.\n" );
     fprintf( stderr, "\n" );
     exit( EXIT_FAILURE );
@@ -259,6 +286,175 @@ static double fix_azimuth(double az, double xdim, double ydim )
   return val;
 }
 
+// Sky view factor: for each pixel, finds the highest elevation angle to the terrain
+// within dist_cutoff steps along each of num_angles azimuths, and averages the sines.
+// The steps along each azimuth are the same for every pixel, so their pixel offsets
+// and distances are tabulated once per azimuth. Elevation angle increases with slope,
+// so rays track the steepest slope and take its angle only once at the end.
+// Every pixel is independent, so small blocks of rows are handed out to threads as
+// they become free.
+
+// steps along each ray (the original dist_cutoff of 10, and the step that reaches it)
+#define SVF_RAY_STEPS 11
+
+struct Svf_State {
+    const float *data;
+    float  *skyview;
+    int     nrows;
+    int     ncols;
+    int     num_angles;
+    const int    *step_x;   // column offset of each step, SVF_RAY_STEPS per azimuth
+    const int    *step_y;   // row    offset of each step, SVF_RAY_STEPS per azimuth
+    const double *step_d;   // distance       of each step, SVF_RAY_STEPS per azimuth
+    double  min_slope;      // horizons at or below this slope are not counted
+};
+
+static void svf_rows( long first, long last, int worker, void *state )
+{
+    const struct Svf_State *s = (const struct Svf_State *)state;
+
+    const float *data = s->data;
+    int    nrows = s->nrows;
+    int    ncols = s->ncols;
+    int    num_angles = s->num_angles;
+
+    const float *ptr;
+    float *ptr2;
+    const int    *step_x;
+    const int    *step_y;
+    const double *step_d;
+
+    long i;
+    int j;
+
+    int a;
+    int d;
+    double base_zval;
+    double slope;
+    double high_slope;
+    double high_sum;
+    int x_int;
+    int y_int;
+    int high_angle_count;
+
+    (void)worker;
+
+    for(i=first;i<last;i++) {
+      ptr = data + (LONG)i * (LONG)ncols;
+      ptr2 = s->skyview + (LONG)i * (LONG)ncols;
+      for(j=0;j<ncols;j++) {
+        base_zval=ptr[j];
+        high_sum=0;
+        high_angle_count=0;
+        for(a=0;a<num_angles;a++) {
+          step_x=s->step_x + a*SVF_RAY_STEPS;
+          step_y=s->step_y + a*SVF_RAY_STEPS;
+          step_d=s->step_d + a*SVF_RAY_STEPS;
+          high_slope=-HUGE_VAL;
+          x_int=j;
+          y_int=(int)i;
+
+          // as originally, a ray ends after reaching the first row or column
+          for(d=0; d<SVF_RAY_STEPS && x_int > 0 && y_int > 0; d++) {
+            x_int=j + step_x[d];
+            y_int=(int)i + step_y[d];
+            if (x_int < 0 || y_int < 0 || x_int >= ncols || y_int >= nrows) {
+              break;
+            }
+            // NaN (void) elevations never compare greater
+            slope=(data[(LONG)y_int * (LONG)ncols + x_int]-base_zval)/step_d[d];
+            if (slope > high_slope) {
+              high_slope = slope;
+            }
+          }
+          if (high_slope > s->min_slope) {
+            high_angle_count++;
+            high_sum=high_sum+sin(atan(high_slope));
+          }
+        }
+        // pixels with no horizon counted (voids) are set to NaN (0/0)
+        ptr2[j]=((high_sum)/high_angle_count);
+      }
+    }
+}
+
+static int sky_view_factor(
+    const float *data,  // input: array of elevations (row-major order)
+    float *skyview,     // output: array of sky view factor values
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    int    num_angles,  // input: number of azimuths to search
+    double xdim,        // input: spacing between pixel columns
+    double ydim,        // input: spacing between pixel rows
+    int    num_threads  // input: number of threads to use (0 = default)
+)
+// Returns 0 on success, nonzero if a memory allocation error occurred.
+{
+    struct Svf_State state;
+    struct Thread_Pool *pool = NULL;
+
+    int    *step_x;
+    int    *step_y;
+    double *step_d;
+    double this_angle;
+    double ang_x;
+    double ang_y;
+    double ang_d;
+    int    a, d;
+
+    step_x = (int *)malloc( (size_t)num_angles * SVF_RAY_STEPS * sizeof( int ) );
+    step_y = (int *)malloc( (size_t)num_angles * SVF_RAY_STEPS * sizeof( int ) );
+    step_d = (double *)malloc( (size_t)num_angles * SVF_RAY_STEPS * sizeof( double ) );
+    if (!step_x || !step_y || !step_d) {
+        free( step_x );
+        free( step_y );
+        free( step_d );
+        return 1;
+    }
+
+    for (a=0; a<num_angles; ++a) {
+        this_angle = deg2rad(fix_azimuth(a*360/num_angles, xdim, ydim)); // Fix azimuth
+        ang_x = sin( this_angle );
+        ang_y = cos( this_angle );
+        ang_d = sqrt( xdim*xdim*ang_x*ang_x + ydim*ydim*ang_y*ang_y );
+        for (d=0; d<SVF_RAY_STEPS; ++d) {
+            // rounding errors in sin() and cos() must not move rays along
+            // rows or columns into the neighboring row or column
+            step_x[a*SVF_RAY_STEPS+d] = (int)floor( (d+1)*ang_x + 1e-9 );
+            step_y[a*SVF_RAY_STEPS+d] = (int)floor( (d+1)*ang_y + 1e-9 );
+            step_d[a*SVF_RAY_STEPS+d] = (d+1)*ang_d;
+        }
+    }
+
+    state.data       = data;
+    state.skyview    = skyview;
+    state.nrows      = nrows;
+    state.ncols      = ncols;
+    state.num_angles = num_angles;
+    state.step_x     = step_x;
+    state.step_y     = step_y;
+    state.step_d     = step_d;
+    state.min_slope  = tan( deg2rad(-70) );
+
+    if (num_threads <= 0) {
+        num_threads = default_thread_count();
+    }
+    if (num_threads > 1) {
+        // if threads cannot be created, fall back to single-threaded processing
+        pool = create_thread_pool( num_threads );
+    }
+
+    run_thread_pool( pool, nrows, 4, svf_rows, &state, NULL );
+
+    destroy_thread_pool( pool );
+
+    free( step_x );
+    free( step_y );
+    free( step_d );
+
+    return 0;
+}
+
 #ifndef NOMAIN
 
 int main( int argc, const char *argv[] )
@@ -307,11 +503,23 @@ int main( int argc, const char *argv[] )
     int proj_type;
     int has_nulls;
     int all_ints;
+    float data_min, data_max;
+    int in_mapped;
 
     double lat1 = 0.0;  // default unless -merc option used
     double lat2 = 0.0;  // default unless -merc option used
     double center_lat;
     double temp;
+    int    remap = 0;
+    float *remapped;
+    int    num_threads = 0;    // default
+    long   count;
+    int    rays = 0;
+    enum Horizon_Measure measure = HORIZON_MEAN_SINE;
+    const char *horizons_name = NULL;
+    struct Horizon_Map *horizons;
+    double xres, yres;
+    double xsize, ysize;
     // float *ptr;
 
     int error;
@@ -396,6 +604,43 @@ int main( int argc, const char *argv[] )
             if (lat1 <= -90.0 || lat2 >= 90.0) {
                 usage_exit( "Mercator latitude limits must be between -90 and +90 (exclusive)." );
             }
+        } else if (strncmp( thisarg, "remap", 5 ) == 0) {
+            remap = 1;
+        } else if (strncmp( thisarg, "threads", 6 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -threads must be followed by a positive integer." );
+            }
+            thisarg = argv[argnum++];
+            count = strtol( thisarg, &endptr, 10 );
+            if (endptr == thisarg || *endptr != '\0' || count < 1 || count > 1024) {
+                usage_exit( "Option -threads must be followed by a positive integer." );
+            }
+            num_threads = (int)count;
+        } else if (strncmp( thisarg, "rays", 4 ) == 0) {
+            rays = 1;
+        } else if (strncmp( thisarg, "measure", 4 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -measure must be followed by a measure name." );
+            }
+            thisarg = argv[argnum++];
+            if (strcmp( thisarg, "sine" ) == 0) {
+                measure = HORIZON_MEAN_SINE;
+            } else if (strcmp( thisarg, "skyview" ) == 0) {
+                measure = HORIZON_SKY_VIEW;
+            } else if (strcmp( thisarg, "openness" ) == 0) {
+                measure = HORIZON_OPENNESS;
+            } else if (strcmp( thisarg, "negopenness" ) == 0) {
+                measure = HORIZON_NEGATIVE_OPENNESS;
+            } else if (strcmp( thisarg, "ambient" ) == 0) {
+                measure = HORIZON_AMBIENT;
+            } else {
+                usage_exit( "Option -measure must be followed by sine, skyview, openness, negopenness, or ambient." );
+            }
+        } else if (strncmp( thisarg, "horizons", 7 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -horizons must be followed by a filename." );
+            }
+            horizons_name = argv[argnum++];
         } else if (strncmp( thisarg, "cellreg", 4 ) == 0 ||
                    strncmp( thisarg, "corner",  6 ) == 0)
         {
@@ -415,6 +660,10 @@ int main( int argc, const char *argv[] )
         }
     }
 
+    if (rays && (measure != HORIZON_MEAN_SINE || horizons_name)) {
+        usage_exit( "Options -measure and -horizons cannot be used with -rays." );
+    }
+
     in_hdr_file = fopen( in_hdr_name, "rb" );   // use binary mode for compatibility
     if (!in_hdr_file) {
         prefix_error();
@@ -454,9 +703,9 @@ int main( int argc, const char *argv[] )
     printf( "Reading input files...\n" );
     fflush( stdout );
 
-    data = read_flt_hdr_files(
+    data = map_flt_hdr_files(
         in_dat_file, in_hdr_file, &nrows, &ncols, &xmin, &xmax, &ymin, &ymax,
-        &has_nulls, &all_ints, 0 );
+        &has_nulls, &all_ints, &data_min, &data_max, &in_mapped, 0 );
 
     fclose( in_dat_file );
     fclose( in_hdr_file );
@@ -515,113 +764,104 @@ int main( int argc, const char *argv[] )
 
     }
 
-    // check pixel aspect ratio and size of map extent
-    check_aspect( xmin, xmax, ymin, ymax, xdim, ydim, proj_type );
-
-    float *skyview = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
-
-    float z_max=-999999;
-
-    float *ptr;
-    float *ptr2;
-    float *ptr3;
+    if (remap) {
+        if (proj_type >= 0) {
+            usage_exit( "Option -remap is only valid for data in geographic coordinates." );
+        }
 
-    double zval;
-    int lit;
-    int xp_int;
-    int yp_int;
-    int i_smooth=4;
+        // the poles themselves cannot be projected (as tectoplot does for -mercator)
+        lat1 = ymin > -89.999 ? ymin : -89.999;
+        lat2 = ymax <  89.999 ? ymax :  89.999;
 
-    double const_deg_m=111132;
+        printf( "Resampling to Mercator projection...\n" );
 
-    double xp;
-    double yp;
+        // same number of rows, equally spaced in northing instead of latitude
+        remapped = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
+        if (!remapped || mercator_remap(
+                data, remapped, nrows, nrows, ncols, lat1, lat2, MERCATOR_FROM_GEOGRAPHIC, num_threads ))
+        {
+            prefix_error();
+            fprintf( stderr, "Memory allocation error occurred.\n" );
+            exit( EXIT_FAILURE );
+        }
+        free_flt_data( data, nrows, ncols, in_mapped );
+        data = remapped;
+        in_mapped = 0;
 
-    int dist_cutoff=10;
-    double high_angles[num_angles];
-    double low_angles[num_angles];
-    double min_skyview=1;
-    double max_skyview=-1;
-    int a;
-    double this_angle;
-    double base_zval;
-    double this_zval;
-    double last_high_el;
-    double last_low_el;
+        // process as if called with -mercator on the resampled grid
+        xdim = (mercator_easting ( xmax ) - mercator_easting ( xmin )) / (double)ncols;
+        ydim = (mercator_northing( lat2 ) - mercator_northing( lat1 )) / (double)nrows;
+        coord_type = TERRAIN_METERS;
+        center_lat = 0.0;
+        proj_type  = 2;
+    }
 
-    double this_el;
-    double ang_x;
-    double ang_y;
-    int d_run;
-    double low_sum;
-    double high_sum;
-    double x;
-    double y;
-    int x_int;
-    int y_int;
-    int high_angle_count;
-    int low_angle_count;
-    double ang_d;
+    // check pixel aspect ratio and size of map extent
+    check_aspect( xmin, xmax, ymin, ymax, xdim, ydim, proj_type );
 
-    for(i=0;i<nrows;i++) {
-      ptr = data + (LONG)i * (LONG)ncols;
-      ptr2 = skyview + (LONG)i * (LONG)ncols;
-      for(j=0;j<ncols;j++) {
-        for(a=0;a<num_angles;a++) {
-          this_angle=deg2rad(fix_azimuth(a*360/num_angles, xdim, ydim)); // Fix azimuth
-          x=j;
-          y=i;
-          base_zval=ptr[j];
-          last_low_el=deg2rad(90);
-          last_high_el=deg2rad(-90);
-          x_int=x;
-          y_int=y;
-          d_run=0;
-          ang_x=sin(this_angle);
-          ang_y=cos(this_angle);
-          ang_d=sqrt(xdim*xdim*ang_x*ang_x+ydim*ydim*ang_y*ang_y);
-
-
-          while(x_int > 0 && x_int < ncols && y_int > 0 && y_int < nrows && d_run <= dist_cutoff) {
-            d_run++;
-            x=x+ang_x;
-            y=y+ang_y;
-            x_int=(int) x;
-            y_int=(int) y;
-            if (x_int < 0 || y_int < 0 || x_int >= ncols | y_int >= nrows) {
-              break;
-            }
-            ptr3 = data + (LONG)y_int * (LONG)ncols;
+    float *skyview = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
+    if (!skyview) {
+        prefix_error();
+        fprintf( stderr, "Insufficient memory for sky view factor data.\n" );
+        exit( EXIT_FAILURE );
+    }
 
-            this_zval=ptr3[x_int];
-            this_el=atan((this_zval-base_zval)/(d_run*ang_d));
-            if (this_el > last_high_el) {
-              last_high_el = this_el;
+    error = 0;
+    if (rays) {
+        if (sky_view_factor( data, skyview, nrows, ncols, num_angles, xdim, ydim, num_threads )) {
+            error = TERRAIN_FILTER_MALLOC_ERROR;
+        }
+    } else {
+        // pixel spacing in meters, as for elevations
+        if (coord_type == TERRAIN_DEGREES) {
+            geographic_scale( center_lat, &xsize, &ysize );
+            xres = xdim * xsize;
+            yres = ydim * ysize;
+        } else if (proj_type == 2) {
+            // Mercator scale at center of map
+            temp = mercator_latitude( 0.5 * (mercator_northing( lat1 ) + mercator_northing( lat2 )) );
+            xres = xdim * cos( deg2rad(temp) );
+            yres = ydim * cos( deg2rad(temp) );
+        } else {
+            xres = xdim;
+            yres = ydim;
+        }
+        if (!horizons_name) {
+            error = horizon_measure(
+                data, nrows, ncols, xres, yres, num_angles, measure, skyview, num_threads );
+        } else {
+            horizons = map_horizon_map(
+                horizons_name, data, nrows, ncols, xres, yres,
+                num_angles, horizon_measure_needs_lower( measure ) );
+            if (!horizons) {
+                printf( "Computing horizons and writing file '%s'...\n", horizons_name );
+                fflush( stdout );
+                error = write_horizon_map(
+                    horizons_name, data, nrows, ncols, xres, yres,
+                    num_angles, horizon_measure_needs_lower( measure ), num_threads );
+                if (error == 2) {
+                    prefix_error();
+                    fprintf( stderr, "Could not write horizon file '%s'.\n", horizons_name );
+                    exit( EXIT_FAILURE );
+                }
+                if (!error) {
+                    horizons = map_horizon_map(
+                        horizons_name, data, nrows, ncols, xres, yres,
+                        num_angles, horizon_measure_needs_lower( measure ) );
+                    error = !horizons;
+                }
+            } else {
+                printf( "Using horizons from file '%s'...\n", horizons_name );
+                fflush( stdout );
             }
-            if (this_el < last_low_el) {
-              last_low_el = this_el;
+            if (!error) {
+                error = horizon_map_measure( horizons, measure, skyview, num_threads );
             }
-          }
-          high_angles[a]=last_high_el;
-          low_angles[a]=last_low_el;
+            free_horizon_map( horizons );
         }
-        high_sum=0;
-        low_sum=0;
-        high_angle_count=0;
-        low_angle_count=0;
-        for(int k=0;k<num_angles;k++) {
-          if (high_angles[k] > deg2rad(-70)) {
-            high_angle_count++;
-            high_sum=high_sum+sin(high_angles[k]);
-          }
-          if (low_angles[k] < deg2rad(70)) {
-            low_angle_count++;
-            low_sum=low_sum+sin(low_angles[k]);
-          }
+        if (error) {
+            error = TERRAIN_FILTER_MALLOC_ERROR;
         }
-        // skyview[i][j]=((high_sum)/high_angle_count + (low_sum)/low_angle_count)/2;
-        ptr2[j]=((high_sum)/high_angle_count);
-      }
     }
 
     if (error) {
@@ -635,6 +875,21 @@ int main( int argc, const char *argv[] )
     //     fix_mercator( data, detail, nrows, ncols, lat1, lat2 );
     // }
 
+    if (remap) {
+        printf( "Resampling back to geographic coordinates...\n" );
+
+        remapped = (float *)malloc( (LONG)nrows * (LONG)ncols * sizeof( float ) );
+        if (!remapped || mercator_remap(
+                skyview, remapped, nrows, nrows, ncols, lat1, lat2, MERCATOR_TO_GEOGRAPHIC, num_threads ))
+        {
+            prefix_error();
+            fprintf( stderr, "Memory allocation error occurred.\n" );
+            exit( EXIT_FAILURE );
+        }
+        free( skyview );
+        skyview = remapped;
+    }
+
     // Write .flt and .hdr files:
 
     printf( "Writing output files...\n" );
@@ -646,7 +901,7 @@ int main( int argc, const char *argv[] )
     fclose( out_dat_file );
     fclose( out_hdr_file );
 
-    free( data );
+    free_flt_data( data, nrows, ncols, in_mapped );
     free( software );
 
     // Copy optional .prj file:
@@ -34,13 +34,14 @@
 
 #include "terrain_filter.h"
 
-#include "transpose_inplace.h"
+#include "thread_pool.h"
 #include "dct.h"
 
 #include "compatibility.h"
 
 #include <stddef.h> // for ptrdiff_t
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 // For a 64-bit compile we need LONG to be 64 bits, even if the compiler uses an LLP64 model
@@ -73,52 +74,6 @@ static double tan_lat_from_isometric( double isolat );
 static double mercator_relscale_from_tan_lat( double tan_lat );
 
 
-void terrain_image_data(
-    float *data,        // input/output: array of data to convert (row-major order)
-    int    nrows,       // input: number of rows    in data array
-    int    ncols,       // input: number of columns in data array
-    double vertical_enhancement,
-                        // input: positive numbers give more contrast in the midrange
-                        //        but less detail in the lightest & darkest areas;
-                        //        negative numbers the opposite
-    double image_min,   // input: minimum value for output pixels
-    double image_max    // input: maximum value for output pixels
-)
-// Converts output of terrain_filter() to grayscale image pixels;
-// selects tone curve based on vertical_enhancement parameter.
-{
-    int i, j;
-    float *ptr;
-
-    double factor;
-    double half_span, image_mean;
-
-    // Transform data values using the requested vertical enhancement:
-
-    factor = pow( 2.0, vertical_enhancement * 0.5 - 1.0 );
-
-    half_span  = 0.5 * (image_max - image_min);
-    image_mean = 0.5 * (image_max + image_min);
-
-    // CONCURRENCY NOTE: The iterations of the loops below will be
-    // independent and can be executed in parallel, if each thread has
-    // its own "ptr" variable initialized as in the comment below.
-    for (i=0, ptr=data; i<nrows; ++i, ptr+=ncols) {
-        //float *ptr = data + (LONG)i * (LONG)ncols;    // for concurrency
-        for (j=0; j<ncols; ++j) {
-            // scale values to set contrast tradeoff
-            double z = ptr[j] * factor;
-
-            // nonlinear mapping to range (-1,1)
-            z = tanh(z);
-
-            // fit to desired range of image pixel values
-            ptr[j] = z * half_span + image_mean;
-        }
-    }
-}
-
-
 static double conformal_lat( double lat )
 {
     // exact formula based on isometric latitude:
@@ -202,6 +157,26 @@ void geographic_scale(
     *ysize *= M_PI/180.0;
 }
 
+double mercator_easting( double londeg )
+// Returns easting in meters of normal Mercator projection for longitude in degrees
+{
+    return equatorial_radius * (M_PI/180.0) * londeg;
+}
+
+double mercator_northing( double latdeg )
+// Returns northing in meters of normal Mercator projection for latitude in degrees
+{
+    return equatorial_radius * isometric_lat( (M_PI/180.0) * latdeg );
+}
+
+double mercator_latitude( double northing )
+// Returns latitude in degrees for northing in meters of normal Mercator projection
+{
+    double tan_lat = tan_lat_from_isometric( northing / equatorial_radius );
+
+    return (180.0/M_PI) * atan( tan_lat );
+}
+
 double geographic_aspect( double latdeg )
 // Determines graticule aspect ratio at given latitude
 {
@@ -427,15 +402,15 @@ void fix_terrain_output(
 
 // How to use the functions setup_operator(), apply_operator(), and cleanup_operator():
 //
-//      float *data;    // transposed array ncols x nrows
+//      float *data;    // column tile in transposed layout (ncols x nrows)
 //
 //      Terrain_Operator_Info info;
-//      int error = setup_operator( detail, ncols, nrows, yscale, registration, &info );
+//      int error = setup_operator( detail, ncols, nrows, yscale, registration, precision, &info );
 //      if (error) {
 //          // handle error here
 //      }
 //      for (int i=0; i<ncols; ++i) {
-//          apply_operator( data, i, nrows, info );
+//          apply_operator( data + (LONG)i * (LONG)nrows, i, nrows, info );
 //      }
 //      cleanup_operator( info );
 //
@@ -452,8 +427,72 @@ struct Terrain_Operator_Info {
     double *yy;
     double  power;
     double  factor;
+    int     m2, n2;     // periods of the symmetric extension (in transposed layout)
+    int     fast;       // nonzero to use fast_log2() and fast_exp2() instead of pow()
+};
+
+// Fast single-precision evaluation for TERRAIN_OPERATOR_FAST:
+// fast_exp2( fast_log2( x ) * p ) has relative error below 3e-6 for 0 <= p <= 1,
+// comparable to the precision of the float data. Evaluated on short vectors
+// (GCC/Clang vector extensions: SSE2 on x86, NEON on ARM) with no branches or tables.
+
+#if defined __GNUC__
+#   define TERRAIN_LANES 4
+typedef float Terrain_VFloat __attribute__(( vector_size( 16 ) ));
+typedef int   Terrain_VInt   __attribute__(( vector_size( 16 ) ));
+#   define TERRAIN_INT_TO_FLOAT( v ) __builtin_convertvector( v, Terrain_VFloat )
+#else
+#   define TERRAIN_LANES 1  // no vector extensions - plain scalar code
+typedef float Terrain_VFloat;
+typedef int   Terrain_VInt;
+#   define TERRAIN_INT_TO_FLOAT( v ) ((float)(v))
+#endif
+
+union Terrain_Vector {
+    Terrain_VFloat f;
+    Terrain_VInt   i;
+    float          lane[TERRAIN_LANES];
 };
 
+static INLINE Terrain_VFloat fast_log2( Terrain_VFloat x )
+// Returns log2(x) for normal x > 0; returns about -127 for x == 0.
+{
+    union Terrain_Vector bits;
+    Terrain_VFloat m, t, t2, t4;
+    Terrain_VInt   e;
+
+    // x = m * 2^e with m in [sqrt(1/2),sqrt(2))
+    bits.f  = x;
+    e       = (bits.i - 0x3F3504F3) >> 23;
+    bits.i -= e << 23;
+    m       = bits.f;
+
+    // log2(m) = 2/ln(2) * atanh(t), t = (m-1)/(m+1), |t| < 0.172
+    t  = (m - 1.0f) / (m + 1.0f);
+    t2 = t * t;
+    t4 = t2 * t2;
+    return TERRAIN_INT_TO_FLOAT( e ) +
+        t * ( (2.88539008f + t2 * 0.961796694f) + t4 * (0.577078016f + t2 * 0.412198583f) );
+}
+
+static INLINE Terrain_VFloat fast_exp2( Terrain_VFloat y )
+// Returns 2^y for -127 <= y < 128 (zero for y == -127).
+{
+    union Terrain_Vector bits, n;
+    Terrain_VFloat f, f2, f4;
+
+    // y = n + f with n = nearest integer (|f| <= 1/2)
+    n.f = y + 12582912.0f;      // 1.5 * 2^23: rounds y to integer in low bits
+    f   = (y - (n.f - 12582912.0f)) * 0.693147181f;
+    f2  = f * f;
+    f4  = f2 * f2;
+
+    // 2^n * exp(f), Taylor series through f^7
+    bits.i = (n.i - (0x4B400000 - 127)) << 23;
+    return bits.f * ( ((1.0f + f) + f2 * (1.0f/2 + f * (1.0f/6))) +
+                      f4 * ((1.0f/24 + f * (1.0f/120)) + f2 * (1.0f/720 + f * (1.0f/5040))) );
+}
+
 static int setup_operator(
     double detail,
     int    ncols,
@@ -462,6 +501,7 @@ static int setup_operator(
     double yscale,
     enum Terrain_Reg
            registration,
+    int    precision,
     struct Terrain_Operator_Info
           *info
 )
@@ -498,6 +538,11 @@ static int setup_operator(
 
     info->power = detail * 0.5;
 
+    info->m2   = m2;
+    info->n2   = n2;
+    // fast_exp2() requires 0 <= power <= 1 (detail from 0 to 2, the normal range)
+    info->fast = (precision == TERRAIN_OPERATOR_FAST && detail >= 0.0 && detail <= 2.0);
+
     xfactor = 1.0 / (double)m2;
     yfactor = 1.0 / (double)n2;
 
@@ -545,22 +590,54 @@ static int setup_operator(
 }
 
 static void apply_operator(
-    float *data,
+    float *ptr,
     int    col,
     int    nrows,
     struct Terrain_Operator_Info
            info
 )
-// Note: data array is in transposed layout (ncols x nrows)
+// Note: ptr points to column col of data array in transposed layout (ncols x nrows)
 {
     int i = col;
-    int j;
-    float *ptr = data + (LONG)i * (LONG)nrows;
+    int j = 0;
+    int k;
 
     // Fractional Laplacian operator
 
+    // Fast evaluation (if requested) covers whole vectors of TERRAIN_LANES values;
+    // exact evaluation with pow() or exp() covers the rest.
+
     #if TERRAIN_OPERATOR_METHOD == 1
-        for (j=0; j<nrows; ++j) {
+        const int m2 = info.m2;
+        const int n2 = info.n2;
+
+        if (info.fast) {
+            // same as below, with logarithms in base 2
+            const float  factor = (float)info.factor;
+            const float  power  = (float)info.power;
+            const double sx1 = info.splinex[i],    xx1 = info.xx[i];
+            const double sx2 = info.splinex[m2-i], xx2 = info.xx[m2-i];
+            for (; j+TERRAIN_LANES<=nrows; j+=TERRAIN_LANES) {
+                union Terrain_Vector w1, w2, w3, w4, r1, r2, r3, r4, val;
+                for (k=0; k<TERRAIN_LANES; ++k) {
+                    w1.lane[k] = (float)(sx1 * info.spliney[j+k]);
+                    w2.lane[k] = (float)(sx1 * info.spliney[n2-j-k]);
+                    w3.lane[k] = (float)(sx2 * info.spliney[j+k]);
+                    w4.lane[k] = (float)(sx2 * info.spliney[n2-j-k]);
+                    r1.lane[k] = (float)(xx1 + info.yy[j+k]);
+                    r2.lane[k] = (float)(xx1 + info.yy[n2-j-k]);
+                    r3.lane[k] = (float)(xx2 + info.yy[j+k]);
+                    r4.lane[k] = (float)(xx2 + info.yy[n2-j-k]);
+                    val.lane[k] = ptr[j+k];
+                }
+                val.f *= factor * fast_exp2( ( (w1.f * fast_log2( r1.f ) + w4.f * fast_log2( r4.f )) +
+                                               (w2.f * fast_log2( r2.f ) + w3.f * fast_log2( r3.f )) ) * power );
+                for (k=0; k<TERRAIN_LANES; ++k) {
+                    ptr[j+k] = val.lane[k];
+                }
+            }
+        }
+        for (; j<nrows; ++j) {
             double log1 = info.splinex[i]    * info.spliney[j]    * log( info.xx[i]    + info.yy[j]    );
             double log2 = info.splinex[i]    * info.spliney[n2-j] * log( info.xx[i]    + info.yy[n2-j] );
             double log3 = info.splinex[m2-i] * info.spliney[j]    * log( info.xx[m2-i] + info.yy[j]    );
@@ -568,7 +645,23 @@ static void apply_operator(
             ptr[j] *= info.factor * exp( ( (log1 + log4) + (log2 + log3) ) * info.power );
         }
     #else
-        for (j=0; j<nrows; ++j) {
+        if (info.fast) {
+            const float  factor = (float)info.factor;
+            const float  power  = (float)info.power;
+            const double sepx   = info.separablex[i];
+            for (; j+TERRAIN_LANES<=nrows; j+=TERRAIN_LANES) {
+                union Terrain_Vector sum, val;
+                for (k=0; k<TERRAIN_LANES; ++k) {
+                    sum.lane[k] = (float)(sepx + info.separabley[j+k]);
+                    val.lane[k] = ptr[j+k];
+                }
+                val.f *= factor * fast_exp2( fast_log2( sum.f ) * power );
+                for (k=0; k<TERRAIN_LANES; ++k) {
+                    ptr[j+k] = val.lane[k];
+                }
+            }
+        }
+        for (; j<nrows; ++j) {
             ptr[j] *= info.factor * pow( info.separablex[i] + info.separabley[j], info.power );
         }
     #endif
@@ -586,56 +679,8 @@ static void cleanup_operator(
 }
 
 
-static void two_dcts(
-    float *ptr,
-    int    length,
-    const struct Dct_Plan *plan
-)
-{
-    int j;
-    float *ptr2 = ptr + length;
-
-    for (j=0; j<length; ++j) {
-        plan->in_data[0][j] = (double)ptr[j];
-    }
-    for (j=0; j<length; ++j) {
-        plan->in_data[1][j] = (double)ptr2[j];
-    }
-
-    perform_dcts( plan );
-
-    for (j=0; j<length; ++j) {
-        ptr[j] = (float)plan->out_data[0][j];
-    }
-    for (j=0; j<length; ++j) {
-        ptr2[j] = (float)plan->out_data[1][j];
-    }
-}
-
-// Note: single_dct() takes the same time as two_dcts() but does half the work,
-// so it is preferred to use two_dcts() whenever possible.
-static void single_dct(
-    float *ptr,
-    int    length,
-    const struct Dct_Plan *plan
-)
-{
-    int j;
-
-    for (j=0; j<length; ++j) {
-        plan->in_data[0][j] = plan->in_data[1][j] = (double)ptr[j];
-    }
-
-    perform_dcts( plan );
-
-    for (j=0; j<length; ++j) {
-        ptr[j] = (float)plan->out_data[0][j];
-    }
-}
-
-
 // Progress info structure used by init_progress(), set_progress(),
-// report_progress(), update_progress(), and relay_progress().
+// report_progress(), and update_progress().
 struct Terrain_Progress_Info {
     const struct Terrain_Progress_Callback
           *progress;        // overall progress callback functor
@@ -650,7 +695,7 @@ struct Terrain_Progress_Info {
 
 
 // Initialize progress info structure to be used by set_progress(),
-// report_progress(), update_progress(), and relay_progress().
+// report_progress(), and update_progress().
 static struct Terrain_Progress_Info
 init_progress(
     const struct Terrain_Progress_Callback
@@ -726,292 +771,1613 @@ static INLINE int update_progress(
         info->progress->state );
 }
 
-// Reports overall progress based on % progress reported by individual steps
-static int relay_progress(
-    float step_progress,    // portion of step completed so far (0.00 to 1.00)
-    void *state)            // pointer to Terrain_Progress_Info structure
-{
-    struct Terrain_Progress_Info *info = (struct Terrain_Progress_Info *)state;
-    float steps_done      = info->steps_done   + step_progress;
-    float overall_portion = info->portion_done + step_progress * info->this_portion;
-    return info->progress->callback(
-        overall_portion,
-        steps_done,
-        info->total_steps,
-        info->progress->state );
-}
-
-
-// Main terrain_filter function:
-
-int terrain_filter(
-    float *data,        // input/output: array of data to process (row-major order)
-    double detail,      // input: "detail" exponent to be applied
-    int    nrows,       // input: number of rows    in data array
-    int    ncols,       // input: number of columns in data array
-    double xdim,        // input: spacing between pixel columns (in degrees or meters)
-    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
-    enum Terrain_Coord_Type
-           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
-    double center_lat,  // input: latitude in degrees at center of data array
-                        //        (ignored if coord_type == TERRAIN_METERS)
-    const struct Terrain_Progress_Callback
-          *progress     // optional callback functor for status; NULL for none
-//  enum Terrain_Reg registration   // feature not yet implemented
-)
-// Computes operator (-Laplacian)^(detail/2) applied to data array.
-// Returns 0 on success, nonzero if an error occurred (see enum Terrain_Filter_Errors).
-// Mean of data array is always (approximately) zero on output.
-// On input, vertical units (data array values) should be in meters.
-{
-    enum Terrain_Reg registration = TERRAIN_REG_CELL;
-
-    int num_threads = 1;    // number of threads used to parallelize the three DCT loops
-
-    // approximate relative amount of time spent in each step
-    // (actual times vary with data array size, memory size, and DCT algorithms chosen):
-    const float step_times[6] =
-        { 0.5, 2.0/num_threads, 1.0, 4.0/num_threads, 1.0, 2.0/num_threads };
-
-    const int total_steps = sizeof( step_times ) / sizeof( *step_times );
-
-    struct Terrain_Progress_Info
-        progress_info = init_progress( progress, step_times, total_steps );
-
-    struct Transpose_Progress_Callback
-        sub_progress = { relay_progress, &progress_info };
-
-    const double steepness = 2.0;
-
-    int error;
-
-    int type_fwd, type_bwd;
-
-    int i, j;
-    float *ptr;
-
-    float data_min, data_max;
-
-    double normalizer;
-
-    double xres,   yres;
-    double xscale, yscale;
-    double xsize,  ysize;
 
-    struct Terrain_Operator_Info info;
+// Parallel DCT passes:
 
-    // Determine pixel dimensions:
+// Parts of the column pass to perform (see dct_tile_pass() and dct_panel_pass()).
+enum Terrain_Column_Stages {
+    TERRAIN_COLUMNS_FORWARD = 1,    // forward DCTs only, leaving the spectrum
+    TERRAIN_COLUMNS_INVERSE = 2,    // operator and inverse DCTs only, starting from spectrum
+    TERRAIN_COLUMNS_ALL     = 3     // forward DCTs, operator, and inverse DCTs
+};
 
-    if (coord_type == TERRAIN_DEGREES) {
-        geographic_scale( center_lat, &xsize, &ysize );
+// Shared state for the row pass and the out-of-core column pass.
+// Work item k covers rows (or panel columns) batch*k to batch*k+batch-1,
+// where batch is the batch_size of the DCT plans.
+struct Terrain_Dct_Pass {
+    float *data;            // array being processed
+    int    length;          // length of each DCT
+    int    count;           // number of rows (or panel columns) to process
+    int    first_col;       // column pass only: index of first column in data array
+    int    out_len;         // column pass only: number of leading coefficients kept
+                            // for the operator and inverse DCTs (see output_rows)
+    double scale;           // row pass only: factor applied to data before the DCTs
+                            // (1.0 for none)
+    struct Dct_Plan
+          *plans;           // one plan per worker
+    struct Dct_Plan
+          *bwd_plans;       // column pass only: one inverse plan per worker
+    const struct Terrain_Operator_Info
+          *info;            // column pass only: operator to apply between DCTs
+    int    stages;          // column pass only: enum Terrain_Column_Stages
+};
 
-        // convert degrees to meters (approximately)
-        xres = xdim * xsize;
-        yres = ydim * ysize;
-    } else {
-        xres = xdim;
-        yres = ydim;
+static void dct_rows_task( long first, long last, int worker, void *state )
+{
+    const struct Terrain_Dct_Pass *pass = (const struct Terrain_Dct_Pass *)state;
+    const struct Dct_Plan *plan = &pass->plans[worker];
+    const int batch = plan->batch_size;
+
+    int    i   = (int)first * batch;
+    int    end = (int)last * batch < pass->count ? (int)last * batch : pass->count;
+    float *ptr = pass->data + (LONG)i * (LONG)pass->length;
+
+    if (pass->scale != 1.0) {
+        // normalize the rows here, while they are in cache for the DCTs
+        LONG k, size = (LONG)(end - i) * (LONG)pass->length;
+        for (k=0; k<size; ++k) {
+            ptr[k] *= pass->scale;
+        }
     }
 
-    xscale = fabs( 1.0 / xres );
-    yscale = fabs( 1.0 / yres );
+    perform_dcts_rows( plan, ptr, end - i, pass->length, 1 );
+}
 
-    switch (registration) {
-        case TERRAIN_REG_GRID:
-            type_fwd = 1;
-            type_bwd = 1;
-            break;
-        case TERRAIN_REG_CELL:
-            type_fwd = 2;
-            type_bwd = 3;
-            break;
-        default:
-            return TERRAIN_FILTER_INVALID_PARAM;
+static void dct_columns_task( long first, long last, int worker, void *state )
+// Note: data array is a panel in transposed layout (width x nrows)
+{
+    const struct Terrain_Dct_Pass *pass = (const struct Terrain_Dct_Pass *)state;
+    const struct Dct_Plan *fwd_plan = &pass->plans[worker];
+    const struct Dct_Plan *bwd_plan = &pass->bwd_plans[worker];
+    const int batch = fwd_plan->batch_size;
+    long k;
+    int  c;
+
+    for (k=first; k<last; ++k) {
+        int    i   = (int)k * batch;
+        int    num = pass->count - i < batch ? pass->count - i : batch;
+        float *ptr = pass->data + (LONG)i * (LONG)pass->length;
+        if (pass->stages & TERRAIN_COLUMNS_FORWARD) {
+            perform_dcts_rows( fwd_plan, ptr, num, pass->length, 1 );
+        }
+        if (pass->stages & TERRAIN_COLUMNS_INVERSE) {
+            for (c=0; c<num; ++c) {
+                apply_operator( ptr + (LONG)c * (LONG)pass->length,
+                                pass->first_col + i + c, pass->out_len, *pass->info );
+            }
+            perform_dcts_rows( bwd_plan, ptr, num, pass->length, 1 );
+        }
     }
+}
 
-    if (progress && report_progress( &progress_info )) {
-        return TERRAIN_FILTER_CANCELED;
-    }
+static int pass_progress( long items_done, long total_items, void *state )
+{
+    struct Terrain_Progress_Info *info = (struct Terrain_Progress_Info *)state;
+    return update_progress( info, (int)items_done, (int)total_items );
+}
 
-    data_min = data[0];
-    data_max = data[0];
+// Allocates one DCT plan per worker; returns NULL if a memory allocation error occurred.
+static struct Dct_Plan *setup_plans( int dct_type, int nelems, int backend, int num_plans )
+{
+    int i;
+    struct Dct_Plan *plans = (struct Dct_Plan *)malloc( sizeof( struct Dct_Plan ) * num_plans );
 
-    for (i=0, ptr=data; i<nrows; ++i, ptr+=ncols) {
-        //float *ptr = data + (LONG)i * (LONG)ncols;
-        for (j=0; j<ncols; ++j) {
-            if (ptr[j] < data_min) {
-                data_min = ptr[j];
-            } else if (ptr[j] > data_max) {
-                data_max = ptr[j];
+    if (!plans) {
+        return NULL;
+    }
+    for (i=0; i<num_plans; ++i) {
+        plans[i] = setup_dcts_backend( dct_type, nelems, (enum Dct_Backend)backend );
+        if (!plans[i].dct_buffer) {
+            while (i-- > 0) {
+                cleanup_dcts( &plans[i] );
             }
+            free( plans );
+            return NULL;
         }
     }
+    return plans;
+}
 
-    normalizer  = pow( 2.0 / (data_max - data_min), 1.0 - detail );
-    normalizer *= pow( steepness, -detail );
+static void cleanup_plans( struct Dct_Plan *plans, int num_plans )
+{
+    int i;
 
-    for (i=0, ptr=data; i<nrows; ++i, ptr+=ncols) {
-        //float *ptr = data + (LONG)i * (LONG)ncols;
-        for (j=0; j<ncols; ++j) {
-            ptr[j] *= normalizer;
-        }
+    if (!plans) {
+        return;
     }
-
-    error = setup_operator( detail, ncols, nrows, xscale, yscale, registration, &info );
-    if (error) {
-        return error;
+    for (i=0; i<num_plans; ++i) {
+        cleanup_dcts( &plans[i] );
     }
+    free( plans );
+}
 
-    set_progress( &progress_info, 1 );
+// Number of row batches handed to a worker at a time:
+// small enough to balance the load, large enough to keep locking overhead negligible.
+static long pass_chunk( long nbatches, int num_threads )
+{
+    long chunk = nbatches / ((long)num_threads * 16);
+    if (chunk < 1) {
+        chunk = 1;
+    } else if (chunk > 64) {
+        chunk = 64;
+    }
+    return chunk;
+}
 
-    if (progress && report_progress( &progress_info )) {
+static int dct_pass(
+    float *data,        // input/output: array of data to process (row-major order)
+    int    length,      // input: length of each DCT (number of columns)
+    int    count,       // input: number of rows to process
+    double scale,       // input: factor to multiply data by before the DCTs (1.0 for none)
+    struct Dct_Plan
+          *plans,       // input: one DCT plan per worker (from setup_plans())
+    struct Thread_Pool
+          *pool,        // input: pool of worker threads, or NULL
+    const struct Thread_Pool_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+)
+// Performs DCTs on all rows of data array, distributed among the workers in pool.
+// Returns 0 on success, nonzero if an error occurred (see enum Terrain_Filter_Errors).
+{
+    int  num_threads = thread_pool_size( pool );
+    long nbatches;
+
+    struct Terrain_Dct_Pass pass;
+
+    pass.data      = data;
+    pass.length    = length;
+    pass.count     = count;
+    pass.first_col = 0;
+    pass.out_len   = length;
+    pass.scale     = scale;
+    pass.info      = NULL;
+    pass.stages    = 0;
+    pass.bwd_plans = NULL;
+    pass.plans     = plans;
+
+    nbatches = ((long)count + plans[0].batch_size - 1) / plans[0].batch_size;
+
+    if (run_thread_pool( pool, nbatches, pass_chunk( nbatches, num_threads ),
+                         dct_rows_task, &pass, progress ))
+    {
         return TERRAIN_FILTER_CANCELED;
     }
+    return TERRAIN_FILTER_SUCCESS;
+}
 
-    // CONCURRENCY NOTE: The iterations of the loop below will be
-    // independent and can be executed in parallel, if each thread has
-    // its own dct_plan with separate calls to setup_dcts() and cleanup_dcts().
-    {
-        struct Dct_Plan dct_plan = setup_dcts( type_fwd, ncols );
+#define TERRAIN_TILE_MEMORY ((size_t)1 << 20)
+
+// Range of tile widths, in columns
+#define TERRAIN_MIN_TILE_WIDTH 16
+#define TERRAIN_MAX_TILE_WIDTH 64
+
+// Shared state for dct_tile_pass(). Work item k covers columns width*k to width*k+width-1.
+struct Terrain_Tile_Pass {
+    float *data;            // row-major data array (nrows x ncols)
+    int    nrows;           // number of rows    in data array
+    int    ncols;           // number of columns in data array
+    float *output;          // row-major output array (out_rows x out_cols); may be data
+    int    out_rows;        // number of rows    in output array (at most nrows)
+    int    out_cols;        // number of columns in output array (at most ncols)
+    int    width;           // number of columns per tile (a multiple of the DCT batch size)
+    float *tiles;           // one tile buffer per worker, each width x nrows (transposed layout)
+    struct Dct_Plan
+          *plans;           // one forward plan per worker
+    struct Dct_Plan
+          *bwd_plans;       // one inverse plan per worker
+    const struct Terrain_Operator_Info
+          *info;            // operator to apply between DCTs
+    int    stages;          // enum Terrain_Column_Stages
+};
 
-        if (!dct_plan.dct_buffer) {
-            return TERRAIN_FILTER_MALLOC_ERROR;
+static void dct_tile_task( long first, long last, int worker, void *state )
+{
+    const struct Terrain_Tile_Pass *pass = (const struct Terrain_Tile_Pass *)state;
+    const struct Dct_Plan *fwd_plan = &pass->plans[worker];
+    const struct Dct_Plan *bwd_plan = &pass->bwd_plans[worker];
+    const int nrows    = pass->nrows;
+    const int ncols    = pass->ncols;
+    const int out_rows = pass->out_rows;
+    const int out_cols = pass->out_cols;
+    float *tile = pass->tiles + (LONG)worker * (LONG)pass->width * (LONG)nrows;
+    long k;
+    int  i, c;
+
+    for (k=first; k<last; ++k) {
+        int first_col = (int)k * pass->width;
+        int width     = out_cols - first_col < pass->width ? out_cols - first_col : pass->width;
+
+        // gather: read a short piece of each row, write one element of each tile column
+        for (i=0; i<nrows; ++i) {
+            const float *src = pass->data + (LONG)i * (LONG)ncols + first_col;
+            for (c=0; c<width; ++c) {
+                tile[(LONG)c * (LONG)nrows + i] = src[c];
+            }
         }
 
-        for (i=0; i<nrows-1; i+=2) {
-            float *ptr = data + (LONG)i * (LONG)ncols;
-            two_dcts( ptr, ncols, &dct_plan );
-            if (progress && update_progress( &progress_info, i+2, nrows ))
-            {
-                return TERRAIN_FILTER_CANCELED;
-            }
+        if (pass->stages & TERRAIN_COLUMNS_FORWARD) {
+            perform_dcts_rows( fwd_plan, tile, width, nrows, 1 );
         }
-        if (nrows & 1) {
-            float *ptr = data + (LONG)(nrows - 1) * (LONG)ncols;
-            single_dct( ptr, ncols, &dct_plan );
+        if (pass->stages & TERRAIN_COLUMNS_INVERSE) {
+            // higher coefficients of each column are dropped if out_rows < nrows
+            for (c=0; c<width; ++c) {
+                apply_operator( tile + (LONG)c * (LONG)nrows, first_col + c, out_rows, *pass->info );
+            }
+            perform_dcts_rows( bwd_plan, tile, width, nrows, 1 );
         }
 
-        cleanup_dcts( &dct_plan );
+        for (i=0; i<out_rows; ++i) {
+            float *dst = pass->output + (LONG)i * (LONG)out_cols + first_col;
+            for (c=0; c<width; ++c) {
+                dst[c] = tile[(LONG)c * (LONG)nrows + i];
+            }
+        }
     }
+}
 
-    set_progress( &progress_info, 2 );
+// Returns number of columns per tile for dct_tile_pass(): a whole number of DCT batches.
+static long tile_width( int nrows, int ncols, int batch )
+{
+    long width = (long)(TERRAIN_TILE_MEMORY / ((size_t)nrows * sizeof( float )));
 
-    if (progress && report_progress( &progress_info )) {
-        return TERRAIN_FILTER_CANCELED;
+    if (width < TERRAIN_MIN_TILE_WIDTH) {
+        width = TERRAIN_MIN_TILE_WIDTH;
+    } else if (width > TERRAIN_MAX_TILE_WIDTH) {
+        width = TERRAIN_MAX_TILE_WIDTH;
     }
-
-    error = transpose_inplace( data, nrows, ncols, progress ? &sub_progress : NULL );
-    if (error) {
-        if (error > 0) {
-            return TERRAIN_FILTER_MALLOC_ERROR;
-        } else {
-            return TERRAIN_FILTER_CANCELED;
-        }
+    width -= width % batch;
+    if (width < batch) {
+        width = batch;
     }
+    if (width > ncols) {
+        width = ncols;
+    }
+    return width;
+}
 
-    set_progress( &progress_info, 3 );
-
-    if (progress && report_progress( &progress_info )) {
+static int dct_tile_pass(
+    float *data,        // input/output: array of data to process (row-major order)
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    float *output,      // output: array for results (row-major order); may be data
+    int    out_rows,    // input: number of rows    in output array (nrows unless truncating)
+    int    out_cols,    // input: number of columns in output array (ncols unless truncating)
+    const struct Terrain_Operator_Info
+          *info,        // input: operator to apply between DCTs (unused for forward stage only)
+    int    stages,      // input: parts of the pass to perform (enum Terrain_Column_Stages)
+    struct Dct_Plan
+          *plans,       // input: one forward DCT plan per worker (from setup_plans())
+    struct Dct_Plan
+          *bwd_plans,   // input: one inverse DCT plan per worker (length out_rows)
+    float *tiles,       // input: buffer space for one tile per worker (width x nrows each)
+    long   width,       // input: number of columns per tile (from tile_width())
+    struct Thread_Pool
+          *pool,        // input: pool of worker threads, or NULL
+    const struct Thread_Pool_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+)
+// Performs the column DCTs and applies the operator directly on the row-major data array,
+// with no transposes. Columns are grouped for the DCTs in whole batches starting at
+// column 0, as in dct_panel_pass(), so the two produce bit-for-bit identical results.
+// Only the first out_rows x out_cols coefficients are kept for the inverse DCTs, which
+// gives a band-limited (alias-free) resampling of the result at the output size.
+// Returns 0 on success, nonzero if an error occurred (see enum Terrain_Filter_Errors).
+{
+    long ntiles;
+
+    struct Terrain_Tile_Pass pass;
+
+    pass.data      = data;
+    pass.nrows     = nrows;
+    pass.ncols     = ncols;
+    pass.output    = output;
+    pass.out_rows  = out_rows;
+    pass.out_cols  = out_cols;
+    pass.width     = (int)width;
+    pass.tiles     = tiles;
+    pass.plans     = plans;
+    pass.bwd_plans = bwd_plans;
+    pass.info      = info;
+    pass.stages    = stages;
+
+    ntiles = ((long)out_cols + width - 1) / width;
+
+    if (run_thread_pool( pool, ntiles, 1, dct_tile_task, &pass, progress )) {
         return TERRAIN_FILTER_CANCELED;
     }
+    return TERRAIN_FILTER_SUCCESS;
+}
 
-    // CONCURRENCY NOTE: The iterations of the loop below will be
-    // independent and can be executed in parallel, if each thread has
-    // its own fwd_plan and bwd_plan with separate calls to setup_dcts()
-    // and cleanup_dcts().
-    {
-        struct Dct_Plan fwd_plan = setup_dcts( type_fwd, nrows );
-        struct Dct_Plan bwd_plan = setup_dcts( type_bwd, nrows );
+struct Terrain_Panel_Copy {
+    float *data;            // row-major data array (nrows x ncols)
+    float *panel;           // panel buffer in transposed layout (width x nrows)
+    int    nrows;           // number of rows    in data array
+    int    ncols;           // number of columns in data array
+    float *output;          // row-major output array (out_rows x out_cols); may be data
+    int    out_cols;        // number of columns in output array
+    int    first_col;       // index of first column of panel in data array
+    int    width;           // number of columns in panel
+};
 
-        if (!fwd_plan.dct_buffer || !bwd_plan.dct_buffer) {
-            return TERRAIN_FILTER_MALLOC_ERROR;
+static void gather_panel_task( long first, long last, int worker, void *state )
+{
+    const struct Terrain_Panel_Copy *copy = (const struct Terrain_Panel_Copy *)state;
+    long i;
+    int  k;
+
+    (void)worker;
+
+    for (k=0; k<copy->width; ++k) {
+        const float *src = copy->data  + copy->first_col + k;
+        float       *dst = copy->panel + (LONG)k * (LONG)copy->nrows;
+        for (i=first; i<last; ++i) {
+            dst[i] = src[(LONG)i * (LONG)copy->ncols];
         }
+    }
+}
 
-        for (i=0; i<ncols-1; i+=2) {
-            float *ptr = data + (LONG)i * (LONG)nrows;
+static void scatter_panel_task( long first, long last, int worker, void *state )
+{
+    const struct Terrain_Panel_Copy *copy = (const struct Terrain_Panel_Copy *)state;
+    long i;
+    int  k;
 
-            two_dcts( ptr, nrows, &fwd_plan );
-            apply_operator( data, i,   nrows, info );
-            apply_operator( data, i+1, nrows, info );
-            two_dcts( ptr, nrows, &bwd_plan );
+    (void)worker;
 
-            if (progress && update_progress( &progress_info, i+2, ncols ))
-            {
-                return TERRAIN_FILTER_CANCELED;
-            }
+    for (k=0; k<copy->width; ++k) {
+        const float *src = copy->panel  + (LONG)k * (LONG)copy->nrows;
+        float       *dst = copy->output + copy->first_col + k;
+        for (i=first; i<last; ++i) {
+            dst[(LONG)i * (LONG)copy->out_cols] = src[i];
         }
+    }
+}
+
+// Progress of the column pass across all panels.
+struct Terrain_Panel_Progress {
+    struct Terrain_Progress_Info
+          *info;
+    int    first_col;       // index of first column of current panel
+    int    width;           // number of columns in current panel
+    int    ncols;           // total number of columns
+};
 
-        if (ncols & 1) {
-            float *ptr = data + (LONG)(ncols - 1) * (LONG)nrows;
+static int panel_progress( long items_done, long total_items, void *state )
+{
+    const struct Terrain_Panel_Progress *panel = (const struct Terrain_Panel_Progress *)state;
+    long cols_done = panel->first_col + panel->width * items_done / total_items;
+    return update_progress( panel->info, (int)cols_done, panel->ncols );
+}
 
-            single_dct( ptr, nrows, &fwd_plan );
-            apply_operator( data, ncols-1, nrows, info );
-            single_dct( ptr, nrows, &bwd_plan );
-        }
+#define TERRAIN_DEFAULT_PANEL_MEMORY ((size_t)256 << 20)
 
-        cleanup_dcts( &bwd_plan );
-        cleanup_dcts( &fwd_plan );
-    }
+// Returns number of columns per panel for dct_panel_pass(): a whole number of DCT batches,
+// so columns are grouped for the DCTs exactly as in dct_tile_pass(); this makes the
+// results bit-for-bit identical.
+static long panel_width( int nrows, int ncols, int batch, size_t panel_memory )
+{
+    long width;
 
-    if (flt_isnan( data[0] )) {
-        return TERRAIN_FILTER_NULL_VALUES;
+    if (!panel_memory) {
+        panel_memory = TERRAIN_DEFAULT_PANEL_MEMORY;
     }
 
-    set_progress( &progress_info, 4 );
-
-    if (progress && report_progress( &progress_info )) {
-        return TERRAIN_FILTER_CANCELED;
+    width = (long)(panel_memory / ((size_t)nrows * sizeof( float )));
+    width -= width % batch;
+    if (width < batch) {
+        width = batch;
     }
+    if (width > ncols) {
+        width = ncols;
+    }
+    return width;
+}
 
-    error = transpose_inplace( data, ncols, nrows, progress ? &sub_progress : NULL );
-    if (error) {
-        if (error > 0) {
-            return TERRAIN_FILTER_MALLOC_ERROR;
-        } else {
+static int dct_panel_pass(
+    float *data,        // input/output: array of data to process (row-major order)
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    float *output,      // output: array for results (row-major order); may be data
+    int    out_rows,    // input: number of rows    in output array (nrows unless truncating)
+    int    out_cols,    // input: number of columns in output array (ncols unless truncating)
+    const struct Terrain_Operator_Info
+          *info,        // input: operator to apply between DCTs (unused for forward stage only)
+    int    stages,      // input: parts of the pass to perform (enum Terrain_Column_Stages)
+    struct Dct_Plan
+          *plans,       // input: one forward DCT plan per worker (from setup_plans())
+    struct Dct_Plan
+          *bwd_plans,   // input: one inverse DCT plan per worker (length out_rows)
+    float *panel,       // input: buffer space for panel (width x nrows)
+    long   width,       // input: number of columns per panel (from panel_width())
+    struct Thread_Pool
+          *pool,        // input: pool of worker threads, or NULL
+    struct Terrain_Progress_Info
+          *progress     // optional progress info for status; NULL for none
+)
+// Performs the column DCTs and applies the operator without transposing the data array.
+// Columns are gathered into a panel buffer many at a time, processed exactly as
+// dct_tile_pass() processes its tiles, and scattered back (to the output array).
+// Rows of the data array are only accessed sequentially, so data can be a memory-mapped
+// file much larger than the available memory.
+// Returns 0 on success, nonzero if an error occurred (see enum Terrain_Filter_Errors).
+{
+    int  num_threads = thread_pool_size( pool );
+    long row_chunk;
+    int  batch       = plans[0].batch_size;
+
+    struct Terrain_Dct_Pass   pass;
+    struct Terrain_Panel_Copy copy;
+
+    struct Terrain_Panel_Progress
+        panel_info = { progress, 0, 0, out_cols };
+
+    struct Thread_Pool_Progress_Callback
+        pool_progress = { panel_progress, &panel_info };
+
+    // copy enough rows at a time to keep caches busy without overflowing them
+    row_chunk = 65536L / width;
+    if (row_chunk < 8) {
+        row_chunk = 8;
+    }
+
+    pass.data      = panel;
+    pass.length    = nrows;
+    pass.out_len   = out_rows;
+    pass.scale     = 1.0;
+    pass.plans     = plans;
+    pass.bwd_plans = bwd_plans;
+    pass.info      = info;
+    pass.stages    = stages;
+
+    copy.data     = data;
+    copy.panel    = panel;
+    copy.nrows    = nrows;
+    copy.ncols    = ncols;
+    copy.output   = output;
+    copy.out_cols = out_cols;
+
+    for (copy.first_col=0; copy.first_col<out_cols; copy.first_col+=width) {
+        long nbatches;
+
+        copy.width = out_cols - copy.first_col < width ? out_cols - copy.first_col : width;
+
+        run_thread_pool( pool, nrows, row_chunk, gather_panel_task, &copy, NULL );
+
+        pass.count     = copy.width;
+        pass.first_col = copy.first_col;
+
+        panel_info.first_col = copy.first_col;
+        panel_info.width     = copy.width;
+
+        nbatches = ((long)copy.width + batch - 1) / batch;
+
+        if (run_thread_pool( pool, nbatches, pass_chunk( nbatches, num_threads ),
+                             dct_columns_task, &pass, progress ? &pool_progress : NULL ))
+        {
             return TERRAIN_FILTER_CANCELED;
         }
+
+        run_thread_pool( pool, out_rows, row_chunk, scatter_panel_task, &copy, NULL );
+    }
+
+    return TERRAIN_FILTER_SUCCESS;
+}
+
+
+// Common setup for terrain_filter_create() and run_context():
+
+// Gets size of results from options (output_rows and output_cols; 0 for data size).
+// Returns 0 on success, TERRAIN_FILTER_INVALID_PARAM if not within the data size.
+static int output_size(
+    const struct Terrain_Filter_Options
+          *options,     // input: processing options, or NULL for defaults
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    int   *out_rows,    // output: number of rows    in results
+    int   *out_cols     // output: number of columns in results
+)
+{
+    *out_rows = nrows;
+    *out_cols = ncols;
+
+    if (options) {
+        if (options->output_rows < 0 || options->output_rows > nrows ||
+            options->output_cols < 0 || options->output_cols > ncols)
+        {
+            return TERRAIN_FILTER_INVALID_PARAM;
+        }
+        if (options->output_rows > 0) {
+            *out_rows = options->output_rows;
+        }
+        if (options->output_cols > 0) {
+            *out_cols = options->output_cols;
+        }
+    }
+    return TERRAIN_FILTER_SUCCESS;
+}
+
+static void pixel_scales(
+    double xdim,        // input: spacing between pixel columns (in degrees or meters)
+    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
+    double center_lat,  // input: latitude in degrees at center of data array
+    double *xscale,     // output: pixel columns per meter
+    double *yscale      // output: pixel rows    per meter
+)
+{
+    double xres,  yres;
+    double xsize, ysize;
+
+    if (coord_type == TERRAIN_DEGREES) {
+        geographic_scale( center_lat, &xsize, &ysize );
+
+        // convert degrees to meters (approximately)
+        xres = xdim * xsize;
+        yres = ydim * ysize;
+    } else {
+        xres = xdim;
+        yres = ydim;
+    }
+
+    *xscale = fabs( 1.0 / xres );
+    *yscale = fabs( 1.0 / yres );
+}
+
+static void data_range(
+    const float *data,  // input: array of data (row-major order)
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    float *data_min,    // output: minimum value in data array
+    float *data_max     // output: maximum value in data array
+)
+{
+    const float *ptr;
+    int i, j;
+
+    *data_min = data[0];
+    *data_max = data[0];
+
+    for (i=0, ptr=data; i<nrows; ++i, ptr+=ncols) {
+        //float *ptr = data + (LONG)i * (LONG)ncols;
+        for (j=0; j<ncols; ++j) {
+            if (ptr[j] < *data_min) {
+                *data_min = ptr[j];
+            } else if (ptr[j] > *data_max) {
+                *data_max = ptr[j];
+            }
+        }
+    }
+}
+
+// Returns factor to multiply data by before (or after) the operator,
+// so the output has a consistent range for any detail.
+static double data_normalizer( double detail, float data_min, float data_max )
+{
+    const double steepness = 2.0;
+
+    double normalizer;
+
+    normalizer  = pow( 2.0 / (data_max - data_min), 1.0 - detail );
+    normalizer *= pow( steepness, -detail );
+
+    return normalizer;
+}
+
+
+// Padding to FFT-friendly sizes:
+
+// Relative time of one DCT of length n with fftpack: the same estimate cosqi() uses
+// to choose between the mixed-radix FFT and Bluestein's algorithm.
+static double dct_cost( int n )
+{
+    const int bluestein_threshold = 10;     // as in cosqi()
+
+    int ntry = 4, j = 0;
+    int nl = n;
+    int m, mf;
+    double sum = 0.0;
+
+    if (n < 2) {
+        return 1.0;
+    }
+
+    // same factorization order as rffti(): 4, 2, 3, 5, then odd numbers
+    while (nl > 1) {
+        if (nl % ntry) {
+            ++j;
+            ntry = j == 1 ? 2 : j == 2 ? 3 : j == 3 ? 5 : ntry + 2;
+            continue;
+        }
+        nl /= ntry;
+        sum += ntry == 4 ? 5 : 3 + ntry;
+    }
+
+    m  = 4;
+    mf = 4;
+    while (m < n) {
+        m += m;
+        mf++;
+    }
+    m  += m;
+    mf /= 2;
+
+    if (sum * n < (double)bluestein_threshold * mf * m) {
+        return sum * n;
+    }
+    return (double)bluestein_threshold * mf * m;
+}
+
+int terrain_padded_size( int n )
+{
+    int size;
+
+    for (size=n; ; ++size) {
+        int k = size;
+        while (k % 2 == 0) k /= 2;
+        while (k % 3 == 0) k /= 3;
+        while (k % 5 == 0) k /= 5;
+        if (k == 1) {
+            return size;
+        }
+    }
+}
+
+double terrain_filter_cost( int nrows, int ncols )
+{
+    // two row passes, forward & inverse column DCTs, plus operator and copies
+    // (about 20 units per element, as measured with the fftpack backend)
+    return 2.0 * (double)nrows * dct_cost( ncols ) +
+           2.0 * (double)ncols * dct_cost( nrows ) +
+           20.0 * (double)nrows * (double)ncols;
+}
+
+// Smallest side and estimated speedup for which pad_fft_size pads the array
+#define TERRAIN_PAD_MIN_SIZE    64
+#define TERRAIN_PAD_MIN_SPEEDUP 1.5
+
+int terrain_padding_worthwhile( int nrows, int ncols )
+{
+    int prows = terrain_padded_size( nrows );
+    int pcols = terrain_padded_size( ncols );
+
+    if (nrows < TERRAIN_PAD_MIN_SIZE || ncols < TERRAIN_PAD_MIN_SIZE ||
+        (prows == nrows && pcols == ncols))
+    {
+        return 0;
+    }
+    return terrain_filter_cost( nrows, ncols ) >=
+           TERRAIN_PAD_MIN_SPEEDUP * terrain_filter_cost( prows, pcols );
+}
+
+// Folds index i into 0..n-1 by half-sample mirroring about both ends, the
+// even-symmetric extension the DCT-II already assumes at the array edges.
+static LONG mirror_index( LONG i, LONG n )
+{
+    i %= 2 * n;
+    return i < n ? i : 2 * n - 1 - i;
+}
+
+static void pad_mirror(
+    const float *data,      // input: array of data (row-major order)
+    int    nrows,           // input: number of rows    in data array
+    int    ncols,           // input: number of columns in data array
+    float *padded,          // output: data extended by mirroring to prows x pcols
+    int    prows,           // input: number of rows    in padded array (at least nrows)
+    int    pcols            // input: number of columns in padded array (at least ncols)
+)
+{
+    int i, j;
+
+    for (i=0; i<prows; ++i) {
+        const float *src = data   + mirror_index( i, nrows ) * (LONG)ncols;
+        float       *dst = padded + (LONG)i * (LONG)pcols;
+
+        memcpy( dst, src, sizeof( float ) * (size_t)ncols );
+        for (j=ncols; j<pcols; ++j) {
+            dst[j] = src[mirror_index( j, ncols )];
+        }
+    }
+}
+
+static void crop_padded(
+    const float *padded,    // input: array from pad_mirror() after processing
+    int    pcols,           // input: number of columns in padded array
+    float *data,            // output: top left nrows x ncols of padded array
+    int    nrows,           // input: number of rows    in data array
+    int    ncols            // input: number of columns in data array
+)
+{
+    int i;
+
+    for (i=0; i<nrows; ++i) {
+        memcpy( data   + (LONG)i * (LONG)ncols,
+                 padded + (LONG)i * (LONG)pcols, sizeof( float ) * (size_t)ncols );
+    }
+}
+
+
+// Main terrain_filter function:
+
+void terrain_filter_default_options(
+    struct Terrain_Filter_Options *options  // output: default options
+)
+// Sets all processing options to their default values.
+{
+    options->num_threads  = 0;
+    options->out_of_core  = 0;
+    options->panel_memory = 0;
+    options->dct_backend  = DCT_BACKEND_DEFAULT;
+    options->operator_precision = TERRAIN_OPERATOR_EXACT;
+    options->range_known  = 0;
+    options->data_min     = 0.0;
+    options->data_max     = 0.0;
+    options->pad_fft_size = 0;
+    options->output_rows  = 0;
+    options->output_cols  = 0;
+}
+
+int terrain_filter(
+    float *data,        // input/output: array of data to process (row-major order)
+    double detail,      // input: "detail" exponent to be applied
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xdim,        // input: spacing between pixel columns (in degrees or meters)
+    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
+    double center_lat,  // input: latitude in degrees at center of data array
+                        //        (ignored if coord_type == TERRAIN_METERS)
+    const struct Terrain_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+//  enum Terrain_Reg registration   // feature not yet implemented
+)
+// Computes operator (-Laplacian)^(detail/2) applied to data array.
+// Returns 0 on success, nonzero if an error occurred (see enum Terrain_Filter_Errors).
+// Mean of data array is always (approximately) zero on output.
+// On input, vertical units (data array values) should be in meters.
+{
+    return terrain_filter_opts(
+        data, detail, nrows, ncols, xdim, ydim, coord_type, center_lat, progress, NULL );
+}
+
+// Everything terrain_filter() needs besides the data array: worker threads,
+// DCT plans, operator tables, and column buffers, kept for any number of runs.
+struct Terrain_Filter_Context {
+    struct Terrain_Filter_Options
+           options;         // copy of processing options
+    struct Thread_Pool
+          *pool;            // worker threads, or NULL for none
+    int    num_threads;     // number of workers, including calling thread
+    int    nrows;           // number of rows    transformed (padded size if padded)
+    int    ncols;           // number of columns transformed (padded size if padded)
+    int    data_rows;       // number of rows    in caller's data arrays
+    int    data_cols;       // number of columns in caller's data arrays
+    float *padded;          // mirror-padded copy of data, or NULL if not padding
+    int    out_rows;        // number of rows    after inverse DCTs (see output_rows option)
+    int    out_cols;        // number of columns after inverse DCTs (see output_cols option)
+    float *truncated;       // results, if smaller than data array; else NULL
+    double detail;          // "detail" exponent for info
+    double xscale;          // pixel columns per meter
+    double yscale;          // pixel rows    per meter
+    int    type_fwd;        // type of forward DCTs
+    int    type_bwd;        // type of inverse DCTs
+    struct Terrain_Operator_Info
+           info;            // operator for detail
+    struct Dct_Plan
+          *row_plans;       // forward DCTs of rows (length ncols), one per worker
+    struct Dct_Plan
+          *row_bwd_plans;   // inverse DCTs of rows (length out_cols)
+    struct Dct_Plan
+          *col_plans;       // forward DCTs of columns (length nrows), one per worker
+    struct Dct_Plan
+          *col_bwd_plans;   // inverse DCTs of columns (length out_rows)
+    float *buffer;          // column tiles (one per worker), or one panel if out_of_core
+    long   width;           // number of columns per tile or panel
+};
+
+struct Terrain_Filter_Context *terrain_filter_create(
+    double detail,      // input: "detail" exponent to be applied
+    int    nrows,       // input: number of rows    in data arrays
+    int    ncols,       // input: number of columns in data arrays
+    double xdim,        // input: spacing between pixel columns (in degrees or meters)
+    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
+    double center_lat,  // input: latitude in degrees at center of data arrays
+                        //        (ignored if coord_type == TERRAIN_METERS)
+    const struct Terrain_Filter_Options
+          *options      // optional processing options; NULL for defaults
+)
+// Allocates everything needed by terrain_filter_run(); returns NULL if the output size
+// is invalid or a memory allocation error occurred.
+{
+    enum Terrain_Reg registration = TERRAIN_REG_CELL;
+
+    struct Terrain_Filter_Context *context;
+    int out_rows, out_cols;
+    int num_threads;
+    int backend;
+    size_t buffer_size;
+
+    context = (struct Terrain_Filter_Context *)calloc( 1, sizeof( struct Terrain_Filter_Context ) );
+    if (!context) {
+        return NULL;
+    }
+
+    if (options) {
+        context->options = *options;
+    } else {
+        terrain_filter_default_options( &context->options );
+    }
+    backend = context->options.dct_backend;
+
+    context->data_rows = nrows;
+    context->data_cols = ncols;
+
+    if (output_size( &context->options, nrows, ncols, &out_rows, &out_cols )) {
+        free( context );
+        return NULL;
+    }
+
+    // (padding is not done out-of-core, where the data may not fit in memory twice,
+    // nor for a smaller output size, which could not be cropped from the padded result)
+    if (context->options.pad_fft_size && !context->options.out_of_core &&
+        out_rows == nrows && out_cols == ncols && terrain_padding_worthwhile( nrows, ncols ))
+    {
+        nrows = out_rows = terrain_padded_size( nrows );
+        ncols = out_cols = terrain_padded_size( ncols );
+    }
+
+    context->nrows    = nrows;
+    context->ncols    = ncols;
+    context->out_rows = out_rows;
+    context->out_cols = out_cols;
+    context->detail   = detail;
+
+    switch (registration) {
+        case TERRAIN_REG_GRID:
+            context->type_fwd = 1;
+            context->type_bwd = 1;
+            break;
+        case TERRAIN_REG_CELL:
+            context->type_fwd = 2;
+            context->type_bwd = 3;
+            break;
+        default:
+            free( context );
+            return NULL;
+    }
+
+    pixel_scales( xdim, ydim, coord_type, center_lat, &context->xscale, &context->yscale );
+
+    num_threads = context->options.num_threads > 0 ?
+        context->options.num_threads : default_thread_count();
+
+    if (num_threads > 1) {
+        // if threads cannot be created, fall back to single-threaded processing
+        context->pool = create_thread_pool( num_threads );
+    }
+    num_threads = context->num_threads = thread_pool_size( context->pool );
+
+    // Each worker thread has its own DCT plan(s), so the row (and column)
+    // batches of each pass can be processed independently in parallel.
+    context->row_plans     = setup_plans( context->type_fwd, ncols, backend, num_threads );
+    context->row_bwd_plans = setup_plans( context->type_bwd, out_cols, backend, num_threads );
+    context->col_plans     = setup_plans( context->type_fwd, nrows, backend, num_threads );
+    context->col_bwd_plans = setup_plans( context->type_bwd, out_rows, backend, num_threads );
+
+    if (!context->row_plans || !context->row_bwd_plans ||
+        !context->col_plans || !context->col_bwd_plans ||
+        setup_operator( detail, ncols, nrows, context->xscale, context->yscale, registration,
+                        context->options.operator_precision, &context->info ))
+    {
+        terrain_filter_destroy( context );
+        return NULL;
+    }
+
+    if (context->options.out_of_core) {
+        context->width = panel_width(
+            nrows, ncols, context->col_plans[0].batch_size, context->options.panel_memory );
+        buffer_size = (size_t)context->width * (size_t)nrows;
+    } else {
+        context->width = tile_width( nrows, ncols, context->col_plans[0].batch_size );
+        buffer_size = (size_t)num_threads * (size_t)context->width * (size_t)nrows;
+    }
+
+    context->buffer = (float *)malloc( sizeof( float ) * buffer_size );
+    if (!context->buffer) {
+        terrain_filter_destroy( context );
+        return NULL;
+    }
+
+    if (nrows != context->data_rows || ncols != context->data_cols) {
+        context->padded = (float *)malloc( sizeof( float ) * (size_t)nrows * (size_t)ncols );
+        if (!context->padded) {
+            terrain_filter_destroy( context );
+            return NULL;
+        }
+    }
+
+    if (out_rows != nrows || out_cols != ncols) {
+        context->truncated = (float *)malloc( sizeof( float ) * (size_t)out_rows * (size_t)out_cols );
+        if (!context->truncated) {
+            terrain_filter_destroy( context );
+            return NULL;
+        }
+    }
+
+    return context;
+}
+
+void terrain_filter_destroy(
+    struct Terrain_Filter_Context *context  // input: from terrain_filter_create(), or NULL
+)
+{
+    if (!context) {
+        return;
+    }
+
+    free( context->truncated );
+    free( context->padded );
+    free( context->buffer );
+
+    cleanup_plans( context->col_bwd_plans, context->num_threads );
+    cleanup_plans( context->col_plans,     context->num_threads );
+    cleanup_plans( context->row_bwd_plans, context->num_threads );
+    cleanup_plans( context->row_plans,     context->num_threads );
+
+    cleanup_operator( context->info );  // (separablex is null if never set up)
+
+    destroy_thread_pool( context->pool );
+
+    free( context );
+}
+
+// Performs the column pass of the context on data (see enum Terrain_Column_Stages).
+// The inverse stage writes out_rows x out_cols results to output, which may be data.
+static int column_pass(
+    struct Terrain_Filter_Context *context, float *data, float *output,
+    const struct Terrain_Operator_Info *info, int stages,
+    struct Terrain_Progress_Info *progress_info )
+{
+    const int report = progress_info->progress != NULL;
+
+    struct Thread_Pool_Progress_Callback
+        pool_progress = { pass_progress, progress_info };
+
+    int out_rows = context->nrows;
+    int out_cols = context->ncols;
+
+    if (stages & TERRAIN_COLUMNS_INVERSE) {
+        out_rows = context->out_rows;
+        out_cols = context->out_cols;
+    }
+
+    if (context->options.out_of_core) {
+        return dct_panel_pass( data, context->nrows, context->ncols, output, out_rows, out_cols,
+                               info, stages, context->col_plans, context->col_bwd_plans,
+                               context->buffer, context->width,
+                               context->pool, report ? progress_info : NULL );
+    } else {
+        return dct_tile_pass( data, context->nrows, context->ncols, output, out_rows, out_cols,
+                              info, stages, context->col_plans, context->col_bwd_plans,
+                              context->buffer, context->width,
+                              context->pool, report ? &pool_progress : NULL );
+    }
+}
+
+static int filter_steps(
+    struct Terrain_Filter_Context *context,
+    float *data,
+    int    range_known,     // nonzero if data_min and data_max are the range of data
+    float  data_min,
+    float  data_max,
+    const struct Terrain_Progress_Callback *progress )
+// Filters data array of the transform size of context.
+// If the output size is smaller, results are stored at the start of data array.
+{
+    const int nrows = context->nrows;
+    const int ncols = context->ncols;
+
+    float *output = context->truncated ? context->truncated : data;
+
+    // number of threads used to parallelize the three DCT loops
+    int num_threads = context->num_threads;
+
+    // the column pass gathers and scatters columns itself, so steps 3 and 5
+    // (formerly transposes) take no time; the out-of-core copies are not threaded
+    float column_time = context->options.out_of_core ? 5.0 : 4.5/num_threads;
+
+    // the data are normalized during the first row pass, so step 1 is at most
+    // a scan for the data range
+    float range_time = range_known ? 0.0 : 0.25;
+
+    // approximate relative amount of time spent in each step
+    // (actual times vary with data array size, memory size, and DCT algorithms chosen):
+    const float step_times[6] = {
+        range_time, 2.0/num_threads, 0.0, column_time, 0.0, 2.0/num_threads };
+
+    const int total_steps = sizeof( step_times ) / sizeof( *step_times );
+
+    struct Terrain_Progress_Info
+        progress_info = init_progress( progress, step_times, total_steps );
+
+    struct Thread_Pool_Progress_Callback
+        pool_progress = { pass_progress, &progress_info };
+
+    int error;
+
+    double normalizer;
+
+    if (progress && report_progress( &progress_info )) {
+        return TERRAIN_FILTER_CANCELED;
+    }
+
+    if (!range_known) {
+        data_range( data, nrows, ncols, &data_min, &data_max );
+    }
+
+    // data are multiplied by normalizer in the first row pass
+    normalizer = data_normalizer( context->detail, data_min, data_max );
+
+    set_progress( &progress_info, 1 );
+
+    if (progress && report_progress( &progress_info )) {
+        return TERRAIN_FILTER_CANCELED;
     }
 
+    error = dct_pass( data, ncols, nrows, normalizer, context->row_plans,
+                      context->pool, progress ? &pool_progress : NULL );
+    if (error) {
+        return error;
+    }
+
+    set_progress( &progress_info, 2 );
+
+    if (progress && report_progress( &progress_info )) {
+        return TERRAIN_FILTER_CANCELED;
+    }
+
+    set_progress( &progress_info, 3 );
+
+    if (progress && report_progress( &progress_info )) {
+        return TERRAIN_FILTER_CANCELED;
+    }
+
+    error = column_pass( context, data, output, &context->info, TERRAIN_COLUMNS_ALL,
+                         &progress_info );
+    if (error) {
+        return error;
+    }
+
+    if (flt_isnan( output[0] )) {
+        return TERRAIN_FILTER_NULL_VALUES;
+    }
+
+    set_progress( &progress_info, 4 );
     set_progress( &progress_info, 5 );
 
     if (progress && report_progress( &progress_info )) {
         return TERRAIN_FILTER_CANCELED;
     }
 
-    // CONCURRENCY NOTE: The iterations of the loop below will be
-    // independent and can be executed in parallel, if each thread has
-    // its own dct_plan with separate calls to setup_dcts() and cleanup_dcts().
-    {
-        struct Dct_Plan dct_plan = setup_dcts( type_bwd, ncols );
+    error = dct_pass( output, context->out_cols, context->out_rows, 1.0, context->row_bwd_plans,
+                      context->pool, progress ? &pool_progress : NULL );
+    if (error) {
+        return error;
+    }
 
-        if (!dct_plan.dct_buffer) {
-            return TERRAIN_FILTER_MALLOC_ERROR;
+    if (output != data) {
+        memcpy( data, output,
+                sizeof( float ) * (size_t)context->out_rows * (size_t)context->out_cols );
+    }
+
+    set_progress( &progress_info, 6 );
+
+    if (progress) {
+        // report final progress; ignore any cancel request at this point
+        report_progress( &progress_info );
+    }
+
+    return TERRAIN_FILTER_SUCCESS;
+}
+
+static int run_context(
+    struct Terrain_Filter_Context *context,
+    float *data,
+    int    range_known,     // nonzero if data_min and data_max are the range of data
+    float  data_min,
+    float  data_max,
+    const struct Terrain_Progress_Callback *progress )
+// Implements terrain_filter_run() and terrain_filter_opts().
+{
+    int error;
+
+    if (!context->padded) {
+        return filter_steps( context, data, range_known, data_min, data_max, progress );
+    }
+
+    // mirroring does not change the data range
+    pad_mirror( data, context->data_rows, context->data_cols,
+                context->padded, context->nrows, context->ncols );
+
+    error = filter_steps( context, context->padded, range_known, data_min, data_max, progress );
+
+    if (!error) {
+        crop_padded( context->padded, context->ncols,
+                     data, context->data_rows, context->data_cols );
+    }
+    return error;
+}
+
+int terrain_filter_run(
+    struct Terrain_Filter_Context
+          *context,     // input: from terrain_filter_create()
+    float *data,        // input/output: array of data to process (row-major order)
+    const struct Terrain_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+)
+{
+    return run_context( context, data, 0, 0.0, 0.0, progress );
+}
+
+int terrain_filter_opts(
+    float *data,        // input/output: array of data to process (row-major order)
+    double detail,      // input: "detail" exponent to be applied
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xdim,        // input: spacing between pixel columns (in degrees or meters)
+    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
+    double center_lat,  // input: latitude in degrees at center of data array
+                        //        (ignored if coord_type == TERRAIN_METERS)
+    const struct Terrain_Progress_Callback
+          *progress,    // optional callback functor for status; NULL for none
+    const struct Terrain_Filter_Options
+          *options      // optional processing options; NULL for defaults
+)
+// Same as terrain_filter(), with additional processing options.
+{
+    struct Terrain_Filter_Context *context;
+    int out_rows, out_cols;
+    int error;
+
+    error = output_size( options, nrows, ncols, &out_rows, &out_cols );
+    if (error) {
+        return error;
+    }
+
+    context = terrain_filter_create(
+        detail, nrows, ncols, xdim, ydim, coord_type, center_lat, options );
+    if (!context) {
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+
+    error = run_context( context, data, context->options.range_known,
+                         context->options.data_min, context->options.data_max, progress );
+
+    terrain_filter_destroy( context );
+
+    return error;
+}
+
+// Relative time of the steps of spectrum_steps() and inverse_steps()
+// (as in run_context(), but each column pass does only half the DCTs):
+// data range, forward row DCTs, forward column DCTs,
+// then for each detail: operator & inverse column DCTs, inverse row DCTs.
+static float *split_step_times(
+    int num_forward,    // input: 0 if spectrum is known, 3 if not
+    int num_details,    // input: number of details for inverse steps (may be 0)
+    const struct Terrain_Filter_Context *context )
+{
+    int   num_threads = context->num_threads;
+    float column_time = context->options.out_of_core ? 2.5 : 2.25/num_threads;
+    float range_time  = context->options.range_known ? 0.0 : 0.25;
+
+    float *step_times = (float *)malloc( sizeof( float ) * (num_forward + 2 * num_details) );
+    float *ptr = step_times;
+    int k;
+
+    if (!step_times) {
+        return NULL;
+    }
+    if (num_forward) {
+        *ptr++ = range_time;
+        *ptr++ = 2.0/num_threads;
+        *ptr++ = column_time;
+    }
+    for (k=0; k<num_details; ++k) {
+        *ptr++ = column_time;
+        *ptr++ = 2.0/num_threads;
+    }
+    return step_times;
+}
+
+static int spectrum_steps(
+    struct Terrain_Filter_Context *context, float *data, float *data_min, float *data_max,
+    struct Terrain_Progress_Info *progress_info )
+// Computes the unnormalized spectrum in place: steps 0 to 2 of progress_info.
+{
+    const int report = progress_info->progress != NULL;
+
+    struct Thread_Pool_Progress_Callback
+        pool_progress = { pass_progress, progress_info };
+
+    int error;
+
+    if (report && report_progress( progress_info )) {
+        return TERRAIN_FILTER_CANCELED;
+    }
+
+    if (context->options.range_known) {
+        *data_min = context->options.data_min;
+        *data_max = context->options.data_max;
+    } else {
+        data_range( data, context->nrows, context->ncols, data_min, data_max );
+    }
+
+    set_progress( progress_info, 1 );
+
+    if (report && report_progress( progress_info )) {
+        return TERRAIN_FILTER_CANCELED;
+    }
+
+    // no normalization here: it depends on detail (see inverse_steps())
+    error = dct_pass( data, context->ncols, context->nrows, 1.0, context->row_plans,
+                      context->pool, report ? &pool_progress : NULL );
+    if (error) {
+        return error;
+    }
+
+    set_progress( progress_info, 2 );
+
+    if (report && report_progress( progress_info )) {
+        return TERRAIN_FILTER_CANCELED;
+    }
+
+    return column_pass( context, data, data, NULL, TERRAIN_COLUMNS_FORWARD, progress_info );
+}
+
+static int inverse_steps(
+    struct Terrain_Filter_Context *context,
+    float *spectrum, float data_min, float data_max,
+    const double *details, int num_details, float *const *outputs,
+    struct Terrain_Progress_Info *progress_info, int first_step )
+// For each detail, copies the spectrum to the output array and applies the operator,
+// inverse column DCTs, and inverse row DCTs there: two steps of progress_info per detail,
+// starting at first_step. If the output size is smaller, the column pass reads the
+// spectrum directly and writes the (out_rows x out_cols) results to the output array.
+{
+    enum Terrain_Reg registration = TERRAIN_REG_CELL;
+
+    const int nrows = context->nrows;
+    const int ncols = context->ncols;
+
+    const int report = progress_info->progress != NULL;
+
+    struct Thread_Pool_Progress_Callback
+        pool_progress = { pass_progress, progress_info };
+
+    int error = TERRAIN_FILTER_SUCCESS;
+
+    int k;
+
+    struct Terrain_Operator_Info info;
+
+    for (k=0; k<num_details-1; ++k) {
+        if (outputs[k] == spectrum) {
+            return TERRAIN_FILTER_INVALID_PARAM;
+        }
+    }
+
+    for (k=0; k<num_details; ++k) {
+        float *output = outputs[k];
+        float *source = output;     // input of column pass
+        float *result = output;     // output of column pass and inverse row DCTs
+        int    shared = details[k] == context->detail;  // use operator tables of context
+
+        set_progress( progress_info, first_step + 2*k );
+
+        if (report && report_progress( progress_info )) {
+            return TERRAIN_FILTER_CANCELED;
+        }
+
+        if (shared) {
+            info = context->info;
+        } else {
+            error = setup_operator( details[k], ncols, nrows, context->xscale, context->yscale,
+                                    registration, context->options.operator_precision, &info );
+            if (error) {
+                return error;
+            }
         }
 
-        for (i=0; i<nrows-1; i+=2) {
-            float *ptr = data + (LONG)i * (LONG)ncols;
-            two_dcts( ptr, ncols, &dct_plan );
-            if (progress && update_progress( &progress_info, i+2, nrows ))
-            {
-                return TERRAIN_FILTER_CANCELED;
+        // the operator is linear, so normalization is folded into its constant factor
+        info.factor *= data_normalizer( details[k], data_min, data_max );
+
+        if (context->truncated) {
+            // the spectrum is still needed while the results are written
+            source = spectrum;
+            if (output == spectrum) {
+                result = context->truncated;
             }
+        } else if (output != spectrum) {
+            memcpy( output, spectrum, sizeof( float ) * (size_t)nrows * (size_t)ncols );
+        }
+
+        error = column_pass( context, source, result, &info, TERRAIN_COLUMNS_INVERSE,
+                             progress_info );
+
+        if (!shared) {
+            cleanup_operator( info );
+        }
+
+        if (error) {
+            return error;
+        }
+
+        if (flt_isnan( result[0] )) {
+            return TERRAIN_FILTER_NULL_VALUES;
+        }
+
+        set_progress( progress_info, first_step + 2*k + 1 );
+
+        if (report && report_progress( progress_info )) {
+            return TERRAIN_FILTER_CANCELED;
         }
-        if (nrows & 1) {
-            float *ptr = data + (LONG)(nrows - 1) * (LONG)ncols;
-            single_dct( ptr, ncols, &dct_plan );
+
+        error = dct_pass( result, context->out_cols, context->out_rows, 1.0,
+                          context->row_bwd_plans, context->pool, report ? &pool_progress : NULL );
+        if (error) {
+            return error;
         }
 
-        cleanup_dcts( &dct_plan );
+        if (result != output) {
+            memcpy( output, result,
+                    sizeof( float ) * (size_t)context->out_rows * (size_t)context->out_cols );
+        }
     }
 
-    cleanup_operator( info );
+    return TERRAIN_FILTER_SUCCESS;
+}
 
-    set_progress( &progress_info, 6 );
+static int padded_multi(
+    struct Terrain_Filter_Context *context, float *data,
+    const double *details, int num_details, float *const *outputs,
+    struct Terrain_Progress_Info *progress_info )
+// Implements terrain_filter_multi() when context pads the data: the spectrum stays in
+// context->padded, and each output is made in a padded scratch array and cropped.
+{
+    float *spectrum = context->padded;
+    float *scratch  = NULL;
+    float *output;
+    float data_min, data_max;
+    int error;
+    int k;
+
+    pad_mirror( data, context->data_rows, context->data_cols,
+                spectrum, context->nrows, context->ncols );
+
+    error = spectrum_steps( context, spectrum, &data_min, &data_max, progress_info );
+    if (error) {
+        return error;
+    }
+
+    if (num_details > 1) {
+        scratch = (float *)malloc(
+            sizeof( float ) * (size_t)context->nrows * (size_t)context->ncols );
+        if (!scratch) {
+            return TERRAIN_FILTER_MALLOC_ERROR;
+        }
+    }
+
+    for (k=0; k<num_details && !error; ++k) {
+        // the last output may overwrite the spectrum
+        output = k < num_details-1 ? scratch : spectrum;
+
+        error = inverse_steps( context, spectrum, data_min, data_max, details + k, 1,
+                               &output, progress_info, 3 + 2*k );
+        if (!error) {
+            crop_padded( output, context->ncols,
+                         outputs[k], context->data_rows, context->data_cols );
+        }
+    }
+
+    free( scratch );
+
+    return error;
+}
+
+// Common ending for the functions below: reports final progress and frees resources.
+static int finish_split(
+    int error, struct Terrain_Progress_Info *progress_info,
+    float *step_times, struct Terrain_Filter_Context *context )
+{
+    if (!error && progress_info->progress) {
+        set_progress( progress_info, progress_info->total_steps );
 
-    if (progress) {
         // report final progress; ignore any cancel request at this point
-        report_progress( &progress_info );
+        report_progress( progress_info );
     }
 
-    return TERRAIN_FILTER_SUCCESS;
+    free( step_times );
+    terrain_filter_destroy( context );
+
+    return error;
+}
+
+int terrain_filter_multi(
+    float *data,        // input: array of data to process (row-major order);
+                        // output: DCT spectrum of data (unless also in outputs)
+    const double
+          *details,     // input: "detail" exponents to be applied
+    int    num_details, // input: number of values in details and outputs arrays
+    float *const
+          *outputs,     // output: arrays for results, one for each detail (row-major order);
+                        // outputs[num_details-1] may be data, others must not be
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xdim,        // input: spacing between pixel columns (in degrees or meters)
+    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
+    double center_lat,  // input: latitude in degrees at center of data array
+                        //        (ignored if coord_type == TERRAIN_METERS)
+    const struct Terrain_Progress_Callback
+          *progress,    // optional callback functor for status; NULL for none
+    const struct Terrain_Filter_Options
+          *options      // optional processing options; NULL for defaults
+)
+// Same as terrain_filter_opts() for several detail exponents, sharing the forward DCTs.
+{
+    struct Terrain_Filter_Context *context;
+    struct Terrain_Progress_Info progress_info;
+    float *step_times;
+    float data_min, data_max;
+    int out_rows, out_cols;
+    int error;
+
+    if (num_details < 1 || output_size( options, nrows, ncols, &out_rows, &out_cols )) {
+        return TERRAIN_FILTER_INVALID_PARAM;
+    }
+
+    context = terrain_filter_create(
+        details[0], nrows, ncols, xdim, ydim, coord_type, center_lat, options );
+    if (!context) {
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+
+    step_times = split_step_times( 3, num_details, context );
+    if (!step_times) {
+        terrain_filter_destroy( context );
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+    progress_info = init_progress( progress, step_times, 3 + 2 * num_details );
+
+    if (context->padded) {
+        error = padded_multi( context, data, details, num_details, outputs, &progress_info );
+    } else {
+        error = spectrum_steps( context, data, &data_min, &data_max, &progress_info );
+        if (!error) {
+            error = inverse_steps( context, data, data_min, data_max, details, num_details,
+                                   outputs, &progress_info, 3 );
+        }
+    }
+
+    return finish_split( error, &progress_info, step_times, context );
+}
+
+// The spectrum functions work on the data size, since the spectrum is the caller's array.
+static void unpadded_options(
+    const struct Terrain_Filter_Options *options, struct Terrain_Filter_Options *unpadded )
+{
+    if (options) {
+        *unpadded = *options;
+    } else {
+        terrain_filter_default_options( unpadded );
+    }
+    unpadded->pad_fft_size = 0;
+}
+
+int terrain_filter_spectrum(
+    float *data,        // input: array of data to process (row-major order);
+                        // output: DCT spectrum of data
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    float *data_min,    // output: minimum value of input data
+    float *data_max,    // output: maximum value of input data
+    const struct Terrain_Progress_Callback
+          *progress,    // optional callback functor for status; NULL for none
+    const struct Terrain_Filter_Options
+          *options      // optional processing options; NULL for defaults
+)
+// First half of terrain_filter_multi(); see terrain_filter_from_spectrum().
+{
+    struct Terrain_Filter_Options unpadded;
+    struct Terrain_Filter_Context *context;
+    struct Terrain_Progress_Info progress_info;
+    float *step_times;
+    int error;
+
+    // detail and pixel size do not affect the spectrum
+    unpadded_options( options, &unpadded );
+    unpadded.output_rows = 0;   // (no inverse DCTs here)
+    unpadded.output_cols = 0;
+
+    context = terrain_filter_create(
+        1.0, nrows, ncols, 1.0, 1.0, TERRAIN_METERS, 0.0, &unpadded );
+    if (!context) {
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+
+    step_times = split_step_times( 3, 0, context );
+    if (!step_times) {
+        terrain_filter_destroy( context );
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+    progress_info = init_progress( progress, step_times, 3 );
+
+    error = spectrum_steps( context, data, data_min, data_max, &progress_info );
+
+    return finish_split( error, &progress_info, step_times, context );
+}
+
+int terrain_filter_from_spectrum(
+    float *spectrum,    // input: DCT spectrum from terrain_filter_spectrum()
+                        //        (unchanged unless it is also the last output)
+    float  data_min,    // input: minimum value from terrain_filter_spectrum()
+    float  data_max,    // input: maximum value from terrain_filter_spectrum()
+    const double
+          *details,     // input: "detail" exponents to be applied
+    int    num_details, // input: number of values in details and outputs arrays
+    float *const
+          *outputs,     // output: arrays for results, one for each detail (row-major order);
+                        // outputs[num_details-1] may be spectrum, others must not be
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xdim,        // input: spacing between pixel columns (in degrees or meters)
+    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
+    double center_lat,  // input: latitude in degrees at center of data array
+                        //        (ignored if coord_type == TERRAIN_METERS)
+    const struct Terrain_Progress_Callback
+          *progress,    // optional callback functor for status; NULL for none
+    const struct Terrain_Filter_Options
+          *options      // optional processing options; NULL for defaults
+)
+// Second half of terrain_filter_multi(); see terrain_filter_spectrum().
+{
+    struct Terrain_Filter_Options unpadded;
+    struct Terrain_Filter_Context *context;
+    struct Terrain_Progress_Info progress_info;
+    float *step_times;
+    int out_rows, out_cols;
+    int error;
+
+    if (num_details < 1 || output_size( options, nrows, ncols, &out_rows, &out_cols )) {
+        return TERRAIN_FILTER_INVALID_PARAM;
+    }
+
+    unpadded_options( options, &unpadded );
+
+    context = terrain_filter_create(
+        details[0], nrows, ncols, xdim, ydim, coord_type, center_lat, &unpadded );
+    if (!context) {
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+
+    step_times = split_step_times( 0, num_details, context );
+    if (!step_times) {
+        terrain_filter_destroy( context );
+        return TERRAIN_FILTER_MALLOC_ERROR;
+    }
+    progress_info = init_progress( progress, step_times, 2 * num_details );
+
+    error = inverse_steps( context, spectrum, data_min, data_max, details, num_details, outputs,
+                           &progress_info, 0 );
+
+    return finish_split( error, &progress_info, step_times, context );
 }
@@ -31,6 +31,8 @@
 #ifndef TERRAIN_FILTER_H
 #define TERRAIN_FILTER_H
 
+#include <stddef.h> // for size_t
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -56,6 +58,12 @@ enum Terrain_Filter_Errors {
     TERRAIN_FILTER_CANCELED      = -1   // cancellation requested by progress callback function
 };
 
+enum Terrain_Operator_Precision {
+    TERRAIN_OPERATOR_EXACT = 0, // evaluate fractional Laplacian with pow() in double precision
+    TERRAIN_OPERATOR_FAST  = 1  // single-precision polynomial log2/exp2 (relative error ~1e-6);
+                                // used only for detail from 0 to 2, otherwise same as EXACT
+};
+
 struct Terrain_Progress_Callback {
     // callback function - return nonzero value to cancel operation:
     int (*callback)(
@@ -76,6 +84,47 @@ struct Terrain_Scale_Callback {
 };
 
 
+struct Terrain_Filter_Options {
+    // Fill in with terrain_filter_default_options() before changing any fields.
+    int num_threads;    // number of worker threads used for the DCT passes
+                        // (0 = default: see default_thread_count() in thread_pool.h)
+    int out_of_core;    // nonzero to process the columns in large panels instead of small
+                        // per-thread tiles; accesses data strictly row by row, so data may
+                        // be a memory-mapped file larger than available memory
+                        // (output is identical either way)
+    size_t panel_memory;// bytes of working memory for column panels when out_of_core != 0
+                        // (0 = default)
+    int dct_backend;    // DCT implementation, enum Dct_Backend in dct.h
+                        // (0 = default: see default_dct_backend() in dct.h);
+                        // output differs slightly from the FFTPACK backend for SIMD backends
+    int operator_precision;
+                        // evaluation of the fractional Laplacian multiplier,
+                        // enum Terrain_Operator_Precision (default: TERRAIN_OPERATOR_EXACT)
+    int range_known;    // nonzero if data_min and data_max are the range of the input data
+                        // (e.g., from read_flt_hdr_range()), to skip a pass over the data
+    float data_min;     // minimum value in data array, if range_known != 0
+    float data_max;     // maximum value in data array, if range_known != 0
+    int pad_fft_size;   // nonzero to extend the data by mirroring to the next sizes whose
+                        // only prime factors are 2, 3, and 5 (see terrain_padded_size()),
+                        // filter, and crop back: much faster for sizes with large prime
+                        // factors, but only approximate, as the padded array has different
+                        // boundary conditions. Nearly every output value changes; errors
+                        // are largest within about 10 pixels of the edges (typically 0.1%
+                        // to 5% of the output range, worst at the bottom and right edges),
+                        // about 1% or less from 10 to 50 pixels in, and 0.1% or less beyond
+                        // 150. Only done if terrain_padding_worthwhile(); ignored if
+                        // out_of_core != 0, and by the spectrum functions
+    int output_rows;    // number of rows    in results, at most nrows (0 = nrows)
+    int output_cols;    // number of columns in results, at most ncols (0 = ncols)
+                        // If smaller than the data array, only the corresponding lowest
+                        // DCT coefficients are kept after the operator, and the inverse
+                        // DCTs are done at the output size: the result is the texture
+                        // resampled without aliasing to output_cols x output_rows cells
+                        // covering the same extent, stored row-major at the start of each
+                        // output array. (pad_fft_size is ignored in this case.)
+};
+
+
 // PRIMARY TEXTURE SHADING FUNCTION:
 // ================================
 
@@ -99,6 +148,155 @@ int terrain_filter(
 //  enum Terrain_Reg registration   // feature not yet implemented
 );
 
+// Same as terrain_filter(), with additional processing options.
+int terrain_filter_opts(
+    float *data,        // input/output: array of data to process (row-major order)
+    double detail,      // input: "detail" exponent to be applied
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xdim,        // input: spacing between pixel columns (in degrees or meters)
+    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
+    double center_lat,  // input: latitude in degrees at center of data array
+                        //        (ignored if coord_type == TERRAIN_METERS)
+    const struct Terrain_Progress_Callback
+          *progress,    // optional callback functor for status; NULL for none
+    const struct Terrain_Filter_Options
+          *options      // optional processing options; NULL for defaults
+);
+
+// Same as terrain_filter_opts() for several detail exponents: the forward DCTs of data
+// are computed only once, then the operator and inverse DCTs for each detail
+// (num_details+1 instead of 2*num_details transforms).
+// outputs[k] receives the result for details[k]; each must hold nrows x ncols values.
+// Data array is overwritten with its DCT spectrum, unless it is the last output
+// (or pad_fft_size is set, in which case it is unchanged unless it is an output).
+// Results differ from terrain_filter_opts() only by float roundoff.
+int terrain_filter_multi(
+    float *data,        // input: array of data to process (row-major order);
+                        // output: DCT spectrum of data (unless also in outputs)
+    const double
+          *details,     // input: "detail" exponents to be applied
+    int    num_details, // input: number of values in details and outputs arrays
+    float *const
+          *outputs,     // output: arrays for results, one for each detail (row-major order);
+                        // outputs[num_details-1] may be data, others must not be
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xdim,        // input: spacing between pixel columns (in degrees or meters)
+    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
+    double center_lat,  // input: latitude in degrees at center of data array
+                        //        (ignored if coord_type == TERRAIN_METERS)
+    const struct Terrain_Progress_Callback
+          *progress,    // optional callback functor for status; NULL for none
+    const struct Terrain_Filter_Options
+          *options      // optional processing options; NULL for defaults
+);
+
+// The two halves of terrain_filter_multi(), so the spectrum can be saved and reused:
+// terrain_filter_spectrum() replaces data with its DCT spectrum (which depends only on
+// the data and the DCT backend), and terrain_filter_from_spectrum() computes the
+// outputs from it. Calling both gives the same results as terrain_filter_multi().
+int terrain_filter_spectrum(
+    float *data,        // input: array of data to process (row-major order);
+                        // output: DCT spectrum of data
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    float *data_min,    // output: minimum value of input data
+    float *data_max,    // output: maximum value of input data
+    const struct Terrain_Progress_Callback
+          *progress,    // optional callback functor for status; NULL for none
+    const struct Terrain_Filter_Options
+          *options      // optional processing options; NULL for defaults
+);
+
+int terrain_filter_from_spectrum(
+    float *spectrum,    // input: DCT spectrum from terrain_filter_spectrum()
+                        //        (unchanged unless it is also the last output)
+    float  data_min,    // input: minimum value from terrain_filter_spectrum()
+    float  data_max,    // input: maximum value from terrain_filter_spectrum()
+    const double
+          *details,     // input: "detail" exponents to be applied
+    int    num_details, // input: number of values in details and outputs arrays
+    float *const
+          *outputs,     // output: arrays for results, one for each detail (row-major order);
+                        // outputs[num_details-1] may be spectrum, others must not be
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double xdim,        // input: spacing between pixel columns (in degrees or meters)
+    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
+    double center_lat,  // input: latitude in degrees at center of data array
+                        //        (ignored if coord_type == TERRAIN_METERS)
+    const struct Terrain_Progress_Callback
+          *progress,    // optional callback functor for status; NULL for none
+    const struct Terrain_Filter_Options
+          *options      // optional processing options; NULL for defaults
+);
+
+// Sets all processing options to their default values.
+void terrain_filter_default_options(
+    struct Terrain_Filter_Options *options  // output: default options
+);
+
+
+// REUSABLE TEXTURE SHADING CONTEXT:
+// ================================
+
+// For processing many data arrays of the same size and detail (e.g., tiles or frames),
+// a context keeps the worker threads, DCT plans, operator tables, and column buffers
+// of terrain_filter_opts() between runs. Each context may be used by only one thread
+// at a time; separate contexts may be used concurrently.
+//
+//      struct Terrain_Filter_Context *context = terrain_filter_create(
+//          detail, nrows, ncols, xdim, ydim, coord_type, center_lat, options );
+//      if (!context) {
+//          // handle error here
+//      }
+//      for (each data array) {
+//          int error = terrain_filter_run( context, data, progress );
+//      }
+//      terrain_filter_destroy( context );
+
+struct Terrain_Filter_Context;
+
+// Allocates a context for terrain_filter_run(); returns NULL if a memory allocation
+// error occurred. options->range_known, data_min, and data_max are ignored.
+struct Terrain_Filter_Context *terrain_filter_create(
+    double detail,      // input: "detail" exponent to be applied
+    int    nrows,       // input: number of rows    in data arrays
+    int    ncols,       // input: number of columns in data arrays
+    double xdim,        // input: spacing between pixel columns (in degrees or meters)
+    double ydim,        // input: spacing between pixel rows    (in degrees or meters)
+    enum Terrain_Coord_Type
+           coord_type,  // input: coordinate type for xdim & ydim (degrees or meters)
+    double center_lat,  // input: latitude in degrees at center of data arrays
+                        //        (ignored if coord_type == TERRAIN_METERS)
+    const struct Terrain_Filter_Options
+          *options      // optional processing options; NULL for defaults
+);
+
+// Same as terrain_filter_opts() with the parameters given to terrain_filter_create().
+// Returns 0 on success, nonzero if an error occurred (see enum Terrain_Filter_Errors);
+// the context remains usable after an error.
+int terrain_filter_run(
+    struct Terrain_Filter_Context
+          *context,     // input: from terrain_filter_create()
+    float *data,        // input/output: array of data to process (row-major order)
+    const struct Terrain_Progress_Callback
+          *progress     // optional callback functor for status; NULL for none
+);
+
+// Frees all resources of a context; NULL is ignored.
+void terrain_filter_destroy(
+    struct Terrain_Filter_Context
+          *context      // input: from terrain_filter_create(), or NULL
+);
+
 
 // AUXILIARY FUNCTIONS FOR TEXTURE SHADING:
 // =======================================
@@ -159,6 +357,30 @@ void terrain_image_data(
     double image_max    // input: maximum value for output pixels
 );
 
+// Pixel types for terrain_image_pixels().
+enum Terrain_Image_Format {
+    TERRAIN_IMAGE_FLOAT,    // float
+    TERRAIN_IMAGE_UINT8,    // unsigned char,  rounded and clamped to 0..255
+    TERRAIN_IMAGE_UINT16    // unsigned short, rounded and clamped to 0..65535
+};
+
+// Same as terrain_image_data(), writing pixels of the given type to a separate
+// array (or in place for TERRAIN_IMAGE_FLOAT), using multiple threads.
+// Integer pixels for NaN (void) input values are set to 0.
+void terrain_image_pixels(
+    const float *data,  // input: array of data to convert (row-major order)
+    void  *pixels,      // output: array of nrows x ncols pixels of given format
+    enum Terrain_Image_Format
+           format,      // input: pixel type of output array
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double vertical_enhancement,
+                        // input: as for terrain_image_data()
+    double image_min,   // input: minimum value for output pixels
+    double image_max,   // input: maximum value for output pixels
+    int    num_threads  // input: number of threads to use (0 = default)
+);
+
 
 // MISCELLANEOUS UTILITY FUNCTIONS:
 // ===============================
@@ -184,6 +406,37 @@ void geographic_scale(
 // Determines graticule aspect ratio at given latitude
 double geographic_aspect( double latdeg );
 
+// Returns easting in meters of normal Mercator projection (true scale at the equator)
+// for longitude in degrees.
+double mercator_easting( double londeg );
+
+// Returns northing in meters of normal Mercator projection (true scale at the equator)
+// for latitude in degrees.
+double mercator_northing( double latdeg );
+
+// Returns latitude in degrees for northing in meters of normal Mercator projection;
+// inverse of mercator_northing().
+double mercator_latitude( double northing );
+
+// Returns smallest length >= n whose only prime factors are 2, 3, and 5;
+// the array size used for each axis when pad_fft_size is set (see Terrain_Filter_Options).
+int terrain_padded_size( int n );
+
+// Returns nonzero if pad_fft_size pads an array of the given size: only if both sides
+// are at least 64 and the estimated speedup (see terrain_filter_cost()) is at least 1.5,
+// as padding small arrays has large relative errors, and gains little elsewhere.
+int terrain_padding_worthwhile(
+    int    nrows,       // input: number of rows    in data array
+    int    ncols        // input: number of columns in data array
+);
+
+// Returns estimated relative time of terrain_filter() on an array of the given size,
+// e.g. to report the speedup from pad_fft_size. Units are arbitrary.
+double terrain_filter_cost(
+    int    nrows,       // input: number of rows    in data array
+    int    ncols        // input: number of columns in data array
+);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,307 @@
+/*
+ * terrain_image.c
+ *
+ * Tone mapping of texture shading output to image pixels.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+//
+// Each pixel is mapped through tanh(), which dominates the cost when computed in
+// double precision by the C library. Here tanh() is evaluated in single precision
+// by a rational approximation (odd degree-13 numerator over even degree-6
+// denominator, the same form as Eigen's fast float tanh), with maximum absolute
+// error 4e-7 - well below one level of a 16-bit image. It needs only multiplies,
+// adds, and one divide, so it runs on several pixels at once in SIMD registers.
+// Rows are independent and are divided among threads.
+//
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "terrain_filter.h"
+#include "thread_pool.h"
+
+#include <stddef.h> // for ptrdiff_t
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// For a 64-bit compile we need LONG to be 64 bits, even if the compiler uses an LLP64 model
+#define LONG ptrdiff_t
+
+#if defined __GNUC__
+#   define IMAGE_LANES 4    // portable GCC/Clang vectors (SSE2, NEON, ...)
+#else
+#   define IMAGE_LANES 1    // no vector extensions - plain scalar code
+#endif
+
+// tanh(x) rounds to +/-1 in single precision beyond this
+static const float tanh_clamp = 7.90531110763549805f;
+
+// numerator coefficients (odd powers 1..13)
+static const float tanh_a1  =  4.89352455891786e-03f;
+static const float tanh_a3  =  6.37261928875436e-04f;
+static const float tanh_a5  =  1.48572235717979e-05f;
+static const float tanh_a7  =  5.12229709037114e-08f;
+static const float tanh_a9  = -8.60467152213735e-11f;
+static const float tanh_a11 =  2.00018790482477e-13f;
+static const float tanh_a13 = -2.76076847742355e-16f;
+
+// denominator coefficients (even powers 0..6)
+static const float tanh_b0  =  4.89352518554385e-03f;
+static const float tanh_b2  =  2.26843463243900e-03f;
+static const float tanh_b4  =  1.18534705686654e-04f;
+static const float tanh_b6  =  1.19825839466702e-06f;
+
+struct Image_State {
+    const float *data;
+    void  *pixels;
+    enum Terrain_Image_Format format;
+    int    ncols;
+    float  factor;
+    float  half_span;
+    float  image_mean;
+    float  pixel_max;   // largest integer pixel value
+};
+
+static float scalar_tone( const struct Image_State *s, float x )
+// Returns image value for x (NaN if x is NaN).
+{
+    float z = x * s->factor;
+    float z2, p, q, t;
+
+    // comparisons are false for NaN, which passes through
+    z = z >  tanh_clamp ?  tanh_clamp : z;
+    z = z < -tanh_clamp ? -tanh_clamp : z;
+
+    z2 = z * z;
+    p = tanh_a13;
+    p = p * z2 + tanh_a11;
+    p = p * z2 + tanh_a9;
+    p = p * z2 + tanh_a7;
+    p = p * z2 + tanh_a5;
+    p = p * z2 + tanh_a3;
+    p = p * z2 + tanh_a1;
+    q = tanh_b6;
+    q = q * z2 + tanh_b4;
+    q = q * z2 + tanh_b2;
+    q = q * z2 + tanh_b0;
+    t = z * p / q;
+
+    t = t >  1.0f ?  1.0f : t;
+    t = t < -1.0f ? -1.0f : t;
+
+    return t * s->half_span + s->image_mean;
+}
+
+static float scalar_pixel( const struct Image_State *s, float x )
+// Returns rounded integer pixel value for x; NaN gives 0 (as in WriteGrayscaleTIFF.c).
+{
+    float v = scalar_tone( s, x ) + 0.5f;
+
+    if (v != v || v <= 0.0f) {
+        return 0.0f;
+    }
+    return v >= s->pixel_max ? s->pixel_max : (float)(int)v;
+}
+
+#if IMAGE_LANES > 1
+
+typedef float VFLOAT __attribute__(( vector_size( IMAGE_LANES * sizeof( float ) ) ));
+typedef int   VINT   __attribute__(( vector_size( IMAGE_LANES * sizeof( int   ) ) ));
+
+static VFLOAT vsplat( float x )
+{
+    VFLOAT v = { x, x, x, x };
+    return v;
+}
+
+static VFLOAT vselect( VINT mask, VFLOAT a, VFLOAT b )
+// Returns a where mask is set, b elsewhere.
+{
+    return (VFLOAT)( ((VINT)a & mask) | ((VINT)b & ~mask) );
+}
+
+static VFLOAT vector_tone( const struct Image_State *s, VFLOAT x )
+// Same as scalar_tone() for IMAGE_LANES pixels.
+{
+    const VFLOAT hi  = vsplat(  tanh_clamp );
+    const VFLOAT lo  = vsplat( -tanh_clamp );
+    const VFLOAT one = vsplat( 1.0f );
+
+    VFLOAT z = x * vsplat( s->factor );
+    VFLOAT z2, p, q, t;
+
+    z = vselect( z > hi, hi, z );
+    z = vselect( z < lo, lo, z );
+
+    z2 = z * z;
+    p = vsplat( tanh_a13 );
+    p = p * z2 + tanh_a11;
+    p = p * z2 + tanh_a9;
+    p = p * z2 + tanh_a7;
+    p = p * z2 + tanh_a5;
+    p = p * z2 + tanh_a3;
+    p = p * z2 + tanh_a1;
+    q = vsplat( tanh_b6 );
+    q = q * z2 + tanh_b4;
+    q = q * z2 + tanh_b2;
+    q = q * z2 + tanh_b0;
+    t = z * p / q;
+
+    t = vselect( t >  one,  one, t );
+    t = vselect( t < -one, -one, t );
+
+    return t * s->half_span + s->image_mean;
+}
+
+static VINT vector_pixel( const struct Image_State *s, VFLOAT x )
+// Same as scalar_pixel() for IMAGE_LANES pixels.
+{
+    const VFLOAT vmax = vsplat( s->pixel_max );
+
+    VFLOAT v = vector_tone( s, x ) + 0.5f;
+
+    // NaN and negative values give 0
+    v = (VFLOAT)( (VINT)v & (v > 0.0f) );
+    v = vselect( v >= vmax, vmax, v );
+
+    return __builtin_convertvector( v, VINT );
+}
+
+#endif
+
+static void image_rows( long first, long last, int worker, void *state )
+{
+    const struct Image_State *s = (const struct Image_State *)state;
+
+    int  ncols = s->ncols;
+    long i;
+    int  j, k;
+
+    (void)worker;
+
+    for (i=first; i<last; ++i) {
+        const float *ptr = s->data + (LONG)i * (LONG)ncols;
+
+        j = 0;
+
+        switch (s->format) {
+            case TERRAIN_IMAGE_FLOAT: {
+                float *out = (float *)s->pixels + (LONG)i * (LONG)ncols;
+#if IMAGE_LANES > 1
+                for (; j+IMAGE_LANES<=ncols; j+=IMAGE_LANES) {
+                    VFLOAT x;
+                    memcpy( &x, ptr+j, sizeof( x ) );
+                    x = vector_tone( s, x );
+                    memcpy( out+j, &x, sizeof( x ) );
+                }
+#endif
+                for (; j<ncols; ++j) {
+                    out[j] = scalar_tone( s, ptr[j] );
+                }
+                break;
+            }
+            case TERRAIN_IMAGE_UINT8: {
+                unsigned char *out = (unsigned char *)s->pixels + (LONG)i * (LONG)ncols;
+#if IMAGE_LANES > 1
+                for (; j+IMAGE_LANES<=ncols; j+=IMAGE_LANES) {
+                    VFLOAT x;
+                    VINT   v;
+                    memcpy( &x, ptr+j, sizeof( x ) );
+                    v = vector_pixel( s, x );
+                    for (k=0; k<IMAGE_LANES; ++k) {
+                        out[j+k] = (unsigned char)v[k];
+                    }
+                }
+#endif
+                for (; j<ncols; ++j) {
+                    out[j] = (unsigned char)scalar_pixel( s, ptr[j] );
+                }
+                break;
+            }
+            case TERRAIN_IMAGE_UINT16: {
+                unsigned short *out = (unsigned short *)s->pixels + (LONG)i * (LONG)ncols;
+#if IMAGE_LANES > 1
+                for (; j+IMAGE_LANES<=ncols; j+=IMAGE_LANES) {
+                    VFLOAT x;
+                    VINT   v;
+                    memcpy( &x, ptr+j, sizeof( x ) );
+                    v = vector_pixel( s, x );
+                    for (k=0; k<IMAGE_LANES; ++k) {
+                        out[j+k] = (unsigned short)v[k];
+                    }
+                }
+#endif
+                for (; j<ncols; ++j) {
+                    out[j] = (unsigned short)scalar_pixel( s, ptr[j] );
+                }
+                break;
+            }
+        }
+    }
+}
+
+void terrain_image_pixels(
+    const float *data,  // input: array of data to convert (row-major order)
+    void  *pixels,      // output: array of nrows x ncols pixels of given format
+                        //         (may be data itself for TERRAIN_IMAGE_FLOAT)
+    enum Terrain_Image_Format
+           format,      // input: pixel type of output array
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double vertical_enhancement,
+                        // input: positive numbers give more contrast in the midrange
+                        //        but less detail in the lightest & darkest areas;
+                        //        negative numbers the opposite
+    double image_min,   // input: minimum value for output pixels
+    double image_max,   // input: maximum value for output pixels
+    int    num_threads  // input: number of threads to use (0 = default)
+)
+// Same as terrain_image_data(), writing pixels of the given format to a separate array.
+// Integer pixels are rounded and clamped to the range of the type; NaN gives 0.
+{
+    struct Image_State state;
+    struct Thread_Pool *pool = NULL;
+
+    state.data       = data;
+    state.pixels     = pixels;
+    state.format     = format;
+    state.ncols      = ncols;
+    state.factor     = (float)pow( 2.0, vertical_enhancement * 0.5 - 1.0 );
+    state.half_span  = (float)(0.5 * (image_max - image_min));
+    state.image_mean = (float)(0.5 * (image_max + image_min));
+    state.pixel_max  = format == TERRAIN_IMAGE_UINT8 ? 255.0f : 65535.0f;
+
+    if (num_threads <= 0) {
+        num_threads = default_thread_count();
+    }
+    if (num_threads > 1) {
+        // if threads cannot be created, fall back to single-threaded processing
+        pool = create_thread_pool( num_threads );
+    }
+
+    run_thread_pool( pool, nrows, 16, image_rows, &state, NULL );
+
+    destroy_thread_pool( pool );
+}
+
+void terrain_image_data(
+    float *data,        // input/output: array of data to convert (row-major order)
+    int    nrows,       // input: number of rows    in data array
+    int    ncols,       // input: number of columns in data array
+    double vertical_enhancement,
+                        // input: positive numbers give more contrast in the midrange
+                        //        but less detail in the lightest & darkest areas;
+                        //        negative numbers the opposite
+    double image_min,   // input: minimum value for output pixels
+    double image_max    // input: maximum value for output pixels
+)
+// Converts output of terrain_filter() to grayscale image pixels;
+// selects tone curve based on vertical_enhancement parameter.
+{
+    terrain_image_pixels(
+        data, data, TERRAIN_IMAGE_FLOAT, nrows, ncols,
+        vertical_enhancement, image_min, image_max, 0 );
+}
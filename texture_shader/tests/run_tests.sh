@@ -0,0 +1,20 @@
+#!/bin/bash
+# Usage: tests/run_tests.sh   (from the texture_shader directory)
+# Builds and runs the test programs in tests/; exits nonzero if any fails.
+
+CC=gcc
+CFLAGS="-O2 -funroll-loops"
+LIBS="-lm -lpthread"
+
+TMP_DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP_DIR"' EXIT
+
+status=0
+for test in tests/test_*.c; do
+    name=$(basename "$test" .c)
+    ${CC} ${CFLAGS} -DNOMAIN *.c "$test" -o "$TMP_DIR/$name" ${LIBS} || { status=1; continue; }
+    echo "$name:"
+    "$TMP_DIR/$name" "$TMP_DIR/$name.tmp" || status=1
+done
+
+exit $status
@@ -0,0 +1,208 @@
+/*
+ * test_transpose.c
+ *
+ * Checks transpose_inplace_pool() and transpose_outplace() against a naive
+ * transpose for square, non-square and prime shapes, with and without a pool
+ * of worker threads, and checks that the progress callback is still called
+ * (from the calling thread only) and can cancel the operation.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ *
+ * Build and run from the texture_shader directory with tests/run_tests.sh.
+ */
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "../transpose_inplace.h"
+#include "../thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define NUM_SHAPES  15
+#define NUM_THREADS 4
+
+struct Shape {
+    long nrows;
+    long ncols;
+    int  reports;   // nonzero if large enough for transpose_inplace() to report progress
+};
+
+static const struct Shape shapes[NUM_SHAPES] = {
+    {    1,    1, 0 },
+    {    1,   37, 0 },
+    {   37,    1, 0 },
+    {    2,    2, 0 },
+    {    5,    7, 0 },
+    {   64,   64, 1 },
+    {  256,  256, 1 },
+    {   97,   97, 1 },    // prime, square
+    {  101,  103, 1 },    // prime, non-square
+    {    3,  500, 1 },
+    {  500,    3, 1 },
+    {  127,  509, 1 },
+    { 1009,   13, 1 },
+    {  480,  640, 1 },
+    { 1031, 1021, 1 }
+};
+
+struct Progress_State {
+    pthread_t caller;
+    int   calls;
+    int   wrong_thread;
+    int   out_of_order;
+    float last;
+    int   cancel_after;     // cancel on this call; 0 for never
+};
+
+static int progress_callback( float portion_complete, void *state_ptr )
+{
+    struct Progress_State *state = (struct Progress_State *)state_ptr;
+
+    ++state->calls;
+    if (!pthread_equal( pthread_self(), state->caller )) {
+        ++state->wrong_thread;
+    }
+    if (portion_complete < state->last || portion_complete > 1.001f) {
+        ++state->out_of_order;
+    }
+    state->last = portion_complete;
+
+    return state->cancel_after > 0 && state->calls >= state->cancel_after;
+}
+
+static void start_progress( struct Progress_State *state, int cancel_after )
+{
+    state->caller       = pthread_self();
+    state->calls        = 0;
+    state->wrong_thread = 0;
+    state->out_of_order = 0;
+    state->last         = 0.0f;
+    state->cancel_after = cancel_after;
+}
+
+static void fill_matrix( float *a, long nrows, long ncols )
+{
+    long i, j;
+
+    for (i=0; i<nrows; ++i) {
+        for (j=0; j<ncols; ++j) {
+            a[i * ncols + j] = (float)(i * ncols + j);
+        }
+    }
+}
+
+static long count_errors( const float *b, long nrows, long ncols )
+// Returns number of elements of b that are not the transpose of fill_matrix().
+{
+    long errors = 0;
+    long i, j;
+
+    for (j=0; j<ncols; ++j) {
+        for (i=0; i<nrows; ++i) {
+            if (b[j * nrows + i] != (float)(i * ncols + j)) {
+                ++errors;
+            }
+        }
+    }
+    return errors;
+}
+
+static int test_shape( const struct Shape *shape, struct Thread_Pool *pool, const char *pool_name )
+// Returns number of failures.
+{
+    struct Transpose_Progress_Callback progress;
+    struct Progress_State state;
+    long   nrows = shape->nrows;
+    long   ncols = shape->ncols;
+    size_t size  = (size_t)nrows * (size_t)ncols;
+    float *a = (float *)malloc( size * sizeof( float ) );
+    float *b = (float *)malloc( size * sizeof( float ) );
+    long   inplace_errors, outplace_errors;
+    int    result;
+    int    failures = 0;
+
+    if (!a || !b) {
+        fprintf( stderr, "out of memory\n" );
+        free( a );
+        free( b );
+        return 1;
+    }
+
+    progress.callback = progress_callback;
+    progress.state    = &state;
+
+    fill_matrix( a, nrows, ncols );
+    start_progress( &state, 0 );
+    result = transpose_inplace_pool( a, nrows, ncols, &progress, pool );
+    inplace_errors = count_errors( a, nrows, ncols );
+
+    if (result != 0 || inplace_errors || state.wrong_thread || state.out_of_order ||
+        (shape->reports && state.calls == 0))
+    {
+        printf( "FAIL inplace  %4ld x %4ld, %-7s: result %d, %ld wrong values, "
+                "%d progress calls (%d from other threads, %d out of order)\n",
+                nrows, ncols, pool_name, result, inplace_errors,
+                state.calls, state.wrong_thread, state.out_of_order );
+        ++failures;
+    }
+
+    fill_matrix( a, nrows, ncols );
+    memset( b, 0, size * sizeof( float ) );
+    transpose_outplace( a, b, nrows, ncols, pool );
+    outplace_errors = count_errors( b, nrows, ncols );
+
+    if (outplace_errors) {
+        printf( "FAIL outplace %4ld x %4ld, %-7s: %ld wrong values\n",
+                nrows, ncols, pool_name, outplace_errors );
+        ++failures;
+    }
+
+    // a cancel request from the callback must stop the transpose
+    if (shape->reports) {
+        fill_matrix( a, nrows, ncols );
+        start_progress( &state, 1 );
+        result = transpose_inplace_pool( a, nrows, ncols, &progress, pool );
+        if (result != -1) {
+            printf( "FAIL cancel   %4ld x %4ld, %-7s: result %d\n",
+                    nrows, ncols, pool_name, result );
+            ++failures;
+        }
+    }
+
+    if (!failures) {
+        printf( "ok   %4ld x %4ld, %-7s\n", nrows, ncols, pool_name );
+    }
+
+    free( a );
+    free( b );
+    return failures;
+}
+
+int main( int argc, char *argv[] )
+{
+    struct Thread_Pool *pool;
+    int failures = 0;
+    int k;
+
+    (void)argc;
+    (void)argv;
+
+    pool = create_thread_pool( NUM_THREADS );
+    if (!pool) {
+        fprintf( stderr, "cannot create thread pool\n" );
+        return 1;
+    }
+
+    for (k=0; k<NUM_SHAPES; ++k) {
+        failures += test_shape( &shapes[k], NULL, "no pool" );
+        failures += test_shape( &shapes[k], pool, "pool" );
+    }
+
+    destroy_thread_pool( pool );
+
+    return failures != 0;
+}
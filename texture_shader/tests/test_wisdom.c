@@ -0,0 +1,244 @@
+/*
+ * test_wisdom.c
+ *
+ * Checks that damaged DCT wisdom files are rejected entry by entry, that the
+ * transforms then fall back to computing their own twiddle factors, and that
+ * the rejected entries are written again by the next export.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ *
+ * Build and run from the texture_shader directory with tests/run_tests.sh.
+ */
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "../dct.h"
+#include "../spectrum_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_SIZES  6
+#define HEADER_LEN 28   // bytes of wisdom file header written by dct.c
+
+// lengths with small factors only, a large prime factor, and Bluestein's algorithm
+static const int sizes[NUM_SIZES] = { 1, 2, 12, 360, 998, 1009 };
+
+enum Damage {
+    DAMAGE_NONE,
+    DAMAGE_LENGTH,          // ifac[0] != nelems
+    DAMAGE_COUNT,           // more factors than fftpack allows
+    DAMAGE_ZERO_COUNT,      // no factors
+    DAMAGE_FACTOR_ONE,      // a factor of 1
+    DAMAGE_PRODUCT,         // factors do not multiply to nelems
+    DAMAGE_BLUESTEIN,       // factorization of the convolution length is wrong
+    DAMAGE_WSAVE,           // twiddle factors overwritten, checksum not updated
+    NUM_DAMAGES
+};
+
+static const char *damage_names[NUM_DAMAGES] = {
+    "none", "length", "count", "zero count", "factor one", "product", "bluestein", "wsave"
+};
+
+static double reference[NUM_SIZES][2][1009];
+
+static void fill_input( const struct Dct_Plan *plan )
+{
+    int i, j;
+
+    for (i=0; i<2; ++i) {
+        for (j=0; j<plan->nelems; ++j) {
+            plan->in_data[i][j] = (double)((j * 37 + i * 11) % 101) - 50.0;
+        }
+    }
+}
+
+static int run_dcts( int save )
+// Transforms the test data for every size; returns number of mismatches with the
+// reference results (or stores them if save is nonzero).
+{
+    int errors = 0;
+    int k, i, j;
+
+    for (k=0; k<NUM_SIZES; ++k) {
+        struct Dct_Plan plan = setup_dcts_backend( 2, sizes[k], DCT_BACKEND_FFTPACK );
+        if (!plan.dct_buffer) {
+            fprintf( stderr, "setup_dcts failed for n = %d\n", sizes[k] );
+            return 1;
+        }
+        fill_input( &plan );
+        perform_dcts( &plan );
+        for (i=0; i<2; ++i) {
+            for (j=0; j<sizes[k]; ++j) {
+                if (save) {
+                    reference[k][i][j] = plan.out_data[i][j];
+                } else if (plan.out_data[i][j] != reference[k][i][j]) {
+                    ++errors;
+                }
+            }
+        }
+        cleanup_dcts( &plan );
+    }
+    return errors;
+}
+
+static int damage_entry( double *wsave, int nsave, int *ifac, int nelems, enum Damage damage )
+// Returns nonzero if the entry was changed.
+{
+    int len = ifac[1] + 2;
+    unsigned char *bytes = (unsigned char *)wsave;
+    int i;
+
+    if (damage == DAMAGE_WSAVE) {
+        for (i=0; i<nsave*(int)sizeof( double ) && i<64; ++i) {
+            bytes[i] ^= 0x5a;
+        }
+        return nsave > 0;
+    }
+    if (nelems < 2 && damage != DAMAGE_NONE) {
+        ifac[1] = 40;
+        return 1;
+    }
+    switch (damage) {
+        case DAMAGE_LENGTH:
+            ifac[0] = nelems + 1;
+            return 1;
+        case DAMAGE_COUNT:
+            ifac[1] = 1000;
+            return 1;
+        case DAMAGE_ZERO_COUNT:
+            ifac[1] = 0;
+            return 1;
+        case DAMAGE_FACTOR_ONE:
+            ifac[2] = 1;
+            return 1;
+        case DAMAGE_PRODUCT:
+            ifac[2] *= 2;
+            return 1;
+        case DAMAGE_BLUESTEIN:
+            if (ifac[len] == 0) {
+                return 0;
+            }
+            ifac[len+1] += 1;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static long write_damaged( const char *name, const unsigned char *wisdom, long length,
+                           enum Damage damage, int *num_damaged )
+// Writes a copy of wisdom with every entry damaged as given; returns nonzero on error.
+// Damaged factorizations get a matching checksum, so that the import must reject
+// them by checking the factors themselves.
+{
+    unsigned char *copy = (unsigned char *)malloc( length );
+    FILE *file;
+    long  pos = HEADER_LEN;
+    int   error;
+
+    if (!copy) {
+        return 1;
+    }
+    memcpy( copy, wisdom, length );
+    *num_damaged = 0;
+    while (pos < length) {
+        unsigned char *start = copy + pos;
+        unsigned long long checksum;
+        int fields[5];
+        int changed;
+
+        memcpy( fields, start, sizeof( fields ) );
+        pos += sizeof( fields );
+        changed = damage_entry( (double *)(copy + pos), fields[3],
+                                (int *)(copy + pos + fields[3] * sizeof( double )),
+                                fields[2], damage );
+        pos += fields[3] * sizeof( double ) + fields[4] * sizeof( int );
+        if (changed && damage != DAMAGE_WSAVE) {
+            checksum = cache_hash( 0, start, copy + pos - start );
+            memcpy( copy + pos, &checksum, sizeof( checksum ) );
+        }
+        pos += sizeof( checksum );
+        *num_damaged += changed;
+    }
+
+    file = fopen( name, "wb" );
+    error = !file || fwrite( copy, 1, length, file ) != (size_t)length;
+    error = (file && fclose( file )) || error;
+    free( copy );
+    return error;
+}
+
+int main( int argc, char *argv[] )
+{
+    const char *name = argc > 1 ? argv[1] : "test_wisdom.tmp";
+    unsigned char *wisdom;
+    long  length;
+    FILE *file;
+    int   failures = 0;
+    int   damage;
+
+    run_dcts( 1 );
+    if (dct_export_wisdom( name )) {
+        fprintf( stderr, "cannot write %s\n", name );
+        return 1;
+    }
+
+    file = fopen( name, "rb" );
+    if (!file) {
+        fprintf( stderr, "cannot read %s\n", name );
+        return 1;
+    }
+    fseek( file, 0, SEEK_END );
+    length = ftell( file );
+    fseek( file, 0, SEEK_SET );
+    wisdom = (unsigned char *)malloc( length );
+    if (!wisdom || fread( wisdom, 1, length, file ) != (size_t)length) {
+        fprintf( stderr, "cannot read %s\n", name );
+        return 1;
+    }
+    fclose( file );
+
+    for (damage=0; damage<NUM_DAMAGES; ++damage) {
+        int num_damaged, count, expected, errors, updated, recount;
+
+        if (write_damaged( name, wisdom, length, (enum Damage)damage, &num_damaged )) {
+            fprintf( stderr, "cannot write %s\n", name );
+            return 1;
+        }
+        dct_forget_plans();
+
+        count    = dct_import_wisdom( name );
+        expected = NUM_SIZES - num_damaged;
+        errors   = run_dcts( 0 );
+        updated  = dct_wisdom_updated();
+
+        // the rewritten file must be complete and undamaged again
+        recount = -1;
+        if (!dct_export_wisdom( name )) {
+            dct_forget_plans();
+            recount = dct_import_wisdom( name );
+            errors += run_dcts( 0 );
+        }
+
+        if (count != expected || errors || updated != (num_damaged > 0) ||
+            recount != NUM_SIZES)
+        {
+            printf( "FAIL damage %-10s: %d entries read (expected %d), %d wrong values, "
+                    "%d read after export\n",
+                    damage_names[damage], count, expected, errors, recount );
+            ++failures;
+        } else {
+            printf( "ok   damage %-10s: %d entries read, %d skipped\n",
+                    damage_names[damage], count, num_damaged );
+        }
+    }
+
+    remove( name );
+    free( wisdom );
+    dct_forget_plans();
+
+    return failures != 0;
+}
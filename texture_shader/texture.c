@@ -34,6 +34,9 @@
 #include "read_grid_files.h"
 #include "write_grid_files.h"
 #include "terrain_filter.h"
+#include "spectrum_cache.h"
+#include "mercator_remap.h"
+#include "dct.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -109,16 +112,74 @@ static void usage_exit( const char *message )
     fprintf( stderr, "Input and output filenames must not be the same.\n" );
     fprintf( stderr, "NOTE: Output files will be overwritten if they already exist.\n" );
     fprintf( stderr, "\n" );
-    fprintf( stderr, "Available option:\n" );
+    fprintf( stderr, "Available options:\n" );
     fprintf( stderr, "    -mercator lat1 lat2    " );
     fprintf( stderr, "input is in normal Mercator projection (not UTM)\n" );
+    fprintf( stderr, "    -remap                 " );
+    fprintf( stderr, "input is geographic; process it in Mercator projection\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "internally and write output on the input grid\n" );
+    fprintf( stderr, "    -image contrast        " );
+    fprintf( stderr, "write texture_file as a GeoTIFF image (.tif and .tfw) made\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "as by texture_image with this contrast, instead of .flt\n" );
+    fprintf( stderr, "    -bits n                " );
+    fprintf( stderr, "bits per pixel of -image output: 8 or 16 (default)\n" );
+    fprintf( stderr, "    -threads n             " );
+    fprintf( stderr, "use n worker threads (default: number of processors)\n" );
+    fprintf( stderr, "    -outofcore mb          " );
+    fprintf( stderr, "process in place in output file using mb megabytes of RAM\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "for column panels (for grids larger than memory)\n" );
+    fprintf( stderr, "    -dct name              " );
+    fprintf( stderr, "DCT implementation: fftpack (default), simd (fastest available),\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "sse2, avx2, or avx512 (SIMD results differ slightly from fftpack)\n" );
+    fprintf( stderr, "    -fastop                " );
+    fprintf( stderr, "evaluate fractional Laplacian in single precision (faster;\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "relative error about 1e-6)\n" );
+    fprintf( stderr, "    -also detail file      " );
+    fprintf( stderr, "also write texture_file with another detail value, sharing\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "the forward transforms (option may be repeated); with\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "-image, also converted to a .tif image like texture_file\n" );
+    fprintf( stderr, "    -cache dir             " );
+    fprintf( stderr, "keep DCT spectrum of input in directory dir, and reuse it\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "when run again on the same input (any detail or latitudes)\n" );
+    fprintf( stderr, "    -wisdom file           " );
+    fprintf( stderr, "reuse DCT setup saved in file by earlier runs on grids\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "of the same size (file is created or updated as needed)\n" );
+    fprintf( stderr, "    -outsize cols rows     " );
+    fprintf( stderr, "write texture resampled to cols x rows pixels over the same\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "extent, by dropping the high-frequency part of the spectrum\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "(alias-free; must not exceed input size or use -outofcore)\n" );
+    fprintf( stderr, "    -pad                   " );
+    fprintf( stderr, "mirror-pad rows and columns to FFT-friendly sizes and crop\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "back (much faster for sizes with large prime factors)\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "APPROXIMATE: changes nearly all values, by up to a few\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "percent of range within 10 pixels of the edges, ~1%% or\n" );
+    fprintf( stderr, "                           " );
+    fprintf( stderr, "less to 50 pixels in (skipped for small or fast sizes)\n" );
     fprintf( stderr, "Values lat1 and lat2 must be in decimal degrees.\n" );
+    fprintf( stderr, "Default thread count can also be set with environment variable TEXTURE_THREADS.\n" );
+    fprintf( stderr, "Default DCT implementation can also be set with environment variable TEXTURE_DCT.\n" );
+    fprintf( stderr, "Default wisdom file can also be set with environment variable TEXTURE_DCT_WISDOM.\n" );
+    fprintf( stderr, "Default cache directory can also be set with environment variable TEXTURE_SPECTRUM_CACHE.\n" );
     fprintf( stderr, "\n" );
     exit( EXIT_FAILURE );
 }
 
 static void get_filenames(
-    const char *arg, char **data_name, char **hdr_name, char **prj_name, char *ext )
+    const char *arg, char **data_name, char **hdr_name, char **prj_name, char *ext, char *hdr )
 // NOTE: caller is responsible to free pointers *data_name, *hdr_name, and *prj_name!
 {
     const char *dot;
@@ -134,14 +195,15 @@ static void get_filenames(
     if (dot++ && !strpbrk( dot, "/\\" ) && strlen( dot ) <= 4) {
         // filename has extension (of up to 4 characters)
         strncpy( ext, dot, strlen( ext ) );
-        if (strcmp( dot, "flt" ) != 0 && strcmp( dot, "FLT" ) != 0)
+        if (strcmp( dot, "flt" ) != 0 && strcmp( dot, "FLT" ) != 0 &&
+            strcmp( dot, "tif" ) != 0 && strcmp( dot, "TIF" ) != 0)
         {
-            usage_exit( "Filenames must have .flt extension (if any)." );
+            usage_exit( "Filenames must have .flt or .tif extension (if any)." );
         }
         strcpy ( *data_name, arg );
         strncpy( *hdr_name, arg, len-3 );
         strncpy( *prj_name, arg, len-3 );
-        strcpy ( *hdr_name+len-3, "hdr" );
+        strcpy ( *hdr_name+len-3, hdr );
         strcpy ( *prj_name+len-3, "prj" );
     } else {
         // filename does not have extension
@@ -151,11 +213,93 @@ static void get_filenames(
         (*data_name)[len+4] = '\0';
         strncpy( *hdr_name, arg, len );
         strncpy( *prj_name, arg, len );
-        strcpy ( *hdr_name+len, ".hdr" );
+        (*hdr_name)[len] = '.';
+        strcpy ( *hdr_name+len+1, hdr );
         strcpy ( *prj_name+len, ".prj" );
     }
 }
 
+static int parse_detail( const char *arg, double *detail )
+// Reads detail as decimal number or fraction; returns 0 if arg is neither.
+{
+    char *endptr;
+
+    if ( strchr( arg, '/' ) ) {
+        // read fraction: integer/integer
+        *detail = (double)strtol( arg, &endptr, 10 );
+        if (endptr == arg || *endptr != '/' || endptr[1] < '1' || endptr[1] > '9') {
+            return 0;
+        }
+        *detail /= (double)strtol( endptr+1, &endptr, 10 );
+    } else {
+        // read decimal number
+        *detail = strtod( arg, &endptr );
+    }
+    return endptr != arg && *endptr == '\0';
+}
+
+// Additional output file requested with option -also
+struct Texture_Output {
+    double detail;
+    const char *name_arg;   // filename as given (extension depends on option -image)
+    char  *dat_name;
+    char  *hdr_name;
+    char  *prj_name;
+    FILE  *dat_file;
+    FILE  *hdr_file;
+    float *data;
+    int    mapped;      // nonzero if data array is mapped from .flt file
+};
+
+static void *image_pixels(
+    const float *data,      // input: texture array (row-major order)
+    int    nrows,           // input: number of rows    in data array
+    int    ncols,           // input: number of columns in data array
+    int    bits,            // input: bits per pixel (8 or 16)
+    double contrast,        // input: contrast value, as for texture_image
+    int    num_threads      // input: number of threads to use (0 = default)
+)
+// Returns new array of image pixels; exits if out of memory.
+{
+    void *pixels = malloc( (size_t)nrows * (size_t)ncols * (size_t)(bits / 8) );
+
+    if (!pixels) {
+        prefix_error();
+        fprintf( stderr, "Insufficient memory for output image.\n" );
+        exit( EXIT_FAILURE );
+    }
+
+    // same as texture_image, without writing and reading the texture grid,
+    // and converting directly to integer pixels
+    terrain_image_pixels(
+        data, pixels, bits == 8 ? TERRAIN_IMAGE_UINT8 : TERRAIN_IMAGE_UINT16,
+        nrows, ncols, contrast, 0.0, bits == 8 ? 255.0 : 65535.0, num_threads );
+
+    return pixels;
+}
+
+static void copy_prj( const char *in_prj_name, const char *out_prj_name )
+// Copies optional .prj file, if present.
+{
+    FILE *in_prj_file;
+    FILE *out_prj_file;
+
+    in_prj_file = fopen( in_prj_name, "rb" );   // use binary mode for compatibility
+    if (in_prj_file) {
+        out_prj_file = fopen( out_prj_name, "wb" ); // use binary mode for compatibility
+        if (!out_prj_file) {
+            fprintf( stderr, "*** WARNING: " );
+            fprintf( stderr, "Could not open output file '%s'.\n", out_prj_name );
+        } else {
+            // copy file and change any "ZUNITS" line to "ZUNITS NO"
+            copy_prj_file( in_prj_file, out_prj_file );
+
+            fclose( out_prj_file );
+        }
+        fclose( in_prj_file );
+    }
+}
+
 static int print_progress( float portion, float steps_done, int total_steps, void *state )
 {
     int *last_count = (int *)state;
@@ -253,7 +397,10 @@ int main( int argc, const char *argv[] )
 
     struct Terrain_Progress_Callback progress = { print_progress, &last_count };
 
+    struct Terrain_Filter_Options options;
+
     int argnum;
+    long count;
 
     const char *thisarg;
     char *endptr;
@@ -268,12 +415,16 @@ int main( int argc, const char *argv[] )
 
     double detail;
 
+    struct Texture_Output *extras;  // outputs for option -also
+    int    num_extras = 0;
+    double *details;
+    float **outputs;
+    int    k;
+
     FILE *in_dat_file;
     FILE *in_hdr_file;
-    FILE *in_prj_file;
     FILE *out_dat_file;
     FILE *out_hdr_file;
-    FILE *out_prj_file;
 
     int nrows;
     int ncols;
@@ -286,6 +437,20 @@ int main( int argc, const char *argv[] )
     float *data;
     char *software;
 
+    struct Flt_File_Info flt_info;
+    int mapped = 0;     // nonzero if data array is mapped from output .flt file
+    int in_mapped = 0;  // nonzero if data array is mapped from input .flt file
+    double megabytes;
+    const char *wisdom_name;
+    const char *cache_dir;
+    char  *cache_name;
+    float *spectrum;
+    int    spectrum_mapped;
+    int    padded_rows, padded_cols;
+    int    out_rows, out_cols;
+    float  data_min, data_max;
+    unsigned long long hash;
+
     enum Terrain_Coord_Type coord_type;
 
     int proj_type;
@@ -296,6 +461,13 @@ int main( int argc, const char *argv[] )
     double lat2 = 0.0;  // default unless -merc option used
     double center_lat;
     double temp;
+    int    remap = 0;
+    float *remapped;
+    int    image = 0;
+    double contrast = 0.0;
+    int    bits = 16;
+    void  *pixels = NULL;
+    const char *out_arg;
 
     int error;
 
@@ -315,18 +487,7 @@ int main( int argc, const char *argv[] )
     argnum = 1;
 
     thisarg = argv[argnum++];
-    if ( strchr( thisarg, '/' ) ) {
-        // read fraction: integer/integer
-        detail = (double)strtol( thisarg, &endptr, 10 );
-        if (endptr == thisarg || *endptr != '/' || endptr[1] < '1' || endptr[1] > '9') {
-            usage_exit( "First parameter (detail) must be a number or fraction." );
-        }
-        detail /= (double)strtol( endptr+1, &endptr, 10 );
-    } else {
-        // read decimal number
-        detail = strtod( thisarg, &endptr );
-    }
-    if (endptr == thisarg || *endptr != '\0') {
+    if (!parse_detail( thisarg, &detail )) {
         usage_exit( "First parameter (detail) must be a number or fraction." );
     }
 
@@ -341,13 +502,26 @@ int main( int argc, const char *argv[] )
     // Validate filenames and open files:
 
     strncpy( extension, "flt", 4 );
-    get_filenames( argv[argnum++], &in_dat_name, &in_hdr_name, &in_prj_name, extension );
+    get_filenames( argv[argnum++], &in_dat_name, &in_hdr_name, &in_prj_name, extension, "hdr" );
+    if (strcmp( extension, "flt" ) != 0 && strcmp( extension, "FLT" ) != 0) {
+        usage_exit( "Input filename must have .flt extension (if any)." );
+    }
 
-    strncpy( extension, "flt", 4 );
-    get_filenames( argv[argnum++], &out_dat_name, &out_hdr_name, &out_prj_name, extension );
+    // output filenames depend on option -image
+    out_arg = argv[argnum++];
 
-    if (!strcmp( in_hdr_name, out_hdr_name )) {
-        usage_exit( "Input and outfile filenames must not be the same." );
+    terrain_filter_default_options( &options );
+    wisdom_name = default_dct_wisdom();
+    cache_dir   = getenv( "TEXTURE_SPECTRUM_CACHE" );
+
+    // each -also option uses 3 arguments
+    extras  = (struct Texture_Output *)malloc( sizeof( struct Texture_Output ) * (argc/3 + 1) );
+    details = (double *)malloc( sizeof( double ) * (argc/3 + 1) );
+    outputs = (float **)malloc( sizeof( float * ) * (argc/3 + 1) );
+    if (!extras || !details || !outputs) {
+        prefix_error();
+        fprintf( stderr, "Memory allocation error occurred.\n" );
+        exit( EXIT_FAILURE );
     }
 
     while (argnum < argc) {
@@ -383,6 +557,97 @@ int main( int argc, const char *argv[] )
             if (lat1 <= -90.0 || lat2 >= 90.0) {
                 usage_exit( "Mercator latitude limits must be between -90 and +90 (exclusive)." );
             }
+        } else if (strncmp( thisarg, "threads", 6 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -threads must be followed by a positive integer." );
+            }
+            thisarg = argv[argnum++];
+            count = strtol( thisarg, &endptr, 10 );
+            if (endptr == thisarg || *endptr != '\0' || count < 1 || count > 1024) {
+                usage_exit( "Option -threads must be followed by a positive integer." );
+            }
+            options.num_threads = (int)count;
+        } else if (strncmp( thisarg, "outofcore", 6 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -outofcore must be followed by a positive number of megabytes." );
+            }
+            thisarg = argv[argnum++];
+            megabytes = strtod( thisarg, &endptr );
+            if (endptr == thisarg || *endptr != '\0' || megabytes <= 0.0) {
+                usage_exit( "Option -outofcore must be followed by a positive number of megabytes." );
+            }
+            options.out_of_core  = 1;
+            options.panel_memory = (size_t)(megabytes * 1048576.0);
+        } else if (strncmp( thisarg, "dct", 3 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -dct must be followed by fftpack, simd, sse2, avx2, or avx512." );
+            }
+            thisarg = argv[argnum++];
+            options.dct_backend = dct_backend_from_name( thisarg );
+            if (options.dct_backend == DCT_BACKEND_DEFAULT) {
+                usage_exit( "Option -dct must be followed by fftpack, simd, sse2, avx2, or avx512." );
+            }
+        } else if (strncmp( thisarg, "fastop", 6 ) == 0) {
+            options.operator_precision = TERRAIN_OPERATOR_FAST;
+        } else if (strncmp( thisarg, "also", 4 ) == 0) {
+            if (argnum+1 >= argc) {
+                usage_exit( "Option -also must be followed by detail and texture_file." );
+            }
+            if (!parse_detail( argv[argnum++], &extras[num_extras].detail )) {
+                usage_exit( "Option -also must be followed by a number or fraction (detail)." );
+            }
+            // filenames depend on option -image
+            extras[num_extras].name_arg = argv[argnum++];
+            ++num_extras;
+        } else if (strncmp( thisarg, "cache", 5 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -cache must be followed by a directory name." );
+            }
+            cache_dir = argv[argnum++];
+        } else if (strncmp( thisarg, "outsize", 7 ) == 0) {
+            if (argnum+1 >= argc) {
+                usage_exit( "Option -outsize must be followed by two positive integers." );
+            }
+            for (k=0; k<2; ++k) {
+                thisarg = argv[argnum++];
+                count = strtol( thisarg, &endptr, 10 );
+                if (endptr == thisarg || *endptr != '\0' || count < 1 || count > 1000000000L) {
+                    usage_exit( "Option -outsize must be followed by two positive integers." );
+                }
+                if (k == 0) {
+                    options.output_cols = (int)count;
+                } else {
+                    options.output_rows = (int)count;
+                }
+            }
+        } else if (strncmp( thisarg, "pad", 3 ) == 0) {
+            options.pad_fft_size = 1;
+        } else if (strncmp( thisarg, "remap", 5 ) == 0) {
+            remap = 1;
+        } else if (strncmp( thisarg, "image", 5 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -image must be followed by a numeric contrast value." );
+            }
+            thisarg = argv[argnum++];
+            contrast = strtod( thisarg, &endptr );
+            if (endptr == thisarg || *endptr != '\0') {
+                usage_exit( "Option -image must be followed by a numeric contrast value." );
+            }
+            image = 1;
+        } else if (strncmp( thisarg, "bits", 4 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -bits must be followed by 8 or 16." );
+            }
+            thisarg = argv[argnum++];
+            bits = (int)strtol( thisarg, &endptr, 10 );
+            if (endptr == thisarg || *endptr != '\0' || (bits != 8 && bits != 16)) {
+                usage_exit( "Option -bits must be followed by 8 or 16." );
+            }
+        } else if (strncmp( thisarg, "wisdom", 6 ) == 0) {
+            if (argnum >= argc) {
+                usage_exit( "Option -wisdom must be followed by a filename." );
+            }
+            wisdom_name = argv[argnum++];
         } else if (strncmp( thisarg, "cellreg", 4 ) == 0 ||
                    strncmp( thisarg, "corner",  6 ) == 0)
         {
@@ -402,6 +667,58 @@ int main( int argc, const char *argv[] )
         }
     }
 
+    if (options.out_of_core && (options.output_rows || options.output_cols)) {
+        usage_exit( "Options -outofcore and -outsize cannot be used together." );
+    }
+    if (remap && options.out_of_core) {
+        usage_exit( "Options -outofcore and -remap cannot be used together." );
+    }
+    if (remap && lat1 != lat2) {
+        usage_exit( "Options -mercator and -remap cannot be used together." );
+    }
+    if (image && options.out_of_core) {
+        usage_exit( "Options -outofcore and -image cannot be used together." );
+    }
+
+    if (image) {
+        strncpy( extension, "tif", 4 );
+        get_filenames( out_arg, &out_dat_name, &out_hdr_name, &out_prj_name, extension, "tfw" );
+        if (strcmp( extension, "tif" ) != 0 && strcmp( extension, "TIF" ) != 0) {
+            usage_exit( "Output filename must have .tif extension (if any) with -image." );
+        }
+    } else {
+        strncpy( extension, "flt", 4 );
+        get_filenames( out_arg, &out_dat_name, &out_hdr_name, &out_prj_name, extension, "hdr" );
+        if (strcmp( extension, "flt" ) != 0 && strcmp( extension, "FLT" ) != 0) {
+            usage_exit( "Output filename must have .flt extension (if any)." );
+        }
+    }
+
+    if (!strcmp( in_prj_name, out_prj_name )) {
+        usage_exit( "Input and outfile filenames must not be the same." );
+    }
+
+    for (k=0; k<num_extras; ++k) {
+        if (image) {
+            strncpy( extension, "tif", 4 );
+            get_filenames( extras[k].name_arg, &extras[k].dat_name, &extras[k].hdr_name,
+                           &extras[k].prj_name, extension, "tfw" );
+            if (strcmp( extension, "tif" ) != 0 && strcmp( extension, "TIF" ) != 0) {
+                usage_exit( "Option -also filename must have .tif extension (if any) with -image." );
+            }
+        } else {
+            strncpy( extension, "flt", 4 );
+            get_filenames( extras[k].name_arg, &extras[k].dat_name, &extras[k].hdr_name,
+                           &extras[k].prj_name, extension, "hdr" );
+            if (strcmp( extension, "flt" ) != 0 && strcmp( extension, "FLT" ) != 0) {
+                usage_exit( "Option -also filename must have .flt extension (if any)." );
+            }
+        }
+        if (!strcmp( in_prj_name, extras[k].prj_name )) {
+            usage_exit( "Input and outfile filenames must not be the same." );
+        }
+    }
+
     in_hdr_file = fopen( in_hdr_name, "rb" );   // use binary mode for compatibility
     if (!in_hdr_file) {
         prefix_error();
@@ -426,7 +743,8 @@ int main( int argc, const char *argv[] )
         usage_exit( 0 );
     }
 
-    out_dat_file = fopen( out_dat_name, "wb" );
+    // out-of-core processing needs read/write access to the output file
+    out_dat_file = fopen( out_dat_name, options.out_of_core ? "w+b" : "wb" );
     if (!out_dat_file) {
         prefix_error();
         fprintf( stderr, "Could not open output file '%s'.\n", out_dat_name );
@@ -436,18 +754,100 @@ int main( int argc, const char *argv[] )
     free( out_dat_name );
     free( out_hdr_name );
 
+    for (k=0; k<num_extras; ++k) {
+        extras[k].hdr_file = fopen( extras[k].hdr_name, "wb" );
+        if (!extras[k].hdr_file) {
+            prefix_error();
+            fprintf( stderr, "Could not open output file '%s'.\n", extras[k].hdr_name );
+            usage_exit( 0 );
+        }
+        extras[k].dat_file = fopen( extras[k].dat_name, options.out_of_core ? "w+b" : "wb" );
+        if (!extras[k].dat_file) {
+            prefix_error();
+            fprintf( stderr, "Could not open output file '%s'.\n", extras[k].dat_name );
+            usage_exit( 0 );
+        }
+        free( extras[k].dat_name );
+        free( extras[k].hdr_name );
+    }
+
     // Read .flt and .hdr files:
 
     printf( "Reading input files...\n" );
     fflush( stdout );
 
-    data = read_flt_hdr_files(
-        in_dat_file, in_hdr_file, &nrows, &ncols, &xmin, &xmax, &ymin, &ymax,
-        &has_nulls, &all_ints, 0 );
+    if (options.out_of_core) {
+        // read input directly into the memory-mapped output file,
+        // and let the operating system page the data to and from disk
+        read_hdr_info( in_hdr_file, &flt_info, 0 );
+
+        nrows = flt_info.nrows;
+        ncols = flt_info.ncols;
+        xmin  = flt_info.xmin;
+        xmax  = flt_info.xmax;
+        ymin  = flt_info.ymin;
+        ymax  = flt_info.ymax;
+
+        data = map_flt_output_file( out_dat_file, nrows, ncols );
+        if (data) {
+            mapped = 1;
+        } else {
+            fprintf( stderr, "*** WARNING: " );
+            fprintf( stderr, "Could not map output file into memory.\n" );
+            fprintf( stderr, "***          " );
+            fprintf( stderr, "Processing entire array in memory instead.\n" );
+
+            data = (float *)malloc( (size_t)nrows * (size_t)ncols * sizeof( float ) );
+            if (!data) {
+                prefix_error();
+                fprintf( stderr, "Insufficient memory for input .flt data.\n" );
+                exit( EXIT_FAILURE );
+            }
+        }
+
+        read_flt_data( in_dat_file, &flt_info, data, &has_nulls, &all_ints,
+                       &options.data_min, &options.data_max );
+    } else {
+        // input is mapped copy-on-write if possible and filtered in place
+        data = map_flt_hdr_files(
+            in_dat_file, in_hdr_file, &nrows, &ncols, &xmin, &xmax, &ymin, &ymax,
+            &has_nulls, &all_ints, &options.data_min, &options.data_max, &in_mapped, 0 );
+    }
+    options.range_known = 1;    // saves a pass over the data in terrain_filter_opts()
 
     fclose( in_dat_file );
     fclose( in_hdr_file );
 
+    out_rows = options.output_rows ? options.output_rows : nrows;
+    out_cols = options.output_cols ? options.output_cols : ncols;
+    if (out_rows > nrows || out_cols > ncols) {
+        prefix_error();
+        fprintf( stderr, "Output size %d x %d is larger than input size %d x %d.\n",
+                 out_cols, out_rows, ncols, nrows );
+        exit( EXIT_FAILURE );
+    }
+    if (out_rows == nrows && out_cols == ncols) {
+        options.output_rows = 0;
+        options.output_cols = 0;
+    }
+
+    for (k=0; k<num_extras; ++k) {
+        extras[k].data   = NULL;
+        extras[k].mapped = 0;
+        if (options.out_of_core) {
+            extras[k].data = map_flt_output_file( extras[k].dat_file, nrows, ncols );
+            extras[k].mapped = extras[k].data != NULL;
+        }
+        if (!extras[k].data) {
+            extras[k].data = (float *)malloc( (size_t)out_rows * (size_t)out_cols * sizeof( float ) );
+            if (!extras[k].data) {
+                prefix_error();
+                fprintf( stderr, "Insufficient memory for additional output arrays.\n" );
+                exit( EXIT_FAILURE );
+            }
+        }
+    }
+
     if (has_nulls) {
         fprintf( stderr, "*** WARNING: " );
         fprintf( stderr, "Input .flt file contains void (NODATA) points.\n" );
@@ -502,6 +902,40 @@ int main( int argc, const char *argv[] )
 
     }
 
+    if (remap) {
+        if (proj_type >= 0) {
+            usage_exit( "Option -remap is only valid for data in geographic coordinates." );
+        }
+
+        // the poles themselves cannot be projected (as tectoplot does for -mercator)
+        lat1 = ymin > -89.999 ? ymin : -89.999;
+        lat2 = ymax <  89.999 ? ymax :  89.999;
+
+        printf( "Resampling to Mercator projection...\n" );
+        fflush( stdout );
+
+        // same number of rows, equally spaced in northing instead of latitude
+        remapped = (float *)malloc( (size_t)nrows * (size_t)ncols * sizeof( float ) );
+        if (!remapped || mercator_remap(
+                data, remapped, nrows, nrows, ncols, lat1, lat2,
+                MERCATOR_FROM_GEOGRAPHIC, options.num_threads ))
+        {
+            prefix_error();
+            fprintf( stderr, "Memory allocation error occurred.\n" );
+            exit( EXIT_FAILURE );
+        }
+        free_flt_data( data, nrows, ncols, in_mapped );
+        data = remapped;
+        in_mapped = 0;
+
+        // process as if called with -mercator on the resampled grid
+        xdim = (mercator_easting ( xmax ) - mercator_easting ( xmin )) / (double)ncols;
+        ydim = (mercator_northing( lat2 ) - mercator_northing( lat1 )) / (double)nrows;
+        coord_type = TERRAIN_METERS;
+        center_lat = 0.0;
+        proj_type  = 2;
+    }
+
     // check pixel aspect ratio and size of map extent
     check_aspect( xmin, xmax, ymin, ymax, xdim, ydim, proj_type );
 
@@ -513,10 +947,104 @@ int main( int argc, const char *argv[] )
     printf(
         "Processing %d column x %d row array using detail = %f...\n",
         ncols, nrows, detail );
+    for (k=0; k<num_extras; ++k) {
+        printf( "Also using detail = %f...\n", extras[k].detail );
+    }
+    if (options.output_rows) {
+        printf( "Output resampled to %d column x %d row array.\n", out_cols, out_rows );
+    }
+    if (options.pad_fft_size) {
+        padded_rows = terrain_padded_size( nrows );
+        padded_cols = terrain_padded_size( ncols );
+
+        if (options.out_of_core || options.output_rows || (cache_dir && *cache_dir)) {
+            printf( "Option -pad is ignored with -outofcore, -outsize, and -cache.\n" );
+            options.pad_fft_size = 0;
+        } else if (padded_rows == nrows && padded_cols == ncols) {
+            printf( "Array size is already FFT-friendly; no padding needed.\n" );
+        } else if (!terrain_padding_worthwhile( nrows, ncols )) {
+            printf( "Not padding: array is too small, or padding would gain little.\n" );
+            options.pad_fft_size = 0;
+        } else {
+            printf( "Padding to %d column x %d row array for faster DCTs ", padded_cols, padded_rows );
+            printf( "(estimated speedup %.1fx)...\n",
+                terrain_filter_cost( nrows, ncols ) /
+                terrain_filter_cost( padded_rows, padded_cols ) );
+        }
+    }
     fflush( stdout );
 
-    error = terrain_filter(
-        data, detail, nrows, ncols, xdim, ydim, coord_type, center_lat, &progress );
+    if (wisdom_name) {
+        // a missing file is not an error - it is written below
+        dct_import_wisdom( wisdom_name );
+    }
+
+    // forward DCTs are shared; main output is done last, in place
+    for (k=0; k<num_extras; ++k) {
+        details[k] = extras[k].detail;
+        outputs[k] = extras[k].data;
+    }
+    details[num_extras] = detail;
+    outputs[num_extras] = data;
+
+    if (cache_dir && *cache_dir) {
+        // the spectrum depends on the data and the DCT backend, not on detail
+        // or Mercator latitudes; xdim, ydim, and coord_type are included for safety
+        if (options.dct_backend == DCT_BACKEND_DEFAULT) {
+            options.dct_backend = default_dct_backend();
+        }
+        hash = spectrum_hash( data, nrows, ncols, xdim, ydim, coord_type, options.dct_backend );
+
+        cache_name = spectrum_cache_name( cache_dir, hash );
+        if (!cache_name) {
+            prefix_error();
+            fprintf( stderr, "Memory allocation error occurred.\n" );
+            exit( EXIT_FAILURE );
+        }
+
+        spectrum = map_spectrum_cache(
+            cache_name, nrows, ncols, hash, &data_min, &data_max, &spectrum_mapped );
+
+        if (spectrum) {
+            printf( "Using cached spectrum '%s'.\n", cache_name );
+            fflush( stdout );
+
+            error = terrain_filter_from_spectrum(
+                spectrum, data_min, data_max, details, num_extras+1, outputs,
+                nrows, ncols, xdim, ydim, coord_type, center_lat, &progress, &options );
+
+            free_spectrum_cache( spectrum, nrows, ncols, spectrum_mapped );
+        } else {
+            error = terrain_filter_spectrum(
+                data, nrows, ncols, &data_min, &data_max, &progress, &options );
+
+            if (!error) {
+                printf( "Writing cached spectrum '%s'...\n", cache_name );
+                fflush( stdout );
+
+                if (write_spectrum_cache(
+                        cache_name, data, nrows, ncols, hash, data_min, data_max ))
+                {
+                    fprintf( stderr, "*** WARNING: " );
+                    fprintf( stderr, "Could not write cache file '%s'.\n", cache_name );
+                }
+
+                last_count = -1;    // phases of second half are numbered from 1
+                error = terrain_filter_from_spectrum(
+                    data, data_min, data_max, details, num_extras+1, outputs,
+                    nrows, ncols, xdim, ydim, coord_type, center_lat, &progress, &options );
+            }
+        }
+
+        free( cache_name );
+    } else if (num_extras > 0) {
+        error = terrain_filter_multi(
+            data, details, num_extras+1, outputs, nrows, ncols, xdim, ydim,
+            coord_type, center_lat, &progress, &options );
+    } else {
+        error = terrain_filter_opts(
+            data, detail, nrows, ncols, xdim, ydim, coord_type, center_lat, &progress, &options );
+    }
 
     if (error) {
         assert( error == TERRAIN_FILTER_MALLOC_ERROR );
@@ -525,44 +1053,117 @@ int main( int argc, const char *argv[] )
         exit( EXIT_FAILURE );
     }
 
+    if (wisdom_name && dct_wisdom_updated() && dct_export_wisdom( wisdom_name )) {
+        fprintf( stderr, "*** WARNING: " );
+        fprintf( stderr, "Could not write DCT wisdom file '%s'.\n", wisdom_name );
+    }
+    dct_forget_plans();     // no more DCTs - free memory for output
+
     if (lat1 != lat2) {
-        fix_mercator( data, detail, nrows, ncols, lat1, lat2 );
+        fix_mercator( data, detail, out_rows, out_cols, lat1, lat2 );
+        for (k=0; k<num_extras; ++k) {
+            fix_mercator( extras[k].data, extras[k].detail, out_rows, out_cols, lat1, lat2 );
+        }
+    }
+
+    if (remap) {
+        printf( "Resampling back to geographic coordinates...\n" );
+        fflush( stdout );
+
+        for (k=0; k<=num_extras; ++k) {
+            remapped = (float *)malloc( (size_t)out_rows * (size_t)out_cols * sizeof( float ) );
+            if (!remapped || mercator_remap(
+                    outputs[k], remapped, out_rows, out_rows, out_cols, lat1, lat2,
+                    MERCATOR_TO_GEOGRAPHIC, options.num_threads ))
+            {
+                prefix_error();
+                fprintf( stderr, "Memory allocation error occurred.\n" );
+                exit( EXIT_FAILURE );
+            }
+            free( outputs[k] );
+            outputs[k] = remapped;
+        }
+        for (k=0; k<num_extras; ++k) {
+            extras[k].data = outputs[k];
+        }
+        data = outputs[num_extras];
+    }
+
+    if (image) {
+        printf( "Converting to %d-bit image using contrast value of %f...\n", bits, contrast );
+        fflush( stdout );
+
+        pixels = image_pixels( data, out_rows, out_cols, bits, contrast, options.num_threads );
+
+        free_flt_data( data, nrows, ncols, in_mapped );
     }
 
-    // Write .flt and .hdr files:
+    // Write .flt and .hdr (or .tif and .tfw) files:
 
     printf( "Writing output files...\n" );
     fflush( stdout );
 
-    write_flt_hdr_files(
-        out_dat_file, out_hdr_file, nrows, ncols, xmin, xmax, ymin, ymax, data, software );
+    if (image) {
+        write_geotiff_tfw_files(
+            out_dat_file, out_hdr_file, out_rows, out_cols, xmin, xmax, ymin, ymax,
+            coord_type == TERRAIN_DEGREES || remap, bits, pixels, software );
+
+        free( pixels );
+    } else if (mapped) {
+        finish_mapped_flt_hdr_files(
+            out_hdr_file, nrows, ncols, xmin, xmax, ymin, ymax, data, software );
+    } else {
+        write_flt_hdr_files(
+            out_dat_file, out_hdr_file, out_rows, out_cols, xmin, xmax, ymin, ymax, data, software );
+
+        free_flt_data( data, nrows, ncols, in_mapped );
+    }
 
     fclose( out_dat_file );
     fclose( out_hdr_file );
 
-    free( data );
-    free( software );
+    for (k=0; k<num_extras; ++k) {
+        if (image) {
+            pixels = image_pixels(
+                extras[k].data, out_rows, out_cols, bits, contrast, options.num_threads );
+            free( extras[k].data );
 
-    // Copy optional .prj file:
+            write_geotiff_tfw_files(
+                extras[k].dat_file, extras[k].hdr_file, out_rows, out_cols, xmin, xmax, ymin, ymax,
+                coord_type == TERRAIN_DEGREES || remap, bits, pixels, software );
 
-    in_prj_file = fopen( in_prj_name, "rb" );   // use binary mode for compatibility
-    if (in_prj_file) {
-        out_prj_file = fopen( out_prj_name, "wb" ); // use binary mode for compatibility
-        if (!out_prj_file) {
-            fprintf( stderr, "*** WARNING: " );
-            fprintf( stderr, "Could not open output file '%s'.\n", out_prj_name );
+            free( pixels );
+        } else if (extras[k].mapped) {
+            finish_mapped_flt_hdr_files(
+                extras[k].hdr_file, nrows, ncols, xmin, xmax, ymin, ymax, extras[k].data, software );
         } else {
-            // copy file and change any "ZUNITS" line to "ZUNITS NO"
-            copy_prj_file( in_prj_file, out_prj_file );
+            write_flt_hdr_files(
+                extras[k].dat_file, extras[k].hdr_file, out_rows, out_cols, xmin, xmax, ymin, ymax,
+                extras[k].data, software );
 
-            fclose( out_prj_file );
+            free( extras[k].data );
         }
-        fclose( in_prj_file );
+        fclose( extras[k].dat_file );
+        fclose( extras[k].hdr_file );
+    }
+
+    free( software );
+
+    // Copy optional .prj file:
+
+    copy_prj( in_prj_name, out_prj_name );
+    for (k=0; k<num_extras; ++k) {
+        copy_prj( in_prj_name, extras[k].prj_name );
+        free( extras[k].prj_name );
     }
 
     free( in_prj_name );
     free( out_prj_name );
 
+    free( outputs );
+    free( details );
+    free( extras );
+
     printf( "DONE.\n" );
 
     return EXIT_SUCCESS;
@@ -191,6 +191,8 @@ int main( int argc, const char *argv[] )
     
     int has_nulls;
     int all_ints;
+    float data_min, data_max;
+    int in_mapped;
 
     printf( "\nTexture shading image data generator - version %s, built %s\n", sw_version, sw_date );
 
@@ -273,9 +275,9 @@ int main( int argc, const char *argv[] )
     printf( "Reading input files...\n" );
     fflush( stdout );
 
-    data = read_flt_hdr_files(
+    data = map_flt_hdr_files(
         in_dat_file, in_hdr_file, &nrows, &ncols, &xmin, &xmax, &ymin, &ymax,
-        &has_nulls, &all_ints, &software1 );
+        &has_nulls, &all_ints, &data_min, &data_max, &in_mapped, &software1 );
     
     fclose( in_dat_file );
     fclose( in_hdr_file );
@@ -322,7 +324,7 @@ int main( int argc, const char *argv[] )
     fclose( out_dat_file );
     fclose( out_hdr_file );
 
-    free( data );
+    free_flt_data( data, nrows, ncols, in_mapped );
     free( software2 );
     
     // Copy optional .prj file:
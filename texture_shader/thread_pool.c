@@ -0,0 +1,340 @@
+/*
+ * thread_pool.c
+ *
+ * Worker pool used to parallelize the texture shading tools.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+#define _CRT_SECURE_NO_DEPRECATE
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "thread_pool.h"
+
+#include <stdlib.h>
+
+#ifndef _WIN32
+#   include <unistd.h>      // sysconf()
+#   include <pthread.h>
+#   define THREAD_POOL_PTHREADS 1
+#else
+#   define THREAD_POOL_PTHREADS 0   // no native threads - all work done by calling thread
+#endif
+
+int default_thread_count( void )
+{
+    const char *env = getenv( "TEXTURE_THREADS" );
+    long count = 0;
+
+    if (env) {
+        count = strtol( env, NULL, 10 );
+    }
+#if THREAD_POOL_PTHREADS && defined _SC_NPROCESSORS_ONLN
+    if (count <= 0) {
+        count = sysconf( _SC_NPROCESSORS_ONLN );
+    }
+#endif
+    if (count <= 0) {
+        count = 1;
+    } else if (count > 1024) {
+        count = 1024;
+    }
+    return (int)count;
+}
+
+#if THREAD_POOL_PTHREADS
+
+// Description of the work currently being handed out by the pool.
+struct Thread_Pool_Job {
+    Thread_Pool_Task task;
+    void *state;
+    long  nitems;
+    long  chunk;
+    long  next_item;    // first item of next chunk to hand out
+    long  items_done;   // number of items completed
+    int   cancel;       // nonzero if remaining chunks should be skipped
+};
+
+struct Thread_Pool {
+    int              num_threads;   // number of workers, including calling thread
+    pthread_t       *threads;       // num_threads-1 helper threads
+    pthread_mutex_t  lock;
+    pthread_cond_t   job_ready;     // signaled when a new job is posted
+    pthread_cond_t   job_done;      // signaled when a helper finishes its part of a job
+    struct Thread_Pool_Job
+                     job;
+    unsigned long    generation;    // incremented each time a job is posted
+    int              busy;          // number of helpers still working on current job
+    int              shutdown;
+};
+
+struct Thread_Pool_Start {
+    struct Thread_Pool *pool;
+    int worker;
+};
+
+// Takes the next chunk of the current job; returns 0 if none left.
+// Must be called with pool->lock held.
+static int take_chunk( struct Thread_Pool_Job *job, long *first, long *last )
+{
+    if (job->cancel || job->next_item >= job->nitems) {
+        return 0;
+    }
+    *first = job->next_item;
+    *last  = *first + job->chunk;
+    if (*last > job->nitems) {
+        *last = job->nitems;
+    }
+    job->next_item = *last;
+    return 1;
+}
+
+static void work_on_job( struct Thread_Pool *pool, int worker )
+// Called with pool->lock held; returns with pool->lock held.
+{
+    struct Thread_Pool_Job *job = &pool->job;
+    long first, last;
+
+    while (take_chunk( job, &first, &last )) {
+        pthread_mutex_unlock( &pool->lock );
+        job->task( first, last, worker, job->state );
+        pthread_mutex_lock( &pool->lock );
+        job->items_done += last - first;
+    }
+}
+
+static void *helper_main( void *arg )
+{
+    struct Thread_Pool_Start *start = (struct Thread_Pool_Start *)arg;
+    struct Thread_Pool *pool = start->pool;
+    int worker = start->worker;
+    unsigned long seen = 0;
+
+    free( start );
+
+    pthread_mutex_lock( &pool->lock );
+    for (;;) {
+        while (pool->generation == seen && !pool->shutdown) {
+            pthread_cond_wait( &pool->job_ready, &pool->lock );
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        work_on_job( pool, worker );
+        if (--pool->busy == 0) {
+            pthread_cond_signal( &pool->job_done );
+        }
+    }
+    pthread_mutex_unlock( &pool->lock );
+
+    return NULL;
+}
+
+struct Thread_Pool *create_thread_pool( int num_threads )
+{
+    struct Thread_Pool *pool;
+    int i;
+
+    if (num_threads <= 0) {
+        num_threads = default_thread_count();
+    }
+
+    pool = (struct Thread_Pool *)malloc( sizeof( struct Thread_Pool ) );
+    if (!pool) {
+        return NULL;
+    }
+    pool->threads = (pthread_t *)malloc( sizeof( pthread_t ) * num_threads );
+    if (!pool->threads) {
+        free( pool );
+        return NULL;
+    }
+
+    pthread_mutex_init( &pool->lock, NULL );
+    pthread_cond_init( &pool->job_ready, NULL );
+    pthread_cond_init( &pool->job_done,  NULL );
+    pool->generation  = 0;
+    pool->busy        = 0;
+    pool->shutdown    = 0;
+    pool->num_threads = 1;
+
+    for (i=1; i<num_threads; ++i) {
+        struct Thread_Pool_Start *start =
+            (struct Thread_Pool_Start *)malloc( sizeof( struct Thread_Pool_Start ) );
+        if (!start) {
+            break;
+        }
+        start->pool   = pool;
+        start->worker = i;
+        if (pthread_create( &pool->threads[i-1], NULL, helper_main, start )) {
+            free( start );
+            break;
+        }
+        ++pool->num_threads;
+    }
+
+    if (pool->num_threads < num_threads) {
+        destroy_thread_pool( pool );
+        return NULL;
+    }
+
+    return pool;
+}
+
+int thread_pool_size( const struct Thread_Pool *pool )
+{
+    return pool ? pool->num_threads : 1;
+}
+
+int run_thread_pool(
+    struct Thread_Pool *pool,
+    long   nitems,
+    long   chunk,
+    Thread_Pool_Task task,
+    void  *state,
+    const struct Thread_Pool_Progress_Callback
+          *progress
+)
+{
+    struct Thread_Pool_Job *job;
+    long first, last;
+    long done;
+    int  cancel;
+
+    if (chunk < 1) {
+        chunk = 1;
+    }
+
+    if (!pool || pool->num_threads == 1 || nitems <= chunk) {
+        for (first=0; first<nitems; first=last) {
+            last = first + chunk < nitems ? first + chunk : nitems;
+            task( first, last, 0, state );
+            if (progress && progress->callback( last, nitems, progress->state )) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    job = &pool->job;
+
+    pthread_mutex_lock( &pool->lock );
+    job->task       = task;
+    job->state      = state;
+    job->nitems     = nitems;
+    job->chunk      = chunk;
+    job->next_item  = 0;
+    job->items_done = 0;
+    job->cancel     = 0;
+    pool->busy      = pool->num_threads - 1;
+    ++pool->generation;
+    pthread_cond_broadcast( &pool->job_ready );
+
+    // calling thread acts as worker 0 and also reports progress
+    while (take_chunk( job, &first, &last )) {
+        pthread_mutex_unlock( &pool->lock );
+        task( first, last, 0, state );
+        pthread_mutex_lock( &pool->lock );
+        job->items_done += last - first;
+        if (progress) {
+            done = job->items_done;
+            pthread_mutex_unlock( &pool->lock );
+            cancel = progress->callback( done, nitems, progress->state );
+            pthread_mutex_lock( &pool->lock );
+            if (cancel) {
+                job->cancel = 1;
+            }
+        }
+    }
+
+    while (pool->busy > 0) {
+        pthread_cond_wait( &pool->job_done, &pool->lock );
+    }
+    cancel = job->cancel;
+    pthread_mutex_unlock( &pool->lock );
+
+    if (cancel) {
+        return -1;
+    }
+    if (progress) {
+        return progress->callback( nitems, nitems, progress->state ) ? -1 : 0;
+    }
+    return 0;
+}
+
+void destroy_thread_pool( struct Thread_Pool *pool )
+{
+    int i;
+
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock( &pool->lock );
+    pool->shutdown = 1;
+    pthread_cond_broadcast( &pool->job_ready );
+    pthread_mutex_unlock( &pool->lock );
+
+    for (i=1; i<pool->num_threads; ++i) {
+        pthread_join( pool->threads[i-1], NULL );
+    }
+
+    pthread_cond_destroy( &pool->job_done );
+    pthread_cond_destroy( &pool->job_ready );
+    pthread_mutex_destroy( &pool->lock );
+
+    free( pool->threads );
+    free( pool );
+}
+
+#else   // !THREAD_POOL_PTHREADS
+
+struct Thread_Pool {
+    int num_threads;
+};
+
+struct Thread_Pool *create_thread_pool( int num_threads )
+{
+    struct Thread_Pool *pool = (struct Thread_Pool *)malloc( sizeof( struct Thread_Pool ) );
+    if (pool) {
+        pool->num_threads = 1;
+    }
+    return pool;
+}
+
+int thread_pool_size( const struct Thread_Pool *pool )
+{
+    return 1;
+}
+
+int run_thread_pool(
+    struct Thread_Pool *pool,
+    long   nitems,
+    long   chunk,
+    Thread_Pool_Task task,
+    void  *state,
+    const struct Thread_Pool_Progress_Callback
+          *progress
+)
+{
+    long first, last;
+
+    if (chunk < 1) {
+        chunk = 1;
+    }
+    for (first=0; first<nitems; first=last) {
+        last = first + chunk < nitems ? first + chunk : nitems;
+        task( first, last, 0, state );
+        if (progress && progress->callback( last, nitems, progress->state )) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void destroy_thread_pool( struct Thread_Pool *pool )
+{
+    free( pool );
+}
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * thread_pool.h
+ *
+ * Worker pool used to parallelize the texture shading tools.
+ * Part of the texture shading code distributed with tectoplot;
+ * see LICENSE.txt for copyright and redistribution terms.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct Thread_Pool;     // opaque - use create_thread_pool() and destroy_thread_pool()
+
+// Work function executed by the pool for each chunk of work items.
+// Items first .. last-1 are to be processed by the calling worker.
+// Workers are numbered 0 .. num_threads-1 (worker 0 is the thread that
+// called run_thread_pool()), so per-worker resources can be indexed by worker.
+typedef void (*Thread_Pool_Task)(
+    long  first,        // first work item of this chunk
+    long  last,         // one past the last work item of this chunk
+    int   worker,       // index of worker executing this chunk
+    void *state);       // copy of state pointer passed to run_thread_pool()
+
+struct Thread_Pool_Progress_Callback {
+    // callback function - return nonzero value to cancel operation:
+    int (*callback)(
+        long  items_done,   // number of work items completed so far
+        long  total_items,  // total number of work items
+        void *state);       // copy of state information pointer
+    // pointer to optional state information for use by callback() function:
+    void *state;
+};
+
+// Returns the number of threads to use by default: the value of the
+// TEXTURE_THREADS environment variable if it is set to a positive number,
+// otherwise the number of online processors.
+int default_thread_count( void );
+
+// Creates a pool of num_threads workers (including the calling thread).
+// If num_threads <= 0, default_thread_count() is used.
+// Returns NULL if a memory allocation or thread creation error occurred.
+struct Thread_Pool *create_thread_pool( int num_threads );
+
+// Returns number of workers in pool (1 if pool is NULL).
+int thread_pool_size( const struct Thread_Pool *pool );
+
+// Processes work items 0 .. nitems-1 by calling task() on chunks of up to
+// chunk items at a time, distributed dynamically among the workers.
+// Returns only after all chunks are done. If pool is NULL, all work is done
+// by the calling thread. The progress callback (if any) is only ever called
+// from the calling thread.
+// Returns 0 on success, or -1 if canceled via progress callback (in which case
+// some chunks may not have been processed).
+int run_thread_pool(
+    struct Thread_Pool *pool,       // from create_thread_pool(), or NULL
+    long   nitems,                  // total number of work items
+    long   chunk,                   // number of items per task() call
+    Thread_Pool_Task task,          // work function
+    void  *state,                   // state pointer passed to task()
+    const struct Thread_Pool_Progress_Callback
+          *progress                 // optional callback functor for status; NULL for none
+);
+
+// Stops all workers and frees memory allocated by create_thread_pool().
+void destroy_thread_pool( struct Thread_Pool *pool );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -32,6 +32,7 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include "transpose_inplace.h"
+#include "thread_pool.h"
 
 #include "compatibility.h"
 
@@ -100,9 +101,9 @@ static INLINE int report_progress( const struct Transpose_Progress_Info *info )
         info->progress->state );
 }
 
-static int transpose_inplace_small( float *a, long nrows, long ncols );
+static int transpose_inplace_small( float *a, long nrows, long ncols, struct Thread_Pool *pool );
 
-static void transpose_outplace(
+static void transpose_block(
     const void *RESTRICT a, void *RESTRICT b, long nrows, long ncols );
 
 static int check_bands_inplace( long nrows, long ncols, int nbands );
@@ -112,6 +113,7 @@ static int choose_bands_inplace( long nrows, long ncols );
 typedef struct {
     char *addr;
     long  size;
+    LONG  offset;   // offset in bytes of band within a column (p bands) or row (q bands)
 } Band_Info;
 
 static int setup_bands(
@@ -121,16 +123,16 @@ static int setup_bands(
 static int isolate_blocks(
     void *a, const Band_Info *RESTRICT pinfo, const Band_Info *RESTRICT qinfo,
     long nrows, long ncols, int nbands,
-    struct Transpose_Progress_Info *progress_info );
+    struct Transpose_Progress_Info *progress_info, struct Thread_Pool *pool );
 
 static int transpose_blocks(
     const Band_Info *RESTRICT pinfo, const Band_Info *RESTRICT qinfo, int nbands,
-    struct Transpose_Progress_Info *progress_info );
+    struct Transpose_Progress_Info *progress_info, struct Thread_Pool *pool );
 
 static int merge_blocks(
     void *a, const Band_Info *RESTRICT pinfo, const Band_Info *RESTRICT qinfo,
     long nrows, long ncols, int nbands,
-    struct Transpose_Progress_Info *progress_info );
+    struct Transpose_Progress_Info *progress_info, struct Thread_Pool *pool );
 
 
 int transpose_inplace(
@@ -143,6 +145,20 @@ int transpose_inplace(
 // Transposes matrix of nrows x ncols elements to ncols x nrows.
 // Returns 0 on success, 1 if a memory allocation error occurred (with matrix unchanged),
 // or -1 if canceled via progress callback (leaving matrix corrupted).
+{
+    return transpose_inplace_pool( a, nrows, ncols, progress, NULL );
+}
+
+int transpose_inplace_pool(
+    float *a,           // matrix to transpose (row-major order)
+    long   nrows,       // number of rows    in matrix a
+    long   ncols,       // number of columns in matrix a
+    const struct Transpose_Progress_Callback
+          *progress,    // optional callback functor for status; NULL for none
+    struct Thread_Pool
+          *pool         // pool of worker threads, or NULL for none
+)
+// Same as transpose_inplace(), with the block moves distributed among the workers in pool.
 {
     int error;
     int cancel = 0;
@@ -162,7 +178,7 @@ int transpose_inplace(
     }
 
     if (nbands <= 2) {
-        return transpose_inplace_small( a, nrows, ncols );
+        return transpose_inplace_small( a, nrows, ncols, pool );
     }
 
     error = setup_bands( a, a, nrows, ncols, nbands, nbands, &bufin, &bufout, &pinfo, &qinfo );
@@ -178,14 +194,14 @@ int transpose_inplace(
         progress_ptr = &progress_info;
     }
 
-    cancel = cancel || isolate_blocks( a, pinfo, qinfo, nrows, ncols, nbands, progress_ptr );
+    cancel = cancel || isolate_blocks( a, pinfo, qinfo, nrows, ncols, nbands, progress_ptr, pool );
 
-    cancel = cancel || transpose_blocks( pinfo, qinfo, nbands, progress_ptr );
+    cancel = cancel || transpose_blocks( pinfo, qinfo, nbands, progress_ptr, pool );
     
     free( bufin );
 //  pinfo[nbands-1].addr = NULL;
 
-    cancel = cancel || merge_blocks( a, pinfo, qinfo, nrows, ncols, nbands, progress_ptr );
+    cancel = cancel || merge_blocks( a, pinfo, qinfo, nrows, ncols, nbands, progress_ptr, pool );
     
     free( bufout );
     
@@ -199,23 +215,84 @@ int transpose_inplace(
     return 0;
 }
 
-static void transpose_outplace(
-    const void *RESTRICT a, void *RESTRICT b, long nrows, long ncols )
+// Largest block transposed directly by transpose_recursive(); smaller blocks fit in L1 cache.
+#define TRANSPOSE_TILE 16
+
+static void transpose_recursive(
+    const float *RESTRICT a, LONG lda, float *RESTRICT b, LONG ldb, long nrows, long ncols )
+// Cache-oblivious transpose: b[j*ldb+i] = a[i*lda+j] for i < nrows, j < ncols.
+// Splits the longer side in half until the block fits in cache at every level.
 {
-    const float *RESTRICT fromaddr = (const float *)a;
-          float *RESTRICT toaddr   =       (float *)b;
     long i, j;
-    // write each new row sequentially, gather from columns
-    for (j=0; j<ncols; ++j) {
-        const float *RESTRICT fromcol = fromaddr + j;
-        for (i=0; i<nrows; ++i) {
-            *toaddr++ = *fromcol;
-            fromcol  += ncols;
+
+    if (nrows <= TRANSPOSE_TILE && ncols <= TRANSPOSE_TILE) {
+        // write each new row sequentially, gather from columns
+        for (j=0; j<ncols; ++j) {
+            for (i=0; i<nrows; ++i) {
+                b[j * ldb + i] = a[i * lda + j];
+            }
         }
+    } else if (nrows >= ncols) {
+        long half = nrows / 2;
+        transpose_recursive( a,              lda, b,        ldb, half,         ncols );
+        transpose_recursive( a + half * lda, lda, b + half, ldb, nrows - half, ncols );
+    } else {
+        long half = ncols / 2;
+        transpose_recursive( a,        lda, b,              ldb, nrows, half         );
+        transpose_recursive( a + half, lda, b + half * ldb, ldb, nrows, ncols - half );
     }
 }
 
-static int transpose_inplace_small( float *a, long nrows, long ncols )
+static void transpose_block(
+    const void *RESTRICT a, void *RESTRICT b, long nrows, long ncols )
+{
+    transpose_recursive( (const float *)a, ncols, (float *)b, nrows, nrows, ncols );
+}
+
+// Number of columns of a (rows of b) per work item of transpose_outplace()
+#define TRANSPOSE_STRIP 64
+
+struct Transpose_Outplace {
+    const float *a;
+    float       *b;
+    long         nrows;
+    long         ncols;
+};
+
+static void transpose_strips_task( long first, long last, int worker, void *state )
+{
+    const struct Transpose_Outplace *job = (const struct Transpose_Outplace *)state;
+    long col0 = first * TRANSPOSE_STRIP;
+    long col1 = last  * TRANSPOSE_STRIP < job->ncols ? last * TRANSPOSE_STRIP : job->ncols;
+
+    (void)worker;
+
+    transpose_recursive( job->a + col0, job->ncols, job->b + (LONG)col0 * job->nrows, job->nrows,
+                         job->nrows, col1 - col0 );
+}
+
+void transpose_outplace(
+    const float *a,     // matrix to transpose (row-major order)
+    float *b,           // output: transposed matrix (row-major order)
+    long   nrows,       // number of rows    in matrix a
+    long   ncols,       // number of columns in matrix a
+    struct Thread_Pool
+          *pool         // pool of worker threads, or NULL for none
+)
+// Transposes matrix a of nrows x ncols elements into matrix b of ncols x nrows.
+{
+    struct Transpose_Outplace job;
+    long nstrips = (ncols + TRANSPOSE_STRIP - 1) / TRANSPOSE_STRIP;
+
+    job.a     = a;
+    job.b     = b;
+    job.nrows = nrows;
+    job.ncols = ncols;
+
+    run_thread_pool( pool, nstrips, 1, transpose_strips_task, &job, NULL );
+}
+
+static int transpose_inplace_small( float *a, long nrows, long ncols, struct Thread_Pool *pool )
 {
     LONG totalsize = (LONG)nrows * (LONG)ncols * sizeof( float );
 
@@ -225,7 +302,7 @@ static int transpose_inplace_small( float *a, long nrows, long ncols )
         return 1;
     }
     
-    transpose_outplace( a, b, nrows, ncols );
+    transpose_outplace( a, b, nrows, ncols, pool );
 
     memcpy( a, b, totalsize );
     
@@ -374,6 +451,11 @@ static int setup_bands(
             ptemp[i].size = pmax;
         }
         offset = 0;
+        for (i=0; i<pbands; ++i) {
+            ptemp[i].offset = offset * elemsize;
+            offset += ptemp[i].size;
+        }
+        offset = 0;
         for (i=0; i<pbands-1;) {
             ptemp[i].addr = (char *)a + rowsize * (offset + pmax);
             offset += ptemp[i++].size;
@@ -387,6 +469,11 @@ static int setup_bands(
             qtemp[j].size = qmin;
         }
         offset = 0;
+        for (j=0; j<qbands; ++j) {
+            qtemp[j].offset = offset * elemsize;
+            offset += qtemp[j].size;
+        }
+        offset = 0;
         qtemp[0].addr = *bufout;
         for (j=0; j<qbands-1;) {
             offset += qtemp[j++].size;
@@ -404,10 +491,80 @@ static int setup_bands(
     return 1;
 }
 
+// Shared state for isolate_rows_task() and merge_rows_task(): copies lines (rows of the
+// matrix, or rows of the transposed matrix) of one band to or from its contiguous blocks.
+struct Transpose_Band_Copy {
+    char *band;             // first line of band in matrix
+    char *blocks;           // contiguous blocks of band
+    long  size;             // number of lines in band
+    LONG  linesize;         // size of each line in bytes
+    const Band_Info
+         *info;             // bands crossing this one, which divide each line into blocks
+    int   nbands;           // number of bands crossing this one
+};
+
+// Number of lines of a band per work item
+static long band_chunk( long size, struct Thread_Pool *pool )
+{
+    long chunk = size / ((long)thread_pool_size( pool ) * 4);
+    if (!pool) {
+        return size;    // one call for the whole band
+    }
+    return chunk > 0 ? chunk : 1;
+}
+
+static void isolate_rows_task( long first, long last, int worker, void *state )
+// read each row sequentially, distribute to blocks
+{
+    const struct Transpose_Band_Copy *copy = (const struct Transpose_Band_Copy *)state;
+    const LONG elemsize = sizeof( float );
+
+    int  j;
+    long k;
+
+    (void)worker;
+
+    for (k=first; k<last; ++k) {
+        const char *fromaddr = copy->band + k * copy->linesize;
+        char       *toblock  = copy->blocks;
+        for (j=0; j<copy->nbands; ++j) {
+            LONG qsize = copy->info[j].size * elemsize;
+            memcpy( toblock + qsize * k, fromaddr, qsize );
+            toblock  += qsize * copy->size;
+            fromaddr += qsize;
+        }
+    }
+}
+
+static void merge_rows_task( long first, long last, int worker, void *state )
+// write each new row sequentially, gathering from blocks
+{
+    const struct Transpose_Band_Copy *copy = (const struct Transpose_Band_Copy *)state;
+    const LONG elemsize = sizeof( float );
+
+    int  i;
+    long k;
+
+    (void)worker;
+
+    for (k=first; k<last; ++k) {
+        char       *toaddr    = copy->band + k * copy->linesize;
+        char       *torow     = toaddr;
+        const char *fromblock = copy->blocks;
+        for (i=0; i<copy->nbands; ++i) {
+            LONG psize = copy->info[i].size * elemsize;
+            memcpy( toaddr, fromblock + psize * k, psize );
+            fromblock += psize * copy->size;
+            toaddr    += psize;
+        }
+        madv_dontneed( torow, copy->linesize );
+    }
+}
+
 static int isolate_blocks(
     void *a, const Band_Info *RESTRICT pinfo, const Band_Info *RESTRICT qinfo,
     long nrows, long ncols, int nbands,
-    struct Transpose_Progress_Info *progress_info )
+    struct Transpose_Progress_Info *progress_info, struct Thread_Pool *pool )
 {
     const LONG elemsize = sizeof( float );
 
@@ -450,23 +607,21 @@ static int isolate_blocks(
                 
             } else {
             
-                // read each row sequentially, distribute to blocks
+                // read each row sequentially, distribute to blocks;
+                // rows are independent, so they are divided among the workers
                 
-                char *fromaddr = fromband;
-                // CONCURRENCY NOTE: The iterations of this loop (over k)
-                // will be independent and can be executed in parallel,
-                // if each thread has its own fromaddr initialized
-                // as in the comment below.
-                for (k=0; k<pinfo[i].size; ++k) {
-                    //char *fromaddr = fromband + k * rowsize;  // for concurrency
-                    char *toblock = toaddr;
-                    for (j=0; j<nbands; ++j) {
-                        LONG qsize = qinfo[j].size * elemsize;
-                        memcpy( toblock + qsize * k, fromaddr, qsize );
-                        toblock  += qsize * pinfo[i].size;
-                        fromaddr += qsize;
-                    }
-                }
+                struct Transpose_Band_Copy copy;
+
+                copy.band     = fromband;
+                copy.blocks   = toaddr;
+                copy.size     = pinfo[i].size;
+                copy.linesize = rowsize;
+                copy.info     = qinfo;
+                copy.nbands   = nbands;
+
+                run_thread_pool( pool, copy.size, band_chunk( copy.size, pool ),
+                                 isolate_rows_task, &copy, NULL );
+
                 madv_dontneed( toaddr, bandsize );
             
                 if (progress_info) {
@@ -489,7 +644,7 @@ static int isolate_blocks(
 static int merge_blocks(
     void *a, const Band_Info *RESTRICT pinfo, const Band_Info *RESTRICT qinfo,
     long nrows, long ncols, int nbands,
-    struct Transpose_Progress_Info *progress_info )
+    struct Transpose_Progress_Info *progress_info, struct Thread_Pool *pool )
 {
     const LONG elemsize = sizeof( float );
 
@@ -531,25 +686,20 @@ static int merge_blocks(
                 
             } else {
             
-                // write each new row sequentially, gathering from blocks
+                // write each new row sequentially, gathering from blocks;
+                // rows are independent, so they are divided among the workers
                 
-                char *toaddr = toband;
-                // CONCURRENCY NOTE: The iterations of this loop (over k)
-                // will be independent and can be executed in parallel,
-                // if each thread has its own toaddr initialized
-                // as in the comment below.
-                for (k=0; k<qinfo[j].size; ++k) {
-                    //char *toaddr = toband + k * colsize;  // for concurrency
-                    const char *fromblock = fromaddr;
-                    char       *torow     = toaddr;
-                    for (i=0; i<nbands; ++i) {
-                        LONG psize = pinfo[i].size * elemsize;
-                        memcpy( toaddr, fromblock + psize * k, psize );
-                        fromblock += psize * qinfo[j].size;
-                        toaddr    += psize;
-                    }
-                    madv_dontneed( torow, colsize );
-                }
+                struct Transpose_Band_Copy copy;
+
+                copy.band     = toband;
+                copy.blocks   = fromaddr;
+                copy.size     = qinfo[j].size;
+                copy.linesize = colsize;
+                copy.info     = pinfo;
+                copy.nbands   = nbands;
+
+                run_thread_pool( pool, copy.size, band_chunk( copy.size, pool ),
+                                 merge_rows_task, &copy, NULL );
             
                 if (progress_info) {
                     progress_info->moves_done += nbands;
@@ -568,9 +718,69 @@ static int merge_blocks(
     return 0;
 }
 
+static void transpose_block_pair(
+    const Band_Info *RESTRICT pinfo, const Band_Info *RESTRICT qinfo, int i, int j )
+// Moves blocks [j,i] and [i,j] (j > i) during step i of transpose_blocks().
+{
+    const LONG elemsize = sizeof( float );
+
+    char *initaddr = pinfo[j].addr + pinfo[j].size * qinfo[i].offset;
+    char *tempaddr = pinfo[j].addr + qinfo[j].size * pinfo[i].offset;
+    char *newaddr  = qinfo[i].addr + qinfo[i].size * pinfo[j].offset;
+    char *oldaddr  = pinfo[i].addr + pinfo[i].size * qinfo[j].offset;
+
+    // transpose and move init block [j,i] to final space [i,j]
+
+    transpose_block( initaddr, newaddr, pinfo[j].size, qinfo[i].size );
+
+    madv_dontneed( newaddr, qinfo[i].size * elemsize * pinfo[j].size );
+
+    // transpose and move init block [i,j] to temp space [j,i]
+
+    transpose_block( oldaddr, tempaddr, pinfo[i].size, qinfo[j].size );
+}
+
+// Shared state for transpose_pairs_task(): step i of transpose_blocks()
+struct Transpose_Step {
+    const Band_Info *pinfo;
+    const Band_Info *qinfo;
+    int i;
+};
+
+static void transpose_pairs_task( long first, long last, int worker, void *state )
+{
+    const struct Transpose_Step *step = (const struct Transpose_Step *)state;
+    long j;
+
+    (void)worker;
+
+    for (j=first; j<last; ++j) {
+        transpose_block_pair( step->pinfo, step->qinfo, step->i, step->i + 1 + (int)j );
+    }
+}
+
+static int pairs_independent(
+    const Band_Info *RESTRICT pinfo, const Band_Info *RESTRICT qinfo, int nbands, int i )
+// Returns 1 if the block pairs of step i of transpose_blocks() can be moved in any order:
+// the final space of q band i must not overlap the remaining data of p bands i and up.
+// Normally there is about one band of room between them; otherwise the pairs are moved
+// in sequence, so each final block only overwrites data already moved out of the way.
+{
+    const LONG elemsize = sizeof( float );
+
+    LONG qbandsize;
+
+    if (i == 0) {
+        return 1;   // q band 0 is in bufout
+    }
+    // p bands i .. nbands-2 are in order in the matrix, above q band i
+    qbandsize = qinfo[i].size * elemsize * (pinfo[nbands-1].offset / elemsize + pinfo[nbands-1].size);
+    return qinfo[i].addr + qbandsize <= pinfo[i].addr;
+}
+
 static int transpose_blocks(
     const Band_Info *RESTRICT pinfo, const Band_Info *RESTRICT qinfo, int nbands,
-    struct Transpose_Progress_Info *progress_info )
+    struct Transpose_Progress_Info *progress_info, struct Thread_Pool *pool )
 // Matrix of nrows x ncols is being transposed to ncols x nrows.
 // Rows and columns are each grouped into nbands groups (bands) of approximately equal size.
 // Resulting blocks are each stored contiguously.
@@ -588,7 +798,6 @@ static int transpose_blocks(
         LONG psize   = pinfo[i].size * elemsize;
         LONG qsize   = qinfo[i].size * elemsize;
         LONG newsize = pinfo[i].size * qsize;   // = qinfo[i].size * psize;
-        LONG oldsize;
 
         LONG newoff  = qinfo[i].size * poffset;
         LONG oldoff  = pinfo[i].size * qoffset;
@@ -616,7 +825,7 @@ static int transpose_blocks(
         
         // transpose and move init block [i,i] to final space [i,i]
         
-        transpose_outplace( oldaddr, newaddr, pinfo[i].size, qinfo[i].size );
+        transpose_block( oldaddr, newaddr, pinfo[i].size, qinfo[i].size );
         
         madv_dontneed( newaddr, newsize );
         
@@ -627,44 +836,32 @@ static int transpose_blocks(
             }
         }
             
-        newaddr += newsize; // can be RESTRICT inside for loop below
-        oldaddr += newsize; // can be RESTRICT inside for loop below
-        
-        for (j=i+1; j<nbands; ++j) {
-            char *initaddr = pinfo[j].addr + pinfo[j].size * qoffset;
-            char *tempaddr = pinfo[j].addr + qinfo[j].size * poffset;
-        //  newaddr        = qinfo[i].addr + pinfo[j].offset * qsize;   // can be RESTRICT in this block
-        //  oldaddr        = pinfo[i].addr + qinfo[j].offset * psize;   // can be RESTRICT in this block
+        if (pool && nbands-1 > i && pairs_independent( pinfo, qinfo, nbands, i )) {
+            struct Transpose_Step step;
 
-            newsize = qsize * pinfo[j].size;
-            oldsize = psize * qinfo[j].size;
+            step.pinfo = pinfo;
+            step.qinfo = qinfo;
+            step.i     = i;
 
-            // transpose and move init block [j,i] to final space [i,j]
-            
-            transpose_outplace( initaddr, newaddr, pinfo[j].size, qinfo[i].size );
-
-            madv_dontneed( newaddr, newsize );
+            run_thread_pool( pool, nbands-1 - i, 1, transpose_pairs_task, &step, NULL );
 
             if (progress_info) {
-                ++progress_info->moves_done;
+                progress_info->moves_done += 2 * (nbands-1 - i);
                 if (report_progress( progress_info )) {
                     return 1;
                 }
             }
-            
-            // transpose and move init block [i,j] to temp space [j,i]
-            
-            transpose_outplace( oldaddr, tempaddr, pinfo[i].size, qinfo[j].size );
+        } else {
+            for (j=i+1; j<nbands; ++j) {
+                transpose_block_pair( pinfo, qinfo, i, j );
 
-            if (progress_info) {
-                ++progress_info->moves_done;
-                if (report_progress( progress_info )) {
-                    return 1;
+                if (progress_info) {
+                    progress_info->moves_done += 2;
+                    if (report_progress( progress_info )) {
+                        return 1;
+                    }
                 }
             }
-            
-            newaddr += newsize;
-            oldaddr += oldsize;
         }
         
         poffset += psize;
@@ -44,6 +44,8 @@ struct Transpose_Progress_Callback {
     void *state;
 };
 
+struct Thread_Pool;     // see thread_pool.h
+
 // Transposes matrix of nrows x ncols elements to ncols x nrows.
 // Returns 0 on success, 1 if a memory allocation error occurred (with matrix unchanged),
 // or -1 if canceled via progress callback (leaving matrix corrupted).
@@ -55,6 +57,29 @@ int transpose_inplace(
           *progress     // optional callback functor for status; NULL for none
 );
 
+// Same as transpose_inplace(), with the block moves distributed among the workers in pool.
+// The progress callback is only called from the calling thread.
+int transpose_inplace_pool(
+    float *a,           // matrix to transpose (row-major order)
+    long   nrows,       // number of rows    in matrix a
+    long   ncols,       // number of columns in matrix a
+    const struct Transpose_Progress_Callback
+          *progress,    // optional callback functor for status; NULL for none
+    struct Thread_Pool
+          *pool         // pool of worker threads, or NULL for none
+);
+
+// Transposes matrix a of nrows x ncols elements into matrix b of ncols x nrows,
+// using a cache-oblivious recursive algorithm. Matrices a and b must not overlap.
+void transpose_outplace(
+    const float *a,     // matrix to transpose (row-major order)
+    float *b,           // output: transposed matrix (row-major order)
+    long   nrows,       // number of rows    in matrix a
+    long   ncols,       // number of columns in matrix a
+    struct Thread_Pool
+          *pool         // pool of worker threads, or NULL for none
+);
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,10 +37,22 @@
 
 #include "WriteGrayscaleTIFF.h"
 
+#include <stddef.h> // for ptrdiff_t
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
+#ifndef _WIN32
+#   include <unistd.h>      // ftruncate()
+#   include <sys/mman.h>    // mmap()
+#   define HAVE_MMAP 1
+#else
+#   define HAVE_MMAP 0
+#endif
+
+// For a 64-bit compile we need LONG to be 64 bits, even if the compiler uses an LLP64 model
+#define LONG ptrdiff_t
+
 static int am_big_endian()
 {
     const int one = 1;
@@ -69,6 +81,12 @@ static void write_flt_file(
     FILE *out_flt_file, int nrows, int ncols,
     const float *data, float *nodata, float *min_value, float *max_value );
 
+static void scan_flt_row(
+    float *buffer, int ncols, int *has_nulls,
+    float *nodata, float *min_value, float *max_value );
+
+static void check_flt_nodata( float nodata, float min_value, float max_value );
+
 static void write_bil_file(
     FILE *out_bil_file, int nrows, int ncols, const float *data,
     unsigned short *nodata, unsigned short *min_value, unsigned short *max_value );
@@ -86,6 +104,8 @@ static void write_tfw_file(
     FILE *out_hdr_file, int nrows, int ncols,
     double xmin, double xmax, double ymin, double ymax );
 
+static void check_tif_file( int error, size_t fileSize );
+
 void write_flt_hdr_files(
     FILE *out_flt_file, // .flt file - should be opened in BINARY mode
     FILE *out_hdr_file, // .hdr file - should be opened in BINARY mode
@@ -114,6 +134,80 @@ void write_flt_hdr_files(
         nodata, min_value, max_value, 1, software );
 }
 
+float *map_flt_output_file(
+    // returns array of data values backed by the .flt file, or null if not supported;
+    // NOTE: caller must pass this pointer to finish_mapped_flt_hdr_files()!
+    FILE *out_flt_file, // .flt file - should be opened in BINARY mode for update ("w+b")
+    int nrows,          // number of rows in data array
+    int ncols           // number of cols in data array
+)
+{
+#if HAVE_MMAP
+    size_t size = (size_t)nrows * (size_t)ncols * sizeof( float );
+    void *data;
+
+    if (fflush( out_flt_file ) || ftruncate( fileno( out_flt_file ), (off_t)size )) {
+        error_exit( "Write error occurred on output .flt file." );
+    }
+
+    data = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno( out_flt_file ), 0 );
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+
+    return (float *)data;
+#else
+    return NULL;
+#endif
+}
+
+void finish_mapped_flt_hdr_files(
+    FILE *out_hdr_file, // .hdr file - should be opened in BINARY mode
+    int nrows,          // number of rows in data array
+    int ncols,          // number of cols in data array
+    double xmin,        // min X coordinate (longitude or easting)
+    double xmax,        // max X coordinate (longitude or easting)
+    double ymin,        // min Y coordinate (latitude  or northing)
+    double ymax,        // max Y coordinate (latitude  or northing)
+    float *data,        // array of data values from map_flt_output_file()
+    const char *software // software name and version number (optional)
+)
+{
+    float nodata;
+    float min_value;
+    float max_value;
+
+    int i;
+    int has_nulls = 0;
+
+    float *ptr;
+
+    // Finish .flt file in place and find min/max values:
+
+    nodata = -1.0e+06;  // must be negative for scan_flt_row() to work correctly
+
+    min_value = *data;
+    max_value = *data;
+
+    for (i=0, ptr=data; i<nrows; ++i, ptr+=ncols) {
+        scan_flt_row( ptr, ncols, &has_nulls, &nodata, &min_value, &max_value );
+    }
+
+#if HAVE_MMAP
+    if (munmap( data, (size_t)nrows * (size_t)ncols * sizeof( float ) )) {
+        error_exit( "Write error occurred on output .flt file." );
+    }
+#endif
+
+    check_flt_nodata( nodata, min_value, max_value );
+
+    // Write .hdr file:
+
+    write_hdr_file(
+        out_hdr_file, nrows, ncols, xmin, xmax, ymin, ymax,
+        nodata, min_value, max_value, 1, software );
+}
+
 void write_bil_hdr_files(
     FILE *out_bil_file, // .bil file - should be opened in BINARY mode
     FILE *out_hdr_file, // .hdr file - should be opened in BINARY mode
@@ -161,6 +255,51 @@ void write_tif_tfw_files(
     // Write .tif file:
 
     error = WriteGrayscale16BitToTIFF( out_tif_file, ncols, nrows, data, software, &fileSize );
+    check_tif_file( error, fileSize );
+
+    // Write .tfw file:
+
+    write_tfw_file( out_tfw_file, nrows, ncols, xmin, xmax, ymin, ymax );
+}
+
+void write_geotiff_tfw_files(
+    FILE *out_tif_file, // .tif file - should be opened in BINARY mode
+    FILE *out_tfw_file, // .tfw file - should be opened in BINARY mode
+    int nrows,          // number of rows in data array
+    int ncols,          // number of cols in data array
+    double xmin,        // min X coordinate (longitude or easting)
+    double xmax,        // max X coordinate (longitude or easting)
+    double ymin,        // min Y coordinate (latitude  or northing)
+    double ymax,        // max Y coordinate (latitude  or northing)
+    int geographic,     // nonzero if coordinates are WGS84 longitude/latitude
+    int bits,           // bits per pixel (8 or 16)
+    const void *pixels, // array of unsigned char or unsigned short pixels
+    const char *software // software name and version number (optional)
+)
+{
+    struct Grayscale_TIFF_Georef georef;
+    int error;
+    size_t fileSize;
+
+    georef.xmin = xmin;
+    georef.ymax = ymax;
+    georef.xdim = (xmax - xmin) / (double)ncols;
+    georef.ydim = (ymax - ymin) / (double)nrows;
+    georef.geographic = geographic;
+
+    // Write .tif file:
+
+    error = WriteGrayscaleToGeoTIFF(
+        out_tif_file, ncols, nrows, pixels, bits, &georef, software, &fileSize );
+    check_tif_file( error, fileSize );
+
+    // Write .tfw file:
+
+    write_tfw_file( out_tfw_file, nrows, ncols, xmin, xmax, ymin, ymax );
+}
+
+static void check_tif_file( int error, size_t fileSize )
+{
     if (error == -2) {
         error_exit( "Memory allocation error occurred during file output." );
     }
@@ -183,10 +322,6 @@ void write_tif_tfw_files(
         fprintf( stderr,
             "This may not be readable by some TIFF readers.\n" );
     }
-
-    // Write .tfw file:
-
-    write_tfw_file( out_tfw_file, nrows, ncols, xmin, xmax, ymin, ymax );
 }
 
 static void write_flt_file(
@@ -195,7 +330,7 @@ static void write_flt_file(
 {
     // Write .flt file and find min/max values:
     
-    int i, j;
+    int i;
     int count;
     int has_nulls = 0;
     int error;
@@ -217,29 +352,8 @@ static void write_flt_file(
 
     for (i=0, ptr=data; i<nrows; ++i, ptr+=ncols) {
         memcpy( buffer, ptr, bufsize );
-        
-        for (j=0; j<ncols; ++j) {
-            if (flt_isnan( buffer[j] )) {
-                buffer[j] = *nodata;
-                has_nulls = 1;
-                continue;
-            }
-            if (!has_nulls) {
-                if (buffer[j] < *nodata * 0.5) {    // assumes nodata < 0
-                    *nodata *= 10.0;
-                }
-            } else if (buffer[j] == *nodata) {
-                prefix_error();
-                fprintf( stderr, "Actual output data point matches chosen NODATA value of " );
-                fprintf( stderr, "%.6g.\n", *nodata );
-                exit( EXIT_FAILURE );
-            }
-            if (buffer[j] < *min_value) {
-                *min_value = buffer[j];
-            } else if (buffer[j] > *max_value) {
-                *max_value = buffer[j];
-            }
-        }
+
+        scan_flt_row( buffer, ncols, &has_nulls, nodata, min_value, max_value );
 
         count = fwrite( buffer, sizeof( float ), ncols, out_flt_file );
         if (count < ncols) {
@@ -253,10 +367,49 @@ static void write_flt_file(
         error_exit( "Write error occurred on output .flt file." );
     }
 
-    if (*min_value <= *nodata && *max_value >= *nodata) {
+    free( buffer );
+
+    check_flt_nodata( *nodata, *min_value, *max_value );
+}
+
+static void scan_flt_row(
+    float *buffer, int ncols, int *has_nulls,
+    float *nodata, float *min_value, float *max_value )
+// Replaces NaNs in one row with NODATA value and updates min/max values.
+// Chooses a NODATA value below all data values seen before the first NaN.
+{
+    int j;
+
+    for (j=0; j<ncols; ++j) {
+        if (flt_isnan( buffer[j] )) {
+            buffer[j] = *nodata;
+            *has_nulls = 1;
+            continue;
+        }
+        if (!*has_nulls) {
+            if (buffer[j] < *nodata * 0.5) {    // assumes nodata < 0
+                *nodata *= 10.0;
+            }
+        } else if (buffer[j] == *nodata) {
+            prefix_error();
+            fprintf( stderr, "Actual output data point matches chosen NODATA value of " );
+            fprintf( stderr, "%.6g.\n", *nodata );
+            exit( EXIT_FAILURE );
+        }
+        if (buffer[j] < *min_value) {
+            *min_value = buffer[j];
+        } else if (buffer[j] > *max_value) {
+            *max_value = buffer[j];
+        }
+    }
+}
+
+static void check_flt_nodata( float nodata, float min_value, float max_value )
+{
+    if (min_value <= nodata && max_value >= nodata) {
         fprintf( stderr, "*** WARNING: " );
         fprintf( stderr,
-            "NODATA value of %.6g is within range of actual output data.\n", *nodata );
+            "NODATA value of %.6g is within range of actual output data.\n", nodata );
         fprintf( stderr, "***          " );
         fprintf( stderr,
             "This could possibly cause good data to be identified as NODATA.\n" );
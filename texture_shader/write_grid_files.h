@@ -50,6 +50,31 @@ void write_flt_hdr_files(
     const char *software // software name and version number (optional)
 );
 
+// Creates .flt file at full size and maps it into memory, so that a data array
+// larger than available memory can be processed in place (paged to and from the file
+// by the operating system). Returns null if memory-mapped files are not supported.
+float *map_flt_output_file(
+    // returns array of data values backed by the .flt file, or null if not supported;
+    // NOTE: caller must pass this pointer to finish_mapped_flt_hdr_files()!
+    FILE *out_flt_file, // .flt file - should be opened in BINARY mode for update ("w+b")
+    int nrows,          // number of rows in data array
+    int ncols           // number of cols in data array
+);
+
+// Same as write_flt_hdr_files() for data array returned by map_flt_output_file():
+// finishes .flt file in place, unmaps data array, and writes .hdr file.
+void finish_mapped_flt_hdr_files(
+    FILE *out_hdr_file, // .hdr file - should be opened in BINARY mode
+    int nrows,          // number of rows in data array
+    int ncols,          // number of cols in data array
+    double xmin,        // min X coordinate (longitude or easting)
+    double xmax,        // max X coordinate (longitude or easting)
+    double ymin,        // min Y coordinate (latitude  or northing)
+    double ymax,        // max Y coordinate (latitude  or northing)
+    float *data,        // array of data values from map_flt_output_file()
+    const char *software // software name and version number (optional)
+);
+
 void write_bil_hdr_files(
     FILE *out_bil_file, // .bil file - should be opened in BINARY mode
     FILE *out_hdr_file, // .hdr file - should be opened in BINARY mode
@@ -76,6 +101,23 @@ void write_tif_tfw_files(
     const char *software // software name and version number (optional)
 );
 
+// Same as write_tif_tfw_files(), but writes 8- or 16-bit pixels already converted (e.g. by
+// terrain_image_pixels()) and also stores the georeferencing as GeoTIFF tags in the .tif file.
+void write_geotiff_tfw_files(
+    FILE *out_tif_file, // .tif file - should be opened in BINARY mode
+    FILE *out_tfw_file, // .tfw file - should be opened in BINARY mode
+    int nrows,          // number of rows in data array
+    int ncols,          // number of cols in data array
+    double xmin,        // min X coordinate (longitude or easting)
+    double xmax,        // max X coordinate (longitude or easting)
+    double ymin,        // min Y coordinate (latitude  or northing)
+    double ymax,        // max Y coordinate (latitude  or northing)
+    int geographic,     // nonzero if coordinates are WGS84 longitude/latitude
+    int bits,           // bits per pixel (8 or 16)
+    const void *pixels, // array of unsigned char or unsigned short pixels
+    const char *software // software name and version number (optional)
+);
+
 #ifdef __cplusplus
 }
 #endif